@@ -0,0 +1,89 @@
+#include "headless_runner.hpp"
+#include "vuk/resources/DeviceNestedResource.hpp"
+
+#include <atomic>
+#include <barrier>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+/* frame_recording_contention
+ * 1 to 16 recording threads allocate semaphores from the current frame and hand image views back to the super frame resource,
+ * which records every handle for destruction at recycle time. The handles come from a stub DeviceResource,
+ * so this measures only the bookkeeping of the frame resources, with the same total number of handles for every thread count.
+ */
+
+namespace {
+	constexpr size_t num_frames = 64;
+	constexpr size_t handles_per_frame = 1 << 16;
+
+	// hands out fake handles and drops them on deallocation - everything else goes to the device
+	struct StubResource : vuk::DeviceNestedResource {
+		std::atomic<uintptr_t> next_handle = 1;
+
+		StubResource(vuk::DeviceResource& upstream) : DeviceNestedResource(upstream) {}
+
+		vuk::Result<void, vuk::AllocateException> allocate_semaphores(std::span<VkSemaphore> dst, vuk::SourceLocationAtFrame loc) override {
+			for (auto& s : dst) {
+				s = (VkSemaphore)next_handle.fetch_add(1, std::memory_order_relaxed);
+			}
+			return { vuk::expected_value };
+		}
+
+		void deallocate_semaphores(std::span<const VkSemaphore> src) override {}
+		void deallocate_image_views(std::span<const vuk::ImageView> src) override {}
+	};
+
+	double run(vuk::DeviceSuperFrameResource& sfr, size_t num_threads) {
+		std::barrier sync((std::ptrdiff_t)num_threads + 1);
+		std::atomic<vuk::DeviceFrameResource*> frame = nullptr;
+		std::vector<std::thread> threads;
+		for (size_t t = 0; t < num_threads; t++) {
+			threads.emplace_back([&] {
+				for (size_t f = 0; f < num_frames; f++) {
+					sync.arrive_and_wait();
+					auto& fr = *frame.load();
+					for (size_t i = 0; i < handles_per_frame / num_threads / 2; i++) {
+						VkSemaphore sema;
+						if (auto res = fr.allocate_semaphores(std::span{ &sema, 1 }, {}); !res) {
+							fprintf(stderr, "allocating a semaphore failed: %s\n", res.error().what());
+							std::abort();
+						}
+						vuk::ImageView iv{};
+						sfr.deallocate_image_views(std::span{ &iv, 1 });
+					}
+					sync.arrive_and_wait();
+				}
+			});
+		}
+
+		double seconds = vuk::time_seconds([&] {
+			for (size_t f = 0; f < num_frames; f++) {
+				frame = &sfr.get_next_frame();
+				sync.arrive_and_wait();
+				sync.arrive_and_wait();
+			}
+			// include the merge and destruction of the last frame
+			sfr.get_next_frame();
+		});
+		for (auto& t : threads) {
+			t.join();
+		}
+		return seconds;
+	}
+} // namespace
+
+int main() {
+	vuk::HeadlessRunner runner;
+	StubResource stub(runner.context->get_vk_resource());
+
+	for (size_t num_threads : { 1, 2, 4, 8, 16 }) {
+		vuk::DeviceSuperFrameResource sfr(stub, 3);
+		auto seconds = run(sfr, num_threads);
+		size_t handles = num_frames * handles_per_frame;
+		printf("%2zu threads: %7.2f Mhandles/s, %6.1f ns per handle\n", num_threads, handles / seconds * 1e-6, seconds / handles * 1e9);
+	}
+
+	return 0;
+}
@@ -0,0 +1,168 @@
+#include "headless_runner.hpp"
+#include "vuk/Future.hpp"
+#include "vuk/Partials.hpp"
+
+#include <atomic>
+#include <condition_variable>
+#include <coroutine>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/* future_awaits
+ * Many small uploads are kept in flight, and their completion is awaited either by parking a thread per wait (Future::wait),
+ * or by suspending a coroutine per wait (co_await), with the coroutines resumed on a small thread pool.
+ */
+
+namespace {
+	constexpr size_t num_uploads = 4096;
+	constexpr size_t num_threads = 4;
+
+	// fire-and-forget coroutine
+	struct Task {
+		struct promise_type {
+			Task get_return_object() {
+				return {};
+			}
+			std::suspend_never initial_suspend() noexcept {
+				return {};
+			}
+			std::suspend_never final_suspend() noexcept {
+				return {};
+			}
+			void return_void() {}
+			void unhandled_exception() {
+				std::terminate();
+			}
+		};
+	};
+
+	struct ThreadPool {
+		std::mutex lock;
+		std::condition_variable cv;
+		std::deque<std::coroutine_handle<>> work;
+		std::vector<std::thread> threads;
+		bool stop = false;
+
+		ThreadPool(size_t count) {
+			for (size_t i = 0; i < count; i++) {
+				threads.emplace_back([this] {
+					while (true) {
+						std::unique_lock _(lock);
+						cv.wait(_, [this] { return stop || !work.empty(); });
+						if (work.empty()) {
+							return;
+						}
+						auto handle = work.front();
+						work.pop_front();
+						_.unlock();
+						handle.resume();
+					}
+				});
+			}
+		}
+
+		~ThreadPool() {
+			{
+				std::unique_lock _(lock);
+				stop = true;
+			}
+			cv.notify_all();
+			for (auto& t : threads) {
+				t.join();
+			}
+		}
+
+		void schedule(std::coroutine_handle<> handle) {
+			{
+				std::unique_lock _(lock);
+				work.push_back(handle);
+			}
+			cv.notify_one();
+		}
+	};
+
+	struct AwaitCounters {
+		std::atomic<size_t> in_flight = 0;
+		std::atomic<size_t> max_in_flight = 0;
+		std::atomic<size_t> completed = 0;
+	};
+
+	Task await_upload(vuk::Future& future, vuk::Allocator& allocator, vuk::Compiler& compiler, vuk::Executor executor, AwaitCounters& counters) {
+		auto in_flight = ++counters.in_flight;
+		auto max = counters.max_in_flight.load();
+		while (in_flight > max && !counters.max_in_flight.compare_exchange_weak(max, in_flight)) {}
+		auto result = co_await future.awaitable(allocator, compiler, executor);
+		if (!result) {
+			fprintf(stderr, "await failed: %s\n", result.error().what());
+		}
+		counters.in_flight--;
+		counters.completed++;
+	}
+
+	std::vector<vuk::Future> make_uploads(vuk::HeadlessRunner& runner, vuk::Allocator& allocator, std::vector<vuk::Unique<vuk::Buffer>>& buffers) {
+		std::vector<uint32_t> data(64, 0xfeedu);
+		std::vector<vuk::Future> futures;
+		futures.reserve(num_uploads);
+		for (size_t i = 0; i < num_uploads; i++) {
+			auto [buf, fut] = vuk::create_buffer(allocator, vuk::MemoryUsage::eGPUonly, vuk::DomainFlagBits::eTransferOnTransfer, std::span(data));
+			// futures are submitted upfront from this thread, as the Compiler is not thread safe
+			fut.submit(allocator, runner.compiler);
+			buffers.emplace_back(std::move(buf));
+			futures.emplace_back(std::move(fut));
+		}
+		return futures;
+	}
+} // namespace
+
+int main() {
+	vuk::HeadlessRunner runner;
+
+	{
+		auto& frame = runner.sfa_resource->get_next_frame();
+		vuk::Allocator frame_allocator(frame);
+		std::vector<vuk::Unique<vuk::Buffer>> buffers;
+		auto futures = make_uploads(runner, frame_allocator, buffers);
+		// every thread blocks in wait() for one upload at a time
+		double blocking = vuk::time_seconds([&] {
+			std::atomic<size_t> next = 0;
+			std::vector<std::thread> threads;
+			for (size_t t = 0; t < num_threads; t++) {
+				threads.emplace_back([&] {
+					for (size_t i = next++; i < num_uploads; i = next++) {
+						futures[i].wait(frame_allocator, runner.compiler);
+					}
+				});
+			}
+			for (auto& t : threads) {
+				t.join();
+			}
+		});
+		printf("blocking waits:  %zu uploads on %zu threads, %.3f ms, at most %zu waits in flight\n", num_uploads, num_threads, blocking * 1e3, num_threads);
+	}
+
+	{
+		auto& frame = runner.sfa_resource->get_next_frame();
+		vuk::Allocator frame_allocator(frame);
+		std::vector<vuk::Unique<vuk::Buffer>> buffers;
+		auto futures = make_uploads(runner, frame_allocator, buffers);
+		AwaitCounters counters;
+		double awaiting = vuk::time_seconds([&] {
+			ThreadPool pool(num_threads);
+			vuk::Executor executor = [&pool](std::coroutine_handle<> handle) {
+				pool.schedule(handle);
+			};
+			for (auto& fut : futures) {
+				await_upload(fut, frame_allocator, runner.compiler, executor, counters);
+			}
+			while (counters.completed.load() < num_uploads) {
+				std::this_thread::yield();
+			}
+		});
+		printf(
+		    "coroutine awaits: %zu uploads on %zu threads, %.3f ms, at most %zu awaits in flight\n", num_uploads, num_threads, awaiting * 1e3, counters.max_in_flight.load());
+	}
+
+	return 0;
+}
@@ -0,0 +1,133 @@
+#pragma once
+
+#include "vuk/Allocator.hpp"
+#include "vuk/AllocatorHelpers.hpp"
+#include "vuk/Context.hpp"
+#include "vuk/RenderGraph.hpp"
+#include "vuk/resources/DeviceFrameResource.hpp"
+#include <VkBootstrap.h>
+#include <chrono>
+#include <optional>
+#include <stdexcept>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+namespace vuk {
+	/// @brief Minimal windowless setup for benchmarks that measure host-side throughput
+	struct HeadlessRunner {
+		VkDevice device;
+		VkPhysicalDevice physical_device;
+		VkQueue graphics_queue;
+		VkQueue transfer_queue;
+		std::optional<Context> context;
+		std::optional<DeviceSuperFrameResource> sfa_resource;
+		std::optional<Allocator> allocator;
+		Compiler compiler;
+		/// @brief Set if VK_EXT_host_image_copy was found and enabled
+		bool host_image_copy = false;
+		vkb::Instance vkbinstance;
+		vkb::Device vkbdevice;
+
+		HeadlessRunner() {
+			vkb::InstanceBuilder builder;
+			builder.set_app_name("vuk_bench").set_engine_name("vuk").require_api_version(1, 2, 0).set_app_version(0, 1, 0).set_headless();
+			auto inst_ret = builder.build();
+			if (!inst_ret) {
+				throw std::runtime_error("Couldn't initialise instance");
+			}
+			vkbinstance = inst_ret.value();
+			auto instance = vkbinstance.instance;
+			vkb::PhysicalDeviceSelector selector{ vkbinstance };
+			selector.set_minimum_version(1, 0).add_required_extension(VK_KHR_SYNCHRONIZATION_2_EXTENSION_NAME);
+#ifdef VK_EXT_host_image_copy
+			// with its dependencies, which are core in 1.3
+			selector.add_desired_extension(VK_EXT_HOST_IMAGE_COPY_EXTENSION_NAME)
+			    .add_desired_extension(VK_KHR_COPY_COMMANDS_2_EXTENSION_NAME)
+			    .add_desired_extension(VK_KHR_FORMAT_FEATURE_FLAGS_2_EXTENSION_NAME);
+#endif
+			auto phys_ret = selector.select();
+			if (!phys_ret) {
+				throw std::runtime_error("Couldn't create physical device");
+			}
+			vkb::PhysicalDevice vkbphysical_device = phys_ret.value();
+			physical_device = vkbphysical_device.physical_device;
+
+			vkb::DeviceBuilder device_builder{ vkbphysical_device };
+			VkPhysicalDeviceVulkan12Features vk12features{ .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES };
+			vk12features.timelineSemaphore = true;
+			vk12features.descriptorBindingPartiallyBound = true;
+			vk12features.descriptorBindingUpdateUnusedWhilePending = true;
+			vk12features.shaderSampledImageArrayNonUniformIndexing = true;
+			vk12features.runtimeDescriptorArray = true;
+			vk12features.descriptorBindingVariableDescriptorCount = true;
+			vk12features.hostQueryReset = true;
+			vk12features.bufferDeviceAddress = true;
+			VkPhysicalDeviceSynchronization2FeaturesKHR sync_feat{ .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SYNCHRONIZATION_2_FEATURES_KHR,
+				                                                     .synchronization2 = true };
+			device_builder.add_pNext(&vk12features).add_pNext(&sync_feat);
+#ifdef VK_EXT_host_image_copy
+			VkPhysicalDeviceHostImageCopyFeaturesEXT hic_feat{ .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_HOST_IMAGE_COPY_FEATURES_EXT, .hostImageCopy = true };
+			{
+				auto vkEnumerateDeviceExtensionProperties =
+				    (PFN_vkEnumerateDeviceExtensionProperties)vkbinstance.fp_vkGetInstanceProcAddr(instance, "vkEnumerateDeviceExtensionProperties");
+				uint32_t count = 0;
+				vkEnumerateDeviceExtensionProperties(physical_device, nullptr, &count, nullptr);
+				std::vector<VkExtensionProperties> extensions(count);
+				vkEnumerateDeviceExtensionProperties(physical_device, nullptr, &count, extensions.data());
+				for (auto& extension : extensions) {
+					host_image_copy |= strcmp(extension.extensionName, VK_EXT_HOST_IMAGE_COPY_EXTENSION_NAME) == 0;
+				}
+			}
+			if (host_image_copy) {
+				device_builder.add_pNext(&hic_feat);
+			}
+#endif
+			auto dev_ret = device_builder.build();
+			if (!dev_ret) {
+				throw std::runtime_error("Couldn't create device");
+			}
+			vkbdevice = dev_ret.value();
+			graphics_queue = vkbdevice.get_queue(vkb::QueueType::graphics).value();
+			auto graphics_queue_family_index = vkbdevice.get_queue_index(vkb::QueueType::graphics).value();
+			transfer_queue = vkbdevice.get_queue(vkb::QueueType::transfer).value();
+			auto transfer_queue_family_index = vkbdevice.get_queue_index(vkb::QueueType::transfer).value();
+			device = vkbdevice.device;
+			ContextCreateParameters::FunctionPointers fps;
+			fps.vkGetInstanceProcAddr = vkbinstance.fp_vkGetInstanceProcAddr;
+			fps.vkGetDeviceProcAddr = vkbinstance.fp_vkGetDeviceProcAddr;
+			ContextCreateParameters params{ instance,
+				                              device,
+				                              physical_device,
+				                              graphics_queue,
+				                              graphics_queue_family_index,
+				                              VK_NULL_HANDLE,
+				                              VK_QUEUE_FAMILY_IGNORED,
+				                              transfer_queue,
+				                              transfer_queue_family_index,
+				                              fps };
+			params.host_image_copy_enabled = host_image_copy;
+			context.emplace(params);
+			const unsigned num_inflight_frames = 3;
+			sfa_resource.emplace(*context, num_inflight_frames);
+			allocator.emplace(*sfa_resource);
+		}
+
+		~HeadlessRunner() {
+			context->wait_idle();
+			allocator.reset();
+			sfa_resource.reset();
+			context.reset();
+			vkb::destroy_device(vkbdevice);
+			vkb::destroy_instance(vkbinstance);
+		}
+	};
+
+	/// @brief Measure the wall clock time of a callable in seconds
+	template<class F>
+	double time_seconds(F&& f) {
+		auto start = std::chrono::steady_clock::now();
+		f();
+		return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	}
+} // namespace vuk
@@ -0,0 +1,77 @@
+#include "headless_runner.hpp"
+#include "vuk/Partials.hpp"
+
+#include <algorithm>
+#include <vector>
+
+/* host_image_copy
+ * RGBA8 images from 256^2 to 4096^2 are uploaded with host_data_to_image, once through staging memory and a transfer submission,
+ * and once with VK_EXT_host_image_copy, which writes the image from the host without staging or submission.
+ * Software implementations expose the extension, so both paths can be compared without a GPU.
+ */
+
+namespace {
+	constexpr size_t bytes_per_size = 256ull * 1024 * 1024;
+
+	double upload_seconds(vuk::HeadlessRunner& runner, vuk::ImageUsageFlags usage, uint32_t size, size_t count, const std::vector<std::byte>& data) {
+		auto& frame = runner.sfa_resource->get_next_frame();
+		vuk::Allocator frame_allocator(frame);
+		vuk::ImageAttachment ia{ .image_type = vuk::ImageType::e2D,
+			                       .usage = usage,
+			                       .extent = vuk::Dimension3D::absolute(size, size),
+			                       .format = vuk::Format::eR8G8B8A8Unorm,
+			                       .sample_count = vuk::Samples::e1,
+			                       .view_type = vuk::ImageViewType::e2D,
+			                       .base_level = 0,
+			                       .level_count = 1,
+			                       .base_layer = 0,
+			                       .layer_count = 1 };
+		std::vector<vuk::Unique<vuk::Image>> images;
+		for (size_t i = 0; i < count; i++) {
+			images.emplace_back(*vuk::allocate_image(frame_allocator, ia));
+		}
+
+		return vuk::time_seconds([&] {
+			std::vector<vuk::Future> futures;
+			futures.reserve(count);
+			for (size_t i = 0; i < count; i++) {
+				auto dst = ia;
+				dst.image = *images[i];
+				auto fut = vuk::host_data_to_image(frame_allocator, vuk::DomainFlagBits::eTransferOnTransfer, dst, data.data());
+				if (fut.get_status() != vuk::FutureBase::Status::eHostAvailable) {
+					fut.submit(frame_allocator, runner.compiler);
+				}
+				futures.emplace_back(std::move(fut));
+			}
+			for (auto& fut : futures) {
+				fut.wait(frame_allocator, runner.compiler);
+			}
+		});
+	}
+} // namespace
+
+int main() {
+	vuk::HeadlessRunner runner;
+	if (!runner.host_image_copy) {
+		printf("VK_EXT_host_image_copy is not supported, only the staging path is measured\n");
+	}
+
+	std::vector<std::byte> data(4096ull * 4096 * 4, std::byte{ 0x5a });
+	for (uint32_t size = 256; size <= 4096; size *= 2) {
+		size_t image_bytes = (size_t)size * size * 4;
+		size_t count = std::max(bytes_per_size / image_bytes, (size_t)4);
+
+		auto staging_usage = vuk::ImageUsageFlagBits::eTransferDst | vuk::ImageUsageFlagBits::eSampled;
+		double staging = upload_seconds(runner, staging_usage, size, count, data);
+		printf("%4u^2 x %4zu: staging %6.2f GB/s", size, count, (double)(image_bytes * count) / staging * 1e-9);
+#ifdef VK_EXT_host_image_copy
+		if (runner.host_image_copy) {
+			double host = upload_seconds(runner, vuk::ImageUsageFlagBits::eHostTransferEXT | vuk::ImageUsageFlagBits::eSampled, size, count, data);
+			printf(", host image copy %6.2f GB/s", (double)(image_bytes * count) / host * 1e-9);
+		}
+#endif
+		printf("\n");
+	}
+
+	return 0;
+}
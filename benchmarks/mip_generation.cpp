@@ -0,0 +1,122 @@
+#include "headless_runner.hpp"
+#include "vuk/CommandBuffer.hpp"
+#include "vuk/Partials.hpp"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <vector>
+
+/* mip_generation
+ * The mip chain of 2D, array and cube images is generated with blits (generate_mips: a pass per level, a diverge and a converge)
+ * and with the single-pass compute downsampler (generate_mips_spd: a single pass and dispatch).
+ * The CPU cost is measured by compiling the graphs, the GPU time with timestamps around the generation.
+ */
+
+namespace {
+	constexpr size_t num_compiles = 200;
+	constexpr size_t num_runs = 32;
+
+	struct Case {
+		const char* name;
+		vuk::Format format;
+		uint32_t size;
+		uint32_t layers;
+		bool cube;
+	};
+
+	using Generator = vuk::Future (*)(vuk::Future, uint32_t, uint32_t);
+
+	// a pass that writes a timestamp once all previous work on the image has completed
+	vuk::Future timestamp(vuk::Future image, vuk::Query query) {
+		std::shared_ptr<vuk::RenderGraph> rgp = std::make_shared<vuk::RenderGraph>("timestamp");
+		rgp->attach_in("_src", std::move(image));
+		rgp->add_pass({ .name = "TIMESTAMP",
+		                .resources = { "_src"_image >> vuk::Access::eComputeRW >> "_src+" },
+		                .execute = [query](vuk::CommandBuffer& command_buffer) {
+			                command_buffer.write_timestamp(query);
+		                } });
+		return { std::move(rgp), "_src+" };
+	}
+} // namespace
+
+int main() {
+	vuk::HeadlessRunner runner;
+	auto& ctx = *runner.context;
+
+	std::array cases = { Case{ "2D 4096^2 rgba8", vuk::Format::eR8G8B8A8Unorm, 4096, 1, false },
+		                   Case{ "array 2048^2 x4 srgb", vuk::Format::eR8G8B8A8Srgb, 2048, 4, false },
+		                   Case{ "cube 1024^2 rgba16f", vuk::Format::eR16G16B16A16Sfloat, 1024, 6, true } };
+	std::array<std::pair<const char*, Generator>, 2> generators = { std::pair<const char*, Generator>{ "blit", &vuk::generate_mips },
+		                                                            std::pair<const char*, Generator>{ "spd", &vuk::generate_mips_spd } };
+
+	for (auto& c : cases) {
+		uint32_t levels = (uint32_t)std::bit_width(c.size);
+		bool srgb = vuk::is_format_srgb(c.format);
+		// sRGB formats can't be used for storage, their images need the usage to be allowed for the UNORM views only
+		vuk::ImageCreateFlags flags = {};
+		if (srgb) {
+			flags |= vuk::ImageCreateFlagBits::eExtendedUsage;
+		}
+		if (c.cube) {
+			flags |= vuk::ImageCreateFlagBits::eCubeCompatible;
+		}
+		vuk::ImageAttachment ia{ .image_flags = flags,
+			                       .image_type = vuk::ImageType::e2D,
+			                       .usage = vuk::ImageUsageFlagBits::eStorage | vuk::ImageUsageFlagBits::eTransferSrc | vuk::ImageUsageFlagBits::eTransferDst |
+			                                vuk::ImageUsageFlagBits::eSampled,
+			                       .extent = vuk::Dimension3D::absolute(c.size, c.size),
+			                       .format = c.format,
+			                       .sample_count = vuk::Samples::e1,
+			                       .allow_srgb_unorm_mutable = srgb,
+			                       .view_type = c.cube ? vuk::ImageViewType::eCube : (c.layers > 1 ? vuk::ImageViewType::e2DArray : vuk::ImageViewType::e2D),
+			                       .base_level = 0,
+			                       .level_count = levels,
+			                       .base_layer = 0,
+			                       .layer_count = c.layers };
+		auto image = *vuk::allocate_image(*runner.allocator, ia);
+		ia.image = *image;
+
+		for (auto& [method, generate] : generators) {
+			double compile_seconds = vuk::time_seconds([&] {
+				for (size_t i = 0; i < num_compiles; i++) {
+					auto fut = generate(vuk::Future(ia), 0, levels);
+					auto rg = fut.get_render_graph();
+					auto result = runner.compiler.compile(std::span{ &rg, 1 }, {});
+				}
+			});
+
+			std::vector<std::pair<vuk::Query, vuk::Query>> queries;
+			double wall_seconds = vuk::time_seconds([&] {
+				for (size_t i = 0; i < num_runs; i++) {
+					auto& frame = runner.sfa_resource->get_next_frame();
+					vuk::Allocator frame_allocator(frame);
+					auto& q = queries.emplace_back(ctx.create_timestamp_query(), ctx.create_timestamp_query());
+					auto fut = timestamp(generate(timestamp(vuk::Future(ia), q.first), 0, levels), q.second);
+					fut.wait(frame_allocator, runner.compiler);
+				}
+			});
+			// timestamps become available when their frame is recycled
+			for (unsigned i = 0; i < 3; i++) {
+				runner.sfa_resource->get_next_frame();
+			}
+
+			double gpu_seconds = 0;
+			size_t gpu_samples = 0;
+			for (auto& [begin, end] : queries) {
+				if (auto duration = ctx.retrieve_duration(begin, end)) {
+					gpu_seconds += *duration;
+					gpu_samples++;
+				}
+			}
+			printf("%-24s %-5s: compile %8.2f us, gpu %8.3f ms, submit+wait %8.3f ms\n",
+			       c.name,
+			       method,
+			       compile_seconds / num_compiles * 1e6,
+			       gpu_samples ? gpu_seconds / gpu_samples * 1e3 : 0.0,
+			       wall_seconds / num_runs * 1e3);
+		}
+	}
+
+	return 0;
+}
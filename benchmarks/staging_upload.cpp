@@ -0,0 +1,57 @@
+#include "headless_runner.hpp"
+#include "vuk/Partials.hpp"
+
+#include <algorithm>
+#include <vector>
+
+/* staging_upload
+ * Host data is uploaded to device-only buffers with host_data_to_buffer, from 1 KiB to 64 MiB per upload.
+ * Uploads that fit are staged through the staging ring of the Context, larger ones fall back to staging buffers of the frame allocator.
+ */
+
+namespace {
+	constexpr size_t bytes_per_size = 256ull * 1024 * 1024;
+}
+
+int main() {
+	vuk::HeadlessRunner runner;
+	auto& ctx = *runner.context;
+
+	std::vector<std::byte> data(64ull * 1024 * 1024, std::byte{ 0x5a });
+	for (size_t size = 1024; size <= data.size(); size *= 4) {
+		size_t count = std::clamp(bytes_per_size / size, (size_t)4, (size_t)4096);
+		auto& frame = runner.sfa_resource->get_next_frame();
+		vuk::Allocator frame_allocator(frame);
+		std::vector<vuk::Unique<vuk::Buffer>> buffers;
+		for (size_t i = 0; i < count; i++) {
+			buffers.emplace_back(*vuk::allocate_buffer(frame_allocator, vuk::BufferCreateInfo{ vuk::MemoryUsage::eGPUonly, size, 1 }));
+		}
+
+		auto before = ctx.get_staging_ring_stats();
+		double seconds = vuk::time_seconds([&] {
+			std::vector<vuk::Future> futures;
+			futures.reserve(count);
+			for (size_t i = 0; i < count; i++) {
+				auto fut = vuk::host_data_to_buffer(frame_allocator, vuk::DomainFlagBits::eTransferOnTransfer, *buffers[i], data.data(), size);
+				fut.submit(frame_allocator, runner.compiler);
+				futures.emplace_back(std::move(fut));
+			}
+			for (auto& fut : futures) {
+				fut.wait(frame_allocator, runner.compiler);
+			}
+		});
+		auto after = ctx.get_staging_ring_stats();
+		printf("%8zu KiB x %4zu: %6.2f GB/s, %zu staged through the ring (%zu wraps), %zu fell back\n",
+		       size / 1024,
+		       count,
+		       (double)(size * count) / seconds * 1e-9,
+		       after.allocations - before.allocations,
+		       after.wraps - before.wraps,
+		       after.fallbacks - before.fallbacks);
+	}
+
+	auto stats = ctx.get_staging_ring_stats();
+	printf("ring of %zu MiB, at most %zu KiB in use\n", stats.capacity / (1024 * 1024), stats.high_water_bytes / 1024);
+
+	return 0;
+}
@@ -0,0 +1,72 @@
+#include "headless_runner.hpp"
+#include "vuk/Partials.hpp"
+#include "vuk/StreamingUpload.hpp"
+
+#include <cstdio>
+#include <vector>
+
+/* streaming_file_upload
+ * A 512 MiB local file is uploaded to a device-only buffer, once by reading it whole into memory and calling host_data_to_buffer,
+ * and then streamed with stream_file_to_buffer for different chunk sizes, with at most 4 chunks in flight.
+ * Streaming keeps the staging memory bounded by the chunks in flight, the whole-file path needs the file size twice on the host.
+ */
+
+namespace {
+	constexpr size_t file_size = 512ull * 1024 * 1024;
+	constexpr const char* file_path = "vuk_streaming_file_upload.bin";
+} // namespace
+
+int main() {
+	vuk::HeadlessRunner runner;
+	auto& ctx = *runner.context;
+
+	{
+		std::vector<std::byte> block(16 * 1024 * 1024, std::byte{ 0x5a });
+		FILE* file = fopen(file_path, "wb");
+		if (!file) {
+			printf("could not create %s\n", file_path);
+			return 1;
+		}
+		for (size_t written = 0; written < file_size; written += block.size()) {
+			fwrite(block.data(), 1, block.size(), file);
+		}
+		fclose(file);
+	}
+
+	auto dst = *vuk::allocate_buffer(*runner.allocator, vuk::BufferCreateInfo{ vuk::MemoryUsage::eGPUonly, file_size, 1 });
+
+	double whole = vuk::time_seconds([&] {
+		auto& frame = runner.sfa_resource->get_next_frame();
+		vuk::Allocator frame_allocator(frame);
+		std::vector<std::byte> data(file_size);
+		FILE* file = fopen(file_path, "rb");
+		fread(data.data(), 1, data.size(), file);
+		fclose(file);
+		auto fut = vuk::host_data_to_buffer(frame_allocator, vuk::DomainFlagBits::eTransferOnTransfer, *dst, data.data(), data.size());
+		fut.wait(frame_allocator, runner.compiler);
+	});
+	printf("whole file           : %6.2f GB/s\n", (double)file_size / whole * 1e-9);
+
+	for (size_t chunk_size : { 1ull * 1024 * 1024, 4ull * 1024 * 1024, 8ull * 1024 * 1024, 32ull * 1024 * 1024 }) {
+		auto before = ctx.get_staging_ring_stats();
+		double seconds = vuk::time_seconds([&] {
+			auto& frame = runner.sfa_resource->get_next_frame();
+			vuk::Allocator frame_allocator(frame);
+			auto fut = vuk::stream_file_to_buffer(frame_allocator,
+			                                      runner.compiler,
+			                                      *dst,
+			                                      file_path,
+			                                      { .chunk_size = chunk_size, .max_chunks_in_flight = 4, .copy_domain = vuk::DomainFlagBits::eTransferOnTransfer });
+			fut->wait(frame_allocator, runner.compiler);
+		});
+		auto after = ctx.get_staging_ring_stats();
+		printf("chunks of %5zu KiB : %6.2f GB/s, %zu chunks staged through the ring, at most %zu KiB of staging in flight\n",
+		       chunk_size / 1024,
+		       (double)file_size / seconds * 1e-9,
+		       after.allocations - before.allocations,
+		       chunk_size * 4 / 1024);
+	}
+
+	remove(file_path);
+	return 0;
+}
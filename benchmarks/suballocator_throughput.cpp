@@ -0,0 +1,250 @@
+#include "../src/BufferAllocator.hpp"
+#include "headless_runner.hpp"
+#include "vuk/Descriptor.hpp"
+#include "vuk/Query.hpp"
+
+#include <atomic>
+#include <cstdlib>
+#include <random>
+#include <thread>
+#include <vector>
+
+/* suballocator_throughput
+ * Long-lived buffers are allocated and freed by several threads with a mix of sizes, keeping a window of live buffers per thread.
+ * The blocks come from a stub DeviceResource backed by host memory, so this measures only the CPU cost of the sub-allocator and needs no device.
+ */
+
+namespace {
+	constexpr size_t num_operations = 1 << 18;
+	constexpr size_t live_window = 512;
+
+	// hands out buffers backed by host memory, so no device is needed - the sub-allocator asks its upstream for nothing else
+	struct StubResource : vuk::DeviceResource {
+		std::atomic<uintptr_t> next_handle = 1;
+
+		vuk::Result<void, vuk::AllocateException>
+		allocate_buffers(std::span<vuk::Buffer> dst, std::span<const vuk::BufferCreateInfo> cis, vuk::SourceLocationAtFrame loc) override {
+			for (size_t i = 0; i < dst.size(); i++) {
+				auto memory = static_cast<std::byte*>(std::malloc(cis[i].size));
+				if (!memory) {
+					deallocate_buffers(dst.subspan(0, i));
+					return { vuk::expected_error, vuk::AllocateException{ VK_ERROR_OUT_OF_HOST_MEMORY } };
+				}
+				dst[i] = {};
+				dst[i].buffer = (VkBuffer)next_handle++;
+				dst[i].size = cis[i].size;
+				dst[i].mapped_ptr = memory;
+				dst[i].memory_usage = cis[i].mem_usage;
+			}
+			return { vuk::expected_value };
+		}
+
+		void deallocate_buffers(std::span<const vuk::Buffer> src) override {
+			for (auto& b : src) {
+				std::free(b.mapped_ptr);
+			}
+		}
+
+		vuk::Context& get_context() override {
+			std::abort();
+		}
+
+		vuk::Result<void, vuk::AllocateException> allocate_semaphores(std::span<VkSemaphore> dst, vuk::SourceLocationAtFrame loc) override {
+			return unsupported();
+		}
+		void deallocate_semaphores(std::span<const VkSemaphore> src) override {}
+
+		vuk::Result<void, vuk::AllocateException> allocate_fences(std::span<VkFence> dst, vuk::SourceLocationAtFrame loc) override {
+			return unsupported();
+		}
+		void deallocate_fences(std::span<const VkFence> src) override {}
+
+		vuk::Result<void, vuk::AllocateException> allocate_command_buffers(std::span<vuk::CommandBufferAllocation> dst,
+		                                                                   std::span<const vuk::CommandBufferAllocationCreateInfo> cis,
+		                                                                   vuk::SourceLocationAtFrame loc) override {
+			return unsupported();
+		}
+		void deallocate_command_buffers(std::span<const vuk::CommandBufferAllocation> src) override {}
+
+		vuk::Result<void, vuk::AllocateException>
+		allocate_command_pools(std::span<vuk::CommandPool> dst, std::span<const VkCommandPoolCreateInfo> cis, vuk::SourceLocationAtFrame loc) override {
+			return unsupported();
+		}
+		void deallocate_command_pools(std::span<const vuk::CommandPool> src) override {}
+
+		vuk::Result<void, vuk::AllocateException>
+		allocate_framebuffers(std::span<VkFramebuffer> dst, std::span<const vuk::FramebufferCreateInfo> cis, vuk::SourceLocationAtFrame loc) override {
+			return unsupported();
+		}
+		void deallocate_framebuffers(std::span<const VkFramebuffer> src) override {}
+
+		vuk::Result<void, vuk::AllocateException>
+		allocate_images(std::span<vuk::Image> dst, std::span<const vuk::ImageCreateInfo> cis, vuk::SourceLocationAtFrame loc) override {
+			return unsupported();
+		}
+		void deallocate_images(std::span<const vuk::Image> src) override {}
+
+		vuk::Result<void, vuk::AllocateException>
+		allocate_image_views(std::span<vuk::ImageView> dst, std::span<const vuk::ImageViewCreateInfo> cis, vuk::SourceLocationAtFrame loc) override {
+			return unsupported();
+		}
+		void deallocate_image_views(std::span<const vuk::ImageView> src) override {}
+
+		vuk::Result<void, vuk::AllocateException> allocate_persistent_descriptor_sets(std::span<vuk::PersistentDescriptorSet> dst,
+		                                                                              std::span<const vuk::PersistentDescriptorSetCreateInfo> cis,
+		                                                                              vuk::SourceLocationAtFrame loc) override {
+			return unsupported();
+		}
+		void deallocate_persistent_descriptor_sets(std::span<const vuk::PersistentDescriptorSet> src) override {}
+
+		vuk::Result<void, vuk::AllocateException>
+		allocate_descriptor_sets_with_value(std::span<vuk::DescriptorSet> dst, std::span<const vuk::SetBinding> cis, vuk::SourceLocationAtFrame loc) override {
+			return unsupported();
+		}
+
+		vuk::Result<void, vuk::AllocateException> allocate_descriptor_sets(std::span<vuk::DescriptorSet> dst,
+		                                                                   std::span<const vuk::DescriptorSetLayoutAllocInfo> cis,
+		                                                                   vuk::SourceLocationAtFrame loc) override {
+			return unsupported();
+		}
+		void deallocate_descriptor_sets(std::span<const vuk::DescriptorSet> src) override {}
+
+		vuk::Result<void, vuk::AllocateException>
+		allocate_descriptor_pools(std::span<VkDescriptorPool> dst, std::span<const VkDescriptorPoolCreateInfo> cis, vuk::SourceLocationAtFrame loc) override {
+			return unsupported();
+		}
+		void deallocate_descriptor_pools(std::span<const VkDescriptorPool> src) override {}
+
+		vuk::Result<void, vuk::AllocateException> allocate_timestamp_query_pools(std::span<vuk::TimestampQueryPool> dst,
+		                                                                         std::span<const VkQueryPoolCreateInfo> cis,
+		                                                                         vuk::SourceLocationAtFrame loc) override {
+			return unsupported();
+		}
+		void deallocate_timestamp_query_pools(std::span<const vuk::TimestampQueryPool> src) override {}
+
+		vuk::Result<void, vuk::AllocateException> allocate_timestamp_queries(std::span<vuk::TimestampQuery> dst,
+		                                                                     std::span<const vuk::TimestampQueryCreateInfo> cis,
+		                                                                     vuk::SourceLocationAtFrame loc) override {
+			return unsupported();
+		}
+		void deallocate_timestamp_queries(std::span<const vuk::TimestampQuery> src) override {}
+
+		vuk::Result<void, vuk::AllocateException> allocate_timeline_semaphores(std::span<vuk::TimelineSemaphore> dst, vuk::SourceLocationAtFrame loc) override {
+			return unsupported();
+		}
+		void deallocate_timeline_semaphores(std::span<const vuk::TimelineSemaphore> src) override {}
+
+		vuk::Result<void, vuk::AllocateException> allocate_acceleration_structures(std::span<VkAccelerationStructureKHR> dst,
+		                                                                           std::span<const VkAccelerationStructureCreateInfoKHR> cis,
+		                                                                           vuk::SourceLocationAtFrame loc) override {
+			return unsupported();
+		}
+		void deallocate_acceleration_structures(std::span<const VkAccelerationStructureKHR> src) override {}
+
+		void deallocate_swapchains(std::span<const VkSwapchainKHR> src) override {}
+
+		vuk::Result<void, vuk::AllocateException> allocate_graphics_pipelines(std::span<vuk::GraphicsPipelineInfo> dst,
+		                                                                      std::span<const vuk::GraphicsPipelineInstanceCreateInfo> cis,
+		                                                                      vuk::SourceLocationAtFrame loc) override {
+			return unsupported();
+		}
+		void deallocate_graphics_pipelines(std::span<const vuk::GraphicsPipelineInfo> src) override {}
+
+		vuk::Result<void, vuk::AllocateException> allocate_compute_pipelines(std::span<vuk::ComputePipelineInfo> dst,
+		                                                                     std::span<const vuk::ComputePipelineInstanceCreateInfo> cis,
+		                                                                     vuk::SourceLocationAtFrame loc) override {
+			return unsupported();
+		}
+		void deallocate_compute_pipelines(std::span<const vuk::ComputePipelineInfo> src) override {}
+
+		vuk::Result<void, vuk::AllocateException> allocate_ray_tracing_pipelines(std::span<vuk::RayTracingPipelineInfo> dst,
+		                                                                         std::span<const vuk::RayTracingPipelineInstanceCreateInfo> cis,
+		                                                                         vuk::SourceLocationAtFrame loc) override {
+			return unsupported();
+		}
+		void deallocate_ray_tracing_pipelines(std::span<const vuk::RayTracingPipelineInfo> src) override {}
+
+		vuk::Result<void, vuk::AllocateException>
+		allocate_render_passes(std::span<VkRenderPass> dst, std::span<const vuk::RenderPassCreateInfo> cis, vuk::SourceLocationAtFrame loc) override {
+			return unsupported();
+		}
+		void deallocate_render_passes(std::span<const VkRenderPass> src) override {}
+
+	private:
+		static vuk::Result<void, vuk::AllocateException> unsupported() {
+			return { vuk::expected_error, vuk::AllocateException{ VK_ERROR_FEATURE_NOT_PRESENT } };
+		}
+	};
+
+	// mostly small uniform-sized buffers, with a tail of larger ones
+	size_t random_size(std::mt19937& rng) {
+		std::uniform_int_distribution<int> pow(6, 18);
+		std::uniform_int_distribution<size_t> jitter(0, 63);
+		auto p = std::min(pow(rng), pow(rng));
+		return ((size_t)1 << p) + jitter(rng) * 4;
+	}
+
+	double run(vuk::BufferSubAllocator& suballocator, size_t num_threads) {
+		return vuk::time_seconds([&] {
+			std::vector<std::thread> threads;
+			for (size_t t = 0; t < num_threads; t++) {
+				threads.emplace_back([&, t] {
+					std::mt19937 rng((unsigned)t);
+					std::vector<vuk::Buffer> live(live_window);
+					for (size_t i = 0; i < num_operations / num_threads; i++) {
+						auto& slot = live[i % live_window];
+						if (slot) {
+							suballocator.deallocate_buffer(slot);
+						}
+						slot = *suballocator.allocate_buffer(random_size(rng), 256, {});
+					}
+					for (auto& b : live) {
+						if (b) {
+							suballocator.deallocate_buffer(b);
+						}
+					}
+				});
+			}
+			for (auto& t : threads) {
+				t.join();
+			}
+		});
+	}
+} // namespace
+
+int main() {
+	StubResource stub;
+
+	for (size_t num_threads : { 1, 4, 8 }) {
+		vuk::BufferSubAllocator suballocator(stub, vuk::MemoryUsage::eGPUonly, vuk::all_buffer_usage_flags, 64 * 1024 * 1024);
+		auto seconds = run(suballocator, num_threads);
+		printf("%zu threads: %.2f Mops/s\n", num_threads, num_operations / seconds * 1e-6);
+	}
+
+	// fragmentation with the window still alive
+	vuk::BufferSubAllocator suballocator(stub, vuk::MemoryUsage::eGPUonly, vuk::all_buffer_usage_flags, 64 * 1024 * 1024);
+	std::mt19937 rng(0);
+	std::vector<vuk::Buffer> live;
+	for (size_t i = 0; i < live_window * 8; i++) {
+		live.push_back(*suballocator.allocate_buffer(random_size(rng), 256, {}));
+	}
+	for (size_t i = 0; i < live.size(); i += 2) {
+		suballocator.deallocate_buffer(live[i]);
+	}
+	auto report = suballocator.get_fragmentation_report();
+	printf("after freeing every other buffer: %zu blocks, %zu KiB allocated, %zu KiB free in %zu ranges (largest %zu KiB), %zu slabs with %zu KiB free slots, "
+	       "fragmentation %.2f\n",
+	       report.block_count,
+	       report.allocated_bytes / 1024,
+	       report.free_bytes / 1024,
+	       report.free_range_count,
+	       report.largest_free_range / 1024,
+	       report.slab_count,
+	       report.slab_free_bytes / 1024,
+	       report.fragmentation);
+	for (size_t i = 1; i < live.size(); i += 2) {
+		suballocator.deallocate_buffer(live[i]);
+	}
+
+	return 0;
+}
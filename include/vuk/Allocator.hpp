@@ -2,6 +2,7 @@
 
 #include "vuk/Config.hpp"
 #include "vuk/Image.hpp"
+#include "vuk/MemoryStats.hpp"
 #include "vuk/Result.hpp"
 #include "vuk/SourceLocation.hpp"
 #include "vuk/vuk_fwd.hpp"
@@ -110,6 +111,17 @@ namespace vuk {
 		allocate_render_passes(std::span<VkRenderPass> dst, std::span<const RenderPassCreateInfo> cis, SourceLocationAtFrame loc) = 0;
 		virtual void deallocate_render_passes(std::span<const VkRenderPass> src) = 0;
 
+		/// @brief Notify this DeviceResource that a submission used its resources, and completes when the queue timeline semaphore reaches value
+		/// DeviceResources that recycle resources must wait for these values before reuse. By default submissions are ignored.
+		virtual void add_submission(VkSemaphore timeline_semaphore, uint64_t value) {}
+
+		/// @brief Report the live, peak and per-frame usage of the device objects allocated through this DeviceResource
+		/// @param top_sites number of allocation sites to report, by live bytes
+		/// By default nothing is tracked and an empty report is returned.
+		virtual MemoryStats get_memory_stats(size_t top_sites = 16) {
+			return {};
+		}
+
 		virtual Context& get_context() = 0;
 	};
 
@@ -488,6 +500,11 @@ namespace vuk {
 		/// @param src Span of render passes to be deallocated
 		void deallocate(std::span<const VkRenderPass> src);
 
+		/// @brief Notify the underlying DeviceResource of a submission using resources from this Allocator
+		/// @param timeline_semaphore Timeline semaphore of the queue the submission was made to
+		/// @param value Value of the timeline semaphore signalled when the submission completes
+		void add_submission(VkSemaphore timeline_semaphore, uint64_t value);
+
 		/// @brief Get the underlying DeviceResource
 		/// @return the underlying DeviceResource
 		DeviceResource& get_device_resource() {
@@ -117,6 +117,7 @@ namespace vuk {
 		ici.arrayLayers = attachment.layer_count;
 		ici.samples = attachment.sample_count.count;
 		ici.tiling = attachment.tiling;
+		ici.sharingMode = attachment.sharing_mode;
 		ici.mipLevels = attachment.level_count;
 		ici.usage = attachment.usage;
 		assert(attachment.extent.sizing == Sizing::eAbsolute);
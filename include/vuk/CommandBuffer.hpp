@@ -656,11 +656,21 @@ namespace vuk {
 		/// @param dst the Name of the destination Resource
 		/// @param copy_params parameters of the copy
 		CommandBuffer& copy_buffer_to_image(Name src, Name dst, BufferImageCopy copy_params);
+		/// @brief Copy a buffer resource into several regions of an image resource, with a single copy command
+		/// @param src the Name of the source Resource
+		/// @param dst the Name of the destination Resource
+		/// @param regions parameters of the copies, buffer offsets are relative to the source Resource
+		CommandBuffer& copy_buffer_to_image(Name src, Name dst, std::span<const BufferImageCopy> regions);
 		/// @brief Copy an image resource into a buffer resource
 		/// @param src the Name of the source Resource
 		/// @param dst the Name of the destination Resource
 		/// @param copy_params parameters of the copy
 		CommandBuffer& copy_image_to_buffer(Name src, Name dst, BufferImageCopy copy_params);
+		/// @brief Copy several regions of an image resource into a buffer resource, with a single copy command
+		/// @param src the Name of the source Resource
+		/// @param dst the Name of the destination Resource
+		/// @param regions parameters of the copies, buffer offsets are relative to the destination Resource
+		CommandBuffer& copy_image_to_buffer(Name src, Name dst, std::span<const BufferImageCopy> regions);
 		/// @brief Copy between two buffer resource
 		/// @param src the Name of the source Resource
 		/// @param dst the Name of the destination Resource
@@ -1,6 +1,9 @@
 #pragma once
 
 #include <array>
+#include <chrono>
+#include <functional>
+#include <memory>
 #include <optional>
 #include <span>
 #include <string_view>
@@ -20,6 +23,9 @@ namespace std {
 } // namespace std
 
 namespace vuk {
+	struct BufferImageCopy;
+	struct ImageAttachment;
+
 	/// @brief Parameters used for creating a Context
 	struct ContextCreateParameters {
 		/// @brief Vulkan instance
@@ -32,11 +38,11 @@ namespace vuk {
 		VkQueue graphics_queue = VK_NULL_HANDLE;
 		/// @brief Optional graphics queue family index
 		uint32_t graphics_queue_family_index = VK_QUEUE_FAMILY_IGNORED;
-		/// @brief Optional compute queue
+		/// @brief Optional compute queue - may be another queue of the graphics family, or the graphics queue itself
 		VkQueue compute_queue = VK_NULL_HANDLE;
 		/// @brief Optional compute queue family index
 		uint32_t compute_queue_family_index = VK_QUEUE_FAMILY_IGNORED;
-		/// @brief Optional transfer queue
+		/// @brief Optional transfer queue - may be another queue of any family, or the graphics or compute queue itself
 		VkQueue transfer_queue = VK_NULL_HANDLE;
 		/// @brief Optional transfer queue family index
 		uint32_t transfer_queue_family_index = VK_QUEUE_FAMILY_IGNORED;
@@ -56,6 +62,87 @@ namespace vuk {
 		/// @brief Allow vuk to load missing required and optional function pointers dynamically
 		/// If this is false, then you must fill in all required function pointers
 		bool allow_dynamic_loading_of_vk_function_pointers = true;
+
+		/// @brief Set if VK_EXT_memory_budget is enabled on the device
+		/// If this is false, then heap budgets are estimated from the heap sizes instead of being reported by the driver
+		bool memory_budget_extension_enabled = false;
+
+		/// @brief Set if VK_EXT_host_image_copy is enabled on the device, together with the hostImageCopy feature
+		/// If this is true, uploads to images created with host transfer usage are done on the host, without staging or submission
+		bool host_image_copy_enabled = false;
+
+		/// @brief Size of the persistently mapped staging ring used for uploads, 0 disables the ring
+		size_t staging_ring_size = 32 * 1024 * 1024;
+
+		/// @brief Size of the persistently mapped readback ring used for downloads, 0 disables the ring
+		size_t readback_ring_size = 8 * 1024 * 1024;
+	};
+
+	/// @brief Parameters for merging submissions to a Queue into fewer vkQueueSubmit2 calls
+	struct SubmitCoalescingParameters {
+		/// @brief If false, every submission is issued immediately
+		bool enabled = false;
+		/// @brief Issue pending submissions once this many VkSubmitInfo2 have accumulated
+		uint32_t max_pending_submits = 256;
+		/// @brief Issue pending submissions once the oldest of them is older than this, enforced by a timer thread of the Queue
+		std::chrono::microseconds max_latency = std::chrono::milliseconds(4);
+	};
+
+	/// @brief Submission statistics of a Queue
+	struct SubmitStats {
+		/// @brief Number of SubmitBatches submitted to the Queue
+		uint64_t batches = 0;
+		/// @brief Number of vkQueueSubmit2 calls issued
+		uint64_t queue_submits = 0;
+		/// @brief Latency from submitting a SubmitBatch until its vkQueueSubmit2 returned
+		/// Bucket i counts latencies in [2^i, 2^(i+1)) microseconds, the first bucket also counts latencies below 1 us and the last bucket all latencies above
+		std::array<uint64_t, 24> latency_histogram = {};
+
+		/// @brief Number of vkQueueSubmit2 calls avoided by coalescing
+		uint64_t submits_saved() const {
+			return batches > queue_submits ? batches - queue_submits : 0;
+		}
+
+		void record_latency(std::chrono::microseconds latency);
+	};
+
+	/// @brief Statistics of the host waiting for queue timelines
+	struct HostWaitStats {
+		/// @brief Number of host waits issued
+		uint64_t waits = 0;
+		/// @brief Number of host waits that timed out
+		uint64_t timeouts = 0;
+		/// @brief Total time blocked in host waits
+		std::chrono::nanoseconds blocked = {};
+	};
+
+	/// @brief Host-visible memory from the staging ring of a Context
+	struct StagingAllocation {
+		/// @brief Persistently mapped buffer
+		Buffer buffer;
+		/// @brief The memory is reclaimed once every copy of this is released and the submissions started until then have completed
+		/// Keep it alive until the commands reading the buffer have been submitted, eg. by capturing it into the pass that reads the buffer.
+		std::shared_ptr<struct StagingRelease> release;
+		/// @brief The memory is from an allocator, because the ring could not serve the request - it is given back to the allocator like ring memory is reclaimed
+		bool dedicated = false;
+	};
+
+	/// @brief Statistics of the staging ring of a Context
+	struct StagingRingStats {
+		/// @brief Size of the ring
+		size_t capacity = 0;
+		/// @brief Number of allocations served by the ring
+		size_t allocations = 0;
+		/// @brief Bytes served by the ring
+		size_t allocated_bytes = 0;
+		/// @brief Number of times the ring wrapped around
+		size_t wraps = 0;
+		/// @brief Number of requests that did not fit and fell back to other memory
+		size_t fallbacks = 0;
+		/// @brief Bytes not yet reclaimed
+		size_t in_use_bytes = 0;
+		/// @brief Highest number of bytes not yet reclaimed
+		size_t high_water_bytes = 0;
 	};
 
 	/// @brief Abstraction of a device queue in Vulkan
@@ -69,12 +156,33 @@ namespace vuk {
 		Queue(Queue&&) noexcept;
 		Queue& operator=(Queue&&) noexcept;
 
+		/// @brief Timeline semaphore signalled by the submissions to this Queue
+		/// The value is only updated while the queue lock is held, use get_reserved_value() to observe the progress of submissions from other threads
 		TimelineSemaphore& get_submit_sync();
 		std::recursive_mutex& get_queue_lock();
+		/// @brief Highest timeline value reserved for submissions to this Queue
+		/// Every submission started before the call signals at most this value, even if it has not been issued to the queue yet
+		uint64_t get_reserved_value();
 
 		Result<void> submit(std::span<VkSubmitInfo> submit_infos, VkFence fence);
 		Result<void> submit(std::span<VkSubmitInfo2KHR> submit_infos, VkFence fence);
 
+		/// @brief Configure coalescing of submissions to this Queue
+		/// When enabled, submissions are held back until a threshold or the latency deadline is reached, a swapchain is involved, the host waits or flush() is called
+		void set_submit_coalescing(SubmitCoalescingParameters params);
+		/// @brief Start a thread that issues the submissions to this Queue
+		/// Submitters then hand off their submissions through a lock-free ring and receive timeline values without waiting for the queue.
+		/// Must not be called while submissions to this Queue are in progress.
+		/// @param ring_capacity Number of submissions that can be in flight to the thread, must be a power of two
+		Result<void> start_submit_thread(size_t ring_capacity = 256);
+		/// @brief Issue all handed off submissions, then stop the submission thread
+		void stop_submit_thread();
+		/// @brief Issue all pending submissions to this Queue in a single vkQueueSubmit2
+		/// If the Queue has a submission thread, wait until it has issued all submissions handed off so far
+		Result<void> flush();
+		/// @brief Retrieve submission statistics for this Queue
+		SubmitStats get_submit_stats();
+
 		struct QueueImpl* impl;
 	};
 
@@ -114,6 +222,8 @@ namespace vuk {
 		VkPhysicalDeviceRayTracingPipelinePropertiesKHR rt_properties{ VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_RAY_TRACING_PIPELINE_PROPERTIES_KHR };
 		VkPhysicalDeviceAccelerationStructurePropertiesKHR as_properties{ VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_ACCELERATION_STRUCTURE_PROPERTIES_KHR };
 		size_t min_buffer_alignment;
+		bool memory_budget_extension_enabled = false;
+		bool host_image_copy_enabled = false;
 
 		// Debug functions
 		
@@ -175,6 +285,43 @@ namespace vuk {
 
 		Texture allocate_texture(Allocator& allocator, ImageCreateInfo ici, SourceLocationAtFrame loc = VUK_HERE_AND_NOW());
 
+		/// @brief Allocate host-visible memory for uploads from the persistently mapped staging ring
+		///
+		/// Space is reclaimed once the allocation is released and the queue timelines reach the values reserved until then.
+		/// @return The allocation, or nothing if the request is too large for the ring or the ring is full
+		std::optional<StagingAllocation> allocate_staging(size_t size, size_t alignment);
+
+		/// @brief Hand memory from an allocator to the staging ring, to be given back to the allocator once released like memory of the ring
+		///
+		/// The memory is deallocated after the submissions started until the release have completed, so that the allocator may destroy it right away.
+		/// The DeviceResource of the allocator must stay alive until then.
+		StagingAllocation adopt_staging(Allocator& allocator, Unique<Buffer> buffer);
+
+		/// @brief Retrieve the statistics of the staging ring
+		StagingRingStats get_staging_ring_stats();
+
+		/// @brief Allocate device-written, host-readable memory for downloads from the persistently mapped readback ring
+		///
+		/// Keep the release token alive until the host has finished reading the memory.
+		/// @return The allocation, or nothing if the request is too large for the ring or the ring is full
+		std::optional<StagingAllocation> allocate_readback(size_t size, size_t alignment);
+
+		/// @brief Retrieve the statistics of the readback ring
+		StagingRingStats get_readback_ring_stats();
+
+		/// @brief Check if an image can be written from the host with VK_EXT_host_image_copy
+		/// The extension must be enabled and the image must exist and have been created with host transfer usage.
+		bool can_copy_memory_to_image(const ImageAttachment& image) const;
+
+		/// @brief Write regions of an image directly from host memory with VK_EXT_host_image_copy, without staging or submission
+		///
+		/// The subresources written by the regions are transitioned on the host from undefined to general layout, which discards their contents, then the regions are copied.
+		/// Other subresources of the image are left untouched. The image must not be in use by the device.
+		/// @param image ImageAttachment to write, can_copy_memory_to_image() must be true for it
+		/// @param src_data source data, the bufferOffset of the regions is relative to it
+		/// @param regions regions to copy
+		Result<void> copy_memory_to_image(const ImageAttachment& image, const void* src_data, std::span<const BufferImageCopy> regions);
+
 		// Swapchain management
 
 		/// @brief Add a swapchain to be managed by the Context
@@ -201,8 +348,42 @@ namespace vuk {
 		Result<void> submit_graphics(std::span<VkSubmitInfo2KHR>);
 		Result<void> submit_transfer(std::span<VkSubmitInfo2KHR>);
 
+		/// @brief Wait on the host until queue timelines reach the given values
 		Result<void> wait_for_domains(std::span<std::pair<DomainFlags, uint64_t>> queue_waits);
 
+		/// @brief Wait on the host until queue timelines reach the given values, with a timeout
+		///
+		/// Waits on the same queue are collapsed (to the highest value, or the lowest one when waiting for any), and all queues are waited on with a single
+		/// vkWaitSemaphores.
+		/// @param timeout Maximum time to block for
+		/// @param wait_any Return as soon as any of the waits is satisfied, instead of all of them
+		/// @return VK_SUCCESS if the waits were satisfied, VK_TIMEOUT if the timeout elapsed first
+		Result<VkResult> wait_for_domains(std::span<std::pair<DomainFlags, uint64_t>> queue_waits, std::chrono::nanoseconds timeout, bool wait_any = false);
+
+		/// @brief Retrieve the host wait statistics of the current frame
+		HostWaitStats get_host_wait_stats() const;
+
+		/// @brief Retrieve the host wait statistics of the previous frame, as delimited by next_frame()
+		HostWaitStats get_last_frame_host_wait_stats() const;
+
+		/// @brief Account a host wait performed outside of wait_for_domains() in the host wait statistics
+		void record_host_wait(std::chrono::nanoseconds blocked, bool timed_out = false);
+
+		/// @brief Issue all pending (coalesced) submissions on all queues
+		Result<void> flush_submissions();
+
+		/// @brief Check without blocking if the queue timeline of a domain has reached a value
+		/// If the value is not reached yet, the pending (coalesced) submissions of the queue are issued, as they might signal it.
+		/// @return whether the value is reached, or the error of querying the timeline (e.g. the device is lost) or of issuing the submissions
+		Result<bool> is_domain_value_reached(DomainFlags domain, uint64_t value);
+
+		/// @brief Invoke a callback once the queue timeline of a domain reaches a value
+		///
+		/// Callbacks are invoked on a completion thread owned by the Context, which waits on all queue timelines at once. The thread is started on first use.
+		/// Callbacks for values already reached are invoked immediately. Callbacks still pending when the Context is destroyed are invoked once the device is idle.
+		/// If the wait of the completion thread fails (e.g. the device is lost), it stops and registering further callbacks returns the error.
+		Result<void> on_domain_value_reached(DomainFlags domain, uint64_t value, std::function<void()> callback);
+
 		// Query functionality
 
 		/// @brief Create a timestamp query to record timing information
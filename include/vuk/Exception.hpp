@@ -35,6 +35,14 @@ namespace vuk {
 		}
 	};
 
+	struct FileIOException : Exception {
+		using Exception::Exception;
+
+		void throw_this() override {
+			throw *this;
+		}
+	};
+
 	struct VkException : Exception {
 		VkResult error_code;
 		
@@ -6,6 +6,8 @@
 #include "vuk/Types.hpp"
 #include "vuk/vuk_fwd.hpp"
 
+#include <coroutine>
+#include <functional>
 #include <memory>
 #include <span>
 #include <variant>
@@ -25,6 +27,7 @@ namespace vuk {
 		DomainFlagBits initial_domain = DomainFlagBits::eNone; // the domain where we submitted this Future to
 		QueueResourceUse last_use;                             // the results of the future are available if waited for on the initial_domain
 		uint64_t initial_visibility;                           // the results of the future are available if waited for {initial_domain, initial_visibility}
+		Context* context = nullptr;                            // the Context this future was submitted to
 
 		std::variant<std::monostate, ImageAttachment, Buffer> result;
 
@@ -34,6 +37,11 @@ namespace vuk {
 		}
 	};
 
+	/// @brief Resumes suspended coroutines, eg. by scheduling them on a thread pool
+	using Executor = std::function<void(std::coroutine_handle<>)>;
+
+	struct FutureAwaitable;
+
 	class Future {
 	public:
 		Future() = default;
@@ -102,6 +110,25 @@ namespace vuk {
 		template<class T>
 		[[nodiscard]] Result<T> get(Allocator& allocator, Compiler& compiler);
 
+		/// @brief Check without blocking if the Future has completed execution
+		/// Pending (coalesced) submissions of the domain are issued if the Future has not completed yet.
+		/// @return true if the Future has been submitted and its result is available, false otherwise, or the error of checking
+		Result<bool> is_ready() const;
+		/// @brief Invoke a callback once the Future has completed execution, without blocking
+		///
+		/// The Future must have been submitted. The callback is invoked on the completion thread of the Context, or immediately if the Future has already completed.
+		/// @param callback Callback receiving the control block of the Future
+		Result<void> then(std::function<void(FutureBase&)> callback);
+
+		/// @brief Await the Future in a coroutine, submitting it if it has not been submitted yet
+		///
+		/// The coroutine is suspended until the Future completes execution, without blocking a thread.
+		/// @param executor Executor to resume the coroutine with, if empty the coroutine is resumed on the completion thread of the Context
+		/// @return Awaitable producing a Result<void>
+		FutureAwaitable awaitable(Allocator& allocator, Compiler& compiler, Executor executor = {});
+		/// @brief Await a submitted Future in a coroutine, resuming on the completion thread of the Context
+		FutureAwaitable operator co_await();
+
 		/// @brief Get control block for Future
 		FutureBase* get_control() {
 			return control.get();
@@ -134,6 +161,71 @@ namespace vuk {
 		friend struct RenderGraph;
 	};
 
+	/// @brief Awaitable for Futures, see Future::awaitable()
+	struct FutureAwaitable {
+		Future& future;
+		Allocator* allocator = nullptr;
+		Compiler* compiler = nullptr;
+		Executor executor;
+		Result<void> result = { expected_value };
+
+		bool await_ready() {
+			auto ready = future.is_ready();
+			if (!ready) {
+				// not suspending, the error is returned on resumption
+				result = std::move(ready);
+				return true;
+			}
+			return *ready;
+		}
+
+		bool await_suspend(std::coroutine_handle<> handle) {
+			if (future.get_status() == FutureBase::Status::eInitial) {
+				if (!allocator) {
+					result = Result<void>{ expected_error, RenderGraphException{} }; // can't await a future that was not submitted without an allocator
+					return false;
+				}
+				if (auto res = future.submit(*allocator, *compiler); !res) {
+					result = std::move(res);
+					return false;
+				}
+			}
+			auto ready = future.is_ready();
+			if (!ready) {
+				result = std::move(ready);
+				return false;
+			}
+			if (*ready) {
+				return false;
+			}
+			// the callback might resume the coroutine before then() returns, so this awaitable must not be touched after a successful then()
+			auto res = future.then([handle, executor = executor](FutureBase&) {
+				if (executor) {
+					executor(handle);
+				} else {
+					handle.resume();
+				}
+			});
+			if (!res) {
+				result = std::move(res);
+				return false;
+			}
+			return true;
+		}
+
+		Result<void> await_resume() {
+			return std::move(result);
+		}
+	};
+
+	inline FutureAwaitable Future::awaitable(Allocator& allocator, Compiler& compiler, Executor executor) {
+		return FutureAwaitable{ *this, &allocator, &compiler, std::move(executor) };
+	}
+
+	inline FutureAwaitable Future::operator co_await() {
+		return FutureAwaitable{ *this };
+	}
+
 	template<class... Args>
 	Result<void> wait_for_futures(Allocator& alloc, Compiler& compiler, Args&&... futs) {
 		std::array controls = { futs.get_control()... };
@@ -162,7 +254,7 @@ namespace vuk {
 			waits.emplace_back(control->initial_domain, control->initial_visibility);
 		}
 		if (waits.size() > 0) {
-			alloc.get_context().wait_for_domains(std::span(waits));
+			VUK_DO_OR_RETURN(alloc.get_context().wait_for_domains(std::span(waits)));
 		}
 
 		return { expected_value };
@@ -193,7 +285,7 @@ namespace vuk {
 			waits.emplace_back(control->initial_domain, control->initial_visibility);
 		}
 		if (waits.size() > 0) {
-			alloc.get_context().wait_for_domains(std::span(waits));
+			VUK_DO_OR_RETURN(alloc.get_context().wait_for_domains(std::span(waits)));
 		}
 
 		return { expected_value };
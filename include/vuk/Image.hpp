@@ -38,6 +38,9 @@ namespace vuk {
 		eInputAttachment = VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT,
 		eShadingRateImageNV = VK_IMAGE_USAGE_SHADING_RATE_IMAGE_BIT_NV,
 		eFragmentDensityMapEXT = VK_IMAGE_USAGE_FRAGMENT_DENSITY_MAP_BIT_EXT,
+#ifdef VK_EXT_host_image_copy
+		eHostTransferEXT = VK_IMAGE_USAGE_HOST_TRANSFER_BIT_EXT,
+#endif
 		eInfer = 1024
 	};
 
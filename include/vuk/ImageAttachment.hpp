@@ -13,6 +13,7 @@ namespace vuk {
 		ImageCreateFlags image_flags = {};
 		ImageType image_type = ImageType::e2D;
 		ImageTiling tiling = ImageTiling::eOptimal;
+		SharingMode sharing_mode = SharingMode::eExclusive; // concurrent images are used on all queues without ownership transfers
 		ImageUsageFlags usage = ImageUsageFlagBits::eInfer;
 		Dimension3D extent = Dimension3D::framebuffer();
 		Format format = Format::eUndefined;
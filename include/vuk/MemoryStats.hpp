@@ -0,0 +1,132 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+namespace vuk {
+	/// @brief Kinds of device objects tracked by memory telemetry
+	enum class TrackedResource : uint8_t {
+		eBuffer,
+		eImage,
+		eImageView,
+		eSemaphore,
+		eFence,
+		eTimelineSemaphore,
+		eCommandPool,
+		eFramebuffer,
+		eDescriptorPool,
+		eQueryPool,
+		eAccelerationStructure,
+		eCount
+	};
+
+	std::string_view to_name(TrackedResource);
+
+	/// @brief Usage counters of a group of device objects
+	struct UsageCounters {
+		/// @brief Number of live objects
+		size_t count = 0;
+		/// @brief Bytes of device memory backing the live objects
+		size_t bytes = 0;
+		/// @brief Highest number of live objects seen
+		size_t peak_count = 0;
+		/// @brief Highest number of live bytes seen
+		size_t peak_bytes = 0;
+		/// @brief Objects allocated during the last completed frame
+		size_t frame_allocations = 0;
+		/// @brief Bytes allocated during the last completed frame
+		size_t frame_bytes = 0;
+	};
+
+	/// @brief Live objects attributed to a single allocation site
+	struct AllocationSiteStats {
+		const char* file;
+		const char* function;
+		uint32_t line;
+		/// @brief Number of live objects allocated from this site
+		size_t count = 0;
+		/// @brief Bytes of device memory backing the live objects allocated from this site
+		size_t bytes = 0;
+		/// @brief Number of objects ever allocated from this site
+		size_t total_allocations = 0;
+	};
+
+	/// @brief Snapshot of the device objects allocated through a DeviceResource
+	struct MemoryStats {
+		/// @brief Usage of all tracked objects
+		UsageCounters total;
+		/// @brief Usage per object kind, indexed by TrackedResource
+		std::array<UsageCounters, (size_t)TrackedResource::eCount> resources;
+		/// @brief Usage of buffers and images per MemoryUsage, indexed by (MemoryUsage - 1)
+		std::array<UsageCounters, 4> memory_usages;
+		/// @brief Allocation sites with the most live bytes, in descending order
+		std::vector<AllocationSiteStats> top_sites;
+	};
+
+	/// @brief Budget of the device memory heap serving a MemoryUsage, as of the last budget query
+	struct MemoryBudget {
+		/// @brief Index of the memory heap
+		uint32_t heap_index = 0;
+		/// @brief Bytes of the heap this process is expected to be able to allocate
+		size_t budget = 0;
+		/// @brief Bytes of the heap currently allocated by this process
+		size_t usage = 0;
+		/// @brief Bytes left until the budget is reached, 0 if over budget
+		size_t headroom = 0;
+	};
+
+	/// @brief Counters of memory budget events of a DeviceResource
+	struct MemoryBudgetEvents {
+		/// @brief Number of heap budget queries
+		size_t budget_queries = 0;
+		/// @brief Number of times the usage of a heap rose above a registered eviction threshold
+		size_t threshold_crossings = 0;
+		/// @brief Number of eviction callbacks invoked
+		size_t eviction_callbacks = 0;
+		/// @brief Number of eGPUonly allocations placed outside of the device local heap
+		size_t fallback_allocations = 0;
+		/// @brief Number of allocations that failed for lack of device memory
+		size_t out_of_memory_failures = 0;
+	};
+
+	/// @brief Linear buffer allocation statistics of a single thread
+	struct LinearAllocationStats {
+		std::thread::id thread;
+		/// @brief Bytes allocated by the thread since the last recycle
+		size_t bytes_allocated = 0;
+		/// @brief Most bytes allocated by the thread between two recycles
+		size_t high_water_bytes = 0;
+		/// @brief Number of chunks the thread has taken from the shared linear allocators
+		size_t chunk_count = 0;
+	};
+
+	/// @brief Occupancy and fragmentation of the long-lived buffer sub-allocations of a MemoryUsage
+	struct BufferFragmentationReport {
+		/// @brief Number of blocks allocated from upstream
+		size_t block_count = 0;
+		/// @brief Total size of the blocks
+		size_t reserved_bytes = 0;
+		/// @brief Bytes currently handed out
+		size_t allocated_bytes = 0;
+		/// @brief Bytes in free ranges of the blocks
+		size_t free_bytes = 0;
+		/// @brief Number of free ranges in the blocks
+		size_t free_range_count = 0;
+		/// @brief Size of the largest free range
+		size_t largest_free_range = 0;
+		/// @brief Number of slabs backing the small size classes
+		size_t slab_count = 0;
+		/// @brief Bytes in unused slots of the slabs
+		size_t slab_free_bytes = 0;
+		/// @brief 0 if all free memory is in a single range, approaching 1 as it is split into many small ranges
+		double fragmentation = 0;
+	};
+
+	/// @brief Serialize memory statistics to JSON, eg. for attaching to captures
+	std::string to_json(const MemoryStats& stats);
+} // namespace vuk
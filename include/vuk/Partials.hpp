@@ -2,13 +2,91 @@
 
 #include "vuk/AllocatorHelpers.hpp"
 #include "vuk/CommandBuffer.hpp"
+#include "vuk/Context.hpp"
 #include "vuk/Future.hpp"
 #include "vuk/RenderGraph.hpp"
 #include "vuk/SourceLocation.hpp"
+#include <algorithm>
+#include <array>
 #include <math.h>
+#include <numeric>
 #include <span>
+#include <vector>
 
 namespace vuk {
+	/// @brief Get host-visible memory for an upload: from the staging ring of the Context if it fits, otherwise from the allocator
+	/// @param allocator Allocator to use if the staging ring can't serve the request
+	inline StagingAllocation allocate_upload_staging(Allocator& allocator, size_t size, size_t alignment) {
+		if (auto staging = allocator.get_context().allocate_staging(size, alignment)) {
+			return std::move(*staging);
+		}
+		// deallocated through the staging ring, once the submission reading it has completed
+		auto src = *allocate_buffer(allocator, BufferCreateInfo{ MemoryUsage::eCPUonly, size, alignment });
+		return allocator.get_context().adopt_staging(allocator, std::move(src));
+	}
+
+	/// @brief Host-visible memory of an upload, to be written in place (eg. straight from a decoder) and then committed
+	/// Obtained from begin_buffer_upload or begin_image_upload, this avoids copying the data from an intermediate host allocation.
+	struct MappedUpload {
+		/// @brief Memory to fill, the staging memory or the destination buffer itself if it is mapped
+		std::span<std::byte> data;
+
+		/// @brief Record the copy of the filled memory to the destination, must be called once, after data has been written
+		/// @return Future of the destination, host-available if the destination was written directly
+		Future commit() {
+			if (!staging.buffer) {
+				return { std::move(dst_buffer) };
+			}
+
+			std::shared_ptr<RenderGraph> rgp;
+			if (regions.empty()) {
+				rgp = std::make_shared<RenderGraph>("host_data_to_buffer");
+				rgp->add_pass({ .name = "BUFFER UPLOAD",
+				                .execute_on = copy_domain,
+				                .resources = { "_dst"_buffer >> vuk::Access::eTransferWrite, "_src"_buffer >> vuk::Access::eTransferRead },
+				                .execute = [size = data.size(), release = std::move(staging.release)](vuk::CommandBuffer& command_buffer) {
+					                command_buffer.copy_buffer("_src", "_dst", size);
+				                } });
+				rgp->attach_buffer("_dst", dst_buffer, vuk::Access::eNone);
+			} else {
+				rgp = std::make_shared<RenderGraph>("host_data_to_image");
+				rgp->add_pass({ .name = "IMAGE UPLOAD",
+				                .execute_on = copy_domain,
+				                .resources = { "_dst"_image >> vuk::Access::eTransferWrite, "_src"_buffer >> vuk::Access::eTransferRead },
+				                .execute = [regions = std::move(regions), release = std::move(staging.release)](vuk::CommandBuffer& command_buffer) {
+					                command_buffer.copy_buffer_to_image("_src", "_dst", regions);
+				                } });
+				rgp->attach_image("_dst", dst_image, vuk::Access::eNone);
+			}
+			rgp->attach_buffer("_src", staging.buffer, vuk::Access::eNone);
+			staging = {};
+			data = {};
+			return { std::move(rgp), "_dst+" };
+		}
+
+		DomainFlagBits copy_domain = DomainFlagBits::eAny;
+		// holds the staging memory until commit() hands its release token to the pass reading it
+		StagingAllocation staging;
+		Buffer dst_buffer;
+		ImageAttachment dst_image;
+		// empty for buffer uploads
+		std::vector<BufferImageCopy> regions;
+	};
+
+	/// @brief Get memory to fill a buffer in place
+	/// @param allocator Allocator to use for temporary allocations
+	/// @param copy_domain The domain where the copy should happen (when dst is mapped, it is handed out directly and there is no copy)
+	/// @param dst Buffer to fill
+	/// @param size size of the data
+	inline MappedUpload begin_buffer_upload(Allocator& allocator, DomainFlagBits copy_domain, Buffer dst, size_t size) {
+		if (dst.mapped_ptr) {
+			return { .data = std::span<std::byte>(reinterpret_cast<std::byte*>(dst.mapped_ptr), size), .copy_domain = copy_domain, .dst_buffer = dst };
+		}
+		auto src = allocate_upload_staging(allocator, size, 1);
+		auto data = std::span<std::byte>(reinterpret_cast<std::byte*>(src.buffer.mapped_ptr), size);
+		return { .data = data, .copy_domain = copy_domain, .staging = std::move(src), .dst_buffer = dst };
+	}
+
 	/// @brief Fill a buffer with host data
 	/// @param allocator Allocator to use for temporary allocations
 	/// @param copy_domain The domain where the copy should happen (when dst is mapped, the copy happens on host)
@@ -16,25 +94,9 @@ namespace vuk {
 	/// @param src_data pointer to source data
 	/// @param size size of source data
 	inline Future host_data_to_buffer(Allocator& allocator, DomainFlagBits copy_domain, Buffer dst, const void* src_data, size_t size) {
-		// host-mapped buffers just get memcpys
-		if (dst.mapped_ptr) {
-			memcpy(dst.mapped_ptr, src_data, size);
-			return { std::move(dst) };
-		}
-
-		auto src = *allocate_buffer(allocator, BufferCreateInfo{ MemoryUsage::eCPUonly, size, 1 });
-		::memcpy(src->mapped_ptr, src_data, size);
-
-		std::shared_ptr<RenderGraph> rgp = std::make_shared<RenderGraph>("host_data_to_buffer");
-		rgp->add_pass({ .name = "BUFFER UPLOAD",
-		                .execute_on = copy_domain,
-		                .resources = { "_dst"_buffer >> vuk::Access::eTransferWrite, "_src"_buffer >> vuk::Access::eTransferRead },
-		                .execute = [size](vuk::CommandBuffer& command_buffer) {
-			                command_buffer.copy_buffer("_src", "_dst", size);
-		                } });
-		rgp->attach_buffer("_src", *src, vuk::Access::eNone);
-		rgp->attach_buffer("_dst", dst, vuk::Access::eNone);
-		return { std::move(rgp), "_dst+" };
+		auto upload = begin_buffer_upload(allocator, copy_domain, dst, size);
+		::memcpy(upload.data.data(), src_data, size);
+		return upload.commit();
 	}
 
 	/// @brief Fill a buffer with host data
@@ -61,39 +123,238 @@ namespace vuk {
 		return { rgp, "dst+" };
 	}
 
-	/// @brief Fill an image with host data
-	/// @param allocator Allocator to use for temporary allocations
-	/// @param copy_domain The domain where the copy should happen (when dst is mapped, the copy happens on host)
-	/// @param image ImageAttachment to fill
-	/// @param src_data pointer to source data
-	inline Future host_data_to_image(Allocator& allocator, DomainFlagBits copy_domain, ImageAttachment image, const void* src_data) {
-		size_t alignment = format_to_texel_block_size(image.format);
+	/// @brief Location of the data of image subresources within host data
+	struct ImageSubresourceData {
+		/// @brief Mip level
+		uint32_t level = 0;
+		uint32_t base_layer = 0;
+		uint32_t layer_count = 1;
+		/// @brief Offset of the data of the first layer
+		size_t offset = 0;
+		/// @brief Bytes between consecutive rows of texel blocks, 0 if tightly packed
+		size_t row_pitch = 0;
+		/// @brief Bytes between consecutive layers (or depth slices), 0 if tightly packed
+		size_t slice_pitch = 0;
+	};
+
+	/// @brief Alignment of host data copied to or from images of a format, buffer offsets of copies must be multiples of the texel block size and of 4
+	inline size_t image_copy_alignment(Format format) {
+		return std::lcm((size_t)format_to_texel_block_size(format), (size_t)4);
+	}
+
+	/// @brief Compute the copy of image subresources from their location in host data
+	/// @param image ImageAttachment of the image, with the extent of level 0
+	/// @param data location of the subresources
+	inline BufferImageCopy to_buffer_image_copy(const ImageAttachment& image, const ImageSubresourceData& data) {
 		assert(image.extent.sizing == Sizing::eAbsolute);
-		size_t size = compute_image_size(image.format, static_cast<Extent3D>(image.extent.extent));
-		auto src = *allocate_buffer(allocator, BufferCreateInfo{ MemoryUsage::eCPUonly, size, alignment });
-		::memcpy(src->mapped_ptr, src_data, size);
+		auto base_extent = static_cast<Extent3D>(image.extent.extent);
+		auto block_extent = format_to_texel_block_extent(image.format);
+		size_t block_size = format_to_texel_block_size(image.format);
 
 		BufferImageCopy bc;
+		bc.bufferOffset = data.offset;
 		bc.imageOffset = { 0, 0, 0 };
-		bc.bufferRowLength = 0;
-		bc.bufferImageHeight = 0;
-		bc.imageExtent = static_cast<Extent3D>(image.extent.extent);
+		bc.imageExtent = Extent3D{ std::max(base_extent.width >> data.level, 1u),
+			                         std::max(base_extent.height >> data.level, 1u),
+			                         std::max(base_extent.depth >> data.level, 1u) };
 		bc.imageSubresource.aspectMask = format_to_aspect(image.format);
-		bc.imageSubresource.mipLevel = image.base_level;
-		bc.imageSubresource.baseArrayLayer = image.base_layer;
-		assert(image.layer_count == 1); // unsupported yet
-		bc.imageSubresource.layerCount = image.layer_count;
-
-		std::shared_ptr<RenderGraph> rgp = std::make_shared<RenderGraph>("host_data_to_image");
-		rgp->add_pass({ .name = "IMAGE UPLOAD",
-		                .execute_on = copy_domain,
-		                .resources = { "_dst"_image >> vuk::Access::eTransferWrite, "_src"_buffer >> vuk::Access::eTransferRead },
-		                .execute = [bc](vuk::CommandBuffer& command_buffer) {
-			                command_buffer.copy_buffer_to_image("_src", "_dst", bc);
-		                } });
-		rgp->attach_buffer("_src", *src, vuk::Access::eNone);
-		rgp->attach_image("_dst", image, vuk::Access::eNone);
-		return { std::move(rgp), "_dst+" };
+		bc.imageSubresource.mipLevel = data.level;
+		bc.imageSubresource.baseArrayLayer = data.base_layer;
+		bc.imageSubresource.layerCount = data.layer_count;
+		// the buffer layout is given in texels, but it is addressed in whole texel blocks (eg. 4x4 texels for BCn)
+		if (data.row_pitch != 0 || data.slice_pitch != 0) {
+			size_t blocks_wide = (bc.imageExtent.width + block_extent.width - 1) / block_extent.width;
+			size_t row_pitch = data.row_pitch != 0 ? data.row_pitch : blocks_wide * block_size;
+			assert(row_pitch % block_size == 0 && row_pitch >= blocks_wide * block_size);
+			bc.bufferRowLength = (uint32_t)(row_pitch / block_size) * block_extent.width;
+			if (data.slice_pitch != 0) {
+				assert(data.slice_pitch % row_pitch == 0);
+				bc.bufferImageHeight = (uint32_t)(data.slice_pitch / row_pitch) * block_extent.height;
+			}
+		}
+		return bc;
+	}
+
+	/// @brief Compute the copies of all levels and layers of an ImageAttachment from tightly packed host data
+	/// The levels follow each other in order, with the layers of a level consecutive.
+	/// @param image ImageAttachment of the image, with the extent of level 0
+	/// @param size receives the size of the host data
+	inline std::vector<BufferImageCopy> tightly_packed_image_regions(const ImageAttachment& image, size_t& size) {
+		assert(image.level_count != VK_REMAINING_MIP_LEVELS && image.layer_count != VK_REMAINING_ARRAY_LAYERS);
+		std::vector<BufferImageCopy> regions;
+		size = 0;
+		for (uint32_t level = image.base_level; level < image.base_level + image.level_count; level++) {
+			auto& bc = regions.emplace_back(
+			    to_buffer_image_copy(image, ImageSubresourceData{ .level = level, .base_layer = image.base_layer, .layer_count = image.layer_count, .offset = size }));
+			size += (size_t)compute_image_size(image.format, bc.imageExtent) * image.layer_count;
+		}
+		return regions;
+	}
+
+	/// @brief Get memory to fill regions of an image in place, copied with a single copy command
+	/// @param allocator Allocator to use for temporary allocations
+	/// @param copy_domain The domain where the copy should happen
+	/// @param image ImageAttachment to fill
+	/// @param size size of the data
+	/// @param regions regions to copy, buffer offsets are relative to the data
+	inline MappedUpload
+	begin_image_upload(Allocator& allocator, DomainFlagBits copy_domain, ImageAttachment image, size_t size, std::span<const BufferImageCopy> regions) {
+		assert(!regions.empty());
+		auto src = allocate_upload_staging(allocator, size, image_copy_alignment(image.format));
+		auto data = std::span<std::byte>(reinterpret_cast<std::byte*>(src.buffer.mapped_ptr), size);
+		return { .data = data,
+			       .copy_domain = copy_domain,
+			       .staging = std::move(src),
+			       .dst_image = image,
+			       .regions = std::vector<BufferImageCopy>(regions.begin(), regions.end()) };
+	}
+
+	/// @brief Get memory to fill the base level of an image in place
+	/// @param allocator Allocator to use for temporary allocations
+	/// @param copy_domain The domain where the copy should happen
+	/// @param image ImageAttachment to fill
+	/// @return MappedUpload with the layers of the base level tightly packed
+	inline MappedUpload begin_image_upload(Allocator& allocator, DomainFlagBits copy_domain, ImageAttachment image) {
+		auto base_level = image;
+		base_level.level_count = 1;
+		base_level.layer_count = image.layer_count == VK_REMAINING_ARRAY_LAYERS ? 1 : image.layer_count;
+		size_t size;
+		auto regions = tightly_packed_image_regions(base_level, size);
+		return begin_image_upload(allocator, copy_domain, image, size, std::span<const BufferImageCopy>(regions));
+	}
+
+	/// @brief Check if regions write every texel of every level and layer of an ImageAttachment
+	/// Regions only count when they cover a whole level, as the subresources they write are transitioned from undefined layout by host image copies.
+	inline bool writes_all_subresources(const ImageAttachment& image, std::span<const BufferImageCopy> regions) {
+		if (image.level_count == VK_REMAINING_MIP_LEVELS || image.layer_count == VK_REMAINING_ARRAY_LAYERS || image.extent.sizing != Sizing::eAbsolute) {
+			return false;
+		}
+		auto base_extent = static_cast<Extent3D>(image.extent.extent);
+		std::vector<bool> written((size_t)image.level_count * image.layer_count);
+		for (auto& region : regions) {
+			auto& subresource = region.imageSubresource;
+			if (subresource.mipLevel < image.base_level || subresource.mipLevel >= image.base_level + image.level_count) {
+				continue;
+			}
+			auto& offset = region.imageOffset;
+			auto& extent = region.imageExtent;
+			if (offset.x != 0 || offset.y != 0 || offset.z != 0 || extent.width < std::max(base_extent.width >> subresource.mipLevel, 1u) ||
+			    extent.height < std::max(base_extent.height >> subresource.mipLevel, 1u) || extent.depth < std::max(base_extent.depth >> subresource.mipLevel, 1u)) {
+				continue;
+			}
+			for (uint32_t layer = subresource.baseArrayLayer; layer < subresource.baseArrayLayer + subresource.layerCount; layer++) {
+				if (layer >= image.base_layer && layer < image.base_layer + image.layer_count) {
+					written[(size_t)(subresource.mipLevel - image.base_level) * image.layer_count + (layer - image.base_layer)] = true;
+				}
+			}
+		}
+		return std::all_of(written.begin(), written.end(), [](bool w) { return w; });
+	}
+
+	/// @brief Fill regions of an image with host data on the host, with VK_EXT_host_image_copy
+	/// The submissions started so far are waited for first, as the device might still be using the image.
+	/// @param ctx Context to use, can_copy_memory_to_image() must be true for the image
+	/// @param image ImageAttachment to fill
+	/// @param src_data pointer to source data
+	/// @param regions regions to copy, buffer offsets are relative to src_data, they must write every level and layer of the image (see writes_all_subresources())
+	/// @return host-available Future of the image, left in general layout
+	inline Result<Future> host_copy_to_image(Context& ctx, ImageAttachment image, const void* src_data, std::span<const BufferImageCopy> regions) {
+		// the Future claims general layout for the whole image, but only the subresources written are transitioned
+		assert(writes_all_subresources(image, regions));
+		// the last use of the image is not known, but it was started before now, so it has reserved its signal value already
+		std::array<std::pair<DomainFlags, uint64_t>, 3> started;
+		uint32_t started_count = 0;
+		for (auto [queue, domain] : { std::pair{ ctx.graphics_queue, DomainFlagBits::eGraphicsQueue },
+		                              std::pair{ ctx.compute_queue, DomainFlagBits::eComputeQueue },
+		                              std::pair{ ctx.transfer_queue, DomainFlagBits::eTransferQueue } }) {
+			if (queue) {
+				started[started_count++] = { domain, queue->get_reserved_value() };
+			}
+		}
+		VUK_DO_OR_RETURN(ctx.wait_for_domains(std::span(started.data(), started_count)));
+		VUK_DO_OR_RETURN(ctx.copy_memory_to_image(image, src_data, regions));
+		Future fut(std::move(image));
+		fut.get_control()->last_use.layout = ImageLayout::eGeneral;
+		return { expected_value, std::move(fut) };
+	}
+
+	/// @brief Fill regions of an image with host data on the host, if the image allows host image copies and the regions write all of it
+	/// @return host-available Future of the image, or nothing if the regions have to be copied through staging memory
+	/// @throws VkException if the host copy failed for another reason than running out of memory
+	inline std::optional<Future> try_host_copy_to_image(Context& ctx, ImageAttachment image, const void* src_data, std::span<const BufferImageCopy> regions) {
+		if (!ctx.can_copy_memory_to_image(image) || !writes_all_subresources(image, regions)) {
+			return {};
+		}
+		auto fut = host_copy_to_image(ctx, image, src_data, regions);
+		if (fut) {
+			return std::move(*fut);
+		}
+		// the copy through staging memory might still fit, but it would not survive other errors, such as a lost device
+		auto& error = fut.error();
+		if (auto vk_error = dynamic_cast<VkException*>(&error);
+		    !vk_error || (vk_error->error_code != VK_ERROR_OUT_OF_HOST_MEMORY && vk_error->error_code != VK_ERROR_OUT_OF_DEVICE_MEMORY)) {
+			error.throw_this();
+		}
+		return {};
+	}
+
+	/// @brief Fill regions of an image with host data, with a single copy command
+	/// If the image allows host image copies and the regions write all of its subresources, the copy is done on the host instead (see try_host_copy_to_image()) and the returned
+	/// Future is host-available.
+	/// @param allocator Allocator to use for temporary allocations
+	/// @param copy_domain The domain where the copy should happen
+	/// @param image ImageAttachment to fill
+	/// @param src_data pointer to source data
+	/// @param size size of source data
+	/// @param regions regions to copy, buffer offsets are relative to src_data
+	inline Future host_data_to_image(Allocator& allocator,
+	                                 DomainFlagBits copy_domain,
+	                                 ImageAttachment image,
+	                                 const void* src_data,
+	                                 size_t size,
+	                                 std::span<const BufferImageCopy> regions) {
+		if (auto fut = try_host_copy_to_image(allocator.get_context(), image, src_data, regions)) {
+			return std::move(*fut);
+		}
+
+		auto upload = begin_image_upload(allocator, copy_domain, image, size, regions);
+		::memcpy(upload.data.data(), src_data, size);
+		return upload.commit();
+	}
+
+	/// @brief Fill subresources of an image with host data, eg. the levels and layers of a KTX2 or DDS file, with a single copy command
+	/// @param allocator Allocator to use for temporary allocations
+	/// @param copy_domain The domain where the copy should happen
+	/// @param image ImageAttachment to fill, with the extent of level 0
+	/// @param src_data pointer to source data
+	/// @param size size of source data
+	/// @param subresources location of the subresources within the source data
+	inline Future host_data_to_image(Allocator& allocator,
+	                                 DomainFlagBits copy_domain,
+	                                 ImageAttachment image,
+	                                 const void* src_data,
+	                                 size_t size,
+	                                 std::span<const ImageSubresourceData> subresources) {
+		std::vector<BufferImageCopy> regions;
+		regions.reserve(subresources.size());
+		for (auto& subresource : subresources) {
+			regions.push_back(to_buffer_image_copy(image, subresource));
+		}
+		return host_data_to_image(allocator, copy_domain, image, src_data, size, std::span<const BufferImageCopy>(regions));
+	}
+
+	/// @brief Fill the base level of an image with host data
+	/// @param allocator Allocator to use for temporary allocations
+	/// @param copy_domain The domain where the copy should happen
+	/// @param image ImageAttachment to fill
+	/// @param src_data pointer to source data, with the layers of the base level tightly packed
+	inline Future host_data_to_image(Allocator& allocator, DomainFlagBits copy_domain, ImageAttachment image, const void* src_data) {
+		auto base_level = image;
+		base_level.level_count = 1;
+		base_level.layer_count = image.layer_count == VK_REMAINING_ARRAY_LAYERS ? 1 : image.layer_count;
+		size_t size;
+		auto regions = tightly_packed_image_regions(base_level, size);
+		return host_data_to_image(allocator, copy_domain, image, src_data, size, std::span<const BufferImageCopy>(regions));
 	}
 
 	/// @brief Transition image for given access - useful to force certain access across different RenderGraphs linked by Futures
@@ -172,6 +433,17 @@ namespace vuk {
 		return { std::move(rgp), "_src+" };
 	}
 
+	/// @brief Generate mips for given ImageAttachment with a single-pass compute downsampler
+	///
+	/// Unlike generate_mips, a single pass and, for images up to 4096 texels in size, a single dispatch writes all levels.
+	/// Every workgroup reduces a 64x64 tile down 6 levels, then the last workgroup to finish continues with the remaining levels.
+	/// 2D, array and cube images of the common storage formats are supported, sRGB images must allow UNORM storage views (allow_srgb_unorm_mutable and eExtendedUsage).
+	/// The image needs storage usage. Otherwise, or without runtime shader compilation, the levels are blitted within the pass.
+	/// @param image input Future of ImageAttachment
+	/// @param base_mip source mip level
+	/// @param num_mips number of mip levels, including the source level
+	Future generate_mips_spd(Future image, uint32_t base_mip, uint32_t num_mips);
+
 	/// @brief Allocates & fills a buffer with explicitly managed lifetime
 	/// @param allocator Allocator to allocate this Buffer from
 	/// @param mem_usage Where to allocate the buffer (host visible buffers will be automatically mapped)
@@ -0,0 +1,89 @@
+#pragma once
+
+#include "vuk/Allocator.hpp"
+#include "vuk/Buffer.hpp"
+#include "vuk/Future.hpp"
+#include "vuk/Image.hpp"
+
+#include <functional>
+#include <optional>
+#include <span>
+#include <unordered_map>
+
+namespace vuk {
+	/// @brief Downloads buffers and images to the host without blocking
+	///
+	/// Every read is submitted immediately and copies into the persistently mapped readback ring of the Context (or into dedicated memory if it does not fit).
+	/// The data can be retrieved once the queue timeline has passed the copy, either by a callback invoked from update() or by polling.
+	/// Reads are reclaimed in any order: a polled read that is held keeps its own memory from being reused, but not the memory of the reads after it once they are released.
+	/// Not thread-safe: reads, update(), poll() and release() must be externally synchronized.
+	struct ReadbackManager {
+		using Callback = std::function<void(std::span<const std::byte>)>;
+
+		/// @param ctx Context to use, it must outlive the ReadbackManager
+		ReadbackManager(Context& ctx);
+		~ReadbackManager();
+
+		ReadbackManager(const ReadbackManager&) = delete;
+		ReadbackManager& operator=(const ReadbackManager&) = delete;
+
+		/// @brief Download the beginning of a buffer
+		/// @param allocator Allocator to use for the submission
+		/// @param compiler Compiler to use for the submission
+		/// @param src Future of the buffer to read
+		/// @param size number of bytes to read
+		/// @param callback if set, invoked with the data from update() once the copy has completed, and the data is released afterwards
+		/// @return identifier of the read, to be used with poll() and release()
+		Result<uint64_t> read_buffer(Allocator& allocator, Compiler& compiler, Future src, size_t size, Callback callback = {});
+
+		/// @brief Download the levels and layers of an image, tightly packed
+		/// The levels follow each other in order, with the layers of a level consecutive (see tightly_packed_image_regions()).
+		/// @param allocator Allocator to use for the submission
+		/// @param compiler Compiler to use for the submission
+		/// @param src Future of the image to read
+		/// @param image ImageAttachment describing the format, the extent of level 0 and the levels and layers to read
+		/// @param callback if set, invoked with the data from update() once the copy has completed, and the data is released afterwards
+		/// @return identifier of the read, to be used with poll() and release()
+		Result<uint64_t> read_image(Allocator& allocator, Compiler& compiler, Future src, const ImageAttachment& image, Callback callback = {});
+
+		/// @brief Invoke the callbacks of the completed reads and release their data, never blocks
+		/// @return number of callbacks invoked, or the error of checking for completion, in which case no callback is invoked
+		Result<size_t> update();
+
+		/// @brief Retrieve the data of a read without a callback, if it has completed
+		/// The data stays valid until release() is called for the read.
+		/// @return the data if the read has completed, an empty optional otherwise, or the error of checking for completion
+		Result<std::optional<std::span<const std::byte>>> poll(uint64_t id);
+
+		/// @brief Release the data of a read, the memory is reused once the host is done with it
+		void release(uint64_t id);
+
+		/// @brief Number of reads not yet released
+		size_t pending() const {
+			return reads.size();
+		}
+
+	private:
+		struct Read {
+			Future future;
+			std::span<const std::byte> data;
+			// range of the mapped memory holding data
+			Buffer memory;
+			bool invalidated = false;
+			Callback callback;
+			std::shared_ptr<struct StagingRelease> release;
+			std::optional<Unique<Buffer>> own_memory;
+		};
+
+		// memory for a read from the ring, or dedicated memory if it doesn't fit
+		Result<Read> allocate(size_t size, size_t alignment, Buffer& dst);
+		Result<uint64_t> submit(Allocator& allocator, Compiler& compiler, Future copy, Read read);
+		// make the copied data visible to the host, the memory might not be host-coherent
+		Result<void> invalidate(Read& read);
+
+		Context* ctx;
+		Allocator direct_allocator;
+		uint64_t next_id = 0;
+		std::unordered_map<uint64_t, Read> reads;
+	};
+} // namespace vuk
@@ -89,8 +89,70 @@ namespace vuk {
 		std::function<void(CommandBuffer&)> execute;
 		std::byte* arguments; // internal use
 		PassType type = PassType::eUserPass;
+
+		/// @brief Optional predicate evaluated when the RenderGraph is executed - if it returns false, the pass is not recorded
+		/// Toggling the predicate doesn't change the compiled graph: the synchronization of a disabled pass is kept, and its outputs keep the contents of
+		/// its inputs. A render pass is not begun if all of its passes are disabled, so its load and clear operations are skipped too.
+		std::function<bool()> condition;
+	};
+
+	/// @brief Resource persisting across RenderGraphs, with a managed history of previous versions (eg. for temporal effects)
+	/// The versions are allocated once. When a RenderGraph using a version is submitted, the last use of that version is recorded,
+	/// and used to acquire the version in the next RenderGraph it is attached to.
+	struct PersistentResource {
+		PersistentResource() = default;
+
+		PersistentResource(const PersistentResource&) = delete;
+		PersistentResource& operator=(const PersistentResource&) = delete;
+
+		PersistentResource(PersistentResource&&) noexcept = default;
+		PersistentResource& operator=(PersistentResource&&) noexcept = default;
+
+		/// @brief Rotate versions: the current version becomes the previous version, the oldest version is reused as the current version
+		/// Call this once per frame, before attaching the resource to the frame's RenderGraph
+		void advance() noexcept;
+
+		/// @brief Number of versions kept, including the current one
+		uint32_t history_length() const noexcept {
+			return (uint32_t)versions.size();
+		}
+
+		/// @brief Get the state of a version
+		/// @param age 0 for the current version, 1 for the previous version and so on
+		FutureBase& get_version(uint32_t age) noexcept;
+
+		/// @brief Compute the name a version is bound to when the resource is attached as `name`
+		/// @param age 0 for the current version (bound to `name`), 1 for the previous version (bound to `name`_prev1) and so on
+		static Name history_name(Name name, uint32_t age);
+
+		Resource::Type get_type() const noexcept {
+			return type;
+		}
+
+	private:
+		Resource::Type type = Resource::Type::eImage;
+		std::vector<std::unique_ptr<FutureBase>> versions;
+		std::vector<Unique<Image>> images;
+		std::vector<Unique<ImageView>> image_views;
+		std::vector<Unique<Buffer>> buffers;
+		uint64_t current = 0;
+
+		friend Result<PersistentResource> create_persistent_image(Allocator&, ImageAttachment, uint32_t);
+		friend Result<PersistentResource> create_persistent_buffer(Allocator&, const BufferCreateInfo&, uint32_t);
 	};
 
+	/// @brief Allocate a persistent image with history
+	/// @param allocator Allocator to allocate the versions from, must outlive the PersistentResource
+	/// @param ia ImageAttachment describing the versions (must have absolute extent, format, view type and usage specified)
+	/// @param history_length Number of versions kept, including the current one
+	Result<PersistentResource> create_persistent_image(Allocator& allocator, ImageAttachment ia, uint32_t history_length = 2);
+
+	/// @brief Allocate a persistent buffer with history
+	/// @param allocator Allocator to allocate the versions from, must outlive the PersistentResource
+	/// @param bci Parameters of the buffer versions
+	/// @param history_length Number of versions kept, including the current one
+	Result<PersistentResource> create_persistent_buffer(Allocator& allocator, const BufferCreateInfo& bci, uint32_t history_length = 2);
+
 	// declare these specializations for GCC
 	template<>
 	ConstMapIterator<QualifiedName, const struct AttachmentInfo&>::~ConstMapIterator();
@@ -123,6 +185,13 @@ namespace vuk {
 		/// @brief Reconverge image from named parts. Prevents diverged use moving before pre_diverge or after post_diverge.
 		void converge_image_explicit(std::span<Name> pre_diverge, Name post_diverge);
 
+		/// @brief Diverge buffer. subrange is available as subrange_name afterwards.
+		/// Uses of the subranges are not synchronized against each other, so subranges diverged from the same buffer must not overlap - compiling fails otherwise.
+		void diverge_buffer(Name whole_name, Subrange::Buffer subrange, Name subrange_name);
+
+		/// @brief Reconverge buffer from named parts. Prevents diverged use moving before pre_diverge or after post_diverge.
+		void converge_buffer_explicit(std::span<Name> pre_diverge, Name post_diverge);
+
 		/// @brief Add a resolve operation from the image resource `ms_name` that consumes `resolved_name_src` and produces `resolved_name_dst`
 		/// This is only supported for color images.
 		/// @param resolved_name_src Image resource name consumed (single-sampled)
@@ -183,6 +252,13 @@ namespace vuk {
 		/// @param futures Futures to be attached into this rendergraph
 		void attach_in(std::span<Future> futures);
 
+		/// @brief Attach all versions of a persistent resource
+		/// The current version is attached as `name` (with its contents discarded), previous versions are attached as PersistentResource::history_name(name, age)
+		/// The last use of each version is carried over from the previous RenderGraph using it, and recorded again when this RenderGraph is submitted
+		/// @param name Name of the resource to attach to
+		/// @param resource PersistentResource to attach, must outlive the submission of this RenderGraph
+		void attach_persistent(Name name, PersistentResource& resource);
+
 		void inference_rule(Name target, std::function<void(const struct InferenceContext& ctx, ImageAttachment& ia)>);
 		void inference_rule(Name target, std::function<void(const struct InferenceContext& ctx, Buffer& ia)>);
 
@@ -250,6 +326,36 @@ namespace vuk {
 	/// @brief Inference target is the same size as the source
 	BufferRule same_size_as(Name inference_source);
 
+	/// @brief Estimated device memory of a resource allocated during execution
+	struct TransientResourceEstimate {
+		QualifiedName name;
+		Resource::Type type;
+		/// @brief Estimated size in bytes (images: sum of all levels and layers, without driver padding)
+		uint64_t size = 0;
+		/// @brief Index of the first pass (in execution order) using the resource
+		int32_t first_pass = -1;
+		/// @brief Index of the last pass (in execution order) using the resource
+		int32_t last_pass = -1;
+		/// @brief The image is allocated from the Allocator passed to execute() - with a DeviceFrameResource it is served from the image cache and recycled
+		/// across frames
+		bool cacheable = false;
+	};
+
+	/// @brief Estimated device memory allocated when executing a linked RenderGraph
+	struct TransientMemoryReport {
+		std::vector<TransientResourceEstimate> resources;
+		/// @brief Sum of all transient resources, this is what execution allocates
+		uint64_t total_size = 0;
+		/// @brief Largest sum of transient resources live during a single pass, this is the lower bound of the footprint when aliasing transient resources
+		uint64_t peak_live_size = 0;
+		/// @brief Index of the pass (in execution order) where peak_live_size is reached
+		int32_t peak_pass = -1;
+		/// @brief Footprint when transient resources that are never live at the same time share memory of one heap (without alignment padding)
+		uint64_t aliased_size = 0;
+		/// @brief Sum of cacheable images, these don't cause new allocations in steady-state when executing with a DeviceFrameResource
+		uint64_t cacheable_size = 0;
+	};
+
 	struct Compiler {
 		Compiler();
 		~Compiler();
@@ -279,9 +385,16 @@ namespace vuk {
 		/// @brief Get the last name that references this chain (may not exist)
 		std::optional<QualifiedName> get_last_use_name(const struct ChainLink* chain);
 
+		/// @brief Number of image barriers emitted by link(), including the release and acquire halves of queue transfers
+		size_t get_image_barrier_count() const;
+
 		/// @brief Dump the pass dependency graph in graphviz format
 		std::string dump_graph();
 
+		/// @brief Estimate the device memory that will be allocated for transient images and buffers when executing
+		/// Infers the bound resources without keeping the result, so it must be called after link() - swapchain attachments are sized by the current extent of their swapchain
+		Result<TransientMemoryReport> estimate_transient_memory();
+
 	private:
 		struct RGCImpl* impl;
 
@@ -300,6 +413,8 @@ namespace vuk {
 		std::vector<std::pair<DomainFlagBits, uint64_t>> absolute_waits;
 		std::vector<VkCommandBuffer> command_buffers;
 		std::vector<FutureBase*> future_signals;
+		// last uses of persistent resource versions, recorded into the versions on submission
+		std::vector<std::pair<FutureBase*, QueueResourceUse>> persistent_uses;
 		std::vector<SwapchainRef> used_swapchains;
 	};
 
@@ -336,8 +451,10 @@ namespace vuk {
 
 		void fill_render_pass_info(struct RenderPassInfo& rpass, const size_t& i, class CommandBuffer& cobuf);
 		Result<SubmitInfo> record_single_submit(Allocator&, std::span<PassInfo*> passes, DomainFlagBits domain);
+		Result<void> infer();
 
 		friend struct InferenceContext;
+		friend struct Compiler;
 	};
 
 } // namespace vuk
@@ -0,0 +1,31 @@
+#pragma once
+
+#include "vuk/Buffer.hpp"
+#include "vuk/Future.hpp"
+
+#include <string>
+
+namespace vuk {
+	/// @brief Parameters for streaming files into buffers
+	struct StreamingUploadParameters {
+		/// @brief Size of the chunks read and copied at a time, chunks up to a quarter of the staging ring are staged through the ring
+		size_t chunk_size = 4 * 1024 * 1024;
+		/// @brief Number of chunks in flight at most, the staging memory used is bounded by chunk_size * max_chunks_in_flight
+		size_t max_chunks_in_flight = 4;
+		/// @brief The domain where the copies should happen
+		DomainFlagBits copy_domain = DomainFlagBits::eTransferQueue;
+	};
+
+	/// @brief Stream the contents of a file into a buffer, with bounded memory use regardless of the size of the file
+	///
+	/// The file is read chunk by chunk straight into staging memory (or into dst if it is mapped), and every chunk is copied by its own submission.
+	/// Reading the next chunks overlaps with the copies in flight. Once max_chunks_in_flight chunks are in flight, the oldest is waited for.
+	/// The call blocks until all chunks have been copied, so it is meant for loader threads.
+	/// @param allocator Allocator to use for submissions and for staging memory that doesn't fit the staging ring
+	/// @param compiler Compiler to use for submissions
+	/// @param dst Buffer to fill, at most dst.size bytes are read from the file
+	/// @param path path of the file
+	/// @param params chunking parameters
+	/// @return host-available Future of dst, or FileIOException if the file couldn't be read
+	Result<Future> stream_file_to_buffer(Allocator& allocator, Compiler& compiler, Buffer dst, const std::string& path, StreamingUploadParameters params = {});
+} // namespace vuk
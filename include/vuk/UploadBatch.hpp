@@ -0,0 +1,83 @@
+#pragma once
+
+#include "vuk/Buffer.hpp"
+#include "vuk/CommandBuffer.hpp"
+#include "vuk/Future.hpp"
+#include "vuk/ImageAttachment.hpp"
+
+#include <span>
+#include <vector>
+
+namespace vuk {
+	struct ImageSubresourceData;
+
+	/// @brief Accumulates buffer and image uploads, and records them into a single RenderGraph with a single transfer pass
+	///
+	/// All uploads of the batch share one staging allocation, one set of barriers and one submission, instead of a RenderGraph per upload.
+	/// The host data of device copies is only read when the batch is built, so it must stay valid until then.
+	struct UploadBatch {
+		/// @param allocator Allocator to use for staging memory that doesn't fit the staging ring
+		/// @param copy_domain The domain where the copies should happen
+		UploadBatch(Allocator& allocator, DomainFlagBits copy_domain = DomainFlagBits::eTransferQueue);
+
+		/// @brief Add an upload of host data to a buffer (when dst is mapped, the copy happens on host right away)
+		/// @return index of the Future of this upload in the result of build()
+		size_t add_buffer(Buffer dst, const void* src_data, size_t size);
+
+		/// @brief Add an upload of host data to a buffer
+		/// @return index of the Future of this upload in the result of build()
+		template<class T>
+		size_t add_buffer(Buffer dst, std::span<T> data) {
+			return add_buffer(dst, data.data(), data.size_bytes());
+		}
+
+		/// @brief Add an upload of host data to regions of an image (when dst allows host image copies and the regions write all of its subresources, the copy happens on host right away)
+		/// @param dst ImageAttachment to fill, an image may only be added once per batch
+		/// @param src_data source data, the bufferOffset of the regions is relative to it
+		/// @param size size of source data
+		/// @param regions regions to copy
+		/// @return index of the Future of this upload in the result of build()
+		size_t add_image(ImageAttachment dst, const void* src_data, size_t size, std::span<const BufferImageCopy> regions);
+
+		/// @brief Add an upload of host data to subresources of an image, eg. the levels and layers of a KTX2 or DDS file
+		/// @param dst ImageAttachment to fill, with the extent of level 0, an image may only be added once per batch
+		/// @param src_data source data
+		/// @param size size of source data
+		/// @param subresources location of the subresources within the source data
+		/// @return index of the Future of this upload in the result of build()
+		size_t add_image(ImageAttachment dst, const void* src_data, size_t size, std::span<const ImageSubresourceData> subresources);
+
+		/// @brief Add an upload of host data to all levels and layers of an ImageAttachment
+		/// @param dst ImageAttachment to fill, an image may only be added once per batch
+		/// @param src_data source data, tightly packed in level order, with all layers of a level consecutive
+		/// @return index of the Future of this upload in the result of build()
+		size_t add_image(ImageAttachment dst, const void* src_data);
+
+		/// @brief Number of uploads added
+		size_t size() const {
+			return uploads.size();
+		}
+
+		/// @brief Copy the host data into staging memory and record the batch
+		/// @return a Future per upload, in the order the uploads were added, all referencing the same RenderGraph
+		std::vector<Future> build();
+
+	private:
+		struct Upload {
+			const void* src_data;
+			size_t size;
+			size_t alignment;
+			Buffer buffer;
+			ImageAttachment image;
+			// empty for buffer uploads
+			std::vector<BufferImageCopy> regions;
+			// mapped buffers and images allowing host image copies are written on host when added
+			bool on_host = false;
+			Future host_future;
+		};
+
+		Allocator* allocator;
+		DomainFlagBits copy_domain;
+		std::vector<Upload> uploads;
+	};
+} // namespace vuk
@@ -20,4 +20,13 @@ VUK_X(vkCreateRayTracingPipelinesKHR)
 
 // VK_EXT_calibrated_timestamps
 VUK_X(vkGetCalibratedTimestampsEXT)
-VUK_Y(vkGetPhysicalDeviceCalibrateableTimeDomainsEXT)
\ No newline at end of file
+VUK_Y(vkGetPhysicalDeviceCalibrateableTimeDomainsEXT)
+
+// VK_EXT_memory_budget
+VUK_Y(vkGetPhysicalDeviceMemoryProperties2)
+
+// VK_EXT_host_image_copy
+#ifdef VK_EXT_host_image_copy
+VUK_X(vkCopyMemoryToImageEXT)
+VUK_X(vkTransitionImageLayoutEXT)
+#endif
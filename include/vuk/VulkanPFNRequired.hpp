@@ -89,6 +89,8 @@ VUK_X(vkDestroyFence)
 
 VUK_X(vkCreateSemaphore)
 VUK_X(vkWaitSemaphores)
+VUK_X(vkSignalSemaphore)
+VUK_X(vkGetSemaphoreCounterValue)
 VUK_X(vkDestroySemaphore)
 
 VUK_X(vkQueueSubmit)
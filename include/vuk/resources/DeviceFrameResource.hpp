@@ -1,10 +1,13 @@
 #pragma once
 
 #include "vuk/Allocator.hpp"
+#include "vuk/MemoryStats.hpp"
 #include "vuk/resources/DeviceNestedResource.hpp"
 #include "vuk/resources/DeviceVkResource.hpp"
 
 #include <memory>
+#include <thread>
+#include <vector>
 
 namespace vuk {
 	struct DeviceSuperFrameResource;
@@ -14,6 +17,8 @@ namespace vuk {
 	///
 	/// Allocations from this resource are tied to the "frame" - all allocations recycled when a DeviceFrameResource is recycled.
 	/// Furthermore all resources allocated are also deallocated at recycle time - it is not necessary (but not an error) to deallocate them.
+	/// Each recording thread keeps the handles to destroy in its own lists, which are merged when the frame is waited for or recycled,
+	/// so recording from many threads doesn't contend on locks. Recording into the frame must have finished before then.
 	struct DeviceFrameResource : DeviceNestedResource {
 		Result<void, AllocateException> allocate_semaphores(std::span<VkSemaphore> dst, SourceLocationAtFrame loc) override;
 
@@ -101,10 +106,16 @@ namespace vuk {
 		allocate_render_passes(std::span<VkRenderPass> dst, std::span<const RenderPassCreateInfo> cis, SourceLocationAtFrame loc) override;
 		void deallocate_render_passes(std::span<const VkRenderPass> src) override;
 
-		/// @brief Wait for the fences / timeline semaphores referencing this frame to complete
+		void add_submission(VkSemaphore timeline_semaphore, uint64_t value) override;
+
+		/// @brief Wait for the submissions / fences / timeline semaphores referencing this frame to complete
 		///
 		/// Called automatically when recycled
-		void wait();
+		/// @return the error of issuing the pending submissions or of the wait, everything issued is waited on regardless
+		Result<void> wait();
+
+		/// @brief Retrieve per-thread statistics of the linear buffer allocations made from this frame
+		std::vector<LinearAllocationStats> get_linear_allocation_stats();
 
 		/// @brief Retrieve the parent Context
 		/// @return the parent Context
@@ -204,8 +215,11 @@ namespace vuk {
 
 		void deallocate_render_passes(std::span<const VkRenderPass> src) override;
 
+		void add_submission(VkSemaphore timeline_semaphore, uint64_t value) override;
+
 		/// @brief Recycle the least-recently-used frame and return it to be used again
 		/// @return DeviceFrameResource for use
+		/// @throws the error of waiting for the recycled frames, after they have been recycled
 		DeviceFrameResource& get_next_frame();
 
 		/// @brief Get a multiframe resource for the current frame with the specified frame lifetime count
@@ -214,6 +228,13 @@ namespace vuk {
 
 		void force_collect();
 
+		/// @brief Account the buffers and images allocated from the frames in their get_memory_stats(), off by default
+		/// Accounting locks the telemetry of the frame for every allocation, which contends when many threads record into the same frame.
+		void set_frame_allocation_tracking(bool enabled);
+
+		/// @brief Report the occupancy and fragmentation of the buffers allocated directly from this resource
+		BufferFragmentationReport get_buffer_fragmentation_report(MemoryUsage mem_usage);
+
 		virtual ~DeviceSuperFrameResource();
 
 		const uint64_t frames_in_flight;
@@ -226,5 +247,6 @@ namespace vuk {
 
 		struct DeviceSuperFrameResourceImpl* impl;
 		friend struct DeviceFrameResource;
+		friend struct DeviceMultiFrameResource;
 	};
 } // namespace vuk
\ No newline at end of file
@@ -84,8 +84,11 @@ namespace vuk {
 
 		void deallocate_timeline_semaphores(std::span<const TimelineSemaphore> src) override; // noop
 
-		/// @brief Wait for the fences / timeline semaphores referencing this allocator
-		void wait();
+		void add_submission(VkSemaphore timeline_semaphore, uint64_t value) override;
+
+		/// @brief Wait for the submissions / fences / timeline semaphores referencing this allocator
+		/// @return the error of issuing the pending submissions or of the wait, everything issued is waited on regardless
+		Result<void> wait();
 
 		/// @brief Release the resources of this resource into the upstream
 		void free();
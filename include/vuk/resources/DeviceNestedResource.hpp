@@ -4,10 +4,19 @@
 #include "vuk/Exception.hpp"
 #include "vuk/vuk_fwd.hpp"
 
+#include <memory>
+
 namespace vuk {
+	struct MemoryTelemetry;
+
 	/// @brief Helper base class for DeviceResources. Forwards all allocations and deallocations to the upstream DeviceResource.
+	/// The buffers and images allocated through this resource are accounted separately from the upstream, see get_memory_stats().
 	struct DeviceNestedResource : DeviceResource {
-		explicit DeviceNestedResource(DeviceResource& upstream) : upstream(&upstream) {}
+		explicit DeviceNestedResource(DeviceResource& upstream);
+		~DeviceNestedResource();
+
+		DeviceNestedResource(DeviceNestedResource&&);
+		DeviceNestedResource& operator=(DeviceNestedResource&&);
 
 		Result<void, AllocateException> allocate_semaphores(std::span<VkSemaphore> dst, SourceLocationAtFrame loc) override;
 
@@ -104,10 +113,27 @@ namespace vuk {
 		allocate_render_passes(std::span<VkRenderPass> dst, std::span<const RenderPassCreateInfo> cis, SourceLocationAtFrame loc) override;
 		void deallocate_render_passes(std::span<const VkRenderPass> src) override;
 
+		void add_submission(VkSemaphore timeline_semaphore, uint64_t value) override;
+
+		/// @brief Report the buffers and images allocated through this resource and not yet released, attributed to the callers
+		/// Sub-allocations are reported with their own size, so the upstream reports the backing blocks while this reports their use.
+		MemoryStats get_memory_stats(size_t top_sites = 16) override;
+
 		Context& get_context() override {
 			return upstream->get_context();
 		}
 
 		DeviceResource* upstream = nullptr;
+
+	protected:
+		/// @brief Account buffers or images handed out by this resource - overrides that don't forward to DeviceNestedResource must call these
+		void track_buffers(std::span<const Buffer> buffers, std::span<const BufferCreateInfo> cis, SourceLocationAtFrame loc);
+		void untrack_buffers(std::span<const Buffer> buffers);
+		void track_images(std::span<const Image> images, SourceLocationAtFrame loc);
+		void untrack_images(std::span<const Image> images);
+		/// @brief Stop accounting all buffers and images, when they are released at once
+		void untrack_all();
+
+		std::unique_ptr<MemoryTelemetry> telemetry;
 	};
 } // namespace vuk
\ No newline at end of file
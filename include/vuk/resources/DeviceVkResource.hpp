@@ -2,8 +2,15 @@
 
 #include "vuk/Allocator.hpp"
 #include "vuk/Config.hpp"
+#include "vuk/MemoryStats.hpp"
+
+#include <functional>
+#include <utility>
 
 namespace vuk {
+	/// @brief Called when the usage of a heap rises above the registered threshold, to give the application a chance to release memory
+	using EvictionCallback = std::function<void(const MemoryBudget&)>;
+
 	/// @brief Device resource that performs direct allocation from the resources from the Vulkan runtime.
 	struct DeviceVkResource final : DeviceResource {
 		DeviceVkResource(Context& ctx);
@@ -105,6 +112,30 @@ namespace vuk {
 		allocate_render_passes(std::span<VkRenderPass> dst, std::span<const RenderPassCreateInfo> cis, SourceLocationAtFrame loc) override;
 		void deallocate_render_passes(std::span<const VkRenderPass> src) override;
 
+		MemoryStats get_memory_stats(size_t top_sites = 16) override;
+		/// @brief Get the size of the memory backing an image allocated from this DeviceVkResource, and the MemoryUsage of the heap it was placed in
+		std::pair<size_t, MemoryUsage> get_image_memory(const Image& image);
+		/// @brief Make device writes to the range of a mapped buffer allocated from this DeviceVkResource visible to host reads
+		/// Required before reading memory that is not host-coherent, a no-op otherwise
+		Result<void> invalidate_mapped_buffer(const Buffer& buffer);
+
+		/// @brief Close the per-frame counters of the memory statistics and query heap budgets, called by Context::next_frame()
+		void next_frame();
+
+		/// @brief Query the heap budgets and invoke the eviction callbacks of heaps that crossed their thresholds
+		void update_memory_budget();
+		/// @brief Get the budget of the heap serving the given MemoryUsage, as of the last budget query
+		MemoryBudget get_memory_budget(MemoryUsage mem_usage);
+		/// @brief Register a callback invoked when the usage of a heap rises above a fraction of its budget
+		/// @param threshold fraction of the budget, in [0, 1]
+		/// @return id of the callback for unregistering
+		size_t register_eviction_callback(float threshold, EvictionCallback callback);
+		void unregister_eviction_callback(size_t id);
+		/// @brief If enabled, eGPUonly allocations that would exceed the budget of the device local heap are placed in other heaps instead of failing
+		/// Buffers are then placed in host-visible memory, images in any memory they support outside of the device local heap
+		void set_memory_fallback(bool enabled);
+		MemoryBudgetEvents get_memory_budget_events();
+
 		Context& get_context() override {
 			return *ctx;
 		}
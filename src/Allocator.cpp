@@ -267,4 +267,8 @@ namespace vuk {
 	void Allocator::deallocate(std::span<const VkRenderPass> src) {
 		device_resource->deallocate_render_passes(src);
 	}
+
+	void Allocator::add_submission(VkSemaphore timeline_semaphore, uint64_t value) {
+		device_resource->add_submission(timeline_semaphore, value);
+	}
 } // namespace vuk
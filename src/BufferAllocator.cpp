@@ -2,7 +2,13 @@
 #include "vuk/Allocator.hpp"
 #include "vuk/Result.hpp"
 #include "vuk/SourceLocation.hpp"
+#include <algorithm>
+#include <bit>
+#ifndef DOCTEST_CONFIG_DISABLE
+#include <doctest/doctest.h>
+#endif
 #include <iostream>
+#include <tuple>
 
 // Aligns given value down to nearest multiply of align value. For example: VmaAlignUp(11, 8) = 8.
 // Use types like uint32_t, uint64_t as T.
@@ -18,7 +24,50 @@ static inline T VmaAlignUp(T val, T align) {
 	return (val + align - 1) / align * align;
 }
 
+namespace {
+	// alignment of thread chunks within the linear blocks
+	constexpr size_t chunk_alignment = 256;
+} // namespace
+
 namespace vuk {
+	std::pair<size_t, size_t> LinearSegmentTable::locate(size_t index) {
+		size_t page = std::bit_width(index / first_page_size + 1) - 1;
+		size_t page_start = first_page_size * ((size_t(1) << page) - 1);
+		return { page, index - page_start };
+	}
+
+	LinearSegment& LinearSegmentTable::ensure(size_t index) {
+		auto [page, offset] = locate(index);
+		assert(page < pages.size());
+		auto p = pages[page].load(std::memory_order_relaxed);
+		if (!p) {
+			p = new LinearSegment[first_page_size << page]{};
+			pages[page].store(p, std::memory_order_release);
+		}
+		return p[offset];
+	}
+
+	LinearSegment& LinearSegmentTable::operator[](size_t index) {
+		auto [page, offset] = locate(index);
+		auto p = pages[page].load(std::memory_order_acquire);
+		assert(p);
+		return p[offset];
+	}
+
+	LinearSegmentTable::~LinearSegmentTable() {
+		for (auto& page : pages) {
+			delete[] page.load();
+		}
+	}
+
+	BufferLinearAllocator::BufferLinearAllocator(
+	    DeviceResource& upstream, MemoryUsage mem_usage, BufferUsageFlags buf_usage, size_t block_size, size_t chunk_size) :
+	    upstream(&upstream),
+	    mem_usage(mem_usage),
+	    usage(buf_usage),
+	    block_size(block_size),
+	    chunk_size(std::min(chunk_size, block_size)) {}
+
 	Result<void, AllocateException> BufferLinearAllocator::grow(size_t num_blocks, SourceLocationAtFrame source) {
 		std::lock_guard _(mutex);
 
@@ -27,7 +76,7 @@ namespace vuk {
 		size_t actual_blocks = num_blocks;
 
 		// find best fit allocation
-		for (size_t i = 0; i < available_allocation_count; i++) {
+		for (size_t i = 0; i < available_allocations.size(); i++) {
 			int block_over = (int)available_allocations[i].num_blocks - (int)num_blocks;
 			if (block_over >= 0 && block_over < best_fit_block_size) {
 				best_fit_block_size = block_over;
@@ -46,23 +95,21 @@ namespace vuk {
 				return result;
 			}
 			for (auto i = 0; i < num_blocks; i++) {
-				used_allocations[used_allocation_count + i] = { alloc, i > 0 ? 0 : num_blocks, 0 };
+				used_allocations.ensure(used_allocation_count + i) = { alloc, i > 0 ? 0 : num_blocks, 0 };
 			}
-			current_buffer += (int)num_blocks;
 		} else { // we found one, we swap it into the used allocations and compact the available allocations
-			std::swap(used_allocations[used_allocation_count], available_allocations[best_fit_index]);
-			std::swap(available_allocations[best_fit_index], available_allocations[available_allocation_count - 1]);
-			available_allocation_count--;
+			used_allocations.ensure(used_allocation_count) = available_allocations[best_fit_index];
+			std::swap(available_allocations[best_fit_index], available_allocations.back());
+			available_allocations.pop_back();
 
 			auto& alloc = used_allocations[used_allocation_count];
 			for (auto i = 1; i < alloc.num_blocks; i++) {
 				// create 1 entry per block in used_allocations
-				used_allocations[used_allocation_count + i] = { alloc.buffer, 0, 0 };
+				used_allocations.ensure(used_allocation_count + i) = { alloc.buffer, 0, 0 };
 			}
-			current_buffer += (int)used_allocations[used_allocation_count].num_blocks;
 			actual_blocks = used_allocations[used_allocation_count].num_blocks;
 		}
-		used_allocations[0].base_address = 0;
+		used_allocations.ensure(0).base_address = 0;
 		for (auto i = 0; i < actual_blocks; i++) {
 			if (used_allocation_count + i == 0) {
 				continue;
@@ -79,16 +126,43 @@ namespace vuk {
 			}
 		}
 		used_allocation_count += actual_blocks;
+		// publish the blocks only once they are complete, allocations read them without locking
+		current_buffer += (int)actual_blocks;
 
 		return {expected_value};
 	}
 
-	// lock-free bump allocation if there is still space
+	// small allocations are bumped from the chunk of the calling thread without any synchronization
 	Result<Buffer, AllocateException> BufferLinearAllocator::allocate_buffer(size_t size, size_t alignment, SourceLocationAtFrame source) {
 		if (size == 0) {
 			return { expected_value, Buffer{ .buffer = VK_NULL_HANDLE, .size = 0 } };
 		}
 
+		if (size + alignment > chunk_size / 4) {
+			return allocate_shared(size, alignment, source);
+		}
+
+		auto& slot = thread_slots.get();
+		// align the offset within the VkBuffer, the chunk itself can be at any offset
+		uint64_t offset = slot.chunk ? VmaAlignUp(slot.chunk.offset + slot.chunk_used, alignment) - slot.chunk.offset : 0;
+		if (!slot.chunk || offset + size > slot.chunk.size) {
+			auto chunk = allocate_shared(chunk_size, chunk_alignment, source);
+			if (!chunk) {
+				return chunk;
+			}
+			slot.chunk = chunk.value();
+			slot.chunk_count.store(slot.chunk_count.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+			offset = VmaAlignUp(slot.chunk.offset, alignment) - slot.chunk.offset;
+		}
+		slot.chunk_used = offset + size;
+		slot.bytes_allocated.store(slot.bytes_allocated.load(std::memory_order_relaxed) + size, std::memory_order_relaxed);
+
+		return { expected_value, slot.chunk.subrange(offset, size) };
+	}
+
+	// lock-free bump allocation if there is still space
+	Result<Buffer, AllocateException> BufferLinearAllocator::allocate_shared(size_t size, size_t alignment, SourceLocationAtFrame source) {
+
 		uint64_t old_needle = needle.load();
 		uint64_t new_needle = VmaAlignUp(old_needle, alignment) + size;
 		uint64_t low_buffer = old_needle / block_size;
@@ -120,12 +194,19 @@ namespace vuk {
 		if (needs_to_create) {
 			size_t num_blocks = std::max(high_buffer - low_buffer + (old_needle == 0 ? 1 : 0), static_cast<uint64_t>(1));
 			while (current_buffer.load() < (int)high_buffer) {
-				grow(num_blocks, source);
+				if (auto result = grow(num_blocks, source); !result) {
+					VkResult error_code = result.error().error_code;
+					grow_result.store(error_code);
+					return { expected_error, AllocateException{ error_code } };
+				}
 			}
 			assert(base % block_size == 0);
 		}
-		// wait for the buffer to be allocated
+		// wait for the buffer to be allocated by another thread, unless growing failed
 		while (current_buffer.load() < (int)high_buffer) {
+			if (auto error_code = grow_result.load(); error_code != VK_SUCCESS) {
+				return { expected_error, AllocateException{ error_code } };
+			}
 		};
 		auto& current_alloc = used_allocations[base_buffer];
 		auto offset = base - current_alloc.base_address;
@@ -138,28 +219,57 @@ namespace vuk {
 		return { expected_value, b };
 	}
 
+	// not thread safe with respect to allocations, like reset() and free()
+	void BufferLinearAllocator::retire_thread_slots() {
+		for (auto slot = thread_slots.first(); slot != nullptr; slot = slot->next) {
+			auto bytes = slot->bytes_allocated.load(std::memory_order_relaxed);
+			if (bytes > slot->high_water_bytes.load(std::memory_order_relaxed)) {
+				slot->high_water_bytes.store(bytes, std::memory_order_relaxed);
+			}
+			slot->bytes_allocated.store(0, std::memory_order_relaxed);
+			slot->chunk = {};
+			slot->chunk_used = 0;
+		}
+	}
+
+	void BufferLinearAllocator::collect_thread_stats(std::vector<LinearAllocationStats>& stats) {
+		for (auto slot = thread_slots.first(); slot != nullptr; slot = slot->next) {
+			auto it = std::find_if(stats.begin(), stats.end(), [&](auto& s) { return s.thread == slot->thread; });
+			if (it == stats.end()) {
+				it = stats.insert(stats.end(), LinearAllocationStats{ .thread = slot->thread });
+			}
+			auto bytes = slot->bytes_allocated.load(std::memory_order_relaxed);
+			it->bytes_allocated += bytes;
+			it->high_water_bytes += std::max(bytes, slot->high_water_bytes.load(std::memory_order_relaxed));
+			it->chunk_count += slot->chunk_count.load(std::memory_order_relaxed);
+		}
+	}
+
 	void BufferLinearAllocator::reset() {
 		std::lock_guard _(mutex);
+		retire_thread_slots();
 		for (size_t i = 0; i < used_allocation_count;) {
-			available_allocations[available_allocation_count++] = used_allocations[i];
+			available_allocations.push_back(used_allocations[i]);
 			i += used_allocations[i].num_blocks;
 		}
-		used_allocations = {};
+		for (size_t i = 0; i < used_allocation_count; i++) {
+			used_allocations[i] = {};
+		}
 		used_allocation_count = 0;
 		current_buffer = -1;
 		needle = 0;
+		grow_result = VK_SUCCESS;
 	}
 
 	// we just destroy the buffers that we have left in the available allocations
 	void BufferLinearAllocator::trim() {
 		std::lock_guard _(mutex);
-		for (size_t i = 0; i < available_allocation_count; i++) {
-			auto& alloc = available_allocations[i];
+		for (auto& alloc : available_allocations) {
 			if (alloc.num_blocks > 0) {
 				upstream->deallocate_buffers(std::span{ &alloc.buffer, 1 });
 			}
 		}
-		available_allocation_count = 0;
+		available_allocations.clear();
 	}
 
 	BufferLinearAllocator::~BufferLinearAllocator() {
@@ -167,113 +277,403 @@ namespace vuk {
 	}
 
 	void BufferLinearAllocator::free() {
+		retire_thread_slots();
 		for (size_t i = 0; i < used_allocation_count; i++) {
 			auto& buf = used_allocations[i].buffer;
 			if (buf && used_allocations[i].num_blocks > 0) {
 				upstream->deallocate_buffers(std::span{ &buf, 1 });
 			}
+			used_allocations[i] = {};
 		}
 		used_allocation_count = 0;
+		current_buffer = -1;
+		needle = 0;
+		grow_result = VK_SUCCESS;
 
-		for (size_t i = 0; i < available_allocation_count; i++) {
-			auto& buf = available_allocations[i].buffer;
-			if (buf && available_allocations[i].num_blocks > 0) {
-				upstream->deallocate_buffers(std::span{ &buf, 1 });
+		for (auto& alloc : available_allocations) {
+			if (alloc.buffer && alloc.num_blocks > 0) {
+				upstream->deallocate_buffers(std::span{ &alloc.buffer, 1 });
 			}
 		}
+		available_allocations.clear();
+	}
 
-		available_allocation_count = 0;
+	std::pair<uint32_t, uint32_t> TLSFAllocator::mapping(size_t size) {
+		size_t units = size / granularity;
+		uint32_t fl = (uint32_t)std::bit_width(units) - 1;
+		// below 2^sl_bits units every size gets its own bin
+		uint32_t sl = fl >= sl_bits ? (uint32_t)(units >> (fl - sl_bits)) : (uint32_t)(units << (sl_bits - fl));
+		return { fl, sl - (1u << sl_bits) };
 	}
 
-	Result<Buffer, AllocateException> BufferSubAllocator::allocate_buffer(size_t size, size_t alignment, SourceLocationAtFrame source) {
-		if (size >= block_size) { // allocate-through
-			BufferCreateInfo bci{ .mem_usage = mem_usage, .size = size, .alignment = alignment };
-			Buffer buf;
-			auto result = upstream->allocate_buffers(std::span{ &buf, 1 }, std::span{ &bci, 1 }, source);
+	TLSFRange* TLSFAllocator::new_range() {
+		if (spare_ranges) {
+			auto r = std::exchange(spare_ranges, spare_ranges->next_free);
+			*r = {};
+			return r;
+		}
+		return new TLSFRange{};
+	}
+
+	void TLSFAllocator::recycle_range(TLSFRange* range) {
+		range->next_free = spare_ranges;
+		spare_ranges = range;
+	}
+
+	void TLSFAllocator::insert_free(TLSFRange* range) {
+		auto [fl, sl] = mapping(range->size);
+		auto& head = free_lists[fl][sl];
+		range->is_free = true;
+		range->prev_free = nullptr;
+		range->next_free = head;
+		if (head) {
+			head->prev_free = range;
+		}
+		head = range;
+		fl_bitmap |= 1u << fl;
+		sl_bitmaps[fl] |= 1u << sl;
+	}
+
+	void TLSFAllocator::remove_free(TLSFRange* range) {
+		auto [fl, sl] = mapping(range->size);
+		if (range->prev_free) {
+			range->prev_free->next_free = range->next_free;
+		} else {
+			free_lists[fl][sl] = range->next_free;
+		}
+		if (range->next_free) {
+			range->next_free->prev_free = range->prev_free;
+		}
+		range->prev_free = range->next_free = nullptr;
+		range->is_free = false;
+		if (!free_lists[fl][sl]) {
+			sl_bitmaps[fl] &= ~(1u << sl);
+			if (sl_bitmaps[fl] == 0) {
+				fl_bitmap &= ~(1u << fl);
+			}
+		}
+	}
+
+	void TLSFAllocator::add_block(size_t block_index, size_t size) {
+		auto r = new_range();
+		r->block_index = block_index;
+		r->offset = 0;
+		r->size = VmaAlignDown(size, granularity);
+		insert_free(r);
+	}
+
+	void TLSFAllocator::remove_block(TLSFRange* range) {
+		assert(range->is_free && !range->prev_physical && !range->next_physical);
+		remove_free(range);
+		recycle_range(range);
+	}
+
+	TLSFAllocator::~TLSFAllocator() {
+		for (auto& fl : free_lists) {
+			for (auto head : fl) {
+				while (head) {
+					delete std::exchange(head, head->next_free);
+				}
+			}
+		}
+		while (spare_ranges) {
+			delete std::exchange(spare_ranges, spare_ranges->next_free);
+		}
+	}
+
+	TLSFRange* TLSFAllocator::allocate(size_t size) {
+		size = VmaAlignUp(size, granularity);
+		// round up to the next bin, so that any range in the bin found fits
+		size_t search_size = size;
+		auto [fl, sl] = mapping(search_size);
+		if (fl >= sl_bits) {
+			search_size += (granularity << (fl - sl_bits)) - 1;
+			std::tie(fl, sl) = mapping(search_size);
+		}
+		if (fl >= 32) {
+			return nullptr;
+		}
+
+		uint32_t sl_map = sl_bitmaps[fl] & (~0u << sl);
+		if (sl_map == 0) {
+			uint32_t fl_map = fl + 1 < 32 ? fl_bitmap & (~0u << (fl + 1)) : 0;
+			if (fl_map == 0) {
+				return nullptr;
+			}
+			fl = (uint32_t)std::countr_zero(fl_map);
+			sl_map = sl_bitmaps[fl];
+		}
+		sl = (uint32_t)std::countr_zero(sl_map);
+		auto range = free_lists[fl][sl];
+		assert(range && range->size >= size);
+		remove_free(range);
+
+		if (range->size - size >= granularity) { // split off the remainder
+			auto rest = new_range();
+			rest->block_index = range->block_index;
+			rest->offset = range->offset + size;
+			rest->size = range->size - size;
+			rest->prev_physical = range;
+			rest->next_physical = range->next_physical;
+			if (rest->next_physical) {
+				rest->next_physical->prev_physical = rest;
+			}
+			range->next_physical = rest;
+			range->size = size;
+			insert_free(rest);
+		}
+		return range;
+	}
+
+	TLSFRange* TLSFAllocator::free(TLSFRange* range) {
+		if (auto next = range->next_physical; next && next->is_free) {
+			remove_free(next);
+			range->size += next->size;
+			range->next_physical = next->next_physical;
+			if (range->next_physical) {
+				range->next_physical->prev_physical = range;
+			}
+			recycle_range(next);
+		}
+		if (auto prev = range->prev_physical; prev && prev->is_free) {
+			remove_free(prev);
+			prev->size += range->size;
+			prev->next_physical = range->next_physical;
+			if (prev->next_physical) {
+				prev->next_physical->prev_physical = prev;
+			}
+			recycle_range(range);
+			range = prev;
+		}
+		insert_free(range);
+		return range;
+	}
+
+#ifndef DOCTEST_CONFIG_DISABLE
+	TEST_CASE("testing TLSF allocation") {
+		TLSFAllocator tlsf;
+		tlsf.add_block(0, 1024 * 1024);
+		auto a = tlsf.allocate(1000);
+		REQUIRE(a);
+		CHECK(a->offset == 0);
+		CHECK(a->size == 1024);
+		auto b = tlsf.allocate(4096);
+		REQUIRE(b);
+		CHECK(b->offset == 1024);
+		CHECK(tlsf.allocate(1024 * 1024) == nullptr);
+
+		// freeing both merges the block back into a single range
+		tlsf.free(a);
+		auto merged = tlsf.free(b);
+		CHECK(merged->offset == 0);
+		CHECK(merged->size == 1024 * 1024);
+		auto whole = tlsf.allocate(1024 * 1024);
+		CHECK(whole == merged);
+		tlsf.remove_block(tlsf.free(whole));
+	}
+#endif
+
+	BufferSubAllocator::BufferSubAllocator(DeviceResource& upstream, MemoryUsage mem_usage, BufferUsageFlags buf_usage, size_t block_size) :
+	    upstream(&upstream),
+	    mem_usage(mem_usage),
+	    usage(buf_usage),
+	    block_size(block_size) {
+		for (size_t i = 0; i < num_size_classes; i++) {
+			auto& sc = size_classes[i];
+			sc.slot_size = min_slot_size << i;
+			sc.slab_size = std::min(std::max(sc.slot_size * 16, (size_t)64 * 1024), block_size / 2);
+		}
+	}
+
+	BufferSubAllocator::~BufferSubAllocator() {
+		for (auto& sc : size_classes) {
+			for (auto slab : sc.slabs) {
+				assert(slab->live == 0 && "buffers were not deallocated");
+				free_range(slab->range);
+				delete slab;
+			}
+		}
+		for (auto& block : blocks) {
+			if (block) {
+				upstream->deallocate_buffers(std::span{ &block, 1 });
+			}
+		}
+	}
+
+	Result<Buffer, AllocateException> BufferSubAllocator::allocate_range(size_t size, TLSFRange*& range, SourceLocationAtFrame source, SubAllocation** record) {
+		// padding for an alignment larger than half a block can exceed the block, such a range can never be placed
+		if (size > block_size) {
+			return { expected_error, AllocateException{ VK_ERROR_OUT_OF_DEVICE_MEMORY } };
+		}
+		std::lock_guard _(block_mutex);
+		range = tlsf.allocate(size);
+		if (!range) { // grow by a block
+			auto it = std::find_if(blocks.begin(), blocks.end(), [](Buffer& b) { return !b; });
+			if (it == blocks.end()) {
+				it = blocks.insert(it, Buffer{});
+			}
+			BufferCreateInfo bci{ .mem_usage = mem_usage, .size = block_size, .alignment = TLSFAllocator::granularity };
+			auto result = upstream->allocate_buffers(std::span{ &*it, 1 }, std::span{ &bci, 1 }, source);
 			if (!result) {
+				*it = {};
 				return result;
-			} else {
-				return { expected_value, buf };
 			}
+			block_count++;
+			tlsf.add_block(it - blocks.begin(), block_size);
+			range = tlsf.allocate(size);
+			assert(range);
+		}
+		if (record) {
+			if (!spare_records) {
+				auto& chunk = record_chunks.emplace_back(new SubAllocation[records_per_chunk]);
+				for (size_t i = 0; i < records_per_chunk; i++) {
+					chunk[i].next_spare = std::exchange(spare_records, &chunk[i]);
+				}
+			}
+			*record = std::exchange(spare_records, spare_records->next_spare);
+			**record = { .range = range, .slab = nullptr };
 		}
+		return { expected_value, blocks[range->block_index].subrange(range->offset, range->size) };
+	}
 
-		std::lock_guard _(mutex);
-		
-		VmaVirtualAllocation va;
-		VkDeviceSize offset;
-		VmaVirtualAllocationCreateInfo vaci{};
-		vaci.size = size + alignment;
-		vaci.alignment = 0; // VMA does not handle NPOT alignment
-
-		std::vector<VmaVirtualAllocation> straddlers;
-		bool is_straddling = true;
-		while (is_straddling) {
-			auto result = vmaVirtualAllocate(virtual_alloc, &vaci, &va, &offset);
-			if (result != VK_SUCCESS) { // this must always succeed, we have 128 GiB memory to allocate from
-				return { expected_error, AllocateException(result) };
+	void BufferSubAllocator::free_range(TLSFRange* range, SubAllocation* record) {
+		std::lock_guard _(block_mutex);
+		if (record) {
+			record->next_spare = std::exchange(spare_records, record);
+		}
+		auto free_range = tlsf.free(range);
+		// release blocks that became empty, but keep the last one to avoid thrashing
+		if (!free_range->prev_physical && !free_range->next_physical && block_count > 1) {
+			auto& block = blocks[free_range->block_index];
+			tlsf.remove_block(free_range);
+			upstream->deallocate_buffers(std::span{ &block, 1 });
+			block = {};
+			block_count--;
+		}
+	}
+
+	Result<Buffer, AllocateException> BufferSubAllocator::allocate_slot(uint32_t size_class, SubAllocation*& sa, SourceLocationAtFrame source) {
+		auto& sc = size_classes[size_class];
+		std::lock_guard _(sc.mutex);
+		if (sc.partial_slabs.empty()) {
+			TLSFRange* range;
+			auto result = allocate_range(sc.slab_size, range, source);
+			if (!result) {
+				return result;
 			}
-			is_straddling = offset / block_size != (offset + vaci.size) / block_size;
-			if (is_straddling) {
-				straddlers.push_back(va);
+			auto slot_count = (uint32_t)(sc.slab_size / sc.slot_size);
+			auto slab = new SizeClassSlab{ .buffer = *result, .range = range, .records = std::make_unique<SubAllocation[]>(slot_count) };
+			slab->free_slots.reserve(slot_count);
+			for (uint32_t i = slot_count; i > 0; i--) {
+				slab->free_slots.push_back(i - 1);
+				slab->records[i - 1] = { .range = range, .slab = slab, .size_class = size_class, .slot = i - 1 };
 			}
+			sc.slabs.push_back(slab);
+			sc.partial_slabs.push_back(slab);
 		}
-		for (auto& s : straddlers) {
-			vmaVirtualFree(virtual_alloc, s);
+		auto slab = sc.partial_slabs.back();
+		sa = &slab->records[slab->free_slots.back()];
+		slab->free_slots.pop_back();
+		slab->live++;
+		if (slab->free_slots.empty()) {
+			sc.partial_slabs.pop_back();
 		}
+		return { expected_value, slab->buffer.subrange(sa->slot * sc.slot_size, sc.slot_size) };
+	}
 
-		auto block_index = offset / block_size;
-		if (blocks.size() <= block_index) {
-			blocks.resize(block_index + 1);
+	void BufferSubAllocator::free_slot(SubAllocation& sa) {
+		auto& sc = size_classes[sa.size_class];
+		std::lock_guard _(sc.mutex);
+		auto slab = sa.slab;
+		slab->free_slots.push_back(sa.slot);
+		slab->live--;
+		if (slab->free_slots.size() == 1) {
+			sc.partial_slabs.push_back(slab);
+		}
+		// return empty slabs to the blocks, unless it is the only one with free slots
+		if (slab->live == 0 && sc.partial_slabs.size() > 1) {
+			std::erase(sc.partial_slabs, slab);
+			std::erase(sc.slabs, slab);
+			free_range(slab->range);
+			delete slab;
 		}
-		
-		if (!blocks[block_index].buffer) {
-			BufferCreateInfo bci{ .mem_usage = mem_usage, .size = block_size, .alignment = 256 };
-			auto result = upstream->allocate_buffers(std::span{ &blocks[block_index].buffer, 1 }, std::span{ &bci, 1 }, source);
+	}
+
+	Result<Buffer, AllocateException> BufferSubAllocator::allocate_buffer(size_t size, size_t alignment, SourceLocationAtFrame source) {
+		if (size > block_size / 2) { // allocate-through
+			BufferCreateInfo bci{ .mem_usage = mem_usage, .size = size, .alignment = alignment };
+			Buffer buf;
+			auto result = upstream->allocate_buffers(std::span{ &buf, 1 }, std::span{ &bci, 1 }, source);
 			if (!result) {
 				return result;
+			} else {
+				return { expected_value, buf };
 			}
 		}
-		
-		auto aligned_offset = VmaAlignUp(offset - block_index * block_size, alignment);
-		Buffer buf = blocks[block_index].buffer.add_offset(aligned_offset);
+
+		// slots and ranges start granularity-aligned, other alignments (including NPOT) are handled by padding
+		bool naturally_aligned = std::has_single_bit(alignment) && alignment <= TLSFAllocator::granularity;
+		size_t padded_size = naturally_aligned ? size : size + alignment;
+
+		SubAllocation* sa;
+		Result<Buffer, AllocateException> result{ expected_value };
+		size_t max_slot_size = min_slot_size << (num_size_classes - 1);
+		if (padded_size <= max_slot_size) {
+			auto size_class = (uint32_t)std::bit_width((std::max(padded_size, min_slot_size) - 1) / min_slot_size);
+			result = allocate_slot(size_class, sa, source);
+		} else {
+			TLSFRange* range;
+			result = allocate_range(padded_size, range, source, &sa);
+		}
+		if (!result) {
+			return result;
+		}
+
+		Buffer& base = *result;
+		auto aligned_offset = VmaAlignUp(base.offset, alignment) - base.offset;
+		Buffer buf = base.subrange(aligned_offset, size);
 		assert(buf.offset % alignment == 0);
-		assert((buf.offset + size) < block_size);
-		buf.size = size;
-		buf.allocation = new SubAllocation{ block_index, va };
-		blocks[block_index].allocation_count++;
+		buf.allocation = sa;
+		allocated_bytes.fetch_add(size, std::memory_order_relaxed);
 		return { expected_value, buf };
 	}
 
 	void BufferSubAllocator::deallocate_buffer(const Buffer& buf) {
-		if (buf.size >= block_size) {
+		if (buf.size > block_size / 2) {
 			upstream->deallocate_buffers(std::span{ &buf, 1 });
 			return;
 		}
-		std::lock_guard _(mutex);
+		// the record is reused (or freed with its slab) once it is returned
 		auto sa = static_cast<SubAllocation*>(buf.allocation);
-		vmaVirtualFree(virtual_alloc, sa->allocation);
-		if (--blocks[sa->block_index].allocation_count == 0) {
-			upstream->deallocate_buffers(std::span{ &blocks[sa->block_index].buffer, 1 });
-			blocks[sa->block_index].buffer = {};
+		if (sa->slab) {
+			free_slot(*sa);
+		} else {
+			free_range(sa->range, sa);
 		}
-		delete sa;
-	}
-
-	BufferSubAllocator::BufferSubAllocator(DeviceResource& upstream, MemoryUsage mem_usage, BufferUsageFlags buf_usage, size_t block_size) :
-	    upstream(&upstream),
-	    mem_usage(mem_usage),
-	    usage(buf_usage),
-	    block_size(block_size) {
-
-		VmaVirtualBlockCreateInfo vbci{};
-		vbci.size = 1024ULL * 1024 * 1024 * 128; // 128 GiB baybeh
-		auto result2 = vmaCreateVirtualBlock(&vbci, &virtual_alloc);
-		assert(result2 == VK_SUCCESS);
+		allocated_bytes.fetch_sub(buf.size, std::memory_order_relaxed);
 	}
 
-	BufferSubAllocator::~BufferSubAllocator() {
-		assert(vmaIsVirtualBlockEmpty(virtual_alloc));
-		vmaDestroyVirtualBlock(virtual_alloc);
+	BufferFragmentationReport BufferSubAllocator::get_fragmentation_report() {
+		BufferFragmentationReport report;
+		for (auto& sc : size_classes) {
+			std::lock_guard _(sc.mutex);
+			report.slab_count += sc.slabs.size();
+			for (auto slab : sc.partial_slabs) {
+				report.slab_free_bytes += slab->free_slots.size() * sc.slot_size;
+			}
+		}
+		std::lock_guard _(block_mutex);
+		report.block_count = block_count;
+		report.reserved_bytes = block_count * block_size;
+		report.allocated_bytes = allocated_bytes.load(std::memory_order_relaxed);
+		tlsf.for_each_free([&](TLSFRange& r) {
+			report.free_bytes += r.size;
+			report.free_range_count++;
+			report.largest_free_range = std::max(report.largest_free_range, r.size);
+		});
+		if (report.free_bytes > 0) {
+			report.fragmentation = 1.0 - (double)report.largest_free_range / (double)report.free_bytes;
+		}
+		return report;
 	}
-
-} // namespace vuk
\ No newline at end of file
+} // namespace vuk
@@ -1,7 +1,9 @@
 #pragma once
 
+#include "ThreadLocalList.hpp"
 #include "vuk/Buffer.hpp"
 #include "vuk/Config.hpp"
+#include "vuk/MemoryStats.hpp"
 #include "vuk/SourceLocation.hpp"
 #include "vuk/Types.hpp"
 
@@ -9,9 +11,9 @@
 #include <atomic>
 #include <memory>
 #include <mutex>
+#include <thread>
 #include <utility>
 #include <vector>
-#include <vk_mem_alloc.h>
 #include <plf_colony.h>
 
 namespace vuk {
@@ -23,26 +25,62 @@ namespace vuk {
 		uint64_t base_address = 0;
 	};
 
+	/// @brief Grow-only table of segments - entries never move, so published entries can be read while the table grows
+	struct LinearSegmentTable {
+		static constexpr size_t first_page_size = 256;
+
+		LinearSegmentTable() = default;
+		LinearSegmentTable(const LinearSegmentTable&) = delete;
+		LinearSegmentTable& operator=(const LinearSegmentTable&) = delete;
+		~LinearSegmentTable();
+
+		/// @brief Access an entry, allocating its page if needed - must be externally synchronized
+		LinearSegment& ensure(size_t index);
+		/// @brief Access an already allocated entry
+		LinearSegment& operator[](size_t index);
+
+	private:
+		// page i holds first_page_size << i entries
+		std::array<std::atomic<LinearSegment*>, 32> pages = {};
+
+		static std::pair<size_t, size_t> locate(size_t index);
+	};
+
+	/// @brief Linear allocation state owned by a single thread
+	struct LinearThreadSlot {
+		std::thread::id thread;
+		LinearThreadSlot* next = nullptr;
+		Buffer chunk = {};
+		size_t chunk_used = 0;
+		// written only by the owning thread, read by statistics queries
+		std::atomic<size_t> bytes_allocated = 0;
+		std::atomic<size_t> high_water_bytes = 0;
+		std::atomic<size_t> chunk_count = 0;
+	};
+
 	struct BufferLinearAllocator {
 		DeviceResource* upstream;
 		std::mutex mutex;
 		std::atomic<int> current_buffer = -1;
 		std::atomic<uint64_t> needle = 0;
+		// error of the last failed grow, allocations waiting for blocks that were not created fail with it until reset
+		std::atomic<VkResult> grow_result = VK_SUCCESS;
 		MemoryUsage mem_usage;
 		BufferUsageFlags usage;
-		// TODO: convert to deque
-		std::array<LinearSegment, 256> available_allocations; // up to 4 GB of allocations with the default block_size
-		std::array<LinearSegment, 256> used_allocations;      // up to 4 GB of allocations with the default block_size
-		size_t available_allocation_count = 0;
+		std::vector<LinearSegment> available_allocations; // only accessed under the mutex
+		LinearSegmentTable used_allocations;
 		size_t used_allocation_count = 0;
 
 		size_t block_size;
+		// small allocations are bumped out of chunks owned by the allocating thread, only taking a chunk touches the shared needle
+		size_t chunk_size;
+		ThreadLocalList<LinearThreadSlot> thread_slots;
 
-		BufferLinearAllocator(DeviceResource& upstream, MemoryUsage mem_usage, BufferUsageFlags buf_usage, size_t block_size = 1024 * 1024 * 16) :
-		    upstream(&upstream),
-		    mem_usage(mem_usage),
-		    usage(buf_usage),
-		    block_size(block_size) {}
+		BufferLinearAllocator(DeviceResource& upstream,
+		                      MemoryUsage mem_usage,
+		                      BufferUsageFlags buf_usage,
+		                      size_t block_size = 1024 * 1024 * 16,
+		                      size_t chunk_size = 1024 * 64);
 		~BufferLinearAllocator();
 
 		Result<void, AllocateException> grow(size_t num_blocks, SourceLocationAtFrame source);
@@ -53,31 +91,136 @@ namespace vuk {
 		void reset();
 		// explicitly release resources
 		void free();
+		// append the statistics of each thread that allocated, merging with entries of the same thread
+		void collect_thread_stats(std::vector<LinearAllocationStats>& stats);
+
+	private:
+		Result<Buffer, AllocateException> allocate_shared(size_t size, size_t alignment, SourceLocationAtFrame source);
+		void retire_thread_slots();
 	};
 
-	struct BufferBlock {
-		Buffer buffer = {};
-		size_t allocation_count = 0;
+	/// @brief A range of a block, either free or allocated
+	struct TLSFRange {
+		size_t block_index;
+		size_t offset;
+		size_t size;
+		bool is_free = false;
+		TLSFRange* prev_physical = nullptr;
+		TLSFRange* next_physical = nullptr;
+		TLSFRange* prev_free = nullptr;
+		TLSFRange* next_free = nullptr;
 	};
 
+	/// @brief Two-level segregated fit allocator over ranges of blocks, not thread safe
+	// ranges are binned by their size class (a power of two split into 2^sl_bits linear steps) for O(1) good-fit lookup
+	// ranges are only merged with their physical neighbours, so allocations never straddle blocks
+	struct TLSFAllocator {
+		static constexpr size_t granularity = 256;
+		static constexpr uint32_t sl_bits = 4;
+
+		TLSFAllocator() = default;
+		TLSFAllocator(const TLSFAllocator&) = delete;
+		TLSFAllocator& operator=(const TLSFAllocator&) = delete;
+		~TLSFAllocator();
+
+		/// @brief Make a block available for allocation
+		void add_block(size_t block_index, size_t size);
+		/// @brief Remove a block that is entirely free, passing its only range
+		void remove_block(TLSFRange* range);
+		/// @brief Allocate a range of at least size bytes, returns nullptr if there is no large enough free range
+		TLSFRange* allocate(size_t size);
+		/// @brief Free a range, returning the (possibly merged) free range containing it
+		TLSFRange* free(TLSFRange* range);
+
+		/// @brief Visit all free ranges
+		template<class F>
+		void for_each_free(F&& f) {
+			for (auto& fl : free_lists) {
+				for (auto head : fl) {
+					for (auto r = head; r != nullptr; r = r->next_free) {
+						f(*r);
+					}
+				}
+			}
+		}
+
+	private:
+		uint32_t fl_bitmap = 0;
+		std::array<uint32_t, 32> sl_bitmaps = {};
+		std::array<std::array<TLSFRange*, 1 << sl_bits>, 32> free_lists = {};
+		TLSFRange* spare_ranges = nullptr;
+
+		static std::pair<uint32_t, uint32_t> mapping(size_t size);
+		void insert_free(TLSFRange* range);
+		void remove_free(TLSFRange* range);
+		TLSFRange* new_range();
+		void recycle_range(TLSFRange* range);
+	};
+
+	struct SubAllocation;
+
+	struct SizeClassSlab {
+		Buffer buffer;
+		TLSFRange* range;
+		uint32_t live = 0;
+		std::vector<uint32_t> free_slots;
+		std::unique_ptr<SubAllocation[]> records; // one per slot
+	};
+
+	/// @brief Fixed size slots carved from slabs, each size class is locked separately
+	struct SizeClass {
+		std::mutex mutex;
+		size_t slot_size = 0;
+		size_t slab_size = 0;
+		std::vector<SizeClassSlab*> partial_slabs; // slabs with at least one free slot
+		std::vector<SizeClassSlab*> slabs;
+	};
+
+	// records are owned by the slab for slots, and pooled by the BufferSubAllocator for ranges, so allocations don't touch the heap
 	struct SubAllocation {
-		size_t block_index;
-		VmaVirtualAllocation allocation;
+		TLSFRange* range;     // the range backing this allocation, or the range of its slab
+		SizeClassSlab* slab;  // nullptr if allocated from the TLSF
+		uint32_t size_class;
+		uint32_t slot;
+		SubAllocation* next_spare = nullptr;
 	};
 
 	struct BufferSubAllocator {
 		DeviceResource* upstream;
 		MemoryUsage mem_usage;
 		BufferUsageFlags usage;
-		std::vector<BufferBlock> blocks;
-		VmaVirtualBlock virtual_alloc;
-		std::mutex mutex;
 		size_t block_size;
 
+		// size classes from 256 B to 64 KiB
+		static constexpr size_t min_slot_size = 256;
+		static constexpr size_t num_size_classes = 9;
+
 		BufferSubAllocator(DeviceResource& upstream, MemoryUsage mem_usage, BufferUsageFlags buf_usage, size_t block_size);
 		~BufferSubAllocator();
 
 		Result<Buffer, AllocateException> allocate_buffer(size_t size, size_t alignment, SourceLocationAtFrame source);
 		void deallocate_buffer(const Buffer& buf);
+
+		BufferFragmentationReport get_fragmentation_report();
+
+	private:
+		std::array<SizeClass, num_size_classes> size_classes;
+		std::mutex block_mutex; // guards the blocks and the TLSF
+		std::vector<Buffer> blocks;
+		size_t block_count = 0;
+		TLSFAllocator tlsf;
+		// records of range allocations, guarded by block_mutex
+		std::vector<std::unique_ptr<SubAllocation[]>> record_chunks;
+		SubAllocation* spare_records = nullptr;
+		std::atomic<size_t> allocated_bytes = 0;
+
+		static constexpr size_t records_per_chunk = 64;
+
+		// if record is not null, it receives a pooled record for the range
+		Result<Buffer, AllocateException> allocate_range(size_t size, TLSFRange*& range, SourceLocationAtFrame source, SubAllocation** record = nullptr);
+		// the record of the range, if any, is returned to the pool
+		void free_range(TLSFRange* range, SubAllocation* record = nullptr);
+		Result<Buffer, AllocateException> allocate_slot(uint32_t size_class, SubAllocation*& sa, SourceLocationAtFrame source);
+		void free_slot(SubAllocation& sa);
 	};
 }; // namespace vuk
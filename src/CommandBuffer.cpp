@@ -930,6 +930,10 @@ namespace vuk {
 	}
 
 	CommandBuffer& CommandBuffer::copy_buffer_to_image(Name src, Name dst, BufferImageCopy bic) {
+		return copy_buffer_to_image(src, dst, std::span{ &bic, 1 });
+	}
+
+	CommandBuffer& CommandBuffer::copy_buffer_to_image(Name src, Name dst, std::span<const BufferImageCopy> regions) {
 		VUK_EARLY_RET();
 		assert(rg);
 		auto src_res = rg->get_resource_buffer(NameReference::direct(src), current_pass);
@@ -938,7 +942,10 @@ namespace vuk {
 			return *this;
 		}
 		auto src_bbuf = src_res->buffer;
-		bic.bufferOffset += src_bbuf.offset;
+		std::vector<VkBufferImageCopy> bics(regions.begin(), regions.end());
+		for (auto& bic : bics) {
+			bic.bufferOffset += src_bbuf.offset;
+		}
 
 		auto dst_res = rg->get_resource_image(NameReference::direct(dst), current_pass);
 		if (!dst_res) {
@@ -953,12 +960,16 @@ namespace vuk {
 			return *this;
 		}
 		auto dst_layout = *res_gl ? ImageLayout::eGeneral : ImageLayout::eTransferDstOptimal;
-		ctx.vkCmdCopyBufferToImage(command_buffer, src_bbuf.buffer, dst_image.image, (VkImageLayout)dst_layout, 1, (VkBufferImageCopy*)&bic);
+		ctx.vkCmdCopyBufferToImage(command_buffer, src_bbuf.buffer, dst_image.image, (VkImageLayout)dst_layout, (uint32_t)bics.size(), bics.data());
 
 		return *this;
 	}
 
 	CommandBuffer& CommandBuffer::copy_image_to_buffer(Name src, Name dst, BufferImageCopy bic) {
+		return copy_image_to_buffer(src, dst, std::span{ &bic, 1 });
+	}
+
+	CommandBuffer& CommandBuffer::copy_image_to_buffer(Name src, Name dst, std::span<const BufferImageCopy> regions) {
 		VUK_EARLY_RET();
 		assert(rg);
 		auto src_res = rg->get_resource_image(NameReference::direct(src), current_pass);
@@ -973,8 +984,10 @@ namespace vuk {
 			return *this;
 		}
 		auto dst_bbuf = dst_res->buffer;
-
-		bic.bufferOffset += dst_bbuf.offset;
+		std::vector<VkBufferImageCopy> bics(regions.begin(), regions.end());
+		for (auto& bic : bics) {
+			bic.bufferOffset += dst_bbuf.offset;
+		}
 
 		auto res_gl = rg->is_resource_image_in_general_layout(NameReference::direct(src), current_pass);
 		if (!res_gl) {
@@ -982,7 +995,7 @@ namespace vuk {
 			return *this;
 		}
 		auto src_layout = *res_gl ? ImageLayout::eGeneral : ImageLayout::eTransferSrcOptimal;
-		ctx.vkCmdCopyImageToBuffer(command_buffer, src_image.image, (VkImageLayout)src_layout, dst_bbuf.buffer, 1, (VkBufferImageCopy*)&bic);
+		ctx.vkCmdCopyImageToBuffer(command_buffer, src_image.image, (VkImageLayout)src_layout, dst_bbuf.buffer, (uint32_t)bics.size(), bics.data());
 
 		return *this;
 	}
@@ -16,10 +16,13 @@
 #endif
 #include <algorithm>
 #include <atomic>
+#include <cstdio>
+#include <iterator>
 
 #include "../src/ContextImpl.hpp"
 #include "vuk/Allocator.hpp"
 #include "vuk/AllocatorHelpers.hpp"
+#include "vuk/CommandBuffer.hpp"
 #include "vuk/Context.hpp"
 #include "vuk/Exception.hpp"
 #include "vuk/Program.hpp"
@@ -92,7 +95,9 @@ namespace vuk {
 	    physical_device(params.physical_device),
 	    graphics_queue_family_index(params.graphics_queue_family_index),
 	    compute_queue_family_index(params.compute_queue_family_index),
-	    transfer_queue_family_index(params.transfer_queue_family_index) {
+	    transfer_queue_family_index(params.transfer_queue_family_index),
+	    memory_budget_extension_enabled(params.memory_budget_extension_enabled),
+	    host_image_copy_enabled(params.host_image_copy_enabled) {
 		// TODO: conversion to static factory fn
 		bool pfn_load_success = load_pfns(params, *this);
 		assert(pfn_load_success);
@@ -105,18 +110,24 @@ namespace vuk {
 			dedicated_graphics_queue_ = true;
 		}
 
-		if (params.compute_queue != VK_NULL_HANDLE && params.compute_queue_family_index != VK_QUEUE_FAMILY_IGNORED) {
+		// passing the same VkQueue for multiple domains makes those domains share a Queue
+		if (params.compute_queue != VK_NULL_HANDLE && params.compute_queue_family_index != VK_QUEUE_FAMILY_IGNORED &&
+		    params.compute_queue != params.graphics_queue) {
 			dedicated_compute_queue_ = true;
 		} else {
 			compute_queue_family_index = params.graphics_queue_family_index;
 		}
 
-		if (params.transfer_queue != VK_NULL_HANDLE && params.transfer_queue_family_index != VK_QUEUE_FAMILY_IGNORED) {
+		bool transfer_on_graphics = params.transfer_queue == params.graphics_queue || !dedicated_compute_queue_;
+		if (params.transfer_queue != VK_NULL_HANDLE && params.transfer_queue_family_index != VK_QUEUE_FAMILY_IGNORED &&
+		    params.transfer_queue != params.graphics_queue && params.transfer_queue != params.compute_queue) {
 			dedicated_transfer_queue_ = true;
 		} else {
-			transfer_queue_family_index = compute_queue ? params.compute_queue_family_index : params.graphics_queue_family_index;
+			transfer_queue_family_index = transfer_on_graphics ? params.graphics_queue_family_index : params.compute_queue_family_index;
 		}
 		impl = new ContextImpl(*this);
+		impl->staging_ring.capacity = params.staging_ring_size;
+		impl->readback_ring.capacity = params.readback_ring_size;
 
 		{
 			TimelineSemaphore ts;
@@ -141,7 +152,7 @@ namespace vuk {
 			set_name(params.transfer_queue, "Transfer Queue");
 			transfer_queue = &dedicated_transfer_queue.value();
 		} else {
-			transfer_queue = compute_queue ? compute_queue : graphics_queue;
+			transfer_queue = transfer_on_graphics ? graphics_queue : compute_queue;
 		}
 
 		this->vkGetPhysicalDeviceProperties(physical_device, &physical_device_properties);
@@ -162,11 +173,14 @@ namespace vuk {
 		graphics_queue_family_index = o.graphics_queue_family_index;
 		compute_queue_family_index = o.compute_queue_family_index;
 		transfer_queue_family_index = o.transfer_queue_family_index;
+		memory_budget_extension_enabled = o.memory_budget_extension_enabled;
+		host_image_copy_enabled = o.host_image_copy_enabled;
+		bool transfer_on_graphics = o.transfer_queue == o.graphics_queue;
 		dedicated_graphics_queue = std::move(o.dedicated_graphics_queue);
 		graphics_queue = &dedicated_graphics_queue.value();
 		dedicated_compute_queue = std::move(o.dedicated_compute_queue);
 		if (dedicated_compute_queue) {
-			compute_queue = &o.dedicated_compute_queue.value();
+			compute_queue = &dedicated_compute_queue.value();
 		} else {
 			compute_queue = graphics_queue;
 		}
@@ -174,7 +188,7 @@ namespace vuk {
 		if (dedicated_transfer_queue) {
 			transfer_queue = &dedicated_transfer_queue.value();
 		} else {
-			transfer_queue = compute_queue ? compute_queue : graphics_queue;
+			transfer_queue = transfer_on_graphics ? graphics_queue : compute_queue;
 		}
 		rt_properties = o.rt_properties;
 
@@ -185,6 +199,8 @@ namespace vuk {
 		impl->descriptor_set_layouts.allocator = this;
 		impl->pipeline_layouts.allocator = this;
 		impl->device_vk_resource->ctx = this;
+		impl->staging_ring.ctx = this;
+		impl->readback_ring.ctx = this;
 	}
 
 	Context& Context::operator=(Context&& o) noexcept {
@@ -195,11 +211,14 @@ namespace vuk {
 		graphics_queue_family_index = o.graphics_queue_family_index;
 		compute_queue_family_index = o.compute_queue_family_index;
 		transfer_queue_family_index = o.transfer_queue_family_index;
+		memory_budget_extension_enabled = o.memory_budget_extension_enabled;
+		host_image_copy_enabled = o.host_image_copy_enabled;
+		bool transfer_on_graphics = o.transfer_queue == o.graphics_queue;
 		dedicated_graphics_queue = std::move(o.dedicated_graphics_queue);
 		graphics_queue = &dedicated_graphics_queue.value();
 		dedicated_compute_queue = std::move(o.dedicated_compute_queue);
 		if (dedicated_compute_queue) {
-			compute_queue = &o.dedicated_compute_queue.value();
+			compute_queue = &dedicated_compute_queue.value();
 		} else {
 			compute_queue = graphics_queue;
 		}
@@ -207,7 +226,7 @@ namespace vuk {
 		if (dedicated_transfer_queue) {
 			transfer_queue = &dedicated_transfer_queue.value();
 		} else {
-			transfer_queue = compute_queue ? compute_queue : graphics_queue;
+			transfer_queue = transfer_on_graphics ? graphics_queue : compute_queue;
 		}
 
 		impl->pipelinebase_cache.allocator = this;
@@ -217,6 +236,8 @@ namespace vuk {
 		impl->descriptor_set_layouts.allocator = this;
 		impl->pipeline_layouts.allocator = this;
 		impl->device_vk_resource->ctx = this;
+		impl->staging_ring.ctx = this;
+		impl->readback_ring.ctx = this;
 
 		return *this;
 	}
@@ -818,8 +839,35 @@ namespace vuk {
 
 	Context::~Context() {
 		if (impl) {
+			// issue everything still held by submission threads
+			for (auto& q : { &dedicated_graphics_queue, &dedicated_compute_queue, &dedicated_transfer_queue }) {
+				if (*q) {
+					(*q)->stop_submit_thread();
+					if (auto result = (*q)->flush(); !result) {
+						fprintf(stderr, "vuk: flushing queued submissions failed: %s\n", result.error().what());
+					}
+				}
+			}
 			this->vkDeviceWaitIdle(device);
 
+			if (impl->completion_thread.joinable()) {
+				{
+					std::unique_lock _(impl->completion_lock);
+					impl->stop_completion_thread = true;
+					VkSemaphoreSignalInfo ssi{ .sType = VK_STRUCTURE_TYPE_SEMAPHORE_SIGNAL_INFO };
+					ssi.semaphore = impl->completion_wakeup.semaphore;
+					ssi.value = ++(*impl->completion_wakeup.value);
+					this->vkSignalSemaphore(device, &ssi);
+				}
+				impl->completion_thread.join();
+				// the device is idle, so all remaining callbacks have completed
+				for (auto& cc : impl->completion_callbacks) {
+					cc.callback();
+				}
+				impl->completion_callbacks.clear();
+				impl->device_vk_resource->deallocate_timeline_semaphores(std::span{ &impl->completion_wakeup, 1 });
+			}
+
 			for (auto& s : impl->swapchains) {
 				for (auto& swiv : s.image_views) {
 					this->vkDestroyImageView(device, swiv.payload, nullptr);
@@ -845,16 +893,105 @@ namespace vuk {
 		}
 	}
 
+	std::optional<StagingAllocation> Context::allocate_staging(size_t size, size_t alignment) {
+		return impl->staging_ring.allocate(size, alignment);
+	}
+
+	StagingAllocation Context::adopt_staging(Allocator& allocator, Unique<Buffer> buffer) {
+		auto dedicated = buffer.release();
+		auto release = std::make_shared<StagingRelease>(&impl->staging_ring, allocator.get_device_resource(), dedicated);
+		return { .buffer = dedicated, .release = std::move(release), .dedicated = true };
+	}
+
+	StagingRingStats Context::get_staging_ring_stats() {
+		return impl->staging_ring.get_stats();
+	}
+
+	std::optional<StagingAllocation> Context::allocate_readback(size_t size, size_t alignment) {
+		return impl->readback_ring.allocate(size, alignment);
+	}
+
+	StagingRingStats Context::get_readback_ring_stats() {
+		return impl->readback_ring.get_stats();
+	}
+
+	bool Context::can_copy_memory_to_image(const ImageAttachment& image) const {
+#ifdef VK_EXT_host_image_copy
+		return host_image_copy_enabled && vkCopyMemoryToImageEXT && vkTransitionImageLayoutEXT && image.has_concrete_image() &&
+		       image.usage != ImageUsageFlagBits::eInfer && (image.usage & ImageUsageFlagBits::eHostTransferEXT) != ImageUsageFlags{};
+#else
+		return false;
+#endif
+	}
+
+	Result<void> Context::copy_memory_to_image(const ImageAttachment& image, const void* src_data, std::span<const BufferImageCopy> regions) {
+		assert(can_copy_memory_to_image(image));
+#ifdef VK_EXT_host_image_copy
+		// only the subresources written are transitioned, the transition from undefined discards their contents
+		std::vector<VkHostImageLayoutTransitionInfoEXT> transitions;
+		for (auto& region : regions) {
+			auto& subresource = static_cast<const VkBufferImageCopy&>(region).imageSubresource;
+			VkImageSubresourceRange range{ subresource.aspectMask, subresource.mipLevel, 1, subresource.baseArrayLayer, subresource.layerCount };
+			bool seen = std::any_of(transitions.begin(), transitions.end(), [&](auto& t) {
+				return t.subresourceRange.aspectMask == range.aspectMask && t.subresourceRange.baseMipLevel == range.baseMipLevel &&
+				       t.subresourceRange.baseArrayLayer == range.baseArrayLayer && t.subresourceRange.layerCount == range.layerCount;
+			});
+			if (!seen) {
+				transitions.push_back(VkHostImageLayoutTransitionInfoEXT{ .sType = VK_STRUCTURE_TYPE_HOST_IMAGE_LAYOUT_TRANSITION_INFO_EXT,
+				                                                          .image = image.image.image,
+				                                                          .oldLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+				                                                          .newLayout = VK_IMAGE_LAYOUT_GENERAL,
+				                                                          .subresourceRange = range });
+			}
+		}
+		if (auto result = vkTransitionImageLayoutEXT(device, (uint32_t)transitions.size(), transitions.data()); result != VK_SUCCESS) {
+			return { expected_error, VkException{ result } };
+		}
+
+		std::vector<VkMemoryToImageCopyEXT> copies;
+		copies.reserve(regions.size());
+		for (auto& region : regions) {
+			auto& copy = copies.emplace_back(VkMemoryToImageCopyEXT{ .sType = VK_STRUCTURE_TYPE_MEMORY_TO_IMAGE_COPY_EXT });
+			copy.pHostPointer = static_cast<const std::byte*>(src_data) + region.bufferOffset;
+			copy.memoryRowLength = region.bufferRowLength;
+			copy.memoryImageHeight = region.bufferImageHeight;
+			copy.imageSubresource = static_cast<const VkBufferImageCopy&>(region).imageSubresource;
+			copy.imageOffset = static_cast<const VkBufferImageCopy&>(region).imageOffset;
+			copy.imageExtent = static_cast<const VkBufferImageCopy&>(region).imageExtent;
+		}
+		VkCopyMemoryToImageInfoEXT cmii{ .sType = VK_STRUCTURE_TYPE_COPY_MEMORY_TO_IMAGE_INFO_EXT };
+		cmii.dstImage = image.image.image;
+		cmii.dstImageLayout = VK_IMAGE_LAYOUT_GENERAL;
+		cmii.regionCount = (uint32_t)copies.size();
+		cmii.pRegions = copies.data();
+		if (auto result = vkCopyMemoryToImageEXT(device, &cmii); result != VK_SUCCESS) {
+			return { expected_error, VkException{ result } };
+		}
+		return { expected_value };
+#else
+		return { expected_error, VkException{ VK_ERROR_EXTENSION_NOT_PRESENT } };
+#endif
+	}
+
 	uint64_t Context::get_unique_handle_id() {
 		return impl->unique_handle_id_counter++;
 	}
 
 	void Context::next_frame() {
+		{
+			std::unique_lock _(impl->begin_frame_lock);
+			impl->last_frame_host_wait_stats = { impl->host_waits.exchange(0),
+				                                   impl->host_wait_timeouts.exchange(0),
+				                                   std::chrono::nanoseconds(impl->host_wait_ns.exchange(0)) };
+		}
+		impl->device_vk_resource->next_frame();
 		impl->frame_counter++;
 		collect(impl->frame_counter);
 	}
 
 	Result<void> Context::wait_idle() {
+		VUK_DO_OR_RETURN(flush_submissions());
+
 		std::unique_lock<std::recursive_mutex> graphics_lock;
 		if (dedicated_graphics_queue) {
 			graphics_lock = std::unique_lock{ graphics_queue->get_queue_lock() };
@@ -875,6 +1012,109 @@ namespace vuk {
 		return { expected_value };
 	}
 
+	Result<bool> Context::is_domain_value_reached(DomainFlags domain, uint64_t value) {
+		auto& queue = domain_to_queue(domain);
+		uint64_t completed;
+		VkResult result = this->vkGetSemaphoreCounterValue(device, queue.get_submit_sync().semaphore, &completed);
+		if (result != VK_SUCCESS) {
+			return { expected_error, VkException{ result } };
+		}
+		if (completed >= value) {
+			return { expected_value, true };
+		}
+		// the value might be signalled by a submission still held back
+		VUK_DO_OR_RETURN(queue.flush());
+		return { expected_value, false };
+	}
+
+	Result<void> Context::on_domain_value_reached(DomainFlags domain, uint64_t value, std::function<void()> callback) {
+		auto reached = is_domain_value_reached(domain, value);
+		if (!reached) {
+			return reached;
+		}
+		if (*reached) {
+			callback();
+			return { expected_value };
+		}
+		auto& queue = domain_to_queue(domain);
+
+		std::unique_lock _(impl->completion_lock);
+		// the completion thread has stopped waiting, the callback would never be invoked
+		if (auto result = impl->completion_result.load(); result != VK_SUCCESS) {
+			return { expected_error, VkException{ result } };
+		}
+		if (!impl->completion_thread.joinable()) {
+			VUK_DO_OR_RETURN(impl->device_vk_resource->allocate_timeline_semaphores(std::span{ &impl->completion_wakeup, 1 }, VUK_HERE_AND_NOW()));
+			impl->completion_thread = std::thread([this] { impl->completion_thread_main(*this); });
+		}
+		impl->completion_callbacks.emplace_back(ContextImpl::CompletionCallback{ queue.get_submit_sync().semaphore, value, std::move(callback) });
+		// signalled under the lock, as values must increase monotonically
+		VkSemaphoreSignalInfo ssi{ .sType = VK_STRUCTURE_TYPE_SEMAPHORE_SIGNAL_INFO };
+		ssi.semaphore = impl->completion_wakeup.semaphore;
+		ssi.value = ++(*impl->completion_wakeup.value);
+		VkResult result = this->vkSignalSemaphore(device, &ssi);
+		if (result != VK_SUCCESS) {
+			return { expected_error, VkException{ result } };
+		}
+		return { expected_value };
+	}
+
+	void ContextImpl::completion_thread_main(Context& ctx) {
+		std::vector<CompletionCallback> reached;
+		std::vector<VkSemaphore> semas;
+		std::vector<uint64_t> values;
+		while (true) {
+			std::unique_lock lock(completion_lock);
+			if (stop_completion_thread) {
+				return;
+			}
+			// wait for the wakeup, or the lowest pending value of any queue timeline
+			semas.assign(1, completion_wakeup.semaphore);
+			values.assign(1, *completion_wakeup.value + 1);
+			for (auto& cc : completion_callbacks) {
+				auto it = std::find(semas.begin() + 1, semas.end(), cc.queue_timeline);
+				if (it == semas.end()) {
+					semas.push_back(cc.queue_timeline);
+					values.push_back(cc.value);
+				} else {
+					auto& v = values[it - semas.begin()];
+					v = std::min(v, cc.value);
+				}
+			}
+			lock.unlock();
+
+			VkSemaphoreWaitInfo swi{ .sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO };
+			swi.flags = VK_SEMAPHORE_WAIT_ANY_BIT;
+			swi.pSemaphores = semas.data();
+			swi.pValues = values.data();
+			swi.semaphoreCount = (uint32_t)semas.size();
+			VkResult result = ctx.vkWaitSemaphores(device, &swi, UINT64_MAX);
+			for (size_t i = 1; i < semas.size() && result == VK_SUCCESS; i++) {
+				result = ctx.vkGetSemaphoreCounterValue(device, semas[i], &values[i]);
+			}
+			if (result != VK_SUCCESS) {
+				// the device is lost, the values waited for might never be reached
+				// the pending callbacks are invoked when the Context is destroyed, registering more callbacks reports the error
+				completion_result = result;
+				return;
+			}
+			lock.lock();
+			// callbacks added since are left for the next round
+			auto it = std::stable_partition(completion_callbacks.begin(), completion_callbacks.end(), [&](CompletionCallback& cc) {
+				auto sit = std::find(semas.begin() + 1, semas.end(), cc.queue_timeline);
+				return sit == semas.end() || values[sit - semas.begin()] < cc.value;
+			});
+			std::move(it, completion_callbacks.end(), std::back_inserter(reached));
+			completion_callbacks.erase(it, completion_callbacks.end());
+			lock.unlock();
+
+			for (auto& cc : reached) {
+				cc.callback();
+			}
+			reached.clear();
+		}
+	}
+
 	void Context::collect(uint64_t frame) {
 		impl->collect(frame);
 	}
@@ -1,5 +1,6 @@
 #include "Cache.hpp"
 #include "RenderPass.hpp"
+#include "StagingRing.hpp"
 #include "vuk/Allocator.hpp"
 #include "vuk/Context.hpp"
 #include "vuk/PipelineInstance.hpp"
@@ -7,12 +8,14 @@
 #include "vuk/resources/DeviceVkResource.hpp"
 
 #include <atomic>
+#include <functional>
 #include <math.h>
 #include <mutex>
 #include <plf_colony.h>
 #include <queue>
 #include <robin_hood.h>
 #include <string_view>
+#include <thread>
 
 namespace vuk {
 	struct ContextImpl {
@@ -31,6 +34,8 @@ namespace vuk {
 
 		std::unique_ptr<DeviceVkResource> device_vk_resource;
 		Allocator direct_allocator;
+		StagingRing staging_ring;
+		StagingRing readback_ring;
 
 		Cache<PipelineBaseInfo> pipelinebase_cache;
 		Cache<DescriptorPool> pool_cache;
@@ -41,6 +46,12 @@ namespace vuk {
 
 		std::mutex begin_frame_lock;
 
+		// host wait statistics of the current frame, moved into last_frame_host_wait_stats by next_frame()
+		std::atomic<uint64_t> host_waits = 0;
+		std::atomic<uint64_t> host_wait_timeouts = 0;
+		std::atomic<int64_t> host_wait_ns = 0;
+		HostWaitStats last_frame_host_wait_stats;
+
 		std::atomic<size_t> frame_counter = 0;
 		std::atomic<size_t> unique_handle_id_counter = 0;
 
@@ -56,6 +67,23 @@ namespace vuk {
 		std::mutex query_lock;
 		robin_hood::unordered_map<Query, uint64_t> timestamp_result_map;
 
+		struct CompletionCallback {
+			VkSemaphore queue_timeline;
+			uint64_t value;
+			std::function<void()> callback;
+		};
+
+		std::mutex completion_lock;
+		std::vector<CompletionCallback> completion_callbacks;
+		std::thread completion_thread;
+		// host-signalled timeline semaphore, waited on together with the queue timelines to wake the completion thread
+		TimelineSemaphore completion_wakeup = {};
+		bool stop_completion_thread = false;
+		// error of the wait of the completion thread, after which it has stopped
+		std::atomic<VkResult> completion_result = VK_SUCCESS;
+
+		void completion_thread_main(Context& ctx);
+
 		void collect(uint64_t absolute_frame) {
 			// collect rarer resources
 			static constexpr uint32_t cache_collection_frequency = 16;
@@ -79,6 +107,8 @@ namespace vuk {
 		    device(ctx.device),
 		    device_vk_resource(std::make_unique<DeviceVkResource>(ctx)),
 		    direct_allocator(*device_vk_resource.get()),
+		    staging_ring(ctx, *device_vk_resource),
+		    readback_ring(ctx, *device_vk_resource, MemoryUsage::eGPUtoCPU),
 		    pipelinebase_cache(&ctx, &FN<struct PipelineBaseInfo>::create_fn, &FN<struct PipelineBaseInfo>::destroy_fn),
 		    pool_cache(&ctx, &FN<struct DescriptorPool>::create_fn, &FN<struct DescriptorPool>::destroy_fn),
 		    sampler_cache(&ctx, &FN<Sampler>::create_fn, &FN<Sampler>::destroy_fn),
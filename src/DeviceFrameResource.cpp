@@ -1,17 +1,23 @@
 #include "vuk/resources/DeviceFrameResource.hpp"
 #include "BufferAllocator.hpp"
 #include "Cache.hpp"
+#include "MemoryTelemetry.hpp"
 #include "RenderPass.hpp"
+#include "ThreadLocalList.hpp"
 #include "vuk/Context.hpp"
 #include "vuk/Descriptor.hpp"
 #include "vuk/PipelineInstance.hpp"
 #include "vuk/Query.hpp"
 
+#include <algorithm>
 #include <atomic>
+#include <chrono>
+#include <cstdio>
 #include <mutex>
 #include <numeric>
 #include <plf_colony.h>
 #include <shared_mutex>
+#include <thread>
 
 namespace vuk {
 	struct DeviceSuperFrameResourceImpl {
@@ -41,6 +47,8 @@ namespace vuk {
 		Cache<VkRenderPass> render_pass_cache;
 
 		BufferSubAllocator suballocators[4];
+		// accounting takes the telemetry lock of the frame, so frame allocations are only accounted on request
+		std::atomic<bool> track_frame_allocations = false;
 
 		DeviceSuperFrameResourceImpl(DeviceSuperFrameResource& sfr, size_t frames_in_flight) :
 		    sfr(&sfr),
@@ -117,53 +125,71 @@ namespace vuk {
 		}
 	};
 
+	/// @brief Handles recorded by a single thread for destruction at recycle time
+	/// Only the owning thread appends, the lists are merged into the frame when it is waited for or recycled.
+	/// The vectors keep their capacity across frames, so recording doesn't allocate once they have grown.
+	struct FrameThreadLists {
+		std::thread::id thread;
+		FrameThreadLists* next = nullptr;
+		std::vector<VkSemaphore> semaphores;
+		std::vector<VkFence> fences;
+		std::vector<CommandBufferAllocation> cmdbuffers_to_free;
+		std::vector<CommandPool> cmdpools_to_free;
+		std::vector<VkFramebuffer> framebuffers;
+		std::vector<Image> images;
+		std::vector<ImageView> image_views;
+		std::vector<PersistentDescriptorSet> persistent_descriptor_sets;
+		std::vector<DescriptorSet> descriptor_sets;
+		std::vector<VkDescriptorPool> ds_pools_to_destroy;
+		std::vector<Buffer> buffer_gpus;
+		std::vector<TimelineSemaphore> tsemas;
+		std::vector<VkAccelerationStructureKHR> ass;
+		std::vector<VkSwapchainKHR> swapchains;
+		std::vector<GraphicsPipelineInfo> graphics_pipes;
+		std::vector<ComputePipelineInfo> compute_pipes;
+		std::vector<RayTracingPipelineInfo> ray_tracing_pipes;
+		std::vector<VkRenderPass> render_passes;
+	};
+
 	struct DeviceFrameResourceImpl {
 		Context* ctx;
-		std::mutex sema_mutex;
+		// recording threads append to their own lists without locking
+		ThreadLocalList<FrameThreadLists> thread_lists;
+
+		// merged from the thread lists, only touched while the frame is waited for or recycled
 		std::vector<VkSemaphore> semaphores;
-		std::mutex buf_mutex;
 		std::vector<Buffer> buffers;
-		std::mutex fence_mutex;
 		std::vector<VkFence> fences;
-		std::mutex cbuf_mutex;
 		std::vector<CommandBufferAllocation> cmdbuffers_to_free;
 		std::vector<CommandPool> cmdpools_to_free;
-		std::mutex framebuffer_mutex;
 		std::vector<VkFramebuffer> framebuffers;
-		std::mutex images_mutex;
 		std::vector<Image> images;
-		std::mutex image_views_mutex;
 		std::vector<ImageView> image_views;
-		std::mutex pds_mutex;
 		std::vector<PersistentDescriptorSet> persistent_descriptor_sets;
-		std::mutex ds_mutex;
 		std::vector<DescriptorSet> descriptor_sets;
-		std::atomic<VkDescriptorPool*> last_ds_pool;
-		plf::colony<VkDescriptorPool> ds_pools;
 		std::vector<VkDescriptorPool> ds_pools_to_destroy;
-
 		// only for use via SuperframeAllocator
-		std::mutex buffers_mutex;
 		std::vector<Buffer> buffer_gpus;
-
-		std::vector<TimestampQueryPool> ts_query_pools;
-		std::mutex query_pool_mutex;
-		std::mutex ts_query_mutex;
-		uint64_t query_index = 0;
-		uint64_t current_ts_pool = 0;
-		std::mutex tsema_mutex;
 		std::vector<TimelineSemaphore> tsemas;
-		std::mutex as_mutex;
 		std::vector<VkAccelerationStructureKHR> ass;
-		std::mutex swapchain_mutex;
 		std::vector<VkSwapchainKHR> swapchains;
-		std::mutex pipelines_mutex;
 		std::vector<GraphicsPipelineInfo> graphics_pipes;
 		std::vector<ComputePipelineInfo> compute_pipes;
 		std::vector<RayTracingPipelineInfo> ray_tracing_pipes;
-		std::mutex render_passes_mutex;
 		std::vector<VkRenderPass> render_passes;
 
+		std::mutex ds_mutex;
+		std::atomic<VkDescriptorPool*> last_ds_pool;
+		plf::colony<VkDescriptorPool> ds_pools;
+
+		std::vector<TimestampQueryPool> ts_query_pools;
+		std::mutex query_pool_mutex;
+		std::mutex ts_query_mutex;
+		uint64_t query_index = 0;
+		uint64_t current_ts_pool = 0;
+		std::mutex submission_mutex;
+		std::vector<std::pair<VkSemaphore, uint64_t>> submission_values; // highest value per queue timeline
+
 		BufferLinearAllocator linear_cpu_only;
 		BufferLinearAllocator linear_cpu_gpu;
 		BufferLinearAllocator linear_gpu_cpu;
@@ -175,6 +201,34 @@ namespace vuk {
 		    linear_cpu_gpu(upstream, vuk::MemoryUsage::eCPUtoGPU, all_buffer_usage_flags),
 		    linear_gpu_cpu(upstream, vuk::MemoryUsage::eGPUtoCPU, all_buffer_usage_flags),
 		    linear_gpu_only(upstream, vuk::MemoryUsage::eGPUonly, all_buffer_usage_flags) {}
+
+		// not thread safe with respect to recording - the frame must not be recorded into while it is waited for or recycled
+		void merge_thread_lists() {
+			auto merge = [](auto& dst, auto& src) {
+				dst.insert(dst.end(), src.begin(), src.end());
+				src.clear();
+			};
+			for (auto l = thread_lists.first(); l != nullptr; l = l->next) {
+				merge(semaphores, l->semaphores);
+				merge(fences, l->fences);
+				merge(cmdbuffers_to_free, l->cmdbuffers_to_free);
+				merge(cmdpools_to_free, l->cmdpools_to_free);
+				merge(framebuffers, l->framebuffers);
+				merge(images, l->images);
+				merge(image_views, l->image_views);
+				merge(persistent_descriptor_sets, l->persistent_descriptor_sets);
+				merge(descriptor_sets, l->descriptor_sets);
+				merge(ds_pools_to_destroy, l->ds_pools_to_destroy);
+				merge(buffer_gpus, l->buffer_gpus);
+				merge(tsemas, l->tsemas);
+				merge(ass, l->ass);
+				merge(swapchains, l->swapchains);
+				merge(graphics_pipes, l->graphics_pipes);
+				merge(compute_pipes, l->compute_pipes);
+				merge(ray_tracing_pipes, l->ray_tracing_pipes);
+				merge(render_passes, l->render_passes);
+			}
+		}
 	};
 
 	DeviceFrameResource::DeviceFrameResource(VkDevice device, DeviceSuperFrameResource& pstream) :
@@ -184,8 +238,7 @@ namespace vuk {
 
 	Result<void, AllocateException> DeviceFrameResource::allocate_semaphores(std::span<VkSemaphore> dst, SourceLocationAtFrame loc) {
 		VUK_DO_OR_RETURN(upstream->allocate_semaphores(dst, loc));
-		std::unique_lock _(impl->sema_mutex);
-		auto& vec = impl->semaphores;
+		auto& vec = impl->thread_lists.get().semaphores;
 		vec.insert(vec.end(), dst.begin(), dst.end());
 		return { expected_value };
 	}
@@ -194,8 +247,7 @@ namespace vuk {
 
 	Result<void, AllocateException> DeviceFrameResource::allocate_fences(std::span<VkFence> dst, SourceLocationAtFrame loc) {
 		VUK_DO_OR_RETURN(upstream->allocate_fences(dst, loc));
-		std::unique_lock _(impl->fence_mutex);
-		auto& vec = impl->fences;
+		auto& vec = impl->thread_lists.get().fences;
 		vec.insert(vec.end(), dst.begin(), dst.end());
 		return { expected_value };
 	}
@@ -206,8 +258,7 @@ namespace vuk {
 	                                                                              std::span<const CommandBufferAllocationCreateInfo> cis,
 	                                                                              SourceLocationAtFrame loc) {
 		VUK_DO_OR_RETURN(upstream->allocate_command_buffers(dst, cis, loc));
-		std::unique_lock _(impl->cbuf_mutex);
-		auto& vec = impl->cmdbuffers_to_free;
+		auto& vec = impl->thread_lists.get().cmdbuffers_to_free;
 		vec.insert(vec.end(), dst.begin(), dst.end());
 		return { expected_value };
 	}
@@ -217,8 +268,7 @@ namespace vuk {
 	Result<void, AllocateException>
 	DeviceFrameResource::allocate_command_pools(std::span<CommandPool> dst, std::span<const VkCommandPoolCreateInfo> cis, SourceLocationAtFrame loc) {
 		VUK_DO_OR_RETURN(upstream->allocate_command_pools(dst, cis, loc));
-		std::unique_lock _(impl->cbuf_mutex);
-		auto& vec = impl->cmdpools_to_free;
+		auto& vec = impl->thread_lists.get().cmdpools_to_free;
 		vec.insert(vec.end(), dst.begin(), dst.end());
 		return { expected_value };
 	}
@@ -248,6 +298,9 @@ namespace vuk {
 			}
 			dst[i] = result.value();
 		}
+		if (static_cast<DeviceSuperFrameResource*>(upstream)->impl->track_frame_allocations.load(std::memory_order_relaxed)) {
+			track_buffers(dst, cis, loc);
+		}
 		return { expected_value };
 	}
 
@@ -256,8 +309,7 @@ namespace vuk {
 	Result<void, AllocateException>
 	DeviceFrameResource::allocate_framebuffers(std::span<VkFramebuffer> dst, std::span<const FramebufferCreateInfo> cis, SourceLocationAtFrame loc) {
 		VUK_DO_OR_RETURN(upstream->allocate_framebuffers(dst, cis, loc));
-		std::unique_lock _(impl->framebuffer_mutex);
-		auto& vec = impl->framebuffers;
+		auto& vec = impl->thread_lists.get().framebuffers;
 		vec.insert(vec.end(), dst.begin(), dst.end());
 		return { expected_value };
 	}
@@ -265,7 +317,11 @@ namespace vuk {
 	void DeviceFrameResource::deallocate_framebuffers(std::span<const VkFramebuffer> src) {} // noop
 
 	Result<void, AllocateException> DeviceFrameResource::allocate_images(std::span<Image> dst, std::span<const ImageCreateInfo> cis, SourceLocationAtFrame loc) {
-		VUK_DO_OR_RETURN(static_cast<DeviceSuperFrameResource*>(upstream)->allocate_cached_images(dst, cis, loc));
+		auto sfr = static_cast<DeviceSuperFrameResource*>(upstream);
+		VUK_DO_OR_RETURN(sfr->allocate_cached_images(dst, cis, loc));
+		if (sfr->impl->track_frame_allocations.load(std::memory_order_relaxed)) {
+			track_images(dst, loc);
+		}
 		return { expected_value };
 	}
 
@@ -283,9 +339,7 @@ namespace vuk {
 	                                                                                         std::span<const PersistentDescriptorSetCreateInfo> cis,
 	                                                                                         SourceLocationAtFrame loc) {
 		VUK_DO_OR_RETURN(upstream->allocate_persistent_descriptor_sets(dst, cis, loc));
-		std::unique_lock _(impl->pds_mutex);
-
-		auto& vec = impl->persistent_descriptor_sets;
+		auto& vec = impl->thread_lists.get().persistent_descriptor_sets;
 		vec.insert(vec.end(), dst.begin(), dst.end());
 		return { expected_value };
 	}
@@ -296,9 +350,7 @@ namespace vuk {
 	DeviceFrameResource::allocate_descriptor_sets_with_value(std::span<DescriptorSet> dst, std::span<const SetBinding> cis, SourceLocationAtFrame loc) {
 		VUK_DO_OR_RETURN(upstream->allocate_descriptor_sets_with_value(dst, cis, loc));
 
-		std::unique_lock _(impl->ds_mutex);
-
-		auto& vec = impl->descriptor_sets;
+		auto& vec = impl->thread_lists.get().descriptor_sets;
 		vec.insert(vec.end(), dst.begin(), dst.end());
 		return { expected_value };
 	}
@@ -414,9 +466,7 @@ namespace vuk {
 
 	Result<void, AllocateException> DeviceFrameResource::allocate_timeline_semaphores(std::span<TimelineSemaphore> dst, SourceLocationAtFrame loc) {
 		VUK_DO_OR_RETURN(upstream->allocate_timeline_semaphores(dst, loc));
-		std::unique_lock _(impl->tsema_mutex);
-
-		auto& vec = impl->tsemas;
+		auto& vec = impl->thread_lists.get().tsemas;
 		vec.insert(vec.end(), dst.begin(), dst.end());
 		return { expected_value };
 	}
@@ -424,9 +474,7 @@ namespace vuk {
 	void DeviceFrameResource::deallocate_timeline_semaphores(std::span<const TimelineSemaphore> src) {} // noop
 
 	void DeviceFrameResource::deallocate_swapchains(std::span<const VkSwapchainKHR> src) {
-		std::scoped_lock _(impl->swapchain_mutex);
-
-		auto& vec = impl->swapchains;
+		auto& vec = impl->thread_lists.get().swapchains;
 		vec.insert(vec.end(), src.begin(), src.end());
 	}
 
@@ -491,33 +539,82 @@ namespace vuk {
 
 	void DeviceFrameResource::deallocate_render_passes(std::span<const VkRenderPass> src) {}
 
-	void DeviceFrameResource::wait() {
+	void DeviceFrameResource::add_submission(VkSemaphore timeline_semaphore, uint64_t value) {
+		std::unique_lock _(impl->submission_mutex);
+		for (auto& [sema, max_value] : impl->submission_values) {
+			if (sema == timeline_semaphore) {
+				max_value = std::max(max_value, value);
+				return;
+			}
+		}
+		impl->submission_values.emplace_back(timeline_semaphore, value);
+	}
+
+	Result<void> DeviceFrameResource::wait() {
+		impl->merge_thread_lists();
+		// submissions of this frame might still be pending
+		// if they can't be issued, their values are signalled without work, but the work submitted before them must still be waited on
+		auto flushed = impl->ctx->flush_submissions();
+		VkResult wait_result = VK_SUCCESS;
+		auto wait_start = std::chrono::steady_clock::now();
 		if (impl->fences.size() > 0) {
 			if (impl->fences.size() > 64) {
 				int i = 0;
 				for (; i < impl->fences.size() - 64; i += 64) {
-					impl->ctx->vkWaitForFences(device, 64, impl->fences.data() + i, true, UINT64_MAX);
+					if (auto result = impl->ctx->vkWaitForFences(device, 64, impl->fences.data() + i, true, UINT64_MAX); result != VK_SUCCESS) {
+						wait_result = result;
+					}
+				}
+				if (auto result = impl->ctx->vkWaitForFences(device, (uint32_t)impl->fences.size() - i, impl->fences.data() + i, true, UINT64_MAX); result != VK_SUCCESS) {
+					wait_result = result;
 				}
-				impl->ctx->vkWaitForFences(device, (uint32_t)impl->fences.size() - i, impl->fences.data() + i, true, UINT64_MAX);
 			} else {
-				impl->ctx->vkWaitForFences(device, (uint32_t)impl->fences.size(), impl->fences.data(), true, UINT64_MAX);
+				if (auto result = impl->ctx->vkWaitForFences(device, (uint32_t)impl->fences.size(), impl->fences.data(), true, UINT64_MAX); result != VK_SUCCESS) {
+					wait_result = result;
+				}
 			}
 		}
-		if (impl->tsemas.size() > 0) {
+		// the queue timelines and the timeline semaphores of this frame are waited on together
+		if (impl->tsemas.size() > 0 || impl->submission_values.size() > 0) {
 			VkSemaphoreWaitInfo swi{ VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO };
 
-			std::vector<VkSemaphore> semas(impl->tsemas.size());
-			std::vector<uint64_t> values(impl->tsemas.size());
+			std::vector<VkSemaphore> semas;
+			std::vector<uint64_t> values;
+			semas.reserve(impl->tsemas.size() + impl->submission_values.size());
+			values.reserve(impl->tsemas.size() + impl->submission_values.size());
 
+			for (auto& [sema, value] : impl->submission_values) {
+				semas.push_back(sema);
+				values.push_back(value);
+			}
 			for (uint64_t i = 0; i < impl->tsemas.size(); i++) {
-				semas[i] = impl->tsemas[i].semaphore;
-				values[i] = *impl->tsemas[i].value;
+				semas.push_back(impl->tsemas[i].semaphore);
+				values.push_back(*impl->tsemas[i].value);
 			}
 			swi.pSemaphores = semas.data();
 			swi.pValues = values.data();
-			swi.semaphoreCount = (uint32_t)impl->tsemas.size();
-			impl->ctx->vkWaitSemaphores(device, &swi, UINT64_MAX);
+			swi.semaphoreCount = (uint32_t)semas.size();
+			if (auto result = impl->ctx->vkWaitSemaphores(device, &swi, UINT64_MAX); result != VK_SUCCESS) {
+				wait_result = result;
+			}
+		}
+		impl->ctx->record_host_wait(std::chrono::steady_clock::now() - wait_start);
+		if (!flushed) {
+			return flushed;
 		}
+		if (wait_result != VK_SUCCESS) {
+			return { expected_error, VkException{ wait_result } };
+		}
+		return { expected_value };
+	}
+
+	std::vector<LinearAllocationStats> DeviceFrameResource::get_linear_allocation_stats() {
+		std::vector<LinearAllocationStats> stats;
+		impl->linear_cpu_only.collect_thread_stats(stats);
+		impl->linear_cpu_gpu.collect_thread_stats(stats);
+		impl->linear_gpu_cpu.collect_thread_stats(stats);
+		impl->linear_gpu_only.collect_thread_stats(stats);
+		return stats;
 	}
 
 	DeviceMultiFrameResource::DeviceMultiFrameResource(VkDevice device, DeviceSuperFrameResource& upstream, uint32_t frame_lifetime) :
@@ -528,7 +625,11 @@ namespace vuk {
 
 	Result<void, AllocateException>
 	DeviceMultiFrameResource::allocate_images(std::span<Image> dst, std::span<const ImageCreateInfo> cis, SourceLocationAtFrame loc) {
-		VUK_DO_OR_RETURN(static_cast<DeviceSuperFrameResource*>(upstream)->allocate_cached_images(dst, cis, loc));
+		auto sfr = static_cast<DeviceSuperFrameResource*>(upstream);
+		VUK_DO_OR_RETURN(sfr->allocate_cached_images(dst, cis, loc));
+		if (sfr->impl->track_frame_allocations.load(std::memory_order_relaxed)) {
+			track_images(dst, loc);
+		}
 		return { expected_value };
 	}
 
@@ -547,24 +648,21 @@ namespace vuk {
 	void DeviceSuperFrameResource::deallocate_semaphores(std::span<const VkSemaphore> src) {
 		std::shared_lock _s(impl->new_frame_mutex);
 		auto& f = get_last_frame();
-		std::unique_lock _(f.impl->sema_mutex);
-		auto& vec = get_last_frame().impl->semaphores;
+		auto& vec = f.impl->thread_lists.get().semaphores;
 		vec.insert(vec.end(), src.begin(), src.end());
 	}
 
 	void DeviceSuperFrameResource::deallocate_fences(std::span<const VkFence> src) {
 		std::shared_lock _s(impl->new_frame_mutex);
 		auto& f = get_last_frame();
-		std::unique_lock _(f.impl->fence_mutex);
-		auto& vec = f.impl->fences;
+		auto& vec = f.impl->thread_lists.get().fences;
 		vec.insert(vec.end(), src.begin(), src.end());
 	}
 
 	void DeviceSuperFrameResource::deallocate_command_buffers(std::span<const CommandBufferAllocation> src) {
 		std::shared_lock _s(impl->new_frame_mutex);
 		auto& f = get_last_frame();
-		std::unique_lock _(f.impl->cbuf_mutex);
-		auto& vec = f.impl->cmdbuffers_to_free;
+		auto& vec = f.impl->thread_lists.get().cmdbuffers_to_free;
 		vec.insert(vec.end(), src.begin(), src.end());
 	}
 
@@ -595,24 +693,21 @@ namespace vuk {
 	void DeviceSuperFrameResource::deallocate_buffers(std::span<const Buffer> src) {
 		std::shared_lock _s(impl->new_frame_mutex);
 		auto& f = get_last_frame();
-		std::unique_lock _(f.impl->buffers_mutex);
-		auto& vec = f.impl->buffer_gpus;
+		auto& vec = f.impl->thread_lists.get().buffer_gpus;
 		vec.insert(vec.end(), src.begin(), src.end());
 	}
 
 	void DeviceSuperFrameResource::deallocate_framebuffers(std::span<const VkFramebuffer> src) {
 		std::shared_lock _s(impl->new_frame_mutex);
 		auto& f = get_last_frame();
-		std::unique_lock _(f.impl->framebuffer_mutex);
-		auto& vec = f.impl->framebuffers;
+		auto& vec = f.impl->thread_lists.get().framebuffers;
 		vec.insert(vec.end(), src.begin(), src.end());
 	}
 
 	void DeviceSuperFrameResource::deallocate_images(std::span<const Image> src) {
 		std::shared_lock _s(impl->new_frame_mutex);
 		auto& f = get_last_frame();
-		std::unique_lock _(f.impl->images_mutex);
-		auto& vec = f.impl->images;
+		auto& vec = f.impl->thread_lists.get().images;
 		vec.insert(vec.end(), src.begin(), src.end());
 	}
 
@@ -654,30 +749,28 @@ namespace vuk {
 			}
 			dst[i] = *res;
 		}
+		track_buffers(dst, cis, loc);
 		return { expected_value };
 	}
 
 	void DeviceSuperFrameResource::deallocate_image_views(std::span<const ImageView> src) {
 		std::shared_lock _s(impl->new_frame_mutex);
 		auto& f = get_last_frame();
-		std::unique_lock _(f.impl->image_views_mutex);
-		auto& vec = f.impl->image_views;
+		auto& vec = f.impl->thread_lists.get().image_views;
 		vec.insert(vec.end(), src.begin(), src.end());
 	}
 
 	void DeviceSuperFrameResource::deallocate_persistent_descriptor_sets(std::span<const PersistentDescriptorSet> src) {
 		std::shared_lock _s(impl->new_frame_mutex);
 		auto& f = get_last_frame();
-		std::unique_lock _(f.impl->pds_mutex);
-		auto& vec = f.impl->persistent_descriptor_sets;
+		auto& vec = f.impl->thread_lists.get().persistent_descriptor_sets;
 		vec.insert(vec.end(), src.begin(), src.end());
 	}
 
 	void DeviceSuperFrameResource::deallocate_descriptor_sets(std::span<const DescriptorSet> src) {
 		std::shared_lock _s(impl->new_frame_mutex);
 		auto& f = get_last_frame();
-		std::unique_lock _(f.impl->ds_mutex);
-		auto& vec = f.impl->descriptor_sets;
+		auto& vec = f.impl->thread_lists.get().descriptor_sets;
 		vec.insert(vec.end(), src.begin(), src.end());
 	}
 
@@ -702,8 +795,7 @@ namespace vuk {
 	void DeviceSuperFrameResource::deallocate_descriptor_pools(std::span<const VkDescriptorPool> src) {
 		std::shared_lock _s(impl->new_frame_mutex);
 		auto& f = get_last_frame();
-		std::unique_lock _(f.impl->ds_mutex);
-		auto& vec = f.impl->ds_pools_to_destroy;
+		auto& vec = f.impl->thread_lists.get().ds_pools_to_destroy;
 		vec.insert(vec.end(), src.begin(), src.end());
 	}
 
@@ -720,24 +812,21 @@ namespace vuk {
 	void DeviceSuperFrameResource::deallocate_timeline_semaphores(std::span<const TimelineSemaphore> src) {
 		std::shared_lock _s(impl->new_frame_mutex);
 		auto& f = get_last_frame();
-		std::unique_lock _(f.impl->tsema_mutex);
-		auto& vec = f.impl->tsemas;
+		auto& vec = f.impl->thread_lists.get().tsemas;
 		vec.insert(vec.end(), src.begin(), src.end());
 	}
 
 	void DeviceSuperFrameResource::deallocate_acceleration_structures(std::span<const VkAccelerationStructureKHR> src) {
 		std::shared_lock _s(impl->new_frame_mutex);
 		auto& f = get_last_frame();
-		std::unique_lock _(f.impl->as_mutex);
-		auto& vec = f.impl->ass;
+		auto& vec = f.impl->thread_lists.get().ass;
 		vec.insert(vec.end(), src.begin(), src.end());
 	}
 
 	void DeviceSuperFrameResource::deallocate_swapchains(std::span<const VkSwapchainKHR> src) {
 		std::shared_lock _s(impl->new_frame_mutex);
 		auto& f = get_last_frame();
-		std::unique_lock _(f.impl->swapchain_mutex);
-		auto& vec = f.impl->swapchains;
+		auto& vec = f.impl->thread_lists.get().swapchains;
 		vec.insert(vec.end(), src.begin(), src.end());
 	}
 
@@ -745,35 +834,36 @@ namespace vuk {
 	void DeviceSuperFrameResource::deallocate_graphics_pipelines(std::span<const GraphicsPipelineInfo> src) {
 		std::shared_lock _s(impl->new_frame_mutex);
 		auto& f = get_last_frame();
-		std::unique_lock _(f.impl->pipelines_mutex);
-		auto& vec = f.impl->graphics_pipes;
+		auto& vec = f.impl->thread_lists.get().graphics_pipes;
 		vec.insert(vec.end(), src.begin(), src.end());
 	}
 	
 	void DeviceSuperFrameResource::deallocate_compute_pipelines(std::span<const ComputePipelineInfo> src) {
 		std::shared_lock _s(impl->new_frame_mutex);
 		auto& f = get_last_frame();
-		std::unique_lock _(f.impl->pipelines_mutex);
-		auto& vec = f.impl->compute_pipes;
+		auto& vec = f.impl->thread_lists.get().compute_pipes;
 		vec.insert(vec.end(), src.begin(), src.end());
 	}
 
 	void DeviceSuperFrameResource::deallocate_ray_tracing_pipelines(std::span<const RayTracingPipelineInfo> src) {
 		std::shared_lock _s(impl->new_frame_mutex);
 		auto& f = get_last_frame();
-		std::unique_lock _(f.impl->pipelines_mutex);
-		auto& vec = f.impl->ray_tracing_pipes;
+		auto& vec = f.impl->thread_lists.get().ray_tracing_pipes;
 		vec.insert(vec.end(), src.begin(), src.end());
 	}
 
 	void DeviceSuperFrameResource::deallocate_render_passes(std::span<const VkRenderPass> src) {
 		std::shared_lock _s(impl->new_frame_mutex);
 		auto& f = get_last_frame();
-		std::unique_lock _(f.impl->render_passes_mutex);
-		auto& vec = f.impl->render_passes;
+		auto& vec = f.impl->thread_lists.get().render_passes;
 		vec.insert(vec.end(), src.begin(), src.end());
 	}
 
+	void DeviceSuperFrameResource::add_submission(VkSemaphore timeline_semaphore, uint64_t value) {
+		std::shared_lock _s(impl->new_frame_mutex);
+		get_last_frame().add_submission(timeline_semaphore, value);
+	}
+
 	DeviceFrameResource& DeviceSuperFrameResource::get_last_frame() {
 		return impl->frames[impl->frame_counter.load() % frames_in_flight];
 	}
@@ -795,10 +885,12 @@ namespace vuk {
 
 		impl->frame_counter++;
 		impl->local_frame = impl->frame_counter % frames_in_flight;
+		telemetry->next_frame();
 
 		// handle FrameResource
 		auto& f = impl->frames[impl->local_frame];
-		f.wait();
+		// the frames are recycled even if a wait fails, the error of the last failed wait is raised after
+		auto waited = f.wait();
 		deallocate_frame(f);
 		f.construction_frame = impl->frame_counter.load();
 
@@ -807,7 +899,9 @@ namespace vuk {
 			auto& multi_frame = *it;
 			multi_frame.remaining_lifetime--;
 			if (multi_frame.remaining_lifetime == 0) {
-				multi_frame.wait();
+				if (auto result = multi_frame.wait(); !result) {
+					waited = std::move(result);
+				}
 				deallocate_frame(multi_frame);
 				it = impl->multi_frames.erase(it);
 			} else {
@@ -825,6 +919,9 @@ namespace vuk {
 		impl->ray_tracing_pipeline_cache.collect(impl->frame_counter, 16);
 		impl->render_pass_cache.collect(impl->frame_counter, 16);
 
+		if (!waited) {
+			waited.error().throw_this();
+		}
 		return f;
 	}
 
@@ -838,6 +935,12 @@ namespace vuk {
 	template<class T>
 	void DeviceSuperFrameResource::deallocate_frame(T& frame) {
 		auto& f = *frame.impl;
+		f.merge_thread_lists();
+		// everything allocated from the frame is released with it, while buffers and images deallocated into it were ours
+		frame.untrack_all();
+		frame.telemetry->next_frame();
+		untrack_buffers(f.buffer_gpus);
+		untrack_images(f.images);
 		upstream->deallocate_semaphores(f.semaphores);
 		upstream->deallocate_fences(f.fences);
 		upstream->deallocate_command_buffers(f.cmdbuffers_to_free);
@@ -873,6 +976,7 @@ namespace vuk {
 
 		f.semaphores.clear();
 		f.fences.clear();
+		f.submission_values.clear();
 		f.buffer_gpus.clear();
 		f.cmdbuffers_to_free.clear();
 		f.cmdpools_to_free.clear();
@@ -910,6 +1014,14 @@ namespace vuk {
 		impl->render_pass_cache.collect(impl->frame_counter, 0);
 	}
 
+	void DeviceSuperFrameResource::set_frame_allocation_tracking(bool enabled) {
+		impl->track_frame_allocations.store(enabled, std::memory_order_relaxed);
+	}
+
+	BufferFragmentationReport DeviceSuperFrameResource::get_buffer_fragmentation_report(MemoryUsage mem_usage) {
+		return impl->suballocators[(int)mem_usage - 1].get_fragmentation_report();
+	}
+
 	DeviceSuperFrameResource::~DeviceSuperFrameResource() {
 		impl->image_cache.clear();
 		impl->image_view_cache.clear();
@@ -921,7 +1033,10 @@ namespace vuk {
 		for (auto i = 0; i < frames_in_flight; i++) {
 			auto lframe = (impl->frame_counter + i) % frames_in_flight;
 			auto& f = impl->frames[lframe];
-			f.wait();
+			if (auto result = f.wait(); !result) {
+				// can't throw from here, the resources are freed regardless
+				fprintf(stderr, "vuk: waiting for frame failed: %s\n", result.error().what());
+			}
 			// free the resources manually, because we are destroying the individual FAs
 			f.impl->linear_cpu_gpu.free();
 			f.impl->linear_gpu_cpu.free();
@@ -5,7 +5,9 @@
 #include "vuk/Descriptor.hpp"
 #include "vuk/Query.hpp"
 
+#include <algorithm>
 #include <atomic>
+#include <chrono>
 #include <mutex>
 #include <numeric>
 #include <plf_colony.h>
@@ -30,6 +32,7 @@ namespace vuk {
 		uint64_t query_index = 0;
 		uint64_t current_ts_pool = 0;
 		std::vector<TimelineSemaphore> tsemas;
+		std::vector<std::pair<VkSemaphore, uint64_t>> submission_values; // highest value per queue timeline
 		std::vector<VkAccelerationStructureKHR> ass;
 
 		BufferLinearAllocator linear_cpu_only;
@@ -54,10 +57,10 @@ namespace vuk {
 		}
 	}
 
-	DeviceLinearResource::DeviceLinearResource(DeviceLinearResource&& o) : DeviceNestedResource(*o.upstream), impl(std::move(o.impl)) {}
+	DeviceLinearResource::DeviceLinearResource(DeviceLinearResource&& o) : DeviceNestedResource(std::move(o)), impl(std::move(o.impl)) {}
 
 	DeviceLinearResource& DeviceLinearResource::operator=(DeviceLinearResource&& o) {
-		upstream = o.upstream;
+		DeviceNestedResource::operator=(std::move(o));
 		impl = std::move(o.impl);
 		return *this;
 	}
@@ -124,6 +127,7 @@ namespace vuk {
 			}
 			dst[i] = result.value();
 		}
+		track_buffers(dst, cis, loc);
 		return { expected_value };
 	}
 
@@ -143,6 +147,7 @@ namespace vuk {
 		VUK_DO_OR_RETURN(upstream->allocate_images(dst, cis, loc));
 		auto& vec = impl->images;
 		vec.insert(vec.end(), dst.begin(), dst.end());
+		track_images(dst, loc);
 		return { expected_value };
 	}
 
@@ -286,37 +291,75 @@ namespace vuk {
 
 	void DeviceLinearResource::deallocate_timeline_semaphores(std::span<const TimelineSemaphore> src) {} // noop
 
-	void DeviceLinearResource::wait() {
+	void DeviceLinearResource::add_submission(VkSemaphore timeline_semaphore, uint64_t value) {
+		for (auto& [sema, max_value] : impl->submission_values) {
+			if (sema == timeline_semaphore) {
+				max_value = std::max(max_value, value);
+				return;
+			}
+		}
+		impl->submission_values.emplace_back(timeline_semaphore, value);
+	}
+
+	Result<void> DeviceLinearResource::wait() {
+		// submissions using this resource might still be pending
+		// if they can't be issued, their values are signalled without work, but the work submitted before them must still be waited on
+		auto flushed = impl->ctx->flush_submissions();
+		VkResult wait_result = VK_SUCCESS;
+		auto wait_start = std::chrono::steady_clock::now();
 		if (impl->fences.size() > 0) {
 			if (impl->fences.size() > 64) {
 				int i = 0;
 				for (; i < impl->fences.size() - 64; i += 64) {
-					impl->ctx->vkWaitForFences(impl->device, 64, impl->fences.data() + i, true, UINT64_MAX);
+					if (auto result = impl->ctx->vkWaitForFences(impl->device, 64, impl->fences.data() + i, true, UINT64_MAX); result != VK_SUCCESS) {
+						wait_result = result;
+					}
+				}
+				if (auto result = impl->ctx->vkWaitForFences(impl->device, (uint32_t)impl->fences.size() - i, impl->fences.data() + i, true, UINT64_MAX); result != VK_SUCCESS) {
+					wait_result = result;
 				}
-				impl->ctx->vkWaitForFences(impl->device, (uint32_t)impl->fences.size() - i, impl->fences.data() + i, true, UINT64_MAX);
 			} else {
-				impl->ctx->vkWaitForFences(impl->device, (uint32_t)impl->fences.size(), impl->fences.data(), true, UINT64_MAX);
+				if (auto result = impl->ctx->vkWaitForFences(impl->device, (uint32_t)impl->fences.size(), impl->fences.data(), true, UINT64_MAX); result != VK_SUCCESS) {
+					wait_result = result;
+				}
 			}
 		}
-		if (impl->tsemas.size() > 0) {
+		if (impl->tsemas.size() > 0 || impl->submission_values.size() > 0) {
 			VkSemaphoreWaitInfo swi{ VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO };
 
-			std::vector<VkSemaphore> semas(impl->tsemas.size());
-			std::vector<uint64_t> values(impl->tsemas.size());
+			std::vector<VkSemaphore> semas;
+			std::vector<uint64_t> values;
+			semas.reserve(impl->tsemas.size() + impl->submission_values.size());
+			values.reserve(impl->tsemas.size() + impl->submission_values.size());
 
+			for (auto& [sema, value] : impl->submission_values) {
+				semas.push_back(sema);
+				values.push_back(value);
+			}
 			for (uint64_t i = 0; i < impl->tsemas.size(); i++) {
-				semas[i] = impl->tsemas[i].semaphore;
-				values[i] = *impl->tsemas[i].value;
+				semas.push_back(impl->tsemas[i].semaphore);
+				values.push_back(*impl->tsemas[i].value);
 			}
 			swi.pSemaphores = semas.data();
 			swi.pValues = values.data();
-			swi.semaphoreCount = (uint32_t)impl->tsemas.size();
-			impl->ctx->vkWaitSemaphores(impl->device, &swi, UINT64_MAX);
+			swi.semaphoreCount = (uint32_t)semas.size();
+			if (auto result = impl->ctx->vkWaitSemaphores(impl->device, &swi, UINT64_MAX); result != VK_SUCCESS) {
+				wait_result = result;
+			}
+		}
+		impl->ctx->record_host_wait(std::chrono::steady_clock::now() - wait_start);
+		if (!flushed) {
+			return flushed;
 		}
+		if (wait_result != VK_SUCCESS) {
+			return { expected_error, VkException{ wait_result } };
+		}
+		return { expected_value };
 	}
 
 	void DeviceLinearResource::free() {
 		auto& f = *impl;
+		untrack_all();
 		upstream->deallocate_semaphores(f.semaphores);
 		upstream->deallocate_fences(f.fences);
 		upstream->deallocate_command_buffers(f.cmdbuffers_to_free);
@@ -1,5 +1,6 @@
 #include "vuk/resources/DeviceVkResource.hpp"
 #include "../src/RenderPass.hpp"
+#include "MemoryTelemetry.hpp"
 #include "vuk/Buffer.hpp"
 #include "vuk/Context.hpp"
 #include "vuk/Exception.hpp"
@@ -16,6 +17,8 @@
 		printf("\n");                                                                                                                                              \
 	} while (false)
 #endif
+#include <algorithm>
+#include <array>
 #include <mutex>
 #include <numeric>
 #include <sstream>
@@ -51,6 +54,58 @@ namespace vuk {
 		VkPhysicalDeviceProperties properties;
 		std::vector<uint32_t> all_queue_families;
 		uint32_t queue_family_count;
+		MemoryTelemetry telemetry;
+
+		struct EvictionCallbackEntry {
+			size_t id;
+			float threshold;
+			EvictionCallback callback;
+			std::array<bool, VK_MAX_MEMORY_HEAPS> above = {};
+		};
+
+		// budget state is guarded by mutex
+		VkPhysicalDeviceMemoryProperties memory_properties;
+		std::array<VmaBudget, VK_MAX_MEMORY_HEAPS> budgets = {};
+		// heap of the memory type VMA picks for each MemoryUsage
+		std::array<uint32_t, 4> heap_of_usage = {};
+		// memory types outside of the heap serving eGPUonly
+		uint32_t fallback_memory_types = 0;
+		bool memory_fallback = false;
+		std::vector<EvictionCallbackEntry> eviction_callbacks;
+		size_t next_eviction_callback_id = 0;
+		MemoryBudgetEvents budget_events;
+
+		bool may_fall_back(MemoryUsage mem_usage) const {
+			return memory_fallback && mem_usage == MemoryUsage::eGPUonly && fallback_memory_types != 0;
+		}
+
+		VmaAllocationCreateInfo fallback_create_info(VmaAllocationCreateFlags flags, VkMemoryPropertyFlags required_flags) const {
+			VmaAllocationCreateInfo aci{};
+			aci.flags = flags & ~VMA_ALLOCATION_CREATE_WITHIN_BUDGET_BIT;
+			aci.requiredFlags = required_flags;
+			aci.memoryTypeBits = fallback_memory_types;
+			return aci;
+		}
+
+		// MemoryUsage an allocation is accounted to, from the heap it was placed in - allocations that fell back leave the requested heap
+		MemoryUsage placed_memory_usage(uint32_t memory_type, MemoryUsage requested) const {
+			auto& type = memory_properties.memoryTypes[memory_type];
+			if (type.heapIndex == heap_of_usage[(int)requested - 1]) {
+				return requested;
+			}
+			if (type.heapIndex == heap_of_usage[(int)MemoryUsage::eGPUonly - 1]) {
+				return MemoryUsage::eGPUonly;
+			}
+			return (type.propertyFlags & VK_MEMORY_PROPERTY_HOST_CACHED_BIT) ? MemoryUsage::eGPUtoCPU : MemoryUsage::eCPUonly;
+		}
+
+		void record_allocation_result(VkResult res, bool fell_back) {
+			if (res == VK_ERROR_OUT_OF_DEVICE_MEMORY) {
+				budget_events.out_of_memory_failures++;
+			} else if (res == VK_SUCCESS && fell_back) {
+				budget_events.fallback_allocations++;
+			}
+		}
 	};
 
 	DeviceVkResource::DeviceVkResource(Context& ctx) : ctx(&ctx), impl(new DeviceVkResourceImpl), device(ctx.device) {
@@ -59,6 +114,10 @@ namespace vuk {
 		allocatorInfo.physicalDevice = ctx.physical_device;
 		allocatorInfo.device = device;
 		allocatorInfo.flags = VMA_ALLOCATOR_CREATE_EXTERNALLY_SYNCHRONIZED_BIT | VMA_ALLOCATOR_CREATE_BUFFER_DEVICE_ADDRESS_BIT;
+		// without the extension VMA estimates the budgets from the heap sizes
+		if (ctx.memory_budget_extension_enabled && ctx.vkGetPhysicalDeviceMemoryProperties2) {
+			allocatorInfo.flags |= VMA_ALLOCATOR_CREATE_EXT_MEMORY_BUDGET_BIT;
+		}
 
 		VmaVulkanFunctions vulkanFunctions = {};
 		vulkanFunctions.vkGetPhysicalDeviceProperties = ctx.vkGetPhysicalDeviceProperties;
@@ -78,21 +137,37 @@ namespace vuk {
 		vulkanFunctions.vkCreateImage = ctx.vkCreateImage;
 		vulkanFunctions.vkDestroyImage = ctx.vkDestroyImage;
 		vulkanFunctions.vkCmdCopyBuffer = ctx.vkCmdCopyBuffer;
+		vulkanFunctions.vkGetPhysicalDeviceMemoryProperties2KHR = ctx.vkGetPhysicalDeviceMemoryProperties2;
 		allocatorInfo.pVulkanFunctions = &vulkanFunctions;
 
 		vmaCreateAllocator(&allocatorInfo, &impl->allocator);
 		ctx.vkGetPhysicalDeviceProperties(ctx.physical_device, &impl->properties);
 
-		if (ctx.transfer_queue_family_index != ctx.graphics_queue_family_index && ctx.compute_queue_family_index != ctx.graphics_queue_family_index) {
-			impl->all_queue_families = { ctx.graphics_queue_family_index, ctx.compute_queue_family_index, ctx.transfer_queue_family_index };
-		} else if (ctx.transfer_queue_family_index != ctx.graphics_queue_family_index) {
-			impl->all_queue_families = { ctx.graphics_queue_family_index, ctx.transfer_queue_family_index };
-		} else if (ctx.compute_queue_family_index != ctx.graphics_queue_family_index) {
-			impl->all_queue_families = { ctx.graphics_queue_family_index, ctx.compute_queue_family_index };
-		} else {
-			impl->all_queue_families = { ctx.graphics_queue_family_index };
+		// several queues may come from the same family, but concurrent sharing requires unique family indices
+		impl->all_queue_families = { ctx.graphics_queue_family_index };
+		for (auto family : { ctx.compute_queue_family_index, ctx.transfer_queue_family_index }) {
+			if (std::find(impl->all_queue_families.begin(), impl->all_queue_families.end(), family) == impl->all_queue_families.end()) {
+				impl->all_queue_families.push_back(family);
+			}
 		}
 		impl->queue_family_count = (uint32_t)impl->all_queue_families.size();
+
+		ctx.vkGetPhysicalDeviceMemoryProperties(ctx.physical_device, &impl->memory_properties);
+		for (uint32_t i = 0; i < impl->heap_of_usage.size(); i++) {
+			VmaAllocationCreateInfo aci{};
+			aci.usage = VmaMemoryUsage(i + 1);
+			uint32_t memory_type_index;
+			if (vmaFindMemoryTypeIndex(impl->allocator, UINT32_MAX, &aci, &memory_type_index) == VK_SUCCESS) {
+				impl->heap_of_usage[i] = impl->memory_properties.memoryTypes[memory_type_index].heapIndex;
+			}
+		}
+		auto device_heap = impl->heap_of_usage[(int)MemoryUsage::eGPUonly - 1];
+		for (uint32_t i = 0; i < impl->memory_properties.memoryTypeCount; i++) {
+			if (impl->memory_properties.memoryTypes[i].heapIndex != device_heap) {
+				impl->fallback_memory_types |= 1u << i;
+			}
+		}
+		update_memory_budget();
 	}
 
 	DeviceVkResource::~DeviceVkResource() {
@@ -100,6 +175,96 @@ namespace vuk {
 		delete impl;
 	}
 
+	MemoryStats DeviceVkResource::get_memory_stats(size_t top_sites) {
+		return impl->telemetry.get_stats(top_sites);
+	}
+
+	std::pair<size_t, MemoryUsage> DeviceVkResource::get_image_memory(const Image& image) {
+		if (!image.allocation) {
+			return { 0, MemoryUsage::eGPUonly };
+		}
+		std::lock_guard _(impl->mutex);
+		VmaAllocationInfo allocation_info;
+		vmaGetAllocationInfo(impl->allocator, static_cast<VmaAllocation>(image.allocation), &allocation_info);
+		return { allocation_info.size, impl->placed_memory_usage(allocation_info.memoryType, MemoryUsage::eGPUonly) };
+	}
+
+	Result<void> DeviceVkResource::invalidate_mapped_buffer(const Buffer& buffer) {
+		std::lock_guard _(impl->mutex);
+		VkResult result = vmaInvalidateAllocation(impl->allocator, static_cast<VmaAllocation>(buffer.allocation), buffer.offset, buffer.size);
+		if (result != VK_SUCCESS) {
+			return { expected_error, VkException{ result } };
+		}
+		return { expected_value };
+	}
+
+	void DeviceVkResource::next_frame() {
+		impl->telemetry.next_frame();
+		update_memory_budget();
+	}
+
+	void DeviceVkResource::update_memory_budget() {
+		std::vector<std::pair<EvictionCallback, MemoryBudget>> triggered;
+		{
+			std::lock_guard _(impl->mutex);
+			vmaGetHeapBudgets(impl->allocator, impl->budgets.data());
+			impl->budget_events.budget_queries++;
+			for (auto& entry : impl->eviction_callbacks) {
+				for (uint32_t heap = 0; heap < impl->memory_properties.memoryHeapCount; heap++) {
+					auto& budget = impl->budgets[heap];
+					bool above = budget.budget > 0 && (double)budget.usage >= entry.threshold * (double)budget.budget;
+					// only report crossings, not every frame spent above the threshold
+					if (above && !entry.above[heap]) {
+						impl->budget_events.threshold_crossings++;
+						triggered.emplace_back(entry.callback,
+						                       MemoryBudget{ .heap_index = heap,
+						                                     .budget = budget.budget,
+						                                     .usage = budget.usage,
+						                                     .headroom = budget.usage < budget.budget ? budget.budget - budget.usage : 0 });
+					}
+					entry.above[heap] = above;
+				}
+			}
+			impl->budget_events.eviction_callbacks += triggered.size();
+		}
+		// invoked without holding the lock, so that callbacks can free memory
+		for (auto& [callback, budget] : triggered) {
+			callback(budget);
+		}
+	}
+
+	MemoryBudget DeviceVkResource::get_memory_budget(MemoryUsage mem_usage) {
+		std::lock_guard _(impl->mutex);
+		auto heap = impl->heap_of_usage[(int)mem_usage - 1];
+		auto& budget = impl->budgets[heap];
+		return MemoryBudget{
+			.heap_index = heap, .budget = budget.budget, .usage = budget.usage, .headroom = budget.usage < budget.budget ? budget.budget - budget.usage : 0
+		};
+	}
+
+	size_t DeviceVkResource::register_eviction_callback(float threshold, EvictionCallback callback) {
+		assert(threshold >= 0.f && threshold <= 1.f);
+		std::lock_guard _(impl->mutex);
+		auto id = impl->next_eviction_callback_id++;
+		impl->eviction_callbacks.push_back({ .id = id, .threshold = threshold, .callback = std::move(callback) });
+		return id;
+	}
+
+	void DeviceVkResource::unregister_eviction_callback(size_t id) {
+		std::lock_guard _(impl->mutex);
+		std::erase_if(impl->eviction_callbacks, [id](auto& entry) { return entry.id == id; });
+	}
+
+	void DeviceVkResource::set_memory_fallback(bool enabled) {
+		std::lock_guard _(impl->mutex);
+		impl->memory_fallback = enabled;
+	}
+
+	MemoryBudgetEvents DeviceVkResource::get_memory_budget_events() {
+		std::lock_guard _(impl->mutex);
+		return impl->budget_events;
+	}
+
 	Result<void, AllocateException> DeviceVkResource::allocate_semaphores(std::span<VkSemaphore> dst, SourceLocationAtFrame loc) {
 		VkSemaphoreCreateInfo sci{ .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO };
 		for (int64_t i = 0; i < (int64_t)dst.size(); i++) {
@@ -108,6 +273,7 @@ namespace vuk {
 				deallocate_semaphores({ dst.data(), (uint64_t)i });
 				return { expected_error, AllocateException{ res } };
 			}
+			impl->telemetry.on_allocate(TrackedResource::eSemaphore, MemoryTelemetry::key(dst[i]), 0, loc);
 		}
 		return { expected_value };
 	}
@@ -115,6 +281,7 @@ namespace vuk {
 	void DeviceVkResource::deallocate_semaphores(std::span<const VkSemaphore> src) {
 		for (auto& v : src) {
 			if (v != VK_NULL_HANDLE) {
+				impl->telemetry.on_deallocate(TrackedResource::eSemaphore, MemoryTelemetry::key(v));
 				ctx->vkDestroySemaphore(device, v, nullptr);
 			}
 		}
@@ -128,6 +295,7 @@ namespace vuk {
 				deallocate_fences({ dst.data(), (uint64_t)i });
 				return { expected_error, AllocateException{ res } };
 			}
+			impl->telemetry.on_allocate(TrackedResource::eFence, MemoryTelemetry::key(dst[i]), 0, loc);
 		}
 		return { expected_value };
 	}
@@ -135,6 +303,7 @@ namespace vuk {
 	void DeviceVkResource::deallocate_fences(std::span<const VkFence> src) {
 		for (auto& v : src) {
 			if (v != VK_NULL_HANDLE) {
+				impl->telemetry.on_deallocate(TrackedResource::eFence, MemoryTelemetry::key(v));
 				ctx->vkDestroyFence(device, v, nullptr);
 			}
 		}
@@ -179,6 +348,7 @@ namespace vuk {
 				deallocate_command_pools({ dst.data(), (uint64_t)i });
 				return { expected_error, AllocateException{ res } };
 			}
+			impl->telemetry.on_allocate(TrackedResource::eCommandPool, MemoryTelemetry::key(dst[i].command_pool), 0, loc);
 		}
 		return { expected_value };
 	}
@@ -186,6 +356,7 @@ namespace vuk {
 	void DeviceVkResource::deallocate_command_pools(std::span<const CommandPool> src) {
 		for (auto& v : src) {
 			if (v.command_pool != VK_NULL_HANDLE) {
+				impl->telemetry.on_deallocate(TrackedResource::eCommandPool, MemoryTelemetry::key(v.command_pool));
 				ctx->vkDestroyCommandPool(device, v.command_pool, nullptr);
 			}
 		}
@@ -200,6 +371,7 @@ namespace vuk {
 				deallocate_framebuffers({ dst.data(), (uint64_t)i });
 				return { expected_error, AllocateException{ res } };
 			}
+			impl->telemetry.on_allocate(TrackedResource::eFramebuffer, MemoryTelemetry::key(dst[i]), 0, loc);
 		}
 		return { expected_value };
 	}
@@ -207,6 +379,7 @@ namespace vuk {
 	void DeviceVkResource::deallocate_framebuffers(std::span<const VkFramebuffer> src) {
 		for (auto& v : src) {
 			if (v != VK_NULL_HANDLE) {
+				impl->telemetry.on_deallocate(TrackedResource::eFramebuffer, MemoryTelemetry::key(v));
 				ctx->vkDestroyFramebuffer(device, v, nullptr);
 			}
 		}
@@ -227,12 +400,23 @@ namespace vuk {
 			VmaAllocationCreateInfo aci = {};
 			aci.usage = VmaMemoryUsage(to_integral(ci.mem_usage));
 			aci.flags = VMA_ALLOCATION_CREATE_MAPPED_BIT;
+			bool may_fall_back = impl->may_fall_back(ci.mem_usage);
+			if (may_fall_back) {
+				aci.flags |= VMA_ALLOCATION_CREATE_WITHIN_BUDGET_BIT;
+			}
 
 			VkBuffer buffer;
 			VmaAllocation allocation;
 			VmaAllocationInfo allocation_info;
 			// ignore alignment: we get a fresh VkBuffer which satisfies all alignments inside the VkBfufer
 			auto res = vmaCreateBuffer(impl->allocator, &bci, &aci, &buffer, &allocation, &allocation_info);
+			bool fell_back = false;
+			if (res == VK_ERROR_OUT_OF_DEVICE_MEMORY && may_fall_back) {
+				auto fallback_aci = impl->fallback_create_info(aci.flags, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT);
+				res = vmaCreateBuffer(impl->allocator, &bci, &fallback_aci, &buffer, &allocation, &allocation_info);
+				fell_back = true;
+			}
+			impl->record_allocation_result(res, fell_back);
 			if (res != VK_SUCCESS) {
 				deallocate_buffers({ dst.data(), (uint64_t)i });
 				return { expected_error, AllocateException{ res } };
@@ -243,6 +427,8 @@ namespace vuk {
 			VkBufferDeviceAddressInfo bdai{ VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO, nullptr, buffer };
 			uint64_t device_address = ctx->vkGetBufferDeviceAddress(device, &bdai);
 			dst[i] = Buffer{ allocation, buffer, 0, ci.size, device_address, static_cast<std::byte*>(allocation_info.pMappedData), ci.mem_usage };
+			impl->telemetry.on_allocate(
+			    TrackedResource::eBuffer, MemoryTelemetry::key(buffer), allocation_info.size, loc, impl->placed_memory_usage(allocation_info.memoryType, ci.mem_usage));
 		}
 		return { expected_value };
 	}
@@ -250,6 +436,7 @@ namespace vuk {
 	void DeviceVkResource::deallocate_buffers(std::span<const Buffer> src) {
 		for (auto& v : src) {
 			if (v) {
+				impl->telemetry.on_deallocate(TrackedResource::eBuffer, MemoryTelemetry::key(v.buffer));
 				vmaDestroyBuffer(impl->allocator, v.buffer, static_cast<VmaAllocation>(v.allocation));
 			}
 		}
@@ -265,12 +452,35 @@ namespace vuk {
 			VkImage vkimg;
 			VmaAllocation allocation;
 			VkImageCreateInfo vkici = cis[i];
+			if (vkici.sharingMode == VK_SHARING_MODE_CONCURRENT && vkici.queueFamilyIndexCount == 0) {
+				// concurrent sharing needs at least two distinct families, otherwise there are no ownership transfers to avoid
+				if (impl->queue_family_count > 1) {
+					vkici.queueFamilyIndexCount = impl->queue_family_count;
+					vkici.pQueueFamilyIndices = impl->all_queue_families.data();
+				} else {
+					vkici.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+				}
+			}
 			if (cis[i].usage & (vuk::ImageUsageFlagBits::eColorAttachment | vuk::ImageUsageFlagBits::eDepthStencilAttachment)) {
 				// this is a rendertarget, put it into the dedicated memory
 				aci.flags = VMA_ALLOCATION_CREATE_DEDICATED_MEMORY_BIT;
 			}
 
-			auto res = vmaCreateImage(impl->allocator, &vkici, &aci, &vkimg, &allocation, nullptr);
+			bool may_fall_back = impl->may_fall_back(MemoryUsage::eGPUonly);
+			if (may_fall_back) {
+				aci.flags |= VMA_ALLOCATION_CREATE_WITHIN_BUDGET_BIT;
+			}
+
+			VmaAllocationInfo allocation_info;
+			auto res = vmaCreateImage(impl->allocator, &vkici, &aci, &vkimg, &allocation, &allocation_info);
+			bool fell_back = false;
+			if (res == VK_ERROR_OUT_OF_DEVICE_MEMORY && may_fall_back) {
+				// host-visible memory might not support optimally tiled images, take any memory outside of the device local heap
+				auto fallback_aci = impl->fallback_create_info(aci.flags, 0);
+				res = vmaCreateImage(impl->allocator, &vkici, &fallback_aci, &vkimg, &allocation, &allocation_info);
+				fell_back = true;
+			}
+			impl->record_allocation_result(res, fell_back);
 
 			if (res != VK_SUCCESS) {
 				deallocate_images({ dst.data(), (uint64_t)i });
@@ -281,6 +491,11 @@ namespace vuk {
 #endif
 
 			dst[i] = Image{ vkimg, allocation };
+			impl->telemetry.on_allocate(TrackedResource::eImage,
+			                            MemoryTelemetry::key(vkimg),
+			                            allocation_info.size,
+			                            loc,
+			                            impl->placed_memory_usage(allocation_info.memoryType, MemoryUsage::eGPUonly));
 		}
 		return { expected_value };
 	}
@@ -288,6 +503,7 @@ namespace vuk {
 	void DeviceVkResource::deallocate_images(std::span<const Image> src) {
 		for (auto& v : src) {
 			if (v) {
+				impl->telemetry.on_deallocate(TrackedResource::eImage, MemoryTelemetry::key(v.image));
 				vmaDestroyImage(impl->allocator, v.image, static_cast<VmaAllocation>(v.allocation));
 			}
 		}
@@ -312,6 +528,7 @@ namespace vuk {
 				return { expected_error, AllocateException{ res } };
 			}
 			dst[i] = ctx->wrap(iv);
+			impl->telemetry.on_allocate(TrackedResource::eImageView, MemoryTelemetry::key(iv), 0, loc);
 		}
 		return { expected_value };
 	}
@@ -383,6 +600,7 @@ namespace vuk {
 			}
 			tda.set_layout_create_info = ci.dslci;
 			tda.set_layout = dsl;
+			impl->telemetry.on_allocate(TrackedResource::eDescriptorPool, MemoryTelemetry::key(tda.backing_pool), 0, loc);
 		}
 
 		return { expected_value };
@@ -390,6 +608,7 @@ namespace vuk {
 
 	void DeviceVkResource::deallocate_persistent_descriptor_sets(std::span<const PersistentDescriptorSet> src) {
 		for (auto& v : src) {
+			impl->telemetry.on_deallocate(TrackedResource::eDescriptorPool, MemoryTelemetry::key(v.backing_pool));
 			ctx->vkDestroyDescriptorPool(ctx->device, v.backing_pool, nullptr);
 		}
 	}
@@ -475,12 +694,14 @@ namespace vuk {
 				deallocate_descriptor_pools({ dst.data(), (uint64_t)i });
 				return { expected_error, AllocateException{ res } };
 			}
+			impl->telemetry.on_allocate(TrackedResource::eDescriptorPool, MemoryTelemetry::key(dst[i]), 0, loc);
 		}
 		return { expected_value };
 	}
 
 	void DeviceVkResource::deallocate_descriptor_pools(std::span<const VkDescriptorPool> src) {
 		for (int64_t i = 0; i < (int64_t)src.size(); i++) {
+			impl->telemetry.on_deallocate(TrackedResource::eDescriptorPool, MemoryTelemetry::key(src[i]));
 			ctx->vkDestroyDescriptorPool(device, src[i], nullptr);
 		}
 	}
@@ -488,6 +709,7 @@ namespace vuk {
 	void DeviceVkResource::deallocate_image_views(std::span<const ImageView> src) {
 		for (auto& v : src) {
 			if (v.payload != VK_NULL_HANDLE) {
+				impl->telemetry.on_deallocate(TrackedResource::eImageView, MemoryTelemetry::key(v.payload));
 				ctx->vkDestroyImageView(device, v.payload, nullptr);
 			}
 		}
@@ -503,6 +725,7 @@ namespace vuk {
 				return { expected_error, AllocateException{ res } };
 			}
 			ctx->vkResetQueryPool(device, dst[i].pool, 0, cis[i].queryCount);
+			impl->telemetry.on_allocate(TrackedResource::eQueryPool, MemoryTelemetry::key(dst[i].pool), 0, loc);
 		}
 		return { expected_value };
 	}
@@ -510,6 +733,7 @@ namespace vuk {
 	void DeviceVkResource::deallocate_timestamp_query_pools(std::span<const TimestampQueryPool> src) {
 		for (auto& v : src) {
 			if (v.pool != VK_NULL_HANDLE) {
+				impl->telemetry.on_deallocate(TrackedResource::eQueryPool, MemoryTelemetry::key(v.pool));
 				ctx->vkDestroyQueryPool(device, v.pool, nullptr);
 			}
 		}
@@ -545,6 +769,7 @@ namespace vuk {
 				return { expected_error, AllocateException{ res } };
 			}
 			dst[i].value = new uint64_t{ 0 }; // TODO: more sensibly
+			impl->telemetry.on_allocate(TrackedResource::eTimelineSemaphore, MemoryTelemetry::key(dst[i].semaphore), 0, loc);
 		}
 		return { expected_value };
 	}
@@ -552,6 +777,7 @@ namespace vuk {
 	void DeviceVkResource::deallocate_timeline_semaphores(std::span<const TimelineSemaphore> src) {
 		for (auto& v : src) {
 			if (v.semaphore != VK_NULL_HANDLE) {
+				impl->telemetry.on_deallocate(TrackedResource::eTimelineSemaphore, MemoryTelemetry::key(v.semaphore));
 				ctx->vkDestroySemaphore(device, v.semaphore, nullptr);
 				delete v.value;
 			}
@@ -569,6 +795,7 @@ namespace vuk {
 				deallocate_acceleration_structures({ dst.data(), (uint64_t)i });
 				return { expected_error, AllocateException{ res } };
 			}
+			impl->telemetry.on_allocate(TrackedResource::eAccelerationStructure, MemoryTelemetry::key(dst[i]), 0, loc);
 		}
 		return { expected_value };
 	}
@@ -576,6 +803,7 @@ namespace vuk {
 	void DeviceVkResource::deallocate_acceleration_structures(std::span<const VkAccelerationStructureKHR> src) {
 		for (auto& v : src) {
 			if (v != VK_NULL_HANDLE) {
+				impl->telemetry.on_deallocate(TrackedResource::eAccelerationStructure, MemoryTelemetry::key(v));
 				ctx->vkDestroyAccelerationStructureKHR(device, v, nullptr);
 			}
 		}
@@ -1087,6 +1315,54 @@ namespace vuk {
 		}
 	}
 
+	DeviceNestedResource::DeviceNestedResource(DeviceResource& upstream) : upstream(&upstream), telemetry(std::make_unique<MemoryTelemetry>()) {}
+
+	DeviceNestedResource::~DeviceNestedResource() = default;
+
+	DeviceNestedResource::DeviceNestedResource(DeviceNestedResource&&) = default;
+
+	DeviceNestedResource& DeviceNestedResource::operator=(DeviceNestedResource&&) = default;
+
+	MemoryStats DeviceNestedResource::get_memory_stats(size_t top_sites) {
+		return telemetry->get_stats(top_sites);
+	}
+
+	void DeviceNestedResource::track_buffers(std::span<const Buffer> buffers, std::span<const BufferCreateInfo> cis, SourceLocationAtFrame loc) {
+		assert(buffers.size() == cis.size());
+		for (size_t i = 0; i < buffers.size(); i++) {
+			telemetry->on_allocate(TrackedResource::eBuffer, MemoryTelemetry::key(buffers[i]), cis[i].size, loc, cis[i].mem_usage);
+		}
+	}
+
+	void DeviceNestedResource::untrack_buffers(std::span<const Buffer> buffers) {
+		for (auto& b : buffers) {
+			if (b) {
+				telemetry->on_deallocate(TrackedResource::eBuffer, MemoryTelemetry::key(b));
+			}
+		}
+	}
+
+	void DeviceNestedResource::track_images(std::span<const Image> images, SourceLocationAtFrame loc) {
+		auto& direct = get_context().get_vk_resource();
+		for (auto& image : images) {
+			auto [bytes, mem_usage] = direct.get_image_memory(image);
+			telemetry->on_allocate(TrackedResource::eImage, MemoryTelemetry::key(image.image), bytes, loc, mem_usage);
+		}
+	}
+
+	void DeviceNestedResource::untrack_images(std::span<const Image> images) {
+		for (auto& image : images) {
+			if (image) {
+				telemetry->on_deallocate(TrackedResource::eImage, MemoryTelemetry::key(image.image));
+			}
+		}
+	}
+
+	void DeviceNestedResource::untrack_all() {
+		telemetry->on_deallocate_all(TrackedResource::eBuffer);
+		telemetry->on_deallocate_all(TrackedResource::eImage);
+	}
+
 	Result<void, AllocateException> DeviceNestedResource::allocate_semaphores(std::span<VkSemaphore> dst, SourceLocationAtFrame loc) {
 		return upstream->allocate_semaphores(dst, loc);
 	}
@@ -1124,10 +1400,13 @@ namespace vuk {
 
 	Result<void, AllocateException>
 	DeviceNestedResource::allocate_buffers(std::span<Buffer> dst, std::span<const BufferCreateInfo> cis, SourceLocationAtFrame loc) {
-		return upstream->allocate_buffers(dst, cis, loc);
+		VUK_DO_OR_RETURN(upstream->allocate_buffers(dst, cis, loc));
+		track_buffers(dst, cis, loc);
+		return { expected_value };
 	}
 
 	void DeviceNestedResource::deallocate_buffers(std::span<const Buffer> src) {
+		untrack_buffers(src);
 		upstream->deallocate_buffers(src);
 	}
 
@@ -1141,10 +1420,13 @@ namespace vuk {
 	}
 
 	Result<void, AllocateException> DeviceNestedResource::allocate_images(std::span<Image> dst, std::span<const ImageCreateInfo> cis, SourceLocationAtFrame loc) {
-		return upstream->allocate_images(dst, cis, loc);
+		VUK_DO_OR_RETURN(upstream->allocate_images(dst, cis, loc));
+		track_images(dst, loc);
+		return { expected_value };
 	}
 
 	void DeviceNestedResource::deallocate_images(std::span<const Image> src) {
+		untrack_images(src);
 		upstream->deallocate_images(src);
 	}
 
@@ -1265,4 +1547,8 @@ namespace vuk {
 	void DeviceNestedResource::deallocate_render_passes(std::span<const VkRenderPass> src) {
 		return upstream->deallocate_render_passes(src);
 	}
+
+	void DeviceNestedResource::add_submission(VkSemaphore timeline_semaphore, uint64_t value) {
+		upstream->add_submission(timeline_semaphore, value);
+	}
 } // namespace vuk
\ No newline at end of file
@@ -176,10 +176,23 @@ namespace vuk {
 		if (this->impl->callbacks.on_begin_command_buffer)
 			cbuf_profile_data = this->impl->callbacks.on_begin_command_buffer(this->impl->callbacks.user_data, cbuf);
 
+		// disabled passes keep their barriers, waits and signals, but don't record commands
+		// a render pass is only begun if one of its passes is enabled - its attachments keep their layouts, so the barriers stay valid without it
+		std::vector<bool> pass_enabled(passes.size());
+		std::vector<bool> render_pass_enabled(impl->rpis.size());
+		for (size_t i = 0; i < passes.size(); i++) {
+			pass_enabled[i] = !passes[i]->pass->condition || passes[i]->pass->condition();
+			if (pass_enabled[i] && passes[i]->render_pass_index >= 0) {
+				render_pass_enabled[passes[i]->render_pass_index] = true;
+			}
+		}
+
 		uint64_t command_buffer_index = passes[0]->command_buffer_index;
 		int32_t render_pass_index = -1;
 		for (size_t i = 0; i < passes.size(); i++) {
 			auto& pass = passes[i];
+			bool enabled = pass_enabled[i];
+			int32_t pass_render_pass_index = pass->render_pass_index >= 0 && render_pass_enabled[pass->render_pass_index] ? pass->render_pass_index : -1;
 
 			for (auto& ref : pass->referenced_swapchains.to_span(impl->swapchain_references)) {
 				used_swapchains.emplace(impl->get_bound_attachment(ref).swapchain);
@@ -203,7 +216,7 @@ namespace vuk {
 			}
 
 			// if we had a render pass running, but now it changes
-			if (pass->render_pass_index != render_pass_index && render_pass_index != -1) {
+			if (pass_render_pass_index != render_pass_index && render_pass_index != -1) {
 				ctx.vkCmdEndRenderPass(cbuf);
 			}
 
@@ -215,11 +228,11 @@ namespace vuk {
 			impl->emit_barriers(ctx, cbuf, domain, pass->pre_memory_barriers, pass->pre_image_barriers);
 
 			// if render pass is changing and new pass uses one
-			if (pass->render_pass_index != render_pass_index && pass->render_pass_index != -1) {
-				begin_render_pass(ctx, impl->rpis[pass->render_pass_index], cbuf, false);
+			if (pass_render_pass_index != render_pass_index && pass_render_pass_index != -1) {
+				begin_render_pass(ctx, impl->rpis[pass_render_pass_index], cbuf, false);
 			}
 
-			render_pass_index = pass->render_pass_index;
+			render_pass_index = pass_render_pass_index;
 
 			for (auto& w : pass->relative_waits.to_span(impl->waits)) {
 				si.relative_waits.emplace_back(w);
@@ -231,7 +244,7 @@ namespace vuk {
 
 			CommandBuffer cobuf(*this, ctx, alloc, cbuf);
 			if (render_pass_index >= 0) {
-				fill_render_pass_info(impl->rpis[pass->render_pass_index], 0, cobuf);
+				fill_render_pass_info(impl->rpis[render_pass_index], 0, cobuf);
 			} else {
 				cobuf.ongoing_render_pass = {};
 			}
@@ -239,11 +252,13 @@ namespace vuk {
 			// propagate signals onto SI
 			auto pass_fut_signals = pass->future_signals.to_span(impl->future_signals);
 			si.future_signals.insert(si.future_signals.end(), pass_fut_signals.begin(), pass_fut_signals.end());
+			auto pass_persistent_uses = pass->persistent_uses.to_span(impl->persistent_uses);
+			si.persistent_uses.insert(si.persistent_uses.end(), pass_persistent_uses.begin(), pass_persistent_uses.end());
 
-			if (!pass->qualified_name.is_invalid()) {
+			if (!pass->qualified_name.is_invalid() && enabled) {
 				ctx.begin_region(cobuf.command_buffer, pass->qualified_name.name);
 			}
-			if (pass->pass->execute) {
+			if (pass->pass->execute && enabled) {
 				cobuf.current_pass = pass;
 				void* pass_profile_data = nullptr;
 				if (this->impl->callbacks.on_begin_pass)
@@ -252,7 +267,7 @@ namespace vuk {
 				if (this->impl->callbacks.on_end_pass)
 					this->impl->callbacks.on_end_pass(this->impl->callbacks.user_data, pass_profile_data);
 			}
-			if (!pass->qualified_name.is_invalid()) {
+			if (!pass->qualified_name.is_invalid() && enabled) {
 				ctx.end_region(cobuf.command_buffer);
 			}
 
@@ -279,20 +294,7 @@ namespace vuk {
 		return { expected_value, std::move(si) };
 	}
 
-	Result<SubmitBundle> ExecutableRenderGraph::execute(Allocator& alloc, std::vector<std::pair<SwapchainRef, size_t>> swp_with_index) {
-		Context& ctx = alloc.get_context();
-
-		// bind swapchain attachment images & ivs
-		for (auto& bound : impl->bound_attachments) {
-			if (bound.type == AttachmentInfo::Type::eSwapchain && bound.parent_attachment == 0) {
-				auto it = std::find_if(swp_with_index.begin(), swp_with_index.end(), [boundb = &bound](auto& t) { return t.first == boundb->swapchain; });
-				bound.attachment.image_view = it->first->image_views[it->second];
-				bound.attachment.image = it->first->images[it->second];
-				bound.attachment.extent = Dimension3D::absolute(it->first->extent);
-				bound.attachment.sample_count = vuk::Samples::e1;
-			}
-		}
-
+	Result<void> ExecutableRenderGraph::infer() {
 		// pre-inference: which IAs are in which FBs?
 		for (auto& rp : impl->rpis) {
 			for (auto& rp_att : rp.attachments.to_span(impl->rp_infos)) {
@@ -395,7 +397,7 @@ namespace vuk {
 
 		std::vector<std::pair<BufferInfo*, BufferInferences*>> bufis_to_infer;
 		for (auto& bound : impl->bound_buffers) {
-			if (bound.buffer.size != ~(0u))
+			if (bound.buffer.size != ~(0u) || bound.parent_buffer != 0)
 				continue;
 
 			BufferInferences* rules_ptr = nullptr;
@@ -641,6 +643,28 @@ namespace vuk {
 			return { expected_error, RenderGraphException{ msg.str() } };
 		}
 
+		impl->inferred = true;
+		return { expected_value };
+	}
+
+	Result<SubmitBundle> ExecutableRenderGraph::execute(Allocator& alloc, std::vector<std::pair<SwapchainRef, size_t>> swp_with_index) {
+		Context& ctx = alloc.get_context();
+
+		// bind swapchain attachment images & ivs
+		for (auto& bound : impl->bound_attachments) {
+			if (bound.type == AttachmentInfo::Type::eSwapchain && bound.parent_attachment == 0) {
+				auto it = std::find_if(swp_with_index.begin(), swp_with_index.end(), [boundb = &bound](auto& t) { return t.first == boundb->swapchain; });
+				bound.attachment.image_view = it->first->image_views[it->second];
+				bound.attachment.image = it->first->images[it->second];
+				bound.attachment.extent = Dimension3D::absolute(it->first->extent);
+				bound.attachment.sample_count = vuk::Samples::e1;
+			}
+		}
+
+		if (!impl->inferred) {
+			VUK_DO_OR_RETURN(infer());
+		}
+
 		// acquire the render passes
 		for (auto& rp : impl->rpis) {
 			if (rp.attachments.size() == 0) {
@@ -665,7 +689,7 @@ namespace vuk {
 
 		// create buffers
 		for (auto& bound : impl->bound_buffers) {
-			if (bound.buffer.buffer == VK_NULL_HANDLE) {
+			if (bound.buffer.buffer == VK_NULL_HANDLE && bound.parent_buffer == 0) {
 				BufferCreateInfo bci{ .mem_usage = bound.buffer.memory_usage, .size = bound.buffer.size, .alignment = 1 }; // TODO: alignment?
 				auto allocator = bound.allocator ? *bound.allocator : alloc;
 				auto buf = allocate_buffer(allocator, bci);
@@ -676,6 +700,18 @@ namespace vuk {
 			}
 		}
 
+		// bind diverged buffers to their subrange of the parent
+		// parents are always bound before their subranges, so a single pass suffices
+		for (auto& bound : impl->bound_buffers) {
+			if (bound.parent_buffer < 0) {
+				auto& parent = impl->get_bound_buffer(bound.parent_buffer);
+				auto& subrange = bound.buffer_subrange;
+				assert(subrange.offset <= parent.buffer.size);
+				auto size = subrange.size == VK_WHOLE_SIZE ? parent.buffer.size - subrange.offset : subrange.size;
+				bound.buffer = parent.buffer.subrange(subrange.offset, size);
+			}
+		}
+
 		// create non-attachment images
 		for (auto& bound : impl->bound_attachments) {
 			if (!bound.attachment.image && bound.parent_attachment == 0) {
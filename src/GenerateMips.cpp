@@ -0,0 +1,314 @@
+#include "vuk/CommandBuffer.hpp"
+#include "vuk/Context.hpp"
+#include "vuk/Partials.hpp"
+#include "vuk/RenderGraph.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <string>
+
+namespace vuk {
+	namespace {
+		// levels written by one dispatch at most: 6 by every workgroup from a 64x64 tile, then 6 more by the last workgroup from the 64x64 level
+		constexpr uint32_t spd_max_levels = 12;
+		constexpr uint32_t spd_tile_size = 64;
+
+#if VUK_USE_SHADERC
+		constexpr const char* spd_glsl = R"(#version 450
+#pragma shader_stage(compute)
+
+layout(local_size_x = 256) in;
+
+layout(binding = 0, FORMAT) uniform readonly image2DArray mip_src;
+layout(binding = 1, FORMAT) uniform coherent image2DArray mip_1;
+layout(binding = 2, FORMAT) uniform coherent image2DArray mip_2;
+layout(binding = 3, FORMAT) uniform coherent image2DArray mip_3;
+layout(binding = 4, FORMAT) uniform coherent image2DArray mip_4;
+layout(binding = 5, FORMAT) uniform coherent image2DArray mip_5;
+layout(binding = 6, FORMAT) uniform coherent image2DArray mip_6;
+layout(binding = 7, FORMAT) uniform coherent image2DArray mip_7;
+layout(binding = 8, FORMAT) uniform coherent image2DArray mip_8;
+layout(binding = 9, FORMAT) uniform coherent image2DArray mip_9;
+layout(binding = 10, FORMAT) uniform coherent image2DArray mip_10;
+layout(binding = 11, FORMAT) uniform coherent image2DArray mip_11;
+layout(binding = 12, FORMAT) uniform coherent image2DArray mip_12;
+
+// workgroups that have finished their tile, per layer
+layout(std430, binding = 13) coherent buffer Counters {
+	uint counters[];
+};
+
+layout(push_constant) uniform Constants {
+	ivec2 src_size;
+	uint mips;
+	uint workgroup_count;
+	uint srgb;
+};
+
+shared vec4 tile[16][16];
+shared bool is_last;
+
+vec4 to_linear(vec4 c) {
+	if (srgb == 0) {
+		return c;
+	}
+	vec3 lo = c.rgb / 12.92;
+	vec3 hi = pow((c.rgb + 0.055) / 1.055, vec3(2.4));
+	return vec4(mix(hi, lo, lessThanEqual(c.rgb, vec3(0.04045))), c.a);
+}
+
+vec4 to_srgb(vec4 c) {
+	if (srgb == 0) {
+		return c;
+	}
+	vec3 lo = c.rgb * 12.92;
+	vec3 hi = 1.055 * pow(c.rgb, vec3(1.0 / 2.4)) - 0.055;
+	return vec4(mix(hi, lo, lessThanEqual(c.rgb, vec3(0.0031308))), c.a);
+}
+
+ivec2 level_size(uint level) {
+	return max(src_size >> level, ivec2(1));
+}
+
+// only the source and level 6 are ever read
+vec4 load(uint level, ivec2 p, int layer) {
+	p = min(p, level_size(level) - 1);
+	vec4 v = level == 0 ? imageLoad(mip_src, ivec3(p, layer)) : imageLoad(mip_6, ivec3(p, layer));
+	return to_linear(v);
+}
+
+void store(uint level, ivec2 p, int layer, vec4 v) {
+	if (any(greaterThanEqual(p, level_size(level)))) {
+		return;
+	}
+	ivec3 c = ivec3(p, layer);
+	v = to_srgb(v);
+	switch (level) {
+	case 1: imageStore(mip_1, c, v); break;
+	case 2: imageStore(mip_2, c, v); break;
+	case 3: imageStore(mip_3, c, v); break;
+	case 4: imageStore(mip_4, c, v); break;
+	case 5: imageStore(mip_5, c, v); break;
+	case 6: imageStore(mip_6, c, v); break;
+	case 7: imageStore(mip_7, c, v); break;
+	case 8: imageStore(mip_8, c, v); break;
+	case 9: imageStore(mip_9, c, v); break;
+	case 10: imageStore(mip_10, c, v); break;
+	case 11: imageStore(mip_11, c, v); break;
+	case 12: imageStore(mip_12, c, v); break;
+	}
+}
+
+// reduce a 64x64 tile of src_level into 6 levels, the first two in registers, the rest through shared memory
+void downsample(uint src_level, uvec2 tile_id, int layer) {
+	uint t = gl_LocalInvocationIndex;
+	uvec2 q = uvec2(t % 16, t / 16);
+
+	vec4 sum = vec4(0);
+	for (int y = 0; y < 2; y++) {
+		for (int x = 0; x < 2; x++) {
+			ivec2 p = ivec2(tile_id * 32 + q * 2) + ivec2(x, y);
+			vec4 v = 0.25 * (load(src_level, 2 * p, layer) + load(src_level, 2 * p + ivec2(1, 0), layer) + load(src_level, 2 * p + ivec2(0, 1), layer) +
+			                 load(src_level, 2 * p + ivec2(1, 1), layer));
+			store(src_level + 1, p, layer, v);
+			sum += v;
+		}
+	}
+	if (src_level + 2 > mips) {
+		return;
+	}
+	tile[q.y][q.x] = 0.25 * sum;
+	store(src_level + 2, ivec2(tile_id * 16 + q), layer, 0.25 * sum);
+	barrier();
+
+	uint size = 8;
+	for (uint level = src_level + 3; level <= min(src_level + 6, mips); level++, size /= 2) {
+		bool active = t < size * size;
+		uvec2 r = uvec2(t % size, t / size);
+		vec4 v;
+		if (active) {
+			v = 0.25 * (tile[2 * r.y][2 * r.x] + tile[2 * r.y][2 * r.x + 1] + tile[2 * r.y + 1][2 * r.x] + tile[2 * r.y + 1][2 * r.x + 1]);
+		}
+		barrier();
+		if (active) {
+			tile[r.y][r.x] = v;
+			store(level, ivec2(tile_id * size + r), layer, v);
+		}
+		barrier();
+	}
+}
+
+void main() {
+	int layer = int(gl_WorkGroupID.z);
+	downsample(0, gl_WorkGroupID.xy, layer);
+	if (mips <= 6) {
+		return;
+	}
+
+	// the last workgroup to finish its tile continues with the remaining levels from level 6
+	memoryBarrierImage();
+	barrier();
+	if (gl_LocalInvocationIndex == 0) {
+		is_last = atomicAdd(counters[layer], 1) == workgroup_count - 1;
+	}
+	barrier();
+	if (!is_last) {
+		return;
+	}
+	memoryBarrierImage();
+	downsample(6, uvec2(0), layer);
+}
+)";
+#endif
+
+		struct SpdConstants {
+			int32_t src_width;
+			int32_t src_height;
+			uint32_t mips;
+			uint32_t workgroup_count;
+			uint32_t srgb;
+		};
+
+		// GLSL storage image format qualifier, empty if the downsampler can't write the format
+		std::string_view storage_format_qualifier(Format format) {
+			switch (format) {
+			case Format::eR8G8B8A8Unorm:
+				return "rgba8";
+			case Format::eR8G8B8A8Snorm:
+				return "rgba8_snorm";
+			case Format::eR8G8Unorm:
+				return "rg8";
+			case Format::eR8Unorm:
+				return "r8";
+			case Format::eR16G16B16A16Unorm:
+				return "rgba16";
+			case Format::eR16G16B16A16Sfloat:
+				return "rgba16f";
+			case Format::eR16G16Sfloat:
+				return "rg16f";
+			case Format::eR16Sfloat:
+				return "r16f";
+			case Format::eR32G32B32A32Sfloat:
+				return "rgba32f";
+			case Format::eR32G32Sfloat:
+				return "rg32f";
+			case Format::eR32Sfloat:
+				return "r32f";
+			case Format::eB10G11R11UfloatPack32:
+				return "r11f_g11f_b10f";
+			case Format::eA2B10G10R10UnormPack32:
+				return "rgb10_a2";
+			default:
+				return {};
+			}
+		}
+
+		// the pass has the whole image in general layout, blits within it are ordered by explicit barriers
+		void blit_mips(CommandBuffer& command_buffer, const ImageAttachment& ia, uint32_t base_mip, uint32_t num_mips) {
+			command_buffer.image_barrier("_src", Access::eComputeRW, Access::eTransferRW, base_mip, num_mips);
+			auto extent = ia.extent.extent;
+			for (uint32_t miplevel = base_mip + 1; miplevel < base_mip + num_mips; miplevel++) {
+				ImageBlit blit;
+				blit.srcSubresource.aspectMask = format_to_aspect(ia.format);
+				blit.srcSubresource.baseArrayLayer = ia.base_layer;
+				blit.srcSubresource.layerCount = ia.layer_count;
+				blit.srcSubresource.mipLevel = miplevel - 1;
+				blit.srcOffsets[0] = Offset3D{ 0 };
+				blit.srcOffsets[1] = Offset3D{ std::max((int32_t)extent.width >> (miplevel - 1), 1),
+					                             std::max((int32_t)extent.height >> (miplevel - 1), 1),
+					                             std::max((int32_t)extent.depth >> (miplevel - 1), 1) };
+				blit.dstSubresource = blit.srcSubresource;
+				blit.dstSubresource.mipLevel = miplevel;
+				blit.dstOffsets[0] = Offset3D{ 0 };
+				blit.dstOffsets[1] = Offset3D{ std::max((int32_t)extent.width >> miplevel, 1),
+					                             std::max((int32_t)extent.height >> miplevel, 1),
+					                             std::max((int32_t)extent.depth >> miplevel, 1) };
+				command_buffer.blit_image("_src", "_src", blit, Filter::eLinear);
+				command_buffer.image_barrier("_src", Access::eTransferWrite, Access::eTransferRead, miplevel, 1);
+			}
+			command_buffer.image_barrier("_src", Access::eTransferRW, Access::eComputeRW, base_mip, num_mips);
+		}
+
+#if VUK_USE_SHADERC
+		void spd_mips(CommandBuffer& command_buffer, const ImageAttachment& ia, std::string_view qualifier, uint32_t base_mip, uint32_t num_mips) {
+			auto& ctx = command_buffer.get_context();
+			Name pipeline_name = Name("vuk_spd_").append(qualifier);
+			if (!ctx.is_pipeline_available(pipeline_name)) {
+				PipelineBaseCreateInfo pbci;
+				pbci.define("FORMAT", std::string(qualifier));
+				pbci.add_glsl(spd_glsl, "<vuk spd>");
+				ctx.create_named_pipeline(pipeline_name, std::move(pbci));
+			}
+			command_buffer.bind_compute_pipeline(pipeline_name);
+
+			bool srgb = is_format_srgb(ia.format);
+			// every level gets its own view, sRGB levels are written through UNORM views and encoded in the shader
+			ImageAttachment mip_ia = ia;
+			mip_ia.image_view = {};
+			mip_ia.format = srgb ? srgb_to_unorm(ia.format) : ia.format;
+			mip_ia.view_type = ImageViewType::e2DArray;
+			mip_ia.usage = ImageUsageFlagBits::eStorage;
+			mip_ia.level_count = 1;
+
+			auto extent = ia.extent.extent;
+			uint32_t end = base_mip + num_mips;
+			for (uint32_t level = base_mip; level + 1 < end;) {
+				int32_t width = std::max((int32_t)extent.width >> level, 1);
+				int32_t height = std::max((int32_t)extent.height >> level, 1);
+				// the last workgroup can only continue if the 6th level fits into a single tile
+				uint32_t max_levels = (uint32_t)std::max(width, height) <= spd_tile_size << 6 ? spd_max_levels : spd_max_levels / 2;
+				uint32_t count = std::min(end - level - 1, max_levels);
+				// unused bindings repeat the last written level
+				for (uint32_t i = 0; i <= spd_max_levels; i++) {
+					mip_ia.base_level = level + std::min(i, count);
+					command_buffer.bind_image(0, i, mip_ia, ImageLayout::eGeneral);
+				}
+				auto counters = command_buffer._map_scratch_buffer(0, spd_max_levels + 1, sizeof(uint32_t) * ia.layer_count);
+				if (counters) {
+					::memset(counters, 0, sizeof(uint32_t) * ia.layer_count);
+				}
+				uint32_t workgroups_x = ((uint32_t)width + spd_tile_size - 1) / spd_tile_size;
+				uint32_t workgroups_y = ((uint32_t)height + spd_tile_size - 1) / spd_tile_size;
+				command_buffer.push_constants(
+				    ShaderStageFlagBits::eCompute, 0, SpdConstants{ width, height, count, workgroups_x * workgroups_y, srgb ? 1u : 0u });
+				command_buffer.dispatch(workgroups_x, workgroups_y, ia.layer_count);
+
+				level += count;
+				if (level + 1 < end) {
+					command_buffer.memory_barrier(Access::eComputeWrite, Access::eComputeRead);
+				}
+			}
+		}
+#endif
+	} // namespace
+
+	Future generate_mips_spd(Future image, uint32_t base_mip, uint32_t num_mips) {
+		std::shared_ptr<RenderGraph> rgp = std::make_shared<RenderGraph>("generate_mips_spd");
+		rgp->attach_in("_src", std::move(image));
+		rgp->add_pass({ .name = "SPD",
+		                .execute_on = DomainFlagBits::eGraphicsOnGraphics,
+		                .resources = { "_src"_image >> Access::eComputeRW >> "_src+" },
+		                .execute = [base_mip, num_mips](CommandBuffer& command_buffer) {
+			                auto ia = *command_buffer.get_resource_image_attachment("_src");
+			                assert(ia.extent.sizing == Sizing::eAbsolute);
+			                if (num_mips < 2) {
+				                return;
+			                }
+			                bool srgb = is_format_srgb(ia.format);
+			                auto qualifier = storage_format_qualifier(srgb ? srgb_to_unorm(ia.format) : ia.format);
+			                bool mutable_format = ia.allow_srgb_unorm_mutable || (ia.image_flags & ImageCreateFlagBits::eMutableFormat) != ImageCreateFlags{};
+			                bool use_compute = !qualifier.empty() && ia.image_type == ImageType::e2D && (ia.usage & ImageUsageFlagBits::eStorage) != ImageUsageFlags{} &&
+			                                   (!srgb || mutable_format);
+#if VUK_USE_SHADERC
+			                if (use_compute) {
+				                spd_mips(command_buffer, ia, qualifier, base_mip, num_mips);
+				                return;
+			                }
+#else
+			                (void)use_compute;
+#endif
+			                blit_mips(command_buffer, ia, base_mip, num_mips);
+		                } });
+		return { std::move(rgp), "_src+" };
+	}
+} // namespace vuk
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+
+namespace vuk {
+	/// @brief Bounded lock-free ring with multiple producers and a single consumer
+	// each cell carries a sequence number: producers claim a position with a CAS, write the cell and publish it by bumping the sequence
+	template<class T>
+	struct MPSCRing {
+		MPSCRing(size_t capacity) : cells(new Cell[capacity]), mask(capacity - 1) {
+			assert(capacity >= 2 && (capacity & (capacity - 1)) == 0 && "capacity must be a power of two");
+			for (size_t i = 0; i < capacity; i++) {
+				cells[i].sequence.store(i, std::memory_order_relaxed);
+			}
+		}
+
+		MPSCRing(const MPSCRing&) = delete;
+		MPSCRing& operator=(const MPSCRing&) = delete;
+
+		/// @brief Try to push a value, returns false if the ring is full
+		bool try_push(T&& value) {
+			size_t pos = enqueue_pos.load(std::memory_order_relaxed);
+			Cell* cell;
+			while (true) {
+				cell = &cells[pos & mask];
+				size_t seq = cell->sequence.load(std::memory_order_acquire);
+				intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+				if (diff == 0) {
+					if (enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+						break;
+					}
+				} else if (diff < 0) {
+					return false; // full
+				} else {
+					pos = enqueue_pos.load(std::memory_order_relaxed);
+				}
+			}
+			cell->value = std::move(value);
+			cell->sequence.store(pos + 1, std::memory_order_release);
+			return true;
+		}
+
+		/// @brief Pop a value, may only be called from the consumer
+		std::optional<T> try_pop() {
+			Cell* cell = &cells[dequeue_pos & mask];
+			size_t seq = cell->sequence.load(std::memory_order_acquire);
+			if ((intptr_t)seq - (intptr_t)(dequeue_pos + 1) < 0) {
+				return {}; // empty, or the producer has not published yet
+			}
+			std::optional<T> value = std::move(cell->value);
+			cell->value = {};
+			cell->sequence.store(dequeue_pos + mask + 1, std::memory_order_release);
+			dequeue_pos++;
+			return value;
+		}
+
+	private:
+		struct Cell {
+			std::atomic<size_t> sequence;
+			T value = {};
+		};
+
+		std::unique_ptr<Cell[]> cells;
+		size_t mask;
+		alignas(64) std::atomic<size_t> enqueue_pos = 0;
+		alignas(64) size_t dequeue_pos = 0;
+	};
+} // namespace vuk
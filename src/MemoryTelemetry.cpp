@@ -0,0 +1,204 @@
+#include "MemoryTelemetry.hpp"
+
+#include <algorithm>
+#include <sstream>
+
+namespace vuk {
+	std::string_view to_name(TrackedResource type) {
+		switch (type) {
+		case TrackedResource::eBuffer:
+			return "buffer";
+		case TrackedResource::eImage:
+			return "image";
+		case TrackedResource::eImageView:
+			return "image_view";
+		case TrackedResource::eSemaphore:
+			return "semaphore";
+		case TrackedResource::eFence:
+			return "fence";
+		case TrackedResource::eTimelineSemaphore:
+			return "timeline_semaphore";
+		case TrackedResource::eCommandPool:
+			return "command_pool";
+		case TrackedResource::eFramebuffer:
+			return "framebuffer";
+		case TrackedResource::eDescriptorPool:
+			return "descriptor_pool";
+		case TrackedResource::eQueryPool:
+			return "query_pool";
+		case TrackedResource::eAccelerationStructure:
+			return "acceleration_structure";
+		default:
+			return "unknown";
+		}
+	}
+
+	void MemoryTelemetry::Counters::add(size_t bytes) {
+		reported.count++;
+		reported.bytes += bytes;
+		reported.peak_count = std::max(reported.peak_count, reported.count);
+		reported.peak_bytes = std::max(reported.peak_bytes, reported.bytes);
+		current_frame_allocations++;
+		current_frame_bytes += bytes;
+	}
+
+	void MemoryTelemetry::Counters::remove(size_t bytes) {
+		reported.count--;
+		reported.bytes -= bytes;
+	}
+
+	void MemoryTelemetry::Counters::next_frame() {
+		reported.frame_allocations = std::exchange(current_frame_allocations, 0);
+		reported.frame_bytes = std::exchange(current_frame_bytes, 0);
+	}
+
+	void MemoryTelemetry::on_allocate(TrackedResource type, Key key, size_t bytes, SourceLocationAtFrame loc, MemoryUsage mem_usage) {
+		std::lock_guard _(mutex);
+		SiteKey site_key{ loc.location.file_name(), loc.location.function_name(), (uint32_t)loc.location.line() };
+		auto [it, inserted] = site_indices.try_emplace(site_key, sites.size());
+		if (inserted) {
+			sites.push_back(AllocationSiteStats{ .file = site_key.file, .function = site_key.function, .line = site_key.line });
+		}
+		auto& site = sites[it->second];
+		site.count++;
+		site.bytes += bytes;
+		site.total_allocations++;
+
+		int usage_index = (int)mem_usage - 1;
+		total.add(bytes);
+		resources[(size_t)type].add(bytes);
+		if (usage_index >= 0) {
+			memory_usages[usage_index].add(bytes);
+		}
+		live[(size_t)type][key] = Record{ bytes, it->second, usage_index };
+	}
+
+	void MemoryTelemetry::remove(TrackedResource type, const Record& record) {
+		auto& site = sites[record.site];
+		site.count--;
+		site.bytes -= record.bytes;
+		total.remove(record.bytes);
+		resources[(size_t)type].remove(record.bytes);
+		if (record.usage_index >= 0) {
+			memory_usages[record.usage_index].remove(record.bytes);
+		}
+	}
+
+	void MemoryTelemetry::on_deallocate(TrackedResource type, Key key) {
+		std::lock_guard _(mutex);
+		auto& map = live[(size_t)type];
+		auto it = map.find(key);
+		if (it == map.end()) { // not allocated through us
+			return;
+		}
+		remove(type, it->second);
+		map.erase(it);
+	}
+
+	void MemoryTelemetry::on_deallocate_all(TrackedResource type) {
+		std::lock_guard _(mutex);
+		auto& map = live[(size_t)type];
+		for (auto& [key, record] : map) {
+			remove(type, record);
+		}
+		map.clear();
+	}
+
+	void MemoryTelemetry::next_frame() {
+		std::lock_guard _(mutex);
+		total.next_frame();
+		for (auto& c : resources) {
+			c.next_frame();
+		}
+		for (auto& c : memory_usages) {
+			c.next_frame();
+		}
+	}
+
+	MemoryStats MemoryTelemetry::get_stats(size_t top_sites) {
+		MemoryStats stats;
+		std::lock_guard _(mutex);
+		stats.total = total.reported;
+		for (size_t i = 0; i < resources.size(); i++) {
+			stats.resources[i] = resources[i].reported;
+		}
+		for (size_t i = 0; i < memory_usages.size(); i++) {
+			stats.memory_usages[i] = memory_usages[i].reported;
+		}
+		stats.top_sites = sites;
+		std::erase_if(stats.top_sites, [](auto& s) { return s.count == 0; });
+		auto n = std::min(top_sites, stats.top_sites.size());
+		std::partial_sort(stats.top_sites.begin(), stats.top_sites.begin() + n, stats.top_sites.end(), [](auto& a, auto& b) {
+			return a.bytes != b.bytes ? a.bytes > b.bytes : a.count > b.count;
+		});
+		stats.top_sites.resize(n);
+		return stats;
+	}
+
+	namespace {
+		void write_string(std::ostream& os, std::string_view s) {
+			os << '"';
+			for (char c : s) {
+				switch (c) {
+				case '"':
+					os << "\\\"";
+					break;
+				case '\\':
+					os << "\\\\";
+					break;
+				case '\n':
+					os << "\\n";
+					break;
+				default:
+					os << c;
+				}
+			}
+			os << '"';
+		}
+
+		void write_counters(std::ostream& os, const UsageCounters& c) {
+			os << "{\"count\":" << c.count << ",\"bytes\":" << c.bytes << ",\"peak_count\":" << c.peak_count << ",\"peak_bytes\":" << c.peak_bytes
+			   << ",\"frame_allocations\":" << c.frame_allocations << ",\"frame_bytes\":" << c.frame_bytes << "}";
+		}
+	} // namespace
+
+	std::string to_json(const MemoryStats& stats) {
+		std::stringstream ss;
+		ss << "{\"total\":";
+		write_counters(ss, stats.total);
+		ss << ",\"resources\":{";
+		for (size_t i = 0; i < stats.resources.size(); i++) {
+			if (i > 0) {
+				ss << ",";
+			}
+			write_string(ss, to_name((TrackedResource)i));
+			ss << ":";
+			write_counters(ss, stats.resources[i]);
+		}
+		// in the order of MemoryUsage
+		constexpr std::string_view usage_names[] = { "gpu_only", "cpu_only", "cpu_to_gpu", "gpu_to_cpu" };
+		ss << "},\"memory_usages\":{";
+		for (size_t i = 0; i < stats.memory_usages.size(); i++) {
+			if (i > 0) {
+				ss << ",";
+			}
+			write_string(ss, usage_names[i]);
+			ss << ":";
+			write_counters(ss, stats.memory_usages[i]);
+		}
+		ss << "},\"top_sites\":[";
+		for (size_t i = 0; i < stats.top_sites.size(); i++) {
+			auto& site = stats.top_sites[i];
+			if (i > 0) {
+				ss << ",";
+			}
+			ss << "{\"file\":";
+			write_string(ss, site.file ? site.file : "");
+			ss << ",\"line\":" << site.line << ",\"function\":";
+			write_string(ss, site.function ? site.function : "");
+			ss << ",\"count\":" << site.count << ",\"bytes\":" << site.bytes << ",\"total_allocations\":" << site.total_allocations << "}";
+		}
+		ss << "]}";
+		return ss.str();
+	}
+} // namespace vuk
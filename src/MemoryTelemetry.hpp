@@ -0,0 +1,91 @@
+#pragma once
+
+#include "vuk/Buffer.hpp"
+#include "vuk/MemoryStats.hpp"
+#include "vuk/SourceLocation.hpp"
+#include "vuk/Types.hpp"
+
+#include <mutex>
+#include <type_traits>
+#include <unordered_map>
+
+namespace vuk {
+	/// @brief Accounting of live device objects, by kind, MemoryUsage and allocation site
+	struct MemoryTelemetry {
+		/// @brief Identifies a live object - sub-allocations of a buffer share the handle and are told apart by their offset
+		struct Key {
+			uint64_t handle;
+			uint64_t offset = 0;
+
+			bool operator==(const Key&) const = default;
+		};
+
+		void on_allocate(TrackedResource type, Key key, size_t bytes, SourceLocationAtFrame loc, MemoryUsage mem_usage = {});
+		void on_deallocate(TrackedResource type, Key key);
+		/// @brief Drop every live object of a kind, when they are all released at once
+		void on_deallocate_all(TrackedResource type);
+		/// @brief Close the per-frame counters of the current frame
+		void next_frame();
+		MemoryStats get_stats(size_t top_sites);
+
+		template<class T>
+		static Key key(T handle) {
+			if constexpr (std::is_pointer_v<T>) {
+				return { (uint64_t)reinterpret_cast<uintptr_t>(handle) };
+			} else {
+				return { (uint64_t)handle };
+			}
+		}
+
+		static Key key(const Buffer& buffer) {
+			return { key(buffer.buffer), buffer.offset };
+		}
+
+	private:
+		struct Counters {
+			UsageCounters reported;
+			size_t current_frame_allocations = 0;
+			size_t current_frame_bytes = 0;
+
+			void add(size_t bytes);
+			void remove(size_t bytes);
+			void next_frame();
+		};
+
+		struct Record {
+			size_t bytes;
+			size_t site;
+			int usage_index;
+		};
+
+		struct KeyHash {
+			size_t operator()(const Key& k) const noexcept {
+				return std::hash<uint64_t>{}(k.handle) ^ (std::hash<uint64_t>{}(k.offset) << 1);
+			}
+		};
+
+		void remove(TrackedResource type, const Record& record);
+
+		struct SiteKey {
+			const char* file;
+			const char* function;
+			uint32_t line;
+
+			bool operator==(const SiteKey&) const = default;
+		};
+
+		struct SiteKeyHash {
+			size_t operator()(const SiteKey& k) const noexcept {
+				return std::hash<const char*>{}(k.file) ^ (std::hash<const char*>{}(k.function) << 1) ^ ((size_t)k.line << 2);
+			}
+		};
+
+		std::mutex mutex;
+		Counters total;
+		std::array<Counters, (size_t)TrackedResource::eCount> resources;
+		std::array<Counters, 4> memory_usages;
+		std::array<std::unordered_map<Key, Record, KeyHash>, (size_t)TrackedResource::eCount> live;
+		std::vector<AllocationSiteStats> sites;
+		std::unordered_map<SiteKey, size_t, SiteKeyHash> site_indices;
+	};
+} // namespace vuk
@@ -0,0 +1,165 @@
+#include "vuk/Readback.hpp"
+#include "StagingRing.hpp"
+#include "vuk/AllocatorHelpers.hpp"
+#include "vuk/CommandBuffer.hpp"
+#include "vuk/Context.hpp"
+#include "vuk/Partials.hpp"
+#include "vuk/RenderGraph.hpp"
+
+#include <cstdio>
+#include <vector>
+
+namespace vuk {
+	ReadbackManager::ReadbackManager(Context& ctx) : ctx(&ctx), direct_allocator(ctx.get_vk_resource()) {}
+
+	ReadbackManager::~ReadbackManager() {
+		// the copies have been submitted, so the ring regions are reclaimed once they complete
+		// dedicated memory is destroyed immediately, so the copies writing it are waited for
+		for (auto& [id, read] : reads) {
+			if (!read.own_memory) {
+				continue;
+			}
+			auto ready = read.future.is_ready();
+			if (ready && *ready) {
+				continue;
+			}
+			// can't throw from here, the memory is destroyed regardless
+			if (!ready) {
+				fprintf(stderr, "vuk: checking readback completion failed: %s\n", ready.error().what());
+			}
+			if (auto result = ctx->wait_idle(); !result) {
+				fprintf(stderr, "vuk: waiting for readbacks failed: %s\n", result.error().what());
+			}
+			break;
+		}
+	}
+
+	Result<ReadbackManager::Read> ReadbackManager::allocate(size_t size, size_t alignment, Buffer& dst) {
+		Read read;
+		if (auto allocation = ctx->allocate_readback(size, alignment)) {
+			dst = allocation->buffer;
+			read.release = std::move(allocation->release);
+		} else {
+			auto buffer = allocate_buffer(direct_allocator, BufferCreateInfo{ MemoryUsage::eGPUtoCPU, size, alignment });
+			if (!buffer) {
+				return { expected_error, buffer.error() };
+			}
+			dst = buffer->get();
+			read.own_memory.emplace(std::move(*buffer));
+		}
+		read.data = std::span<const std::byte>(reinterpret_cast<const std::byte*>(dst.mapped_ptr), size);
+		read.memory = dst;
+		read.memory.size = size;
+		return { expected_value, std::move(read) };
+	}
+
+	Result<void> ReadbackManager::invalidate(Read& read) {
+		if (!read.invalidated) {
+			VUK_DO_OR_RETURN(ctx->get_vk_resource().invalidate_mapped_buffer(read.memory));
+			read.invalidated = true;
+		}
+		return { expected_value };
+	}
+
+	Result<uint64_t> ReadbackManager::submit(Allocator& allocator, Compiler& compiler, Future copy, Read read) {
+		VUK_DO_OR_RETURN(copy.submit(allocator, compiler));
+		if (read.release) {
+			// releasing the read doesn't wait for reads submitted after it
+			read.release->set_last_use(copy);
+		}
+		read.future = std::move(copy);
+		uint64_t id = next_id++;
+		reads.emplace(id, std::move(read));
+		return { expected_value, id };
+	}
+
+	Result<uint64_t> ReadbackManager::read_buffer(Allocator& allocator, Compiler& compiler, Future src, size_t size, Callback callback) {
+		assert(size > 0);
+		Buffer dst;
+		auto read = allocate(size, 1, dst);
+		if (!read) {
+			return { expected_error, read.error() };
+		}
+		read->callback = std::move(callback);
+
+		std::shared_ptr<RenderGraph> rgp = std::make_shared<RenderGraph>("read_buffer");
+		rgp->attach_in("_src", std::move(src));
+		rgp->attach_buffer("_dst", dst, Access::eNone);
+		rgp->add_pass({ .name = "READBACK",
+		                .resources = { "_src"_buffer >> Access::eTransferRead, "_dst"_buffer >> Access::eTransferWrite },
+		                .execute = [size](CommandBuffer& command_buffer) {
+			                command_buffer.copy_buffer("_src", "_dst", size);
+		                } });
+		return submit(allocator, compiler, Future{ std::move(rgp), "_dst+" }, std::move(*read));
+	}
+
+	Result<uint64_t> ReadbackManager::read_image(Allocator& allocator, Compiler& compiler, Future src, const ImageAttachment& image, Callback callback) {
+		size_t size;
+		auto regions = tightly_packed_image_regions(image, size);
+		Buffer dst;
+		auto read = allocate(size, image_copy_alignment(image.format), dst);
+		if (!read) {
+			return { expected_error, read.error() };
+		}
+		read->callback = std::move(callback);
+
+		std::shared_ptr<RenderGraph> rgp = std::make_shared<RenderGraph>("read_image");
+		rgp->attach_in("_src", std::move(src));
+		rgp->attach_buffer("_dst", dst, Access::eNone);
+		rgp->add_pass({ .name = "READBACK",
+		                .resources = { "_src"_image >> Access::eTransferRead, "_dst"_buffer >> Access::eTransferWrite },
+		                .execute = [regions = std::move(regions)](CommandBuffer& command_buffer) {
+			                command_buffer.copy_image_to_buffer("_src", "_dst", regions);
+		                } });
+		return submit(allocator, compiler, Future{ std::move(rgp), "_dst+" }, std::move(*read));
+	}
+
+	Result<size_t> ReadbackManager::update() {
+		// nothing is taken out of the reads until all have been checked, so that an error leaves them all in place
+		std::vector<uint64_t> ready_ids;
+		for (auto& [id, read] : reads) {
+			if (!read.callback) {
+				continue;
+			}
+			auto ready = read.future.is_ready();
+			if (!ready) {
+				return ready;
+			}
+			if (*ready) {
+				VUK_DO_OR_RETURN(invalidate(read));
+				ready_ids.push_back(id);
+			}
+		}
+		// callbacks are collected first, so that they may issue new reads
+		std::vector<Read> completed;
+		for (auto id : ready_ids) {
+			auto it = reads.find(id);
+			completed.emplace_back(std::move(it->second));
+			reads.erase(it);
+		}
+		for (auto& read : completed) {
+			read.callback(read.data);
+		}
+		return { expected_value, completed.size() };
+	}
+
+	Result<std::optional<std::span<const std::byte>>> ReadbackManager::poll(uint64_t id) {
+		auto it = reads.find(id);
+		if (it == reads.end()) {
+			return { expected_value };
+		}
+		auto ready = it->second.future.is_ready();
+		if (!ready) {
+			return ready;
+		}
+		if (!*ready) {
+			return { expected_value };
+		}
+		VUK_DO_OR_RETURN(invalidate(it->second));
+		return { expected_value, it->second.data };
+	}
+
+	void ReadbackManager::release(uint64_t id) {
+		reads.erase(id);
+	}
+} // namespace vuk
@@ -1,14 +1,17 @@
 #include "vuk/RenderGraph.hpp"
 #include "RenderGraphImpl.hpp"
 #include "RenderGraphUtil.hpp"
+#include "vuk/AllocatorHelpers.hpp"
 #include "vuk/CommandBuffer.hpp"
 #include "vuk/Context.hpp"
 #include "vuk/Exception.hpp"
 #include "vuk/Future.hpp"
 
+#include <algorithm>
 #include <bit>
 #include <charconv>
 #include <fmt/printf.h>
+#include <numeric>
 #include <set>
 #include <sstream>
 #include <unordered_set>
@@ -48,6 +51,7 @@ namespace vuk {
 		pw.resources.offset1 = impl->resources.size();
 		pw.type = p.type;
 		pw.source = std::move(source);
+		pw.condition = std::move(p.condition);
 		impl->passes.emplace_back(std::move(pw));
 	}
 
@@ -118,6 +122,11 @@ namespace vuk {
 			diverged_subchain_headers.emplace(QualifiedName{ joiner, name.name }, v);
 		}
 
+		for (auto [name, v] : other.impl->diverged_buffer_subchain_headers) {
+			v.first.prefix = joiner;
+			diverged_buffer_subchain_headers.emplace(QualifiedName{ joiner, name.name }, v);
+		}
+
 		final_releases.insert(final_releases.end(), other.impl->final_releases.begin(), other.impl->final_releases.end());
 	}
 
@@ -145,6 +154,24 @@ namespace vuk {
 		add_pass(std::move(post));
 	}
 
+	void RenderGraph::diverge_buffer(Name whole_name, Subrange::Buffer subrange, Name subrange_name) {
+		impl->diverged_buffer_subchain_headers.emplace_back(QualifiedName{ Name{}, subrange_name }, std::pair{ QualifiedName{ Name{}, whole_name }, subrange });
+
+		add_pass({ .name = whole_name.append("_DIVERGE"),
+		           .resources = { Resource{ whole_name, Resource::Type::eBuffer, Access::eConsume, subrange_name } },
+		           .execute = diverge,
+		           .type = PassType::eDiverge });
+	}
+
+	void RenderGraph::converge_buffer_explicit(std::span<Name> pre_diverge, Name post_diverge) {
+		Pass post{ .name = post_diverge.append("_CONVERGE"), .execute = converge, .type = PassType::eConverge };
+		post.resources.emplace_back(Resource{ Name{}, Resource::Type::eBuffer, Access::eConverge, post_diverge });
+		for (auto& name : pre_diverge) {
+			post.resources.emplace_back(Resource{ name, Resource::Type::eBuffer, Access::eConsume });
+		}
+		add_pass(std::move(post));
+	}
+
 	void RGCImpl::merge_diverge_passes(std::vector<PassInfo, short_alloc<PassInfo, 64>>& passes) {
 		std::unordered_map<QualifiedName, PassInfo*> merge_passes;
 		for (auto& pass : passes) {
@@ -322,7 +349,7 @@ namespace vuk {
 		// diverging subchains are chains where def->pass >= 0 AND def->pass type is eDiverge
 		// reconverged subchains are chains where def->pass >= 0 AND def->pass type is eConverge
 		for (auto& head : chains) {
-			if (head->def->pass >= 0 && head->type == Resource::Type::eImage) { // no Buffer divergence
+			if (head->def->pass >= 0) {
 				auto& pass = get_pass(*head->def);
 				if (pass.pass->type == PassType::eDiverge) { // diverging subchain
 					auto& whole_res = pass.resources.to_span(resources)[0].name;
@@ -342,7 +369,7 @@ namespace vuk {
 		conv_subchains.clear();
 		// take all converged subchains and replace their def with a new attachment that has the original and subrange, and unsynch acq
 		for (auto& head : chains) {
-			if (head->def->pass >= 0 && head->type == Resource::Type::eImage) { // no Buffer divergence
+			if (head->def->pass >= 0) {
 				auto& pass = get_pass(*head->def);
 				if (pass.pass->type == PassType::eConverge) { // converge subchain
 					conv_subchains.push_back(&head);
@@ -378,19 +405,31 @@ namespace vuk {
 					link = link->source;
 				}
 			}
-			auto whole_att = get_bound_attachment(link->def->pass); // the whole attachment
-			whole_att.name = QualifiedName{ Name{}, whole_res.out_name.name };
-			whole_att.acquire.unsynchronized = true;
-			whole_att.parent_attachment = link->def->pass;
-			auto new_bound = bound_attachments.emplace_back(whole_att);
-			// replace head->def with new attachments (the converged resource)
-			(*head)->def = { .pass = static_cast<int32_t>(-1 * bound_attachments.size()) };
+			if ((*head)->type == Resource::Type::eImage) {
+				auto whole_att = get_bound_attachment(link->def->pass); // the whole attachment
+				whole_att.name = QualifiedName{ Name{}, whole_res.out_name.name };
+				whole_att.acquire.unsynchronized = true;
+				whole_att.parent_attachment = link->def->pass;
+				auto new_bound = bound_attachments.emplace_back(whole_att);
+				// replace head->def with new attachments (the converged resource)
+				(*head)->def = { .pass = static_cast<int32_t>(-1 * bound_attachments.size()) };
+			} else {
+				auto whole_buf = get_bound_buffer(link->def->pass); // the whole buffer
+				whole_buf.name = QualifiedName{ Name{}, whole_res.out_name.name };
+				whole_buf.acquire.unsynchronized = true;
+				whole_buf.parent_buffer = link->def->pass;
+				bound_buffers.emplace_back(whole_buf);
+				// replace head->def with new buffer (the converged resource)
+				(*head)->def = { .pass = static_cast<int32_t>(-1 * bound_buffers.size()) };
+			}
 		}
 
 		div_subchains.clear();
+		// subranges diverged together, by diverge pass - their uses are not synchronized against each other, so they must not overlap
+		std::unordered_map<int32_t, std::vector<std::pair<QualifiedName, Subrange::Buffer>>> buffer_divergences;
 		// take all diverged subchains and replace their def with a new attachment that has the proper acq and subrange
 		for (auto& head : chains) {
-			if (head->def->pass >= 0 && head->type == Resource::Type::eImage) { // no Buffer divergence
+			if (head->def->pass >= 0) {
 				auto& pass = get_pass(*head->def);
 				if (pass.pass->type == PassType::eDiverge) { // diverging subchain
 					div_subchains.push_back(head);
@@ -400,15 +439,54 @@ namespace vuk {
 					while (link->prev) { // seek to the head of the original chain
 						link = link->prev;
 					}
-					auto att = get_bound_attachment(link->def->pass); // the original chain attachment, make copy
 					auto& our_res = get_resource(*head->def);
+					if (head->type == Resource::Type::eImage) {
+						auto att = get_bound_attachment(link->def->pass); // the original chain attachment, make copy
+						att.image_subrange = diverged_subchain_headers.at(our_res.out_name).second; // look up subrange referenced by this subchain
+						att.name = QualifiedName{ Name{}, our_res.out_name.name };
+						att.parent_attachment = link->def->pass;
+						auto new_bound = bound_attachments.emplace_back(att);
+						// replace def with new attachment
+						head->def = { .pass = static_cast<int32_t>(-1 * bound_attachments.size()) };
+					} else {
+						auto buf = get_bound_buffer(link->def->pass); // the original chain buffer, make copy
+						buf.buffer_subrange = diverged_buffer_subchain_headers.at(our_res.out_name).second; // look up subrange referenced by this subchain
+						buffer_divergences[head->def->pass].emplace_back(our_res.out_name, buf.buffer_subrange);
+						buf.name = QualifiedName{ Name{}, our_res.out_name.name };
+						buf.parent_buffer = link->def->pass;
+						bound_buffers.emplace_back(buf);
+						// replace def with new buffer
+						head->def = { .pass = static_cast<int32_t>(-1 * bound_buffers.size()) };
+					}
+				}
+			}
+		}
 
-					att.image_subrange = diverged_subchain_headers.at(our_res.out_name).second; // look up subrange referenced by this subchain
-					att.name = QualifiedName{ Name{}, our_res.out_name.name };
-					att.parent_attachment = link->def->pass;
-					auto new_bound = bound_attachments.emplace_back(att);
-					// replace def with new attachment
-					head->def = { .pass = static_cast<int32_t>(-1 * bound_attachments.size()) };
+		for (auto& [pass, subranges] : buffer_divergences) {
+			auto end = [](const Subrange::Buffer& r) {
+				return r.size == VK_WHOLE_SIZE ? ~uint64_t(0) : r.offset + r.size;
+			};
+			for (size_t i = 0; i < subranges.size(); i++) {
+				for (size_t j = i + 1; j < subranges.size(); j++) {
+					auto& [name_a, a] = subranges[i];
+					auto& [name_b, b] = subranges[j];
+					if (a.offset < end(b) && b.offset < end(a)) {
+						auto print = [](std::stringstream& msg, const QualifiedName& name, const Subrange::Buffer& r) {
+							msg << "[" << name.name.c_str() << "] at offset " << r.offset;
+							if (r.size == VK_WHOLE_SIZE) {
+								msg << " to the end";
+							} else {
+								msg << " of size " << r.size;
+							}
+						};
+						std::stringstream msg;
+						msg << "Diverged buffer subranges ";
+						print(msg, name_a, a);
+						msg << " and ";
+						print(msg, name_b, b);
+						msg << " overlap";
+						return { expected_error, RenderGraphException{ msg.str() } };
+					}
 				}
 			}
 		}
@@ -1073,6 +1151,95 @@ namespace vuk {
 		}
 	}
 
+	void RenderGraph::attach_persistent(Name name, PersistentResource& resource) {
+		for (uint32_t age = 0; age < resource.history_length(); age++) {
+			auto& version = resource.get_version(age);
+			Acquire acquire;
+			if (version.status == FutureBase::Status::eInitial) { // never used - discard
+				acquire.src_use = to_use(eNone, DomainFlagBits::eAny);
+				acquire.initial_visibility = 0;
+			} else {
+				acquire = { version.last_use, version.initial_domain, version.initial_visibility };
+			}
+			QualifiedName qname{ Name{}, PersistentResource::history_name(name, age) };
+			if (resource.get_type() == Resource::Type::eImage) {
+				// the current version is overwritten, the contents from history_length frames ago are discarded
+				if (age == 0) {
+					acquire.src_use.layout = ImageLayout::eUndefined;
+				}
+				AttachmentInfo attachment_info;
+				attachment_info.name = qname;
+				attachment_info.attachment = version.get_result<ImageAttachment>();
+				attachment_info.type = AttachmentInfo::Type::eExternal;
+				attachment_info.acquire = acquire;
+				attachment_info.persistent_version = &version;
+				impl->bound_attachments.emplace(qname, attachment_info);
+			} else {
+				BufferInfo buf_info{ .name = qname, .buffer = version.get_result<Buffer>(), .acquire = acquire, .persistent_version = &version };
+				impl->bound_buffers.emplace(qname, buf_info);
+			}
+		}
+	}
+
+	void PersistentResource::advance() noexcept {
+		current++;
+	}
+
+	FutureBase& PersistentResource::get_version(uint32_t age) noexcept {
+		assert(age < versions.size());
+		// versions are stored in a ring, the current version moves backwards every frame
+		auto index = (versions.size() - (current % versions.size()) + age) % versions.size();
+		return *versions[index];
+	}
+
+	Name PersistentResource::history_name(Name name, uint32_t age) {
+		if (age == 0) {
+			return name;
+		}
+		return name.append("_prev" + std::to_string(age));
+	}
+
+	Result<PersistentResource> create_persistent_image(Allocator& allocator, ImageAttachment ia, uint32_t history_length) {
+		assert(history_length > 0);
+		PersistentResource pr;
+		pr.type = Resource::Type::eImage;
+		for (uint32_t i = 0; i < history_length; i++) {
+			auto img = allocate_image(allocator, ia);
+			if (!img) {
+				return img;
+			}
+			auto version_ia = ia;
+			version_ia.image = **img;
+			auto iv = allocate_image_view(allocator, version_ia);
+			if (!iv) {
+				return iv;
+			}
+			version_ia.image_view = **iv;
+			auto& version = pr.versions.emplace_back(std::make_unique<FutureBase>());
+			version->result = version_ia;
+			version->last_use.layout = ImageLayout::eUndefined;
+			pr.images.emplace_back(std::move(*img));
+			pr.image_views.emplace_back(std::move(*iv));
+		}
+		return { expected_value, std::move(pr) };
+	}
+
+	Result<PersistentResource> create_persistent_buffer(Allocator& allocator, const BufferCreateInfo& bci, uint32_t history_length) {
+		assert(history_length > 0);
+		PersistentResource pr;
+		pr.type = Resource::Type::eBuffer;
+		for (uint32_t i = 0; i < history_length; i++) {
+			auto buf = allocate_buffer(allocator, bci);
+			if (!buf) {
+				return buf;
+			}
+			auto& version = pr.versions.emplace_back(std::make_unique<FutureBase>());
+			version->result = **buf;
+			pr.buffers.emplace_back(std::move(*buf));
+		}
+		return { expected_value, std::move(pr) };
+	}
+
 	void RenderGraph::inference_rule(Name target, std::function<void(const struct InferenceContext&, ImageAttachment&)> rule) {
 		impl->ia_inference_rules.emplace_back(IAInference{ QualifiedName{ Name{}, target }, std::move(rule) });
 	}
@@ -1305,8 +1472,16 @@ namespace vuk {
 		if (current_use.domain == DomainFlagBits::eAny) {
 			current_use.domain = last_use.domain;
 		}
-		barrier.srcQueueFamilyIndex = static_cast<uint32_t>((last_use.domain & DomainFlagBits::eQueueMask).m_mask);
-		barrier.dstQueueFamilyIndex = static_cast<uint32_t>((current_use.domain & DomainFlagBits::eQueueMask).m_mask);
+		if (get_bound_attachment(bound_attachment).attachment.sharing_mode == SharingMode::eConcurrent) {
+			// no ownership transfer for concurrent images: there is no release half, the semaphore signal makes the writes available,
+			// and the acquire half performs the layout transition
+			assert(!is_release);
+			barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		} else {
+			barrier.srcQueueFamilyIndex = static_cast<uint32_t>((last_use.domain & DomainFlagBits::eQueueMask).m_mask);
+			barrier.dstQueueFamilyIndex = static_cast<uint32_t>((current_use.domain & DomainFlagBits::eQueueMask).m_mask);
+		}
 
 		if (last_use.stages == PipelineStageFlags{}) {
 			barrier.srcAccessMask = {};
@@ -1347,14 +1522,10 @@ namespace vuk {
 #endif
 
 		// we need to handle chains in order of dependency
+		// subchains are unblocked when their parent chain is processed
 		std::vector<ChainLink*> work_queue;
 		for (auto head : chains) {
-			bool is_image = head->type == Resource::Type::eImage;
-			if (is_image) {
-				if (!head->source) {
-					work_queue.push_back(head);
-				}
-			} else {
+			if (!head->source) {
 				work_queue.push_back(head);
 			}
 		}
@@ -1586,7 +1757,8 @@ namespace vuk {
 
 					if (res.ia != eConsume) {
 						if (is_image) {
-							if (crosses_queue(last_use, use)) { // release barrier
+							bool concurrent = get_bound_attachment(head->def->pass).attachment.sharing_mode == SharingMode::eConcurrent;
+							if (crosses_queue(last_use, use) && !concurrent) { // release barrier, concurrent images are not released
 								if (last_executing_pass_idx !=
 								    -1) { // if last_executing_pass_idx is -1, then there is release in this rg, so we don't emit the release (single-sided acq)
 									emit_image_barrier(get_pass(last_executing_pass_idx).post_image_barriers, head->def->pass, last_use, use, image_subrange, aspect, true);
@@ -1674,21 +1846,24 @@ namespace vuk {
 				QueueResourceUse use = release.dst_use;
 				if (use.layout != ImageLayout::eUndefined) {
 					if (is_image) {
-						// single sided release barrier
-						emit_image_barrier(get_pass(last_pass_idx).post_image_barriers, head->def->pass, last_use, use, image_subrange, aspect, true);
+						// single sided release barrier, concurrent images are not released and keep their last layout for the acquire to transition
+						if (get_bound_attachment(head->def->pass).attachment.sharing_mode != SharingMode::eConcurrent) {
+							emit_image_barrier(get_pass(last_pass_idx).post_image_barriers, head->def->pass, last_use, use, image_subrange, aspect, true);
+						}
 					} else {
 						emit_memory_barrier(get_pass(last_pass_idx).post_memory_barriers, last_use, use);
 					}
 				}
 			} else if (!link->undef) {
 				// no release on this end, so if def belongs to an RP and there were no reads, we can downgrade the store
+				// (unless the resource is persistent, then the contents are used by a later RenderGraph)
 				if (link->def && link->def->pass >= 0 && link->reads.size() == 0) {
 					auto& pass = get_pass(link->def->pass);
 					if (pass.render_pass_index >= 0) {
 						auto& rpi = rpis[pass.render_pass_index];
 						auto& bound_att = get_bound_attachment(head->def->pass);
 						for (auto& att : rpi.attachments.to_span(rp_infos)) {
-							if (att.attachment_info == &bound_att) {
+							if (att.attachment_info == &bound_att && !bound_att.persistent_version) {
 								att.description.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
 							}
 						}
@@ -1697,13 +1872,42 @@ namespace vuk {
 				// TODO: we can also downgrade if the reads are in the same RP, but this is less likely
 			}
 
+			// persistent resources record their last use on this chain, so that the next RenderGraph can acquire them precisely
+			if (!is_subchain) {
+				auto persistent_version = is_image ? get_bound_attachment(head->def->pass).persistent_version : get_bound_buffer(head->def->pass).persistent_version;
+				if (persistent_version) {
+					// the last pass using the resource is the last read, or the def if there were no reads
+					int32_t last_pass_idx = -1;
+					for (auto& r : link->reads.to_span(pass_reads)) {
+						last_pass_idx = std::max(last_pass_idx, (int32_t)computed_pass_idx_to_ordered_idx[r.pass]);
+					}
+					if (last_pass_idx == -1 && link->def->pass >= 0) {
+						last_pass_idx = (int32_t)computed_pass_idx_to_ordered_idx[link->def->pass];
+					}
+					// if the resource was not used, the previously recorded use remains valid
+					if (last_pass_idx != -1) {
+						QueueResourceUse final_use = last_use;
+						if (link->undef && link->undef->pass < 0) {
+							auto& release = get_release(link->undef->pass);
+							if (release.dst_use.layout != ImageLayout::eUndefined) {
+								final_use = release.dst_use;
+								final_use.domain = last_use.domain;
+							}
+						}
+						// only committed to the version when the RenderGraph is submitted, so that compiling without submitting leaves the history intact
+						get_pass(last_pass_idx).persistent_uses.append(persistent_uses, { persistent_version, final_use });
+					}
+				}
+			}
+
 			// we have processed this chain, lets see if we can unblock more chains
 			for (auto new_head : link->child_chains.to_span(child_chains)) {
 				if (!new_head) {
 					continue;
 				}
-				auto& new_att = get_bound_attachment(new_head->def->pass);
-				new_att.acquire.src_use = last_use;
+				auto& new_acquire =
+				    new_head->type == Resource::Type::eImage ? get_bound_attachment(new_head->def->pass).acquire : get_bound_buffer(new_head->def->pass).acquire;
+				new_acquire.src_use = last_use;
 				work_queue.push_back(new_head);
 			}
 		}
@@ -2028,6 +2232,10 @@ namespace vuk {
 		return &impl->bound_buffers;
 	}
 
+	size_t Compiler::get_image_barrier_count() const {
+		return impl->image_barriers.size();
+	}
+
 	ImageUsageFlags Compiler::compute_usage(const ChainLink* head) {
 		return impl->compute_usage(head);
 	}
@@ -2124,4 +2332,142 @@ namespace vuk {
 
 		return {};
 	}
+
+	// compute the interval of passes (in execution order) that use the resource
+	static void compute_live_interval(RGCImpl& impl, RelSpan<ChainLink*> use_chains, int32_t& first_pass, int32_t& last_pass) {
+		auto add_pass = [&](int32_t computed_pass_idx) {
+			auto order_idx = (int32_t)impl.computed_pass_idx_to_ordered_idx[computed_pass_idx];
+			first_pass = first_pass == -1 ? order_idx : std::min(first_pass, order_idx);
+			last_pass = std::max(last_pass, order_idx);
+		};
+		for (auto& head : use_chains.to_span(impl.attachment_use_chain_references)) {
+			for (ChainLink* link = head; link != nullptr; link = link->next) {
+				if (link->def && link->def->pass >= 0) {
+					add_pass(link->def->pass);
+				}
+				for (auto& r : link->reads.to_span(impl.pass_reads)) {
+					add_pass(r.pass);
+				}
+				if (link->undef && link->undef->pass >= 0) {
+					add_pass(link->undef->pass);
+				}
+			}
+		}
+	}
+
+	// report of the transient resources, once their attachments and buffers have been inferred
+	static Result<TransientMemoryReport> estimate_inferred_transient_memory(RGCImpl& impl) {
+		TransientMemoryReport report;
+		for (auto& bound : impl.bound_attachments) {
+			// only images created during execution
+			if (bound.type != AttachmentInfo::Type::eInternal || bound.parent_attachment != 0 || bound.attachment.image) {
+				continue;
+			}
+			auto& ia = bound.attachment;
+			TransientResourceEstimate est{ .name = bound.name, .type = Resource::Type::eImage, .cacheable = !bound.allocator };
+			for (uint32_t level = 0; level < ia.level_count; level++) {
+				Extent3D level_extent{ std::max(ia.extent.extent.width >> level, 1u),
+					                     std::max(ia.extent.extent.height >> level, 1u),
+					                     std::max(ia.extent.extent.depth >> level, 1u) };
+				est.size += (uint64_t)compute_image_size(ia.format, level_extent) * ia.layer_count * (uint32_t)ia.sample_count.count;
+			}
+			compute_live_interval(impl, bound.use_chains, est.first_pass, est.last_pass);
+			report.resources.emplace_back(est);
+		}
+
+		for (auto& bound : impl.bound_buffers) {
+			// only buffers created during execution, subranges are part of their parent
+			if (bound.buffer.buffer != VK_NULL_HANDLE || bound.parent_buffer != 0) {
+				continue;
+			}
+			TransientResourceEstimate est{ .name = bound.name, .type = Resource::Type::eBuffer, .size = bound.buffer.size };
+			compute_live_interval(impl, bound.use_chains, est.first_pass, est.last_pass);
+			report.resources.emplace_back(est);
+		}
+
+		for (auto& est : report.resources) {
+			report.total_size += est.size;
+			if (est.cacheable) {
+				report.cacheable_size += est.size;
+			}
+		}
+
+		// sweep the passes in execution order, summing the resources live during each
+		for (int32_t pass_idx = 0; pass_idx < (int32_t)impl.ordered_passes.size(); pass_idx++) {
+			uint64_t live_size = 0;
+			for (auto& est : report.resources) {
+				if (est.first_pass <= pass_idx && pass_idx <= est.last_pass) {
+					live_size += est.size;
+				}
+			}
+			if (live_size > report.peak_live_size) {
+				report.peak_live_size = live_size;
+				report.peak_pass = pass_idx;
+			}
+		}
+
+		// place the resources into one heap, largest first, at the lowest offset not used by a resource live at the same time
+		std::vector<size_t> order(report.resources.size());
+		std::iota(order.begin(), order.end(), size_t{ 0 });
+		std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return report.resources[a].size > report.resources[b].size; });
+		std::vector<std::pair<uint64_t, uint64_t>> placed(report.resources.size()); // [begin, end) in the heap
+		for (size_t i = 0; i < order.size(); i++) {
+			auto& est = report.resources[order[i]];
+			uint64_t offset = 0;
+			bool moved = true;
+			while (moved) {
+				moved = false;
+				for (size_t j = 0; j < i; j++) {
+					auto& other = report.resources[order[j]];
+					auto [begin, end] = placed[order[j]];
+					bool live_together = est.first_pass <= other.last_pass && other.first_pass <= est.last_pass;
+					if (live_together && offset < end && begin < offset + est.size) {
+						offset = end;
+						moved = true;
+					}
+				}
+			}
+			placed[order[i]] = { offset, offset + est.size };
+			report.aliased_size = std::max(report.aliased_size, offset + est.size);
+		}
+
+		return { expected_value, std::move(report) };
+	}
+
+	Result<TransientMemoryReport> Compiler::estimate_transient_memory() {
+		if (impl->inferred) {
+			return estimate_inferred_transient_memory(*impl);
+		}
+
+		// inference runs on a scratch copy of the state it writes, so that execute() still infers with the swapchain images it is given
+		// the copies are assigned back in place, keeping the pointers into these vectors valid
+		auto bound_attachments = impl->bound_attachments;
+		auto bound_buffers = impl->bound_buffers;
+		auto rpis = impl->rpis;
+		auto attachment_rp_references = impl->attachment_rp_references;
+		auto restore = [&]() {
+			impl->bound_attachments = bound_attachments;
+			impl->bound_buffers = bound_buffers;
+			impl->rpis = rpis;
+			impl->attachment_rp_references = attachment_rp_references;
+			impl->inferred = false;
+		};
+
+		// swapchain images are not acquired yet, but their extent is known
+		for (auto& bound : impl->bound_attachments) {
+			if (bound.type == AttachmentInfo::Type::eSwapchain && bound.parent_attachment == 0) {
+				bound.attachment.extent = Dimension3D::absolute(bound.swapchain->extent);
+				bound.attachment.sample_count = vuk::Samples::e1;
+			}
+		}
+
+		ExecutableRenderGraph erg(*this);
+		if (auto result = erg.infer(); !result) {
+			restore();
+			return result;
+		}
+		auto report = estimate_inferred_transient_memory(*impl);
+		restore();
+		return report;
+	}
 } // namespace vuk
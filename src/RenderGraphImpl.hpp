@@ -58,6 +58,7 @@ namespace vuk {
 		std::byte* arguments; // internal use
 		PassType type;
 		source_location source;
+		std::function<bool()> condition;
 	};
 
 	struct PassInfo {
@@ -80,6 +81,7 @@ namespace vuk {
 		RelSpan<std::pair<DomainFlagBits, uint64_t>> relative_waits;
 		RelSpan<std::pair<DomainFlagBits, uint64_t>> absolute_waits;
 		RelSpan<FutureBase*> future_signals;
+		RelSpan<std::pair<FutureBase*, QueueResourceUse>> persistent_uses;
 		RelSpan<int32_t> referenced_swapchains; // TODO: maybe not the best place for it
 
 		int32_t is_waited_on = 0;
@@ -95,6 +97,9 @@ namespace vuk {
 		std::vector<std::pair<QualifiedName, std::pair<QualifiedName, Subrange::Image>>,
 		            short_alloc<std::pair<QualifiedName, std::pair<QualifiedName, Subrange::Image>>, 64>>
 		    diverged_subchain_headers;
+		std::vector<std::pair<QualifiedName, std::pair<QualifiedName, Subrange::Buffer>>,
+		            short_alloc<std::pair<QualifiedName, std::pair<QualifiedName, Subrange::Buffer>>, 64>>
+		    diverged_buffer_subchain_headers;
 
 		robin_hood::unordered_flat_map<QualifiedName, AttachmentInfo> bound_attachments;
 		robin_hood::unordered_flat_map<QualifiedName, BufferInfo> bound_buffers;
@@ -121,6 +126,7 @@ namespace vuk {
 		    INIT(imported_names),
 		    INIT(aliases),
 		    INIT(diverged_subchain_headers),
+		    INIT(diverged_buffer_subchain_headers),
 		    INIT(ia_inference_rules),
 		    INIT(buf_inference_rules),
 		    INIT(subgraphs),
@@ -159,6 +165,7 @@ namespace vuk {
 		std::vector<std::pair<DomainFlagBits, uint64_t>> waits;
 		std::vector<std::pair<DomainFlagBits, uint64_t>> absolute_waits;
 		std::vector<FutureBase*> future_signals;
+		std::vector<std::pair<FutureBase*, QueueResourceUse>> persistent_uses;
 		std::deque<QualifiedName> qfname_references;
 		// /per PassInfo
 
@@ -239,6 +246,7 @@ namespace vuk {
 		std::unordered_map<QualifiedName, BufferInferences> buf_inference_rules;
 
 		robin_hood::unordered_flat_map<QualifiedName, std::pair<QualifiedName, Subrange::Image>> diverged_subchain_headers;
+		robin_hood::unordered_flat_map<QualifiedName, std::pair<QualifiedName, Subrange::Buffer>> diverged_buffer_subchain_headers;
 
 		QualifiedName resolve_name(QualifiedName in) {
 			auto it = assigned_names.find(in);
@@ -315,6 +323,7 @@ namespace vuk {
 		ImageUsageFlags compute_usage(const ChainLink* head);
 
 		ProfilingCallbacks callbacks;
+		bool inferred = false;
 	};
 #undef INIT
 
@@ -272,6 +272,9 @@ namespace vuk {
 		Buffer buffer;
 		FutureBase* attached_future = nullptr;
 		Acquire acquire;
+		FutureBase* persistent_version = nullptr; // receives the last use when attached from a PersistentResource
+		Subrange::Buffer buffer_subrange;
+		int32_t parent_buffer = 0;
 
 		RelSpan<ChainLink*> use_chains;
 		std::optional<Allocator> allocator = {};
@@ -291,6 +294,7 @@ namespace vuk {
 
 		FutureBase* attached_future = nullptr;
 		Acquire acquire;
+		FutureBase* persistent_version = nullptr; // receives the last use when attached from a PersistentResource
 		Subrange::Image image_subrange;
 		int32_t parent_attachment = 0;
 
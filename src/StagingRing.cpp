@@ -0,0 +1,183 @@
+#include "StagingRing.hpp"
+#include "vuk/Future.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cstdio>
+
+namespace vuk {
+	StagingRing::~StagingRing() {
+		// the Context is destroyed after the device has become idle
+		for (auto& d : dedicated) {
+			d.resource->deallocate_buffers(std::span{ &d.buffer, 1 });
+		}
+		if (buffer) {
+			upstream->deallocate_buffers(std::span{ &buffer, 1 });
+		}
+	}
+
+	std::optional<StagingAllocation> StagingRing::allocate(size_t size, size_t alignment) {
+		std::lock_guard _(mutex);
+		// large uploads would occupy too much of the ring, they are better served by dedicated memory
+		if (capacity == 0 || size == 0 || size > capacity / 4 || allocation_failed) {
+			stats.fallbacks++;
+			return {};
+		}
+		if (!buffer) {
+			BufferCreateInfo bci{ usage, capacity, 1 };
+			auto result = upstream->allocate_buffers(std::span{ &buffer, 1 }, std::span{ &bci, 1 }, VUK_HERE_AND_NOW());
+			if (!result) {
+				// don't retry every upload, they fall back to the memory of their allocator
+				fprintf(stderr, "vuk: allocating the staging ring failed, uploads fall back to their allocator: %s\n", result.error().what());
+				allocation_failed = true;
+				stats.fallbacks++;
+				return {};
+			}
+		}
+
+		reclaim();
+
+		alignment = std::max(alignment, (size_t)1);
+		size_t offset;
+		if (regions.empty()) {
+			offset = 0;
+		} else {
+			size_t tail = regions.front().begin;
+			if (head > tail) {
+				// free space is [head, capacity) and [0, tail)
+				offset = align_up(head, alignment);
+				if (offset + size > capacity) {
+					// the space skipped at the end is reclaimed together with the region before it
+					offset = 0;
+					if (size > tail) {
+						stats.fallbacks++;
+						return {};
+					}
+					stats.wraps++;
+				}
+			} else {
+				// free space is [head, tail), if head == tail the ring is full
+				offset = align_up(head, alignment);
+				if (head == tail || offset + size > tail) {
+					stats.fallbacks++;
+					return {};
+				}
+			}
+		}
+
+		head = offset + size;
+		uint64_t id = first_id + regions.size();
+		regions.push_back(Region{ .begin = offset, .end = head });
+		stats.allocations++;
+		stats.allocated_bytes += size;
+		stats.in_use_bytes += size;
+		stats.high_water_bytes = std::max(stats.high_water_bytes, stats.in_use_bytes);
+
+		return StagingAllocation{ .buffer = buffer.subrange(offset, size), .release = std::make_shared<StagingRelease>(this, id) };
+	}
+
+	StagingRing::Waits StagingRing::waits_for(std::optional<std::pair<VkSemaphore, uint64_t>> last_use) {
+		Waits waits;
+		if (last_use) {
+			waits.values[waits.count++] = *last_use;
+			return waits;
+		}
+		// the memory was last used by a submission started before now, which has reserved its signal value already, even if it has not been issued yet
+		// the submitted value of the timeline would not cover it, so the memory waits for the values reserved so far on every queue
+		for (auto* queue : { ctx->graphics_queue, ctx->compute_queue, ctx->transfer_queue }) {
+			if (!queue) {
+				continue;
+			}
+			auto semaphore = queue->get_submit_sync().semaphore;
+			bool seen = false;
+			for (uint32_t i = 0; i < waits.count; i++) {
+				seen |= waits.values[i].first == semaphore;
+			}
+			if (!seen) {
+				waits.values[waits.count++] = { semaphore, queue->get_reserved_value() };
+			}
+		}
+		return waits;
+	}
+
+	void StagingRing::retire(uint64_t id, std::optional<std::pair<VkSemaphore, uint64_t>> last_use) {
+		std::lock_guard _(mutex);
+		auto& region = regions[id - first_id];
+		region.retired = true;
+		region.waits = waits_for(last_use);
+	}
+
+	void StagingRing::retire_dedicated(DeviceResource& resource, Buffer buffer, std::optional<std::pair<VkSemaphore, uint64_t>> last_use) {
+		std::lock_guard _(mutex);
+		dedicated.push_back(Dedicated{ .resource = &resource, .buffer = buffer, .waits = waits_for(last_use) });
+		reclaim();
+	}
+
+	void StagingRelease::set_last_use(Future& future) {
+		auto control = future.get_control();
+		assert(control->status == FutureBase::Status::eSubmitted);
+		auto& queue = ring->ctx->domain_to_queue(control->initial_domain);
+		last_use = { queue.get_submit_sync().semaphore, control->initial_visibility };
+	}
+
+	void StagingRing::reclaim() {
+		// completed values are queried at most once per queue
+		std::array<std::pair<VkSemaphore, uint64_t>, 3> completed;
+		uint32_t completed_count = 0;
+		auto is_reached = [&](VkSemaphore semaphore, uint64_t value) {
+			for (uint32_t i = 0; i < completed_count; i++) {
+				if (completed[i].first == semaphore) {
+					return completed[i].second >= value;
+				}
+			}
+			uint64_t completed_value = 0;
+			ctx->vkGetSemaphoreCounterValue(ctx->device, semaphore, &completed_value);
+			completed[completed_count++] = { semaphore, completed_value };
+			return completed_value >= value;
+		};
+		auto all_reached = [&](const Waits& waits) {
+			for (uint32_t i = 0; i < waits.count; i++) {
+				if (!is_reached(waits.values[i].first, waits.values[i].second)) {
+					return false;
+				}
+			}
+			return true;
+		};
+
+		for (auto& region : regions) {
+			if (!region.retired || region.reclaimed) {
+				continue;
+			}
+			if (all_reached(region.waits)) {
+				region.reclaimed = true;
+				stats.in_use_bytes -= region.end - region.begin;
+			}
+		}
+
+		std::erase_if(dedicated, [&](Dedicated& d) {
+			if (!all_reached(d.waits)) {
+				return false;
+			}
+			d.resource->deallocate_buffers(std::span{ &d.buffer, 1 });
+			return true;
+		});
+
+		// the oldest regions give back the space up to the next region, the newest give back the space from the previous region
+		// ids of regions reclaimed at the back are handed out again, their release tokens have been destroyed already
+		while (!regions.empty() && regions.front().reclaimed) {
+			regions.pop_front();
+			first_id++;
+		}
+		while (!regions.empty() && regions.back().reclaimed) {
+			regions.pop_back();
+		}
+		head = regions.empty() ? 0 : regions.back().end;
+	}
+
+	StagingRingStats StagingRing::get_stats() {
+		std::lock_guard _(mutex);
+		auto result = stats;
+		result.capacity = capacity;
+		return result;
+	}
+} // namespace vuk
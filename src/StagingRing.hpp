@@ -0,0 +1,104 @@
+#pragma once
+
+#include "vuk/Context.hpp"
+
+#include <array>
+#include <deque>
+#include <mutex>
+#include <optional>
+#include <vector>
+
+namespace vuk {
+	/// @brief Persistently mapped host-visible buffer, handed out in order and reclaimed by queue timeline values
+	/// Regions are reclaimed in any order, but their space is reused once every older or every newer region has been reclaimed too,
+	/// so a region held for long only keeps its own space from being reused, as long as the regions after it are released.
+	/// Used for uploads (eCPUonly) and for readbacks (eGPUtoCPU)
+	struct StagingRing {
+		StagingRing(Context& ctx, DeviceResource& upstream, MemoryUsage usage = MemoryUsage::eCPUonly) : ctx(&ctx), upstream(&upstream), usage(usage) {}
+		~StagingRing();
+
+		StagingRing(const StagingRing&) = delete;
+		StagingRing& operator=(const StagingRing&) = delete;
+
+		std::optional<StagingAllocation> allocate(size_t size, size_t alignment);
+		/// @brief Called when every copy of the release token of a region has been destroyed
+		/// @param last_use timeline value of the last submission using the region, if known - otherwise the values reserved so far on every queue are waited for
+		void retire(uint64_t id, std::optional<std::pair<VkSemaphore, uint64_t>> last_use = {});
+		/// @brief Called when every copy of the release token of memory from an allocator has been destroyed, the memory is given back once its submissions have completed
+		void retire_dedicated(DeviceResource& resource, Buffer dedicated, std::optional<std::pair<VkSemaphore, uint64_t>> last_use = {});
+		StagingRingStats get_stats();
+
+		Context* ctx;
+		DeviceResource* upstream;
+		MemoryUsage usage;
+		size_t capacity = 0;
+
+	private:
+		// queue timeline values to wait for, at most one per queue
+		struct Waits {
+			std::array<std::pair<VkSemaphore, uint64_t>, 3> values;
+			uint32_t count = 0;
+		};
+
+		struct Region {
+			size_t begin;
+			size_t end;
+			bool retired = false;
+			// retired and its submissions have completed, the space is reused once it is at either end of the ring
+			bool reclaimed = false;
+			// filled once retired
+			Waits waits;
+		};
+
+		// memory from an allocator, handed to the ring when the ring could not serve the request
+		struct Dedicated {
+			DeviceResource* resource;
+			Buffer buffer;
+			Waits waits;
+		};
+
+		// the values to wait for before memory last used by last_use (or by any submission started so far) can be reused
+		Waits waits_for(std::optional<std::pair<VkSemaphore, uint64_t>> last_use);
+		// reclaim the regions and dedicated memory whose submissions have completed, and give back the space at both ends of the ring
+		void reclaim();
+
+		std::mutex mutex;
+		Buffer buffer = {};
+		bool allocation_failed = false;
+		size_t head = 0;
+		// id of regions.front()
+		uint64_t first_id = 0;
+		std::deque<Region> regions;
+		std::vector<Dedicated> dedicated;
+		StagingRingStats stats;
+	};
+
+	struct StagingRelease {
+		StagingRing* ring;
+		uint64_t id;
+
+		// signal value of the last submission using the region, if it is known
+		std::optional<std::pair<VkSemaphore, uint64_t>> last_use;
+
+		// memory from an allocator, given back to resource once retired
+		DeviceResource* resource = nullptr;
+		Buffer dedicated = {};
+
+		StagingRelease(StagingRing* ring, uint64_t id) : ring(ring), id(id) {}
+		StagingRelease(StagingRing* ring, DeviceResource& resource, Buffer dedicated) : ring(ring), id(0), resource(&resource), dedicated(dedicated) {}
+		StagingRelease(const StagingRelease&) = delete;
+		StagingRelease& operator=(const StagingRelease&) = delete;
+
+		~StagingRelease() {
+			if (resource) {
+				ring->retire_dedicated(*resource, dedicated, last_use);
+			} else {
+				ring->retire(id, last_use);
+			}
+		}
+
+		/// @brief The region is last used by the submission of future, which must have been submitted
+		/// Submissions started after it don't hold the region back once the token is released.
+		void set_last_use(Future& future);
+	};
+} // namespace vuk
@@ -0,0 +1,152 @@
+#include "vuk/StreamingUpload.hpp"
+#include "StagingRing.hpp"
+#include "vuk/AllocatorHelpers.hpp"
+#include "vuk/CommandBuffer.hpp"
+#include "vuk/Context.hpp"
+#include "vuk/RenderGraph.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <deque>
+#include <memory>
+#include <optional>
+#include <vector>
+
+namespace vuk {
+	Result<Future> stream_file_to_buffer(Allocator& allocator, Compiler& compiler, Buffer dst, const std::string& path, StreamingUploadParameters params) {
+		assert(params.chunk_size > 0 && params.max_chunks_in_flight > 0);
+		std::unique_ptr<FILE, decltype(&fclose)> file(fopen(path.c_str(), "rb"), &fclose);
+		if (!file) {
+			return { expected_error, FileIOException{ "Could not open " + path } };
+		}
+
+		// mapped buffers are read into directly
+		if (dst.mapped_ptr) {
+			size_t read = fread(dst.mapped_ptr, 1, dst.size, file.get());
+			if (read < dst.size && ferror(file.get())) {
+				return { expected_error, FileIOException{ "Could not read " + path } };
+			}
+			return { expected_value, Future(dst) };
+		}
+
+		auto& ctx = allocator.get_context();
+		bool use_ring = params.chunk_size <= ctx.get_staging_ring_stats().capacity / 4;
+
+		struct Chunk {
+			Future future;
+			// index into own_staging, if the chunk wasn't staged through the ring
+			std::optional<size_t> slot;
+			// region of the ring, if the chunk was staged through it
+			std::shared_ptr<StagingRelease> release;
+		};
+		std::deque<Chunk> in_flight;
+		// staging memory that doesn't come from the ring is kept and reused, so that memory use stays bounded
+		std::vector<Unique<Buffer>> own_staging;
+		std::vector<size_t> free_slots;
+
+		auto retire_oldest = [&]() -> Result<void> {
+			auto chunk = std::move(in_flight.front());
+			in_flight.pop_front();
+			if (chunk.slot) {
+				free_slots.push_back(*chunk.slot);
+			}
+			if (chunk.release) {
+				// the region waits only for this chunk, not for the newer chunks submitted since
+				chunk.release->set_last_use(chunk.future);
+			}
+			return chunk.future.wait(allocator, compiler);
+		};
+
+		// own_staging is destroyed on return, so before failing, the chunks in flight that may still read it are waited for
+		auto fail = [&](Result<Future> failed) -> Result<Future> {
+			std::vector<std::pair<DomainFlags, uint64_t>> last_uses;
+			for (auto& chunk : in_flight) {
+				auto control = chunk.future.get_control();
+				last_uses.emplace_back(control->initial_domain, control->initial_visibility);
+			}
+			if (auto result = ctx.wait_for_domains(std::span(last_uses)); !result) {
+				fprintf(stderr, "vuk: waiting for the chunks in flight failed: %s\n", result.error().what());
+			}
+			return failed;
+		};
+
+		for (size_t offset = 0; offset < dst.size;) {
+			if (in_flight.size() >= params.max_chunks_in_flight) {
+				if (auto result = retire_oldest(); !result) {
+					return fail(std::move(result));
+				}
+			}
+			size_t chunk_size = std::min(params.chunk_size, dst.size - offset);
+
+			Buffer staging;
+			std::shared_ptr<StagingRelease> release;
+			std::optional<size_t> slot;
+			// the ring is reclaimed as the queue timelines advance, so while it is full, the oldest chunk is waited for
+			while (use_ring) {
+				if (auto allocation = ctx.allocate_staging(chunk_size, 1)) {
+					staging = allocation->buffer;
+					release = std::move(allocation->release);
+					break;
+				}
+				if (in_flight.empty()) {
+					use_ring = false;
+					break;
+				}
+				if (auto result = retire_oldest(); !result) {
+					return fail(std::move(result));
+				}
+			}
+			if (!staging) {
+				if (free_slots.empty()) {
+					auto buffer = allocate_buffer(allocator, BufferCreateInfo{ MemoryUsage::eCPUonly, params.chunk_size, 1 });
+					if (!buffer) {
+						return fail(std::move(buffer));
+					}
+					free_slots.push_back(own_staging.size());
+					own_staging.emplace_back(std::move(*buffer));
+				}
+				slot = free_slots.back();
+				free_slots.pop_back();
+				staging = own_staging[*slot]->subrange(0, chunk_size);
+			}
+
+			size_t read = fread(staging.mapped_ptr, 1, chunk_size, file.get());
+			if (read < chunk_size && ferror(file.get())) {
+				return fail({ expected_error, FileIOException{ "Could not read " + path } });
+			}
+			if (read == 0) {
+				if (slot) {
+					free_slots.push_back(*slot);
+				}
+				break;
+			}
+
+			std::shared_ptr<RenderGraph> rgp = std::make_shared<RenderGraph>("stream_file_to_buffer");
+			rgp->add_pass({ .name = "STREAM CHUNK",
+			                .execute_on = params.copy_domain,
+			                .resources = { "_dst"_buffer >> Access::eTransferWrite, "_src"_buffer >> Access::eTransferRead },
+			                .execute = [read, release](CommandBuffer& command_buffer) {
+				                command_buffer.copy_buffer("_src", "_dst", read);
+			                } });
+			rgp->attach_buffer("_src", staging, Access::eNone);
+			rgp->attach_buffer("_dst", dst.subrange(offset, read), Access::eNone);
+			Future future{ std::move(rgp), "_dst+" };
+			if (auto result = future.submit(allocator, compiler); !result) {
+				return fail(std::move(result));
+			}
+			in_flight.push_back(Chunk{ std::move(future), slot, std::move(release) });
+
+			offset += read;
+			if (read < chunk_size) {
+				break;
+			}
+		}
+
+		while (!in_flight.empty()) {
+			if (auto result = retire_oldest(); !result) {
+				return fail(std::move(result));
+			}
+		}
+		return { expected_value, Future(dst) };
+	}
+} // namespace vuk
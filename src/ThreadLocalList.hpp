@@ -0,0 +1,76 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace vuk {
+	/// @brief Lock-free list of per-thread state, where each thread finds its own element through a thread-local cache
+	// elements are pushed by their thread on first use and freed with the list, T needs `std::thread::id thread` and `T* next` members
+	template<class T>
+	struct ThreadLocalList {
+		ThreadLocalList() : id(next_id++) {}
+
+		~ThreadLocalList() {
+			auto element = head.load();
+			while (element) {
+				delete std::exchange(element, element->next);
+			}
+		}
+
+		ThreadLocalList(const ThreadLocalList&) = delete;
+		ThreadLocalList& operator=(const ThreadLocalList&) = delete;
+
+		/// @brief The element of the calling thread, created on first use
+		T& get() {
+			for (auto& cached : cache) {
+				if (cached.list_id == id) {
+					return *cached.element;
+				}
+			}
+
+			auto thread = std::this_thread::get_id();
+			T* element = nullptr;
+			for (auto e = first(); e != nullptr; e = e->next) {
+				if (e->thread == thread) {
+					element = e;
+					break;
+				}
+			}
+			if (!element) {
+				element = new T;
+				element->thread = thread;
+				element->next = head.load(std::memory_order_relaxed);
+				while (!head.compare_exchange_weak(element->next, element, std::memory_order_release, std::memory_order_relaxed)) {
+				}
+			}
+
+			if (cache.size() >= max_cached_elements) {
+				cache.clear();
+			}
+			cache.push_back({ id, element });
+			return *element;
+		}
+
+		/// @brief The most recently pushed element, the others follow through next
+		T* first() {
+			return head.load(std::memory_order_acquire);
+		}
+
+	private:
+		struct CachedElement {
+			uint64_t list_id;
+			T* element;
+		};
+		// ids are never reused, so entries of destroyed lists are never matched
+		static inline std::atomic<uint64_t> next_id = 1;
+		static inline thread_local std::vector<CachedElement> cache;
+		static constexpr size_t max_cached_elements = 64;
+
+		uint64_t id;
+		std::atomic<T*> head = nullptr;
+	};
+} // namespace vuk
@@ -0,0 +1,144 @@
+#include "vuk/UploadBatch.hpp"
+#include "vuk/Partials.hpp"
+#include "vuk/RenderGraph.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <numeric>
+#include <string>
+
+namespace vuk {
+	UploadBatch::UploadBatch(Allocator& allocator, DomainFlagBits copy_domain) : allocator(&allocator), copy_domain(copy_domain) {}
+
+	size_t UploadBatch::add_buffer(Buffer dst, const void* src_data, size_t size) {
+		// host-mapped buffers just get memcpys
+		if (dst.mapped_ptr) {
+			::memcpy(dst.mapped_ptr, src_data, size);
+			uploads.push_back(Upload{ .buffer = dst, .on_host = true, .host_future = Future(dst) });
+		} else {
+			uploads.push_back(Upload{ .src_data = src_data, .size = size, .alignment = 4, .buffer = dst });
+		}
+		return uploads.size() - 1;
+	}
+
+	size_t UploadBatch::add_image(ImageAttachment dst, const void* src_data, size_t size, std::span<const BufferImageCopy> regions) {
+		assert(!regions.empty());
+		// images that allow host image copies are written right away, if the regions leave no subresource in an unknown layout
+		if (auto fut = try_host_copy_to_image(allocator->get_context(), dst, src_data, regions)) {
+			uploads.push_back(Upload{ .image = dst, .on_host = true, .host_future = std::move(*fut) });
+			return uploads.size() - 1;
+		}
+		uploads.push_back(Upload{ .src_data = src_data,
+		                          .size = size,
+		                          .alignment = image_copy_alignment(dst.format),
+		                          .image = dst,
+		                          .regions = std::vector<BufferImageCopy>(regions.begin(), regions.end()) });
+		return uploads.size() - 1;
+	}
+
+	size_t UploadBatch::add_image(ImageAttachment dst, const void* src_data, size_t size, std::span<const ImageSubresourceData> subresources) {
+		std::vector<BufferImageCopy> regions;
+		regions.reserve(subresources.size());
+		for (auto& subresource : subresources) {
+			regions.push_back(to_buffer_image_copy(dst, subresource));
+		}
+		return add_image(dst, src_data, size, std::span<const BufferImageCopy>(regions));
+	}
+
+	size_t UploadBatch::add_image(ImageAttachment dst, const void* src_data) {
+		size_t size;
+		auto regions = tightly_packed_image_regions(dst, size);
+		return add_image(dst, src_data, size, std::span<const BufferImageCopy>(regions));
+	}
+
+	std::vector<Future> UploadBatch::build() {
+		std::vector<Future> futures;
+		futures.reserve(uploads.size());
+
+		// pack all device uploads into one staging allocation
+		std::vector<size_t> offsets(uploads.size());
+		size_t total_size = 0;
+		size_t alignment = 1;
+		for (size_t i = 0; i < uploads.size(); i++) {
+			auto& upload = uploads[i];
+			if (upload.on_host) {
+				continue;
+			}
+			total_size = align_up(total_size, upload.alignment);
+			offsets[i] = total_size;
+			total_size += upload.size;
+			alignment = std::lcm(alignment, upload.alignment);
+		}
+
+		if (total_size == 0) {
+			for (auto& upload : uploads) {
+				futures.emplace_back(std::move(upload.host_future));
+			}
+			uploads.clear();
+			return futures;
+		}
+
+		auto src = allocate_upload_staging(*allocator, total_size, alignment);
+
+		struct Copy {
+			Name dst;
+			size_t offset;
+			size_t size;
+			std::vector<BufferImageCopy> regions;
+		};
+		std::vector<Copy> copies;
+		std::vector<Resource> resources;
+		resources.emplace_back(Name("_src"), Resource::Type::eBuffer, Access::eTransferRead);
+
+		std::shared_ptr<RenderGraph> rgp = std::make_shared<RenderGraph>("upload_batch");
+		std::vector<Name> outputs(uploads.size());
+		for (size_t i = 0; i < uploads.size(); i++) {
+			auto& upload = uploads[i];
+			if (upload.on_host) {
+				continue;
+			}
+			::memcpy(src.buffer.mapped_ptr + offsets[i], upload.src_data, upload.size);
+
+			Name dst = Name("_dst").append(std::to_string(i));
+			outputs[i] = dst.append("+");
+			if (upload.regions.empty()) {
+				resources.emplace_back(dst, Resource::Type::eBuffer, Access::eTransferWrite, outputs[i]);
+				rgp->attach_buffer(dst, upload.buffer, Access::eNone);
+			} else {
+				for (auto& region : upload.regions) {
+					region.bufferOffset += offsets[i];
+				}
+				resources.emplace_back(dst, Resource::Type::eImage, Access::eTransferWrite, outputs[i]);
+				rgp->attach_image(dst, upload.image, Access::eNone);
+			}
+			copies.push_back(Copy{ dst, offsets[i], upload.size, std::move(upload.regions) });
+		}
+		rgp->attach_buffer("_src", src.buffer, Access::eNone);
+
+		// a single pass, so that all uploads are covered by the same barriers
+		rgp->add_pass({ .name = "UPLOAD BATCH",
+		                .execute_on = copy_domain,
+		                .resources = std::move(resources),
+		                .execute = [copies = std::move(copies), release = std::move(src.release)](CommandBuffer& command_buffer) {
+			                auto src = *command_buffer.get_resource_buffer("_src");
+			                for (auto& copy : copies) {
+				                if (copy.regions.empty()) {
+					                auto dst = *command_buffer.get_resource_buffer(copy.dst);
+					                command_buffer.copy_buffer(src.subrange(copy.offset, copy.size), dst.subrange(0, copy.size), copy.size);
+				                } else {
+					                command_buffer.copy_buffer_to_image("_src", copy.dst, copy.regions);
+				                }
+			                }
+		                } });
+
+		for (size_t i = 0; i < uploads.size(); i++) {
+			if (uploads[i].on_host) {
+				futures.emplace_back(std::move(uploads[i].host_future));
+			} else {
+				futures.emplace_back(rgp, outputs[i]);
+			}
+		}
+		uploads.clear();
+		return futures;
+	}
+} // namespace vuk
@@ -1,16 +1,23 @@
 #include "vuk/Util.hpp"
+#include "ContextImpl.hpp"
+#include "MPSCRing.hpp"
 #include "vuk/AllocatorHelpers.hpp"
 #include "vuk/Context.hpp"
 #include "vuk/Future.hpp"
 #include "vuk/RenderGraph.hpp"
 #include "vuk/SampledImage.hpp"
 
+#include <algorithm>
 #include <atomic>
+#include <chrono>
+#include <condition_variable>
 #ifndef DOCTEST_CONFIG_DISABLE
 #include <doctest/doctest.h>
 #endif
+#include <map>
 #include <mutex>
 #include <sstream>
+#include <thread>
 #include <utility>
 
 namespace vuk {
@@ -24,18 +31,239 @@ namespace vuk {
 		std::array<std::atomic<uint64_t>, 3> last_device_waits;
 		std::atomic<uint64_t> last_host_wait;
 		uint32_t family_index;
+		// last timeline value handed out, submitters reserve contiguous ranges of values from this
+		std::atomic<uint64_t> next_value;
+
+		// a submission, with storage for the arrays referenced by the VkSubmitInfo2s
+		struct PendingSubmit {
+			std::vector<VkSubmitInfo2KHR> sis;
+			std::vector<VkCommandBufferSubmitInfoKHR> cbufsis;
+			std::vector<VkSemaphoreSubmitInfoKHR> wait_semas;
+			std::vector<VkSemaphoreSubmitInfoKHR> signal_semas;
+			std::chrono::steady_clock::time_point enqueued;
+		};
+
+		SubmitCoalescingParameters coalescing;
+		std::vector<PendingSubmit> pending;
+		size_t pending_submit_count = 0;
+		std::chrono::steady_clock::time_point oldest_pending;
+		SubmitStats stats;
+
+		// a submission handed off to the submission thread
+		struct HandedOffSubmit {
+			PendingSubmit submit;
+			uint64_t first_value = 0; // first timeline value signalled
+			uint64_t value_count = 0;
+		};
+
+		std::thread submit_thread;
+		std::unique_ptr<MPSCRing<std::unique_ptr<HandedOffSubmit>>> ring;
+		std::atomic<uint64_t> ring_wakeups = 0;
+		std::atomic<uint64_t> handed_off = 0;
+		std::atomic<uint64_t> processed = 0;
+		std::atomic<bool> stop_thread = false;
+		// first error of a flush issued by the submission thread or the flush timer, reported by the next flush()
+		std::atomic<VkResult> thread_result = VK_SUCCESS;
+
+		// issues the pending submissions once the oldest is older than coalescing.max_latency, even if nothing else is submitted
+		std::thread flush_timer;
+		std::condition_variable_any pending_added;
+		bool stop_flush_timer = false;
 
 		QueueImpl(PFN_vkQueueSubmit fn1, PFN_vkQueueSubmit2KHR fn2, VkQueue queue, uint32_t queue_family_index, TimelineSemaphore ts) :
 		    queueSubmit(fn1),
 		    queueSubmit2KHR(fn2),
 		    submit_sync(ts),
 		    queue(queue),
-		    family_index(queue_family_index) {}
+		    family_index(queue_family_index),
+		    next_value(*ts.value) {}
+
+		bool has_submit_thread() const noexcept {
+			return submit_thread.joinable();
+		}
+
+		// issue all the pending submissions, queue_lock must be held
+		VkResult flush_pending() {
+			if (pending.empty()) {
+				return VK_SUCCESS;
+			}
+
+			std::vector<VkSubmitInfo2KHR> sis;
+			sis.reserve(pending_submit_count);
+			for (auto& ps : pending) {
+				sis.insert(sis.end(), ps.sis.begin(), ps.sis.end());
+			}
+
+			// completion is tracked only through the timeline values signalled, so no fence is needed
+			VkResult result = queueSubmit2KHR(queue, (uint32_t)sis.size(), sis.data(), VK_NULL_HANDLE);
+			stats.queue_submits++;
+			if (result != VK_SUCCESS) {
+				// the work is dropped, but its timeline values are still signalled, so that waits on them complete (or fail if the device is lost)
+				uint64_t last_value = 0;
+				for (auto& ps : pending) {
+					for (auto& ssi : ps.signal_semas) {
+						if (ssi.semaphore == submit_sync.semaphore) {
+							last_value = std::max(last_value, ssi.value);
+						}
+					}
+				}
+				if (last_value > 0) {
+					VkSemaphoreSubmitInfoKHR ssi{ .sType = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO_KHR,
+						                            .semaphore = submit_sync.semaphore,
+						                            .value = last_value,
+						                            .stageMask = (VkPipelineStageFlagBits2KHR)PipelineStageFlagBits::eAllCommands };
+					VkSubmitInfo2KHR si{ .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO_2_KHR, .signalSemaphoreInfoCount = 1, .pSignalSemaphoreInfos = &ssi };
+					if (queueSubmit2KHR(queue, 1, &si, VK_NULL_HANDLE) == VK_SUCCESS) {
+						stats.queue_submits++;
+					}
+				}
+			}
+
+			auto now = std::chrono::steady_clock::now();
+			for (auto& ps : pending) {
+				stats.record_latency(std::chrono::duration_cast<std::chrono::microseconds>(now - ps.enqueued));
+			}
+			pending.clear();
+			pending_submit_count = 0;
+
+			return result;
+		}
+
+		// signal reserved timeline values without doing any work, for batches that are abandoned after an error
+		// otherwise waits on these values never complete, and the submission thread waits for them forever to keep the submission order
+		void skip_values(uint64_t first_value, uint64_t value_count) {
+			PendingSubmit ps;
+			ps.signal_semas.emplace_back(VkSemaphoreSubmitInfoKHR{ .sType = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO_KHR,
+			                                                       .semaphore = submit_sync.semaphore,
+			                                                       .value = first_value + value_count - 1,
+			                                                       .stageMask = (VkPipelineStageFlagBits2KHR)PipelineStageFlagBits::eAllCommands });
+			ps.sis.emplace_back(VkSubmitInfo2KHR{
+			    .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO_2_KHR, .signalSemaphoreInfoCount = 1, .pSignalSemaphoreInfos = ps.signal_semas.data() });
+			ps.enqueued = std::chrono::steady_clock::now();
+			if (has_submit_thread()) {
+				auto hs = std::make_unique<HandedOffSubmit>();
+				hs->submit = std::move(ps);
+				hs->first_value = first_value;
+				hs->value_count = value_count;
+				hand_off(std::move(hs));
+				return;
+			}
+			std::lock_guard _(queue_lock);
+			if (pending.empty()) {
+				oldest_pending = ps.enqueued;
+				pending_added.notify_one();
+			}
+			pending_submit_count += ps.sis.size();
+			pending.emplace_back(std::move(ps));
+			*submit_sync.value = std::max(*submit_sync.value, first_value + value_count - 1);
+		}
+
+		// hand off a submission to the submission thread, without taking locks
+		void hand_off(std::unique_ptr<HandedOffSubmit> hs) {
+			while (!ring->try_push(std::move(hs))) {
+				// the ring is full, let the submission thread catch up
+				std::this_thread::yield();
+			}
+			handed_off.fetch_add(1, std::memory_order_release);
+			ring_wakeups.fetch_add(1, std::memory_order_release);
+			ring_wakeups.notify_one();
+		}
+
+		void submit_thread_main() {
+			// submissions must be issued in the order of their timeline values, but producers may hand them off out of order
+			std::map<uint64_t, std::unique_ptr<HandedOffSubmit>> reorder;
+			std::vector<std::unique_ptr<HandedOffSubmit>> ready;
+			uint64_t next_first_value = next_value.load() + 1;
+			while (true) {
+				uint64_t wakeups = ring_wakeups.load(std::memory_order_acquire);
+				bool stopping = stop_thread.load(std::memory_order_acquire);
+				while (auto hs = ring->try_pop()) {
+					if ((*hs)->value_count == 0) { // signals nothing on the timeline, so it can be issued at any point
+						ready.emplace_back(std::move(*hs));
+					} else {
+						reorder.emplace((*hs)->first_value, std::move(*hs));
+					}
+				}
+				while (!reorder.empty() && reorder.begin()->first == next_first_value) {
+					next_first_value += reorder.begin()->second->value_count;
+					ready.emplace_back(std::move(reorder.begin()->second));
+					reorder.erase(reorder.begin());
+				}
+
+				if (!ready.empty()) {
+					std::lock_guard _(queue_lock);
+					stats.batches += ready.size();
+					for (auto& hs : ready) {
+						pending_submit_count += hs->submit.sis.size();
+						pending.emplace_back(std::move(hs->submit));
+					}
+					if (auto result = flush_pending(); result != VK_SUCCESS) {
+						VkResult expected = VK_SUCCESS;
+						thread_result.compare_exchange_strong(expected, result);
+					}
+					*submit_sync.value = next_first_value - 1;
+					processed.fetch_add(ready.size(), std::memory_order_release);
+					processed.notify_all();
+					ready.clear();
+					continue;
+				}
+
+				if (stopping && reorder.empty() && processed.load() == handed_off.load()) {
+					break;
+				}
+				ring_wakeups.wait(wakeups, std::memory_order_acquire);
+			}
+		}
+
+		void flush_timer_main() {
+			std::unique_lock lock(queue_lock);
+			while (!stop_flush_timer) {
+				if (pending.empty()) {
+					pending_added.wait(lock);
+					continue;
+				}
+				auto deadline = oldest_pending + coalescing.max_latency;
+				if (std::chrono::steady_clock::now() < deadline) {
+					pending_added.wait_until(lock, deadline);
+					continue;
+				}
+				if (auto result = flush_pending(); result != VK_SUCCESS) {
+					VkResult expected = VK_SUCCESS;
+					thread_result.compare_exchange_strong(expected, result);
+				}
+			}
+		}
+
+		void stop_flush_timer_thread() {
+			if (!flush_timer.joinable()) {
+				return;
+			}
+			{
+				std::lock_guard _(queue_lock);
+				stop_flush_timer = true;
+			}
+			pending_added.notify_one();
+			flush_timer.join();
+		}
 	};
 
+	void SubmitStats::record_latency(std::chrono::microseconds latency) {
+		uint64_t us = (uint64_t)latency.count();
+		size_t bucket = 0;
+		while (us > 1 && bucket < latency_histogram.size() - 1) {
+			us >>= 1;
+			bucket++;
+		}
+		latency_histogram[bucket]++;
+	}
+
 	Queue::Queue(PFN_vkQueueSubmit fn1, PFN_vkQueueSubmit2KHR fn2, VkQueue queue, uint32_t queue_family_index, TimelineSemaphore ts) :
 	    impl(new QueueImpl(fn1, fn2, queue, queue_family_index, ts)) {}
 	Queue::~Queue() {
+		if (impl) {
+			stop_submit_thread();
+			impl->stop_flush_timer_thread();
+		}
 		delete impl;
 	}
 
@@ -54,15 +282,98 @@ namespace vuk {
 		return impl->queue_lock;
 	}
 
+	uint64_t Queue::get_reserved_value() {
+		return impl->next_value.load(std::memory_order_acquire);
+	}
+
 	Result<void> Queue::submit(std::span<VkSubmitInfo2KHR> sis, VkFence fence) {
+		// preserve submission order wrt. coalesced or handed off submissions
+		VUK_DO_OR_RETURN(flush());
+		std::lock_guard _(impl->queue_lock);
 		VkResult result = impl->queueSubmit2KHR(impl->queue, (uint32_t)sis.size(), sis.data(), fence);
 		if (result != VK_SUCCESS) {
 			return { expected_error, VkException{ result } };
 		}
+		impl->stats.queue_submits++;
+		return { expected_value };
+	}
+
+	void Queue::set_submit_coalescing(SubmitCoalescingParameters params) {
+		std::lock_guard _(impl->queue_lock);
+		impl->coalescing = params;
+		if (params.enabled && !impl->flush_timer.joinable()) {
+			impl->stop_flush_timer = false;
+			impl->flush_timer = std::thread([impl = impl]() { impl->flush_timer_main(); });
+		}
+		// the deadline of the pending submissions might have changed
+		impl->pending_added.notify_one();
+	}
+
+	Result<void> Queue::start_submit_thread(size_t ring_capacity) {
+		if (impl->has_submit_thread()) {
+			return { expected_value };
+		}
+		std::lock_guard _(impl->queue_lock);
+		if (auto result = impl->flush_pending(); result != VK_SUCCESS) {
+			return { expected_error, VkException{ result } };
+		}
+		impl->ring = std::make_unique<MPSCRing<std::unique_ptr<QueueImpl::HandedOffSubmit>>>(ring_capacity);
+		impl->stop_thread = false;
+		impl->submit_thread = std::thread([impl = impl]() { impl->submit_thread_main(); });
+		return { expected_value };
+	}
+
+	void Queue::stop_submit_thread() {
+		if (!impl->has_submit_thread()) {
+			return;
+		}
+		impl->stop_thread.store(true, std::memory_order_release);
+		impl->ring_wakeups.fetch_add(1, std::memory_order_release);
+		impl->ring_wakeups.notify_one();
+		impl->submit_thread.join();
+		impl->ring.reset();
+	}
+
+	Result<void> Queue::flush() {
+		if (impl->has_submit_thread()) {
+			// wait for the submission thread to issue everything handed off so far
+			auto target = impl->handed_off.load(std::memory_order_acquire);
+			for (auto processed = impl->processed.load(std::memory_order_acquire); processed < target; processed = impl->processed.load(std::memory_order_acquire)) {
+				impl->processed.wait(processed, std::memory_order_acquire);
+			}
+			if (auto result = impl->thread_result.exchange(VK_SUCCESS); result != VK_SUCCESS) {
+				return { expected_error, VkException{ result } };
+			}
+			return { expected_value };
+		}
+		std::lock_guard _(impl->queue_lock);
+		if (auto result = impl->flush_pending(); result != VK_SUCCESS) {
+			return { expected_error, VkException{ result } };
+		}
+		if (auto result = impl->thread_result.exchange(VK_SUCCESS); result != VK_SUCCESS) {
+			return { expected_error, VkException{ result } };
+		}
+		return { expected_value };
+	}
+
+	SubmitStats Queue::get_submit_stats() {
+		std::lock_guard _(impl->queue_lock);
+		return impl->stats;
+	}
+
+	Result<void> Context::flush_submissions() {
+		VUK_DO_OR_RETURN(graphics_queue->flush());
+		if (compute_queue != graphics_queue) {
+			VUK_DO_OR_RETURN(compute_queue->flush());
+		}
+		if (transfer_queue != graphics_queue && transfer_queue != compute_queue) {
+			VUK_DO_OR_RETURN(transfer_queue->flush());
+		}
 		return { expected_value };
 	}
 
 	Result<void> Queue::submit(std::span<VkSubmitInfo> sis, VkFence fence) {
+		VUK_DO_OR_RETURN(flush());
 		std::lock_guard _(impl->queue_lock);
 		VkResult result = impl->queueSubmit(impl->queue, (uint32_t)sis.size(), sis.data(), fence);
 		if (result != VK_SUCCESS) {
@@ -72,35 +383,77 @@ namespace vuk {
 	}
 
 	Result<void> Context::wait_for_domains(std::span<std::pair<DomainFlags, uint64_t>> queue_waits) {
-		std::array<uint32_t, 3> domain_to_sema_index = { ~0u, ~0u, ~0u };
+		auto result = wait_for_domains(queue_waits, std::chrono::nanoseconds::max());
+		if (!result) {
+			return result;
+		}
+		return { expected_value };
+	}
+
+	Result<VkResult> Context::wait_for_domains(std::span<std::pair<DomainFlags, uint64_t>> queue_waits, std::chrono::nanoseconds timeout, bool wait_any) {
+		// the values waited on might be signalled by submissions still pending
+		VUK_DO_OR_RETURN(flush_submissions());
+
 		std::array<VkSemaphore, 3> queue_timeline_semaphores;
 		std::array<uint64_t, 3> values = {};
 
 		uint32_t count = 0;
 		for (auto [domain, v] : queue_waits) {
-			auto idx = domain_to_queue_index(domain);
-			auto& mapping = domain_to_sema_index[idx];
-			if (mapping == -1) {
-				mapping = count++;
-			}
 			auto& q = domain_to_queue(domain);
-			queue_timeline_semaphores[mapping] = q.impl->submit_sync.semaphore;
-			values[mapping] = values[mapping] > v ? values[mapping] : v;
+			auto it = std::find(queue_timeline_semaphores.begin(), queue_timeline_semaphores.begin() + count, q.impl->submit_sync.semaphore);
+			auto mapping = it - queue_timeline_semaphores.begin();
+			if (mapping == count) {
+				queue_timeline_semaphores[count] = q.impl->submit_sync.semaphore;
+				values[count] = v;
+				count++;
+			} else {
+				// all the waits on a queue are satisfied by the highest value, any of them by the lowest
+				values[mapping] = wait_any ? std::min(values[mapping], v) : std::max(values[mapping], v);
+			}
+		}
+		if (count == 0) {
+			return { expected_value, VK_SUCCESS };
 		}
 
 		VkSemaphoreWaitInfo swi{ .sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO };
+		swi.flags = wait_any ? VK_SEMAPHORE_WAIT_ANY_BIT : 0;
 		swi.pSemaphores = queue_timeline_semaphores.data();
 		swi.pValues = values.data();
 		swi.semaphoreCount = count;
-		VkResult result = this->vkWaitSemaphores(device, &swi, UINT64_MAX);
-		for (auto [domain, v] : queue_waits) {
-			auto& q = domain_to_queue(domain);
-			q.impl->last_host_wait.store(v);
-		}
-		if (result != VK_SUCCESS) {
+		uint64_t timeout_ns = timeout == std::chrono::nanoseconds::max() ? UINT64_MAX : (uint64_t)std::max(timeout.count(), (std::chrono::nanoseconds::rep)0);
+		auto wait_start = std::chrono::steady_clock::now();
+		VkResult result = this->vkWaitSemaphores(device, &swi, timeout_ns);
+		record_host_wait(std::chrono::steady_clock::now() - wait_start, result == VK_TIMEOUT);
+		if (result == VK_TIMEOUT) {
+			return { expected_value, VK_TIMEOUT };
+		} else if (result != VK_SUCCESS) {
 			return { expected_error, VkException{ result } };
 		}
-		return { expected_value };
+		if (!wait_any) {
+			for (auto [domain, v] : queue_waits) {
+				auto& last = domain_to_queue(domain).impl->last_host_wait;
+				uint64_t prev = last.load();
+				while (prev < v && !last.compare_exchange_weak(prev, v)) {}
+			}
+		}
+		return { expected_value, VK_SUCCESS };
+	}
+
+	void Context::record_host_wait(std::chrono::nanoseconds blocked, bool timed_out) {
+		impl->host_waits.fetch_add(1, std::memory_order_relaxed);
+		impl->host_wait_ns.fetch_add(blocked.count(), std::memory_order_relaxed);
+		if (timed_out) {
+			impl->host_wait_timeouts.fetch_add(1, std::memory_order_relaxed);
+		}
+	}
+
+	HostWaitStats Context::get_host_wait_stats() const {
+		return { impl->host_waits.load(), impl->host_wait_timeouts.load(), std::chrono::nanoseconds(impl->host_wait_ns.load()) };
+	}
+
+	HostWaitStats Context::get_last_frame_host_wait_stats() const {
+		std::unique_lock _(impl->begin_frame_lock);
+		return impl->last_frame_host_wait_stats;
 	}
 
 	Result<void> link_execute_submit(Allocator& allocator, Compiler& compiler, std::span<std::shared_ptr<RenderGraph>> rgs, RenderGraphCompileOptions options) {
@@ -190,72 +543,110 @@ namespace vuk {
 		return ss.str();
 	}
 
-	void flatten_transfer_and_compute_onto_graphics(SubmitBundle& bundle) {
+	static uint32_t queue_domain_index(DomainFlags domain) {
+		switch ((DomainFlagBits)(domain & DomainFlagBits::eQueueMask).m_mask) {
+		case DomainFlagBits::eGraphicsQueue:
+			return 0;
+		case DomainFlagBits::eComputeQueue:
+			return 1;
+		case DomainFlagBits::eTransferQueue:
+			return 2;
+		default:
+			assert(0);
+			return 0;
+		}
+	}
+
+	void plan_submission(SubmitBundle& bundle, std::array<DomainFlagBits, 3> queue_of_domain) {
 		if (bundle.batches.empty()) {
 			return;
 		}
-		auto domain_to_index = [](vuk::DomainFlagBits d) {
-			switch (d) {
-			case DomainFlagBits::eTransferQueue:
-				return 2;
-			case DomainFlagBits::eGraphicsQueue:
-				return 0;
-			case DomainFlagBits::eComputeQueue:
-				return 1;
-			default:
-				assert(0);
-				return 4;
-			}
-		};
+		std::array<int32_t, 3> batch_of_domain = { -1, -1, -1 };
 		size_t num_submits = 0;
-		for (auto& batch : bundle.batches) {
-			num_submits += batch.submits.size();
-		}
-		SubmitBatch dst_batch{ .domain = DomainFlagBits::eGraphicsQueue };
-		uint64_t progress[3] = {};
-		while (true) {
-			for (auto& batch : bundle.batches) {
-				auto queue = (DomainFlagBits)(batch.domain & DomainFlagBits::eQueueMask).m_mask;
-				auto our_id = domain_to_index(queue);
-				for (size_t i = progress[our_id]; i < batch.submits.size(); i++) {
-					auto b = batch.submits[i];
-					bool all_waits_satisfied = true;
-					// check if all waits can be satisfied for this submit
-					for (auto& [queue, wait_id] : b.relative_waits) {
-						auto q_id = domain_to_index((DomainFlagBits)(queue & DomainFlagBits::eQueueMask).m_mask);
-						auto& progress_on_wait_queue = progress[q_id];
-						if (progress_on_wait_queue < wait_id) {
-							all_waits_satisfied = false;
-							break;
-						}
+		for (size_t i = 0; i < bundle.batches.size(); i++) {
+			batch_of_domain[queue_domain_index(bundle.batches[i].domain)] = (int32_t)i;
+			num_submits += bundle.batches[i].submits.size();
+		}
+
+		std::vector<SubmitBatch> dst_batches;
+		std::array<int32_t, 3> dst_batch_of_queue = { -1, -1, -1 };
+		// for every source submit, its 1-based position in the destination batch
+		std::vector<std::vector<uint64_t>> placed_at(bundle.batches.size());
+		std::vector<size_t> progress(bundle.batches.size(), 0);
+		size_t num_placed = 0;
+		// submits are placed in a global topological order of their waits - as queues execute in submission order, this is deadlock-free for any aliasing
+		while (num_placed < num_submits) {
+			bool made_progress = false;
+			for (size_t b = 0; b < bundle.batches.size(); b++) {
+				auto& batch = bundle.batches[b];
+				auto queue_domain = queue_of_domain[queue_domain_index(batch.domain)];
+				while (progress[b] < batch.submits.size()) {
+					auto& submit = batch.submits[progress[b]];
+					bool all_waits_satisfied = std::all_of(submit.relative_waits.begin(), submit.relative_waits.end(), [&](auto& wait) {
+						auto wait_batch = batch_of_domain[queue_domain_index(wait.first)];
+						assert(wait_batch >= 0);
+						return wait.second == 0 || progress[wait_batch] >= wait.second;
+					});
+					if (!all_waits_satisfied) {
+						break;
+					}
+
+					auto& dst_index = dst_batch_of_queue[queue_domain_index(queue_domain)];
+					if (dst_index == -1) {
+						dst_index = (int32_t)dst_batches.size();
+						dst_batches.emplace_back(SubmitBatch{ .domain = queue_domain });
 					}
-					if (all_waits_satisfied) {
-						if (!b.relative_waits.empty()) {
-							b.relative_waits = { { DomainFlagBits::eGraphicsQueue, dst_batch.submits.size() } }; // collapse into a single wait
+					auto& dst = dst_batches[dst_index];
+					SubmitInfo placed = std::move(submit);
+					// remap waits onto the destination batches, keeping only the latest wait per queue
+					std::vector<std::pair<DomainFlagBits, uint64_t>> waits;
+					for (auto& [domain, index] : placed.relative_waits) {
+						if (index == 0) {
+							continue;
+						}
+						auto wait_batch = batch_of_domain[queue_domain_index(domain)];
+						auto wait_domain = queue_of_domain[queue_domain_index(domain)];
+						auto wait_index = placed_at[wait_batch][index - 1];
+						auto it = std::find_if(waits.begin(), waits.end(), [=](auto& w) { return w.first == wait_domain; });
+						if (it == waits.end()) {
+							waits.emplace_back(wait_domain, wait_index);
+						} else {
+							it->second = std::max(it->second, wait_index);
 						}
-						dst_batch.submits.emplace_back(b);
-						progress[our_id]++; // retire this batch
-					} else {
-						// couldn't make progress
-						// break here is not correct, because there might be multiple waits with the same rank
-						// TODO: we need to break here anyways for unsorted - we need to sort
-						break;
 					}
+					placed.relative_waits = std::move(waits);
+					dst.submits.emplace_back(std::move(placed));
+					placed_at[b].push_back(dst.submits.size());
+					progress[b]++;
+					num_placed++;
+					made_progress = true;
 				}
 			}
-			if (dst_batch.submits.size() == num_submits) { // we have moved all the submits to the dst_batch
+			if (!made_progress) {
+				assert(false && "submits have cyclic waits");
 				break;
 			}
 		}
-		bundle.batches = { dst_batch };
+
+		// submit the batches waited on by others first, to avoid waits before signals where possible
+		auto cross_queue_waits = [](SubmitBatch& batch) {
+			size_t count = 0;
+			for (auto& submit : batch.submits) {
+				count += std::count_if(submit.relative_waits.begin(), submit.relative_waits.end(), [&](auto& w) { return w.first != batch.domain; });
+			}
+			return count;
+		};
+		std::stable_sort(dst_batches.begin(), dst_batches.end(), [&](SubmitBatch& a, SubmitBatch& b) { return cross_queue_waits(a) < cross_queue_waits(b); });
+		bundle.batches = std::move(dst_batches);
 	}
 
 #ifndef DOCTEST_CONFIG_DISABLE
-	TEST_CASE("testing flattening submit graphs") {
+	TEST_CASE("testing submission planning") {
+		constexpr std::array<DomainFlagBits, 3> all_on_graphics = { DomainFlagBits::eGraphicsQueue, DomainFlagBits::eGraphicsQueue, DomainFlagBits::eGraphicsQueue };
 		{
 			SubmitBundle empty{};
 			auto before = to_dot(empty);
-			flatten_transfer_and_compute_onto_graphics(empty);
+			plan_submission(empty, all_on_graphics);
 			auto after = to_dot(empty);
 			CHECK(before == after);
 		}
@@ -268,8 +659,7 @@ namespace vuk {
 				                                                                 { .relative_waits = { { vuk::DomainFlagBits::eTransferQueue, 2 } } },
 				                                                                 { .relative_waits = { { vuk::DomainFlagBits::eTransferQueue, 3 } } } } } } };
 
-			auto before = to_dot(only_transfer);
-			flatten_transfer_and_compute_onto_graphics(only_transfer);
+			plan_submission(only_transfer, all_on_graphics);
 			auto after = to_dot(only_transfer);
 			CHECK(after == "digraph {subgraph cluster_Graphics {GA;GB;GC;GD;}GB->GA;GC->GB;GD->GC;}");
 		}
@@ -290,11 +680,26 @@ namespace vuk {
 				                                                             { .relative_waits = { { vuk::DomainFlagBits::eTransferQueue, 3 } } },
 				                                                             { .relative_waits = { { vuk::DomainFlagBits::eGraphicsQueue, 3 } } } } } } };
 
-			auto before = to_dot(two_queue);
-			flatten_transfer_and_compute_onto_graphics(two_queue);
+			plan_submission(two_queue, all_on_graphics);
 			auto after = to_dot(two_queue);
 			CHECK(after == "digraph {subgraph cluster_Graphics {GA;GB;GC;GD;GE;GF;GG;GH;}GC->GB;GD->GC;GE->GD;GF->GE;GG->GF;GH->GG;}");
 		}
+		{
+			// transfer shares the compute queue, graphics is separate
+			// compute : CB  CA      transfer : TA
+			//            v               ^
+			// graphics :  GA ------------/
+			SubmitBundle transfer_on_compute{ .batches = { SubmitBatch{ .domain = vuk::DomainFlagBits::eComputeQueue,
+				                                                          .submits = { { .relative_waits = {} },
+				                                                                       { .relative_waits = { { vuk::DomainFlagBits::eGraphicsQueue, 1 } } } } },
+				                                             SubmitBatch{ .domain = vuk::DomainFlagBits::eTransferQueue, .submits = { { .relative_waits = {} } } },
+				                                             SubmitBatch{ .domain = vuk::DomainFlagBits::eGraphicsQueue,
+				                                                          .submits = { { .relative_waits = { { vuk::DomainFlagBits::eTransferQueue, 1 } } } } } } };
+
+			plan_submission(transfer_on_compute, { DomainFlagBits::eGraphicsQueue, DomainFlagBits::eComputeQueue, DomainFlagBits::eComputeQueue });
+			auto after = to_dot(transfer_on_compute);
+			CHECK(after == "digraph {subgraph cluster_Compute {CA;CB;CC;}subgraph cluster_Graphics {GA;}CC->GA;GA->CB;}");
+		}
 	}
 #endif
 
@@ -306,46 +711,63 @@ namespace vuk {
 			used_domains |= batch.domain;
 		}
 
-		std::array<uint64_t, 3> queue_progress_references;
+		// queues with a submission thread are handed off to without locking
 		std::unique_lock<std::recursive_mutex> gfx_lock;
-		if (used_domains & DomainFlagBits::eGraphicsQueue) {
-			queue_progress_references[ctx.domain_to_queue_index(DomainFlagBits::eGraphicsQueue)] = *ctx.graphics_queue->impl->submit_sync.value;
+		if ((used_domains & DomainFlagBits::eGraphicsQueue) && !ctx.graphics_queue->impl->has_submit_thread()) {
 			gfx_lock = std::unique_lock{ ctx.graphics_queue->impl->queue_lock };
 		}
 		std::unique_lock<std::recursive_mutex> compute_lock;
-		if (used_domains & DomainFlagBits::eComputeQueue) {
-			queue_progress_references[ctx.domain_to_queue_index(DomainFlagBits::eComputeQueue)] = *ctx.compute_queue->impl->submit_sync.value;
+		if ((used_domains & DomainFlagBits::eComputeQueue) && !ctx.compute_queue->impl->has_submit_thread()) {
 			compute_lock = std::unique_lock{ ctx.compute_queue->impl->queue_lock };
 		}
 		std::unique_lock<std::recursive_mutex> transfer_lock;
-		if (used_domains & DomainFlagBits::eTransferQueue) {
-			queue_progress_references[ctx.domain_to_queue_index(DomainFlagBits::eTransferQueue)] = *ctx.transfer_queue->impl->submit_sync.value;
+		if ((used_domains & DomainFlagBits::eTransferQueue) && !ctx.transfer_queue->impl->has_submit_thread()) {
 			transfer_lock = std::unique_lock{ ctx.transfer_queue->impl->queue_lock };
 		}
-		bool needs_flatten = ((used_domains & DomainFlagBits::eTransferQueue) &&
-		                      (ctx.domain_to_queue_index(DomainFlagBits::eTransferQueue) == ctx.domain_to_queue_index(DomainFlagBits::eGraphicsQueue) ||
-		                       ctx.domain_to_queue_index(DomainFlagBits::eTransferQueue) == ctx.domain_to_queue_index(DomainFlagBits::eComputeQueue))) ||
-		                     ((used_domains & DomainFlagBits::eComputeQueue) &&
-		                      (ctx.domain_to_queue_index(DomainFlagBits::eComputeQueue) == ctx.domain_to_queue_index(DomainFlagBits::eGraphicsQueue)));
-		if (needs_flatten) {
-			bool needs_transfer_compute_flatten =
-			    ctx.domain_to_queue_index(DomainFlagBits::eTransferQueue) == ctx.domain_to_queue_index(DomainFlagBits::eGraphicsQueue) &&
-			    ctx.domain_to_queue_index(DomainFlagBits::eComputeQueue) == ctx.domain_to_queue_index(DomainFlagBits::eGraphicsQueue);
-			if (needs_transfer_compute_flatten) {
-				flatten_transfer_and_compute_onto_graphics(bundle);
-			} else {
-				assert(false && "NYI");
-			}
-		} else {
-			if (bundle.batches.size() > 1) {
-				std::swap(bundle.batches[0], bundle.batches[1]); // FIXME: silence some false positive validation
+		// map every domain onto the first domain sharing its queue, then merge the batches of domains that share a queue
+		std::array<DomainFlagBits, 3> queue_of_domain = { DomainFlagBits::eGraphicsQueue, DomainFlagBits::eComputeQueue, DomainFlagBits::eTransferQueue };
+		for (size_t i = 0; i < queue_of_domain.size(); i++) {
+			for (size_t j = 0; j < i; j++) {
+				if (ctx.domain_to_queue(queue_of_domain[i]).impl == ctx.domain_to_queue(queue_of_domain[j]).impl) {
+					queue_of_domain[i] = queue_of_domain[j];
+					break;
+				}
 			}
 		}
+		plan_submission(bundle, queue_of_domain);
+
+		// reserve a contiguous range of timeline values on each queue, relative waits are resolved against the start of these
+		// only submits with command buffers signal, so a relative wait on the n-th submit resolves to the number of signalling submits up to it
+		std::array<uint64_t, 3> queue_progress_references = {};
+		std::array<std::vector<uint64_t>, 3> value_offsets;
 		for (SubmitBatch& batch : bundle.batches) {
+			auto& offsets = value_offsets[queue_domain_index(batch.domain)];
+			uint64_t value_count = 0;
+			for (SubmitInfo& si : batch.submits) {
+				value_count += si.command_buffers.size() > 0 ? 1 : 0;
+				offsets.push_back(value_count);
+			}
+			queue_progress_references[queue_domain_index(batch.domain)] = ctx.domain_to_queue(batch.domain).impl->next_value.fetch_add(value_count);
+		}
+
+		// if a batch fails, the values reserved for the batches after it are signalled without work, so that nothing waits for them forever
+		auto abandon_batches_after = [&](size_t failed_batch) {
+			for (size_t b = failed_batch + 1; b < bundle.batches.size(); b++) {
+				auto index = queue_domain_index(bundle.batches[b].domain);
+				uint64_t value_count = value_offsets[index].empty() ? 0 : value_offsets[index].back();
+				if (value_count > 0) {
+					ctx.domain_to_queue(bundle.batches[b].domain).impl->skip_values(queue_progress_references[index] + 1, value_count);
+				}
+			}
+		};
+
+		for (size_t batch_index = 0; batch_index < bundle.batches.size(); batch_index++) {
+			SubmitBatch& batch = bundle.batches[batch_index];
 			auto domain = batch.domain;
 			Queue& queue = ctx.domain_to_queue(domain);
-			Unique<VkFence> fence(allocator);
-			VUK_DO_OR_RETURN(allocator.allocate_fences({ &*fence, 1 }));
+			auto& qi = *queue.impl;
+			uint64_t first_value = queue_progress_references[queue_domain_index(domain)] + 1;
+			uint64_t value = first_value;
 
 			uint64_t num_cbufs = 0;
 			uint64_t num_waits = 1; // 1 extra for present_rdy
@@ -370,8 +792,18 @@ namespace vuk {
 				for (auto& fut : submit_info.future_signals) {
 					fut->status = FutureBase::Status::eSubmitted;
 				}
+				for (auto& [version, use] : submit_info.persistent_uses) {
+					version->status = FutureBase::Status::eSubmitted;
+					version->last_use = use;
+				}
 
 				if (submit_info.command_buffers.size() == 0) {
+					// nothing is signalled for this submit, the versions are visible once the work submitted before it on this queue is
+					for (auto& [version, use] : submit_info.persistent_uses) {
+						version->initial_domain = domain;
+						version->initial_visibility = value - 1;
+						version->context = &ctx;
+					}
 					continue;
 				}
 
@@ -382,10 +814,14 @@ namespace vuk {
 
 				uint32_t wait_sema_count = 0;
 				for (auto& w : submit_info.relative_waits) {
+					auto offset = w.second == 0 ? 0 : value_offsets[queue_domain_index(w.first)][w.second - 1];
+					if (offset == 0) { // nothing was signalled before the waited-for submit
+						continue;
+					}
 					VkSemaphoreSubmitInfoKHR ssi{ VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO_KHR };
 					auto& wait_queue = ctx.domain_to_queue(w.first).impl->submit_sync;
 					ssi.semaphore = wait_queue.semaphore;
-					ssi.value = queue_progress_references[ctx.domain_to_queue_index(w.first)] + w.second;
+					ssi.value = queue_progress_references[queue_domain_index(w.first)] + offset;
 					ssi.stageMask = (VkPipelineStageFlagBits2KHR)PipelineStageFlagBits::eAllCommands;
 					wait_semas.emplace_back(ssi);
 					wait_sema_count++;
@@ -409,7 +845,7 @@ namespace vuk {
 
 				VkSemaphoreSubmitInfoKHR ssi{ VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO_KHR };
 				ssi.semaphore = queue.impl->submit_sync.semaphore;
-				ssi.value = ++(*queue.impl->submit_sync.value);
+				ssi.value = value++;
 
 				ssi.stageMask = (VkPipelineStageFlagBits2KHR)PipelineStageFlagBits::eAllCommands;
 
@@ -417,6 +853,12 @@ namespace vuk {
 					fut->status = FutureBase::Status::eSubmitted;
 					fut->initial_domain = domain;
 					fut->initial_visibility = ssi.value;
+					fut->context = &ctx;
+				}
+				for (auto& [version, use] : submit_info.persistent_uses) {
+					version->initial_domain = domain;
+					version->initial_visibility = ssi.value;
+					version->context = &ctx;
 				}
 
 				uint32_t signal_sema_count = 1;
@@ -442,7 +884,48 @@ namespace vuk {
 				si.signalSemaphoreInfoCount = signal_sema_count;
 			}
 
-			VUK_DO_OR_RETURN(queue.submit(std::span{ sis }, *fence));
+			auto now = std::chrono::steady_clock::now();
+			// moving the vectors keeps the pointers in sis valid
+			QueueImpl::PendingSubmit ps{ std::move(sis), std::move(cbufsis), std::move(wait_semas), std::move(signal_semas), now };
+			// resources of the allocator may only be recycled once the last value of this batch has been signalled
+			if (value > first_value) {
+				allocator.add_submission(qi.submit_sync.semaphore, value - 1);
+			}
+
+			if (qi.has_submit_thread()) {
+				auto hs = std::make_unique<QueueImpl::HandedOffSubmit>();
+				hs->submit = std::move(ps);
+				hs->first_value = first_value;
+				hs->value_count = value - first_value;
+				qi.hand_off(std::move(hs));
+				// binary semaphores for presentation must be signalled before presenting
+				if (present_rdy != VK_NULL_HANDLE || render_complete != VK_NULL_HANDLE) {
+					if (auto result = queue.flush(); !result) {
+						abandon_batches_after(batch_index);
+						return result;
+					}
+				}
+				continue;
+			}
+
+			if (qi.pending.empty()) {
+				qi.oldest_pending = now;
+				qi.pending_added.notify_one();
+			}
+			qi.pending_submit_count += ps.sis.size();
+			qi.pending.emplace_back(std::move(ps));
+			qi.stats.batches++;
+			*qi.submit_sync.value = value - 1;
+
+			// binary semaphores for presentation must be signalled before presenting, so those submissions can't be held back
+			bool flush_now = !qi.coalescing.enabled || present_rdy != VK_NULL_HANDLE || render_complete != VK_NULL_HANDLE ||
+			                 qi.pending_submit_count >= qi.coalescing.max_pending_submits || now - qi.oldest_pending >= qi.coalescing.max_latency;
+			if (flush_now) {
+				if (auto result = queue.flush(); !result) {
+					abandon_batches_after(batch_index);
+					return result;
+				}
+			}
 		}
 
 		return { expected_value };
@@ -473,7 +956,9 @@ namespace vuk {
 		pi.pImageIndices = &bundle.image_index;
 		pi.waitSemaphoreCount = 1;
 		pi.pWaitSemaphores = &bundle.render_complete;
+		std::unique_lock _(ctx.graphics_queue->impl->queue_lock); // the queue may be used by a submission thread
 		auto present_result = ctx.vkQueuePresentKHR(ctx.graphics_queue->impl->queue, &pi);
+		_.unlock();
 		if (present_result != VK_SUCCESS && present_result != VK_SUBOPTIMAL_KHR) {
 			return { expected_error, VkException{ present_result } };
 		}
@@ -625,7 +1110,7 @@ namespace vuk {
 			return { expected_value };
 		} else if (control->status == FutureBase::Status::eSubmitted) {
 			std::pair w = { (DomainFlags)control->initial_domain, control->initial_visibility };
-			allocator.get_context().wait_for_domains(std::span{ &w, 1 });
+			VUK_DO_OR_RETURN(allocator.get_context().wait_for_domains(std::span{ &w, 1 }));
 			return { expected_value };
 		} else {
 			auto erg = compiler.link(std::span{ &rg, 1 }, options);
@@ -635,7 +1120,7 @@ namespace vuk {
 			std::pair v = { &allocator, &*erg };
 			VUK_DO_OR_RETURN(execute_submit(allocator, std::span{ &v, 1 }, {}, {}, {}));
 			std::pair w = { (DomainFlags)control->initial_domain, control->initial_visibility };
-			allocator.get_context().wait_for_domains(std::span{ &w, 1 });
+			VUK_DO_OR_RETURN(allocator.get_context().wait_for_domains(std::span{ &w, 1 }));
 			control->status = FutureBase::Status::eHostAvailable;
 			return { expected_value };
 		}
@@ -667,6 +1152,26 @@ namespace vuk {
 		}
 	}
 
+	Result<bool> Future::is_ready() const {
+		if (!control || control->status == FutureBase::Status::eInitial) {
+			return { expected_value, false };
+		} else if (control->status == FutureBase::Status::eHostAvailable || control->initial_domain == DomainFlagBits::eNone) {
+			return { expected_value, true };
+		}
+		return control->context->is_domain_value_reached(control->initial_domain, control->initial_visibility);
+	}
+
+	Result<void> Future::then(std::function<void(FutureBase&)> callback) {
+		if (!control || control->status == FutureBase::Status::eInitial) {
+			return { expected_error, RenderGraphException{} }; // can't complete before being submitted
+		} else if (control->status == FutureBase::Status::eHostAvailable || control->initial_domain == DomainFlagBits::eNone) {
+			callback(*control);
+			return { expected_value };
+		}
+		return control->context->on_domain_value_reached(
+		    control->initial_domain, control->initial_visibility, [control = control, callback = std::move(callback)]() { callback(*control); });
+	}
+
 	template Result<Buffer> Future::get(Allocator&, Compiler&);
 	template Result<ImageAttachment> Future::get(Allocator&, Compiler&);
 
@@ -7,11 +7,14 @@
 #include "vuk/RenderGraph.hpp"
 #include "vuk/resources/DeviceFrameResource.hpp"
 #include <VkBootstrap.h>
+#include <cstring>
+#include <vector>
 
 namespace vuk {
 	struct TestContext {
 		Compiler compiler;
 		bool has_rt;
+		bool host_image_copy = false;
 		VkDevice device;
 		VkPhysicalDevice physical_device;
 		VkQueue graphics_queue;
@@ -54,12 +57,23 @@ namespace vuk {
 			    .add_required_extension(VK_KHR_ACCELERATION_STRUCTURE_EXTENSION_NAME)
 			    .add_required_extension(VK_KHR_RAY_TRACING_PIPELINE_EXTENSION_NAME)
 			    .add_required_extension(VK_KHR_DEFERRED_HOST_OPERATIONS_EXTENSION_NAME);
+#ifdef VK_EXT_host_image_copy
+			// with its dependencies, which are core in 1.3 - software implementations expose it, so the host copy paths are tested
+			selector.add_desired_extension(VK_EXT_HOST_IMAGE_COPY_EXTENSION_NAME)
+			    .add_desired_extension(VK_KHR_COPY_COMMANDS_2_EXTENSION_NAME)
+			    .add_desired_extension(VK_KHR_FORMAT_FEATURE_FLAGS_2_EXTENSION_NAME);
+#endif
 			auto phys_ret = selector.select();
 			vkb::PhysicalDevice vkbphysical_device;
 			if (!phys_ret) {
 				has_rt = false;
 				vkb::PhysicalDeviceSelector selector2{ vkbinstance };
 				selector2.set_minimum_version(1, 0).add_required_extension(VK_KHR_SYNCHRONIZATION_2_EXTENSION_NAME);
+#ifdef VK_EXT_host_image_copy
+				selector2.add_desired_extension(VK_EXT_HOST_IMAGE_COPY_EXTENSION_NAME)
+				    .add_desired_extension(VK_KHR_COPY_COMMANDS_2_EXTENSION_NAME)
+				    .add_desired_extension(VK_KHR_FORMAT_FEATURE_FLAGS_2_EXTENSION_NAME);
+#endif
 				auto phys_ret2 = selector2.select();
 				if (!phys_ret2) {
 					throw std::runtime_error("Couldn't create physical device");
@@ -96,6 +110,23 @@ namespace vuk {
 			if (has_rt) {
 				device_builder = device_builder.add_pNext(&rtPipelineFeature);
 			}
+#ifdef VK_EXT_host_image_copy
+			VkPhysicalDeviceHostImageCopyFeaturesEXT hic_feat{ .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_HOST_IMAGE_COPY_FEATURES_EXT, .hostImageCopy = true };
+			{
+				auto vkEnumerateDeviceExtensionProperties =
+				    (PFN_vkEnumerateDeviceExtensionProperties)vkbinstance.fp_vkGetInstanceProcAddr(instance, "vkEnumerateDeviceExtensionProperties");
+				uint32_t count = 0;
+				vkEnumerateDeviceExtensionProperties(physical_device, nullptr, &count, nullptr);
+				std::vector<VkExtensionProperties> extensions(count);
+				vkEnumerateDeviceExtensionProperties(physical_device, nullptr, &count, extensions.data());
+				for (auto& extension : extensions) {
+					host_image_copy |= strcmp(extension.extensionName, VK_EXT_HOST_IMAGE_COPY_EXTENSION_NAME) == 0;
+				}
+			}
+			if (host_image_copy) {
+				device_builder = device_builder.add_pNext(&hic_feat);
+			}
+#endif
 			auto dev_ret = device_builder.build();
 			if (!dev_ret) {
 				throw std::runtime_error("Couldn't create device");
@@ -109,16 +140,18 @@ namespace vuk {
 			ContextCreateParameters::FunctionPointers fps;
 			fps.vkGetInstanceProcAddr = vkbinstance.fp_vkGetInstanceProcAddr;
 			fps.vkGetDeviceProcAddr = vkbinstance.fp_vkGetDeviceProcAddr;
-			context.emplace(ContextCreateParameters{ instance,
-			                                         device,
-			                                         physical_device,
-			                                         graphics_queue,
-			                                         graphics_queue_family_index,
-			                                         VK_NULL_HANDLE,
-			                                         VK_QUEUE_FAMILY_IGNORED,
-			                                         transfer_queue,
-			                                         transfer_queue_family_index,
-			                                         fps });
+			ContextCreateParameters params{ instance,
+				                              device,
+				                              physical_device,
+				                              graphics_queue,
+				                              graphics_queue_family_index,
+				                              VK_NULL_HANDLE,
+				                              VK_QUEUE_FAMILY_IGNORED,
+				                              transfer_queue,
+				                              transfer_queue_family_index,
+				                              fps };
+			params.host_image_copy_enabled = host_image_copy;
+			context.emplace(params);
 			const unsigned num_inflight_frames = 3;
 			sfa_resource.emplace(*context, num_inflight_frames);
 			allocator.emplace(*sfa_resource);
@@ -1,7 +1,19 @@
 #include "TestContext.hpp"
 #include "vuk/AllocatorHelpers.hpp"
 #include "vuk/Partials.hpp"
+#include "vuk/Readback.hpp"
+#include "vuk/StreamingUpload.hpp"
+#include "vuk/UploadBatch.hpp"
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
 #include <doctest/doctest.h>
+#include <thread>
+#include <tuple>
+#include <vector>
 
 using namespace vuk;
 
@@ -45,4 +57,792 @@ TEST_CASE("test buffer upload/download") {
 		auto res = download_buffer(fut).get<Buffer>(*test_context.allocator, test_context.compiler);
 		CHECK(std::span((uint32_t*)res->mapped_ptr, 5) == std::span(data));
 	}
-}
\ No newline at end of file
+}
+
+TEST_CASE("test staging ring upload") {
+	REQUIRE(test_context.prepare());
+	auto& ctx = *test_context.context;
+	auto before = ctx.get_staging_ring_stats();
+	{
+		auto data = { 1u, 2u, 3u };
+		auto [buf, fut] = create_buffer(*test_context.allocator, MemoryUsage::eGPUonly, DomainFlagBits::eTransferOnTransfer, std::span(data));
+
+		auto res = download_buffer(fut).get<Buffer>(*test_context.allocator, test_context.compiler);
+		CHECK(std::span((uint32_t*)res->mapped_ptr, 3) == std::span(data));
+	}
+	auto after = ctx.get_staging_ring_stats();
+	CHECK(after.allocations == before.allocations + 1);
+	CHECK(after.allocated_bytes == before.allocated_bytes + 3 * sizeof(uint32_t));
+
+	// too large for the ring, callers fall back to their allocator
+	CHECK(!ctx.allocate_staging(after.capacity, 1));
+	CHECK(ctx.get_staging_ring_stats().fallbacks == after.fallbacks + 1);
+}
+
+TEST_CASE("test upload batch") {
+	REQUIRE(test_context.prepare());
+	auto a = { 1u, 2u, 3u };
+	auto b = { 4u, 5u, 6u, 7u, 8u };
+	auto buf_a = *allocate_buffer(*test_context.allocator, BufferCreateInfo{ MemoryUsage::eGPUonly, sizeof(uint32_t) * 3, 1 });
+	auto buf_b = *allocate_buffer(*test_context.allocator, BufferCreateInfo{ MemoryUsage::eGPUonly, sizeof(uint32_t) * 5, 1 });
+
+	UploadBatch batch(*test_context.allocator, DomainFlagBits::eTransferOnTransfer);
+	auto ia = batch.add_buffer(*buf_a, std::span(a));
+	auto ib = batch.add_buffer(*buf_b, std::span(b));
+	auto futures = batch.build();
+	REQUIRE(futures.size() == 2);
+	// both uploads are recorded into the same graph
+	CHECK(futures[ia].get_render_graph() == futures[ib].get_render_graph());
+
+	auto res_b = download_buffer(futures[ib]).get<Buffer>(*test_context.allocator, test_context.compiler);
+	CHECK(std::span((uint32_t*)res_b->mapped_ptr, 5) == std::span(b));
+	auto res_a = download_buffer(futures[ia]).get<Buffer>(*test_context.allocator, test_context.compiler);
+	CHECK(std::span((uint32_t*)res_a->mapped_ptr, 3) == std::span(a));
+
+	// staging memory of batches too large for the ring outlives the graph, until the copies have completed
+	Allocator direct_allocator(test_context.context->get_vk_resource());
+	size_t count = std::max(test_context.context->get_staging_ring_stats().capacity / 4 / sizeof(uint32_t) + 1, (size_t)16);
+	std::vector<uint32_t> large(count);
+	for (uint32_t i = 0; i < count; i++) {
+		large[i] = i;
+	}
+	auto large_buf = *allocate_buffer(*test_context.allocator, BufferCreateInfo{ MemoryUsage::eGPUonly, sizeof(uint32_t) * count, 1 });
+	{
+		UploadBatch large_batch(direct_allocator, DomainFlagBits::eTransferOnTransfer);
+		large_batch.add_buffer(*large_buf, std::span(large));
+		auto large_futures = large_batch.build();
+		REQUIRE(large_futures[0].submit(*test_context.allocator, test_context.compiler));
+	}
+	REQUIRE(test_context.context->wait_idle());
+	auto large_res = download_buffer(Future(*large_buf)).get<Buffer>(*test_context.allocator, test_context.compiler);
+	CHECK(std::span((uint32_t*)large_res->mapped_ptr, count) == std::span(large));
+}
+
+TEST_CASE("test upload batch image regions") {
+	REQUIRE(test_context.prepare());
+	ImageAttachment ia{ .usage = ImageUsageFlagBits::eTransferSrc | ImageUsageFlagBits::eTransferDst,
+		                  .extent = Dimension3D::absolute(8, 4),
+		                  .format = Format::eR8G8B8A8Unorm,
+		                  .sample_count = Samples::e1,
+		                  .view_type = ImageViewType::e2DArray,
+		                  .base_level = 0,
+		                  .level_count = 3,
+		                  .base_layer = 0,
+		                  .layer_count = 2 };
+	auto image = *allocate_image(*test_context.allocator, ia);
+	ia.image = *image;
+	size_t size;
+	tightly_packed_image_regions(ia, size);
+	// 8x4, 4x2 and 2x1 texels, for 2 layers each
+	REQUIRE(size == (32 + 8 + 2) * 2 * sizeof(uint32_t));
+	std::vector<uint32_t> expected(size / sizeof(uint32_t));
+	for (size_t i = 0; i < expected.size(); i++) {
+		expected[i] = (uint32_t)i + 1;
+	}
+
+	// the host data has the levels in reverse order, the layers of level 1 in separate regions and padded rows in level 0
+	std::vector<ImageSubresourceData> subresources = { { .level = 2, .layer_count = 2, .offset = 0 },
+		                                                 { .level = 1, .base_layer = 1, .offset = 16 },
+		                                                 { .level = 1, .base_layer = 0, .offset = 48 },
+		                                                 { .level = 0, .layer_count = 2, .offset = 80, .row_pitch = 48, .slice_pitch = 48 * 4 } };
+	std::vector<std::byte> src(80 + 2 * 48 * 4);
+	auto place = [&](size_t src_offset, size_t row_pitch, size_t packed_offset, size_t width, size_t height) {
+		for (size_t row = 0; row < height; row++) {
+			memcpy(src.data() + src_offset + row * row_pitch, (std::byte*)expected.data() + packed_offset + row * width * sizeof(uint32_t), width * sizeof(uint32_t));
+		}
+	};
+	for (size_t layer = 0; layer < 2; layer++) {
+		place(80 + layer * 48 * 4, 48, layer * 128, 8, 4);
+		place(layer == 0 ? 48 : 16, 16, 256 + layer * 32, 4, 2);
+		place(layer * 8, 8, 320 + layer * 8, 2, 1);
+	}
+
+	UploadBatch batch(*test_context.allocator, DomainFlagBits::eTransferOnTransfer);
+	auto index = batch.add_image(ia, src.data(), src.size(), std::span<const ImageSubresourceData>(subresources));
+	auto futures = batch.build();
+
+	ReadbackManager readback(*test_context.context);
+	std::vector<uint32_t> result;
+	auto read = readback.read_image(*test_context.allocator, test_context.compiler, std::move(futures[index]), ia, [&](std::span<const std::byte> bytes) {
+		result.resize(bytes.size() / sizeof(uint32_t));
+		memcpy(result.data(), bytes.data(), bytes.size());
+	});
+	REQUIRE(read);
+	REQUIRE(test_context.context->wait_idle());
+	auto invoked = readback.update();
+	REQUIRE(invoked);
+	CHECK(*invoked == 1);
+	CHECK(std::span(result) == std::span(expected));
+}
+
+TEST_CASE("test in-place upload") {
+	REQUIRE(test_context.prepare());
+	auto buf = *allocate_buffer(*test_context.allocator, BufferCreateInfo{ MemoryUsage::eGPUonly, sizeof(uint32_t) * 4, 1 });
+	auto upload = begin_buffer_upload(*test_context.allocator, DomainFlagBits::eTransferOnTransfer, *buf, sizeof(uint32_t) * 4);
+	REQUIRE(upload.data.size() == sizeof(uint32_t) * 4);
+	auto values = std::span((uint32_t*)upload.data.data(), 4);
+	for (uint32_t i = 0; i < 4; i++) {
+		values[i] = i * 3;
+	}
+	auto res = download_buffer(upload.commit()).get<Buffer>(*test_context.allocator, test_context.compiler);
+	auto expected = { 0u, 3u, 6u, 9u };
+	CHECK(std::span((uint32_t*)res->mapped_ptr, 4) == std::span(expected));
+
+	// memory of uploads too large for the ring is given back to the allocator once the copy has completed, even if the allocator destroys buffers right away
+	Allocator direct_allocator(test_context.context->get_vk_resource());
+	size_t count = std::max(test_context.context->get_staging_ring_stats().capacity / 4 / sizeof(uint32_t) + 1, (size_t)16);
+	auto large_buf = *allocate_buffer(*test_context.allocator, BufferCreateInfo{ MemoryUsage::eGPUonly, sizeof(uint32_t) * count, 1 });
+	auto large = begin_buffer_upload(direct_allocator, DomainFlagBits::eTransferOnTransfer, *large_buf, sizeof(uint32_t) * count);
+	REQUIRE(large.staging.dedicated);
+	auto large_values = std::span((uint32_t*)large.data.data(), count);
+	for (uint32_t i = 0; i < count; i++) {
+		large_values[i] = i;
+	}
+	auto large_res = download_buffer(large.commit()).get<Buffer>(*test_context.allocator, test_context.compiler);
+	auto downloaded = std::span((uint32_t*)large_res->mapped_ptr, count);
+	CHECK(downloaded.front() == 0);
+	CHECK(downloaded.back() == count - 1);
+
+	// mapped destinations are handed out directly
+	auto mapped = *allocate_buffer(*test_context.allocator, BufferCreateInfo{ MemoryUsage::eCPUtoGPU, sizeof(uint32_t), 1 });
+	auto direct = begin_buffer_upload(*test_context.allocator, DomainFlagBits::eTransferOnTransfer, *mapped, sizeof(uint32_t));
+	CHECK((void*)direct.data.data() == (void*)mapped->mapped_ptr);
+	CHECK(direct.commit().get_status() == FutureBase::Status::eHostAvailable);
+}
+
+TEST_CASE("test file streaming upload") {
+	REQUIRE(test_context.prepare());
+	uint32_t data[10] = { 1, 2, 3, 4, 5, 6, 7, 8, 9, 10 };
+	FILE* file = fopen("vuk_test_stream.bin", "wb");
+	REQUIRE(file);
+	fwrite(data, 1, sizeof(data), file);
+	fclose(file);
+
+	auto buf = *allocate_buffer(*test_context.allocator, BufferCreateInfo{ MemoryUsage::eGPUonly, sizeof(data), 1 });
+	// chunks of 3 values, with at most 2 in flight
+	auto fut = stream_file_to_buffer(*test_context.allocator,
+	                                 test_context.compiler,
+	                                 *buf,
+	                                 "vuk_test_stream.bin",
+	                                 { .chunk_size = 3 * sizeof(uint32_t), .max_chunks_in_flight = 2, .copy_domain = DomainFlagBits::eTransferOnTransfer });
+	REQUIRE(fut);
+	auto res = download_buffer(*fut).get<Buffer>(*test_context.allocator, test_context.compiler);
+	CHECK(std::span((uint32_t*)res->mapped_ptr, 10) == std::span<uint32_t>(data));
+	remove("vuk_test_stream.bin");
+
+	auto missing = stream_file_to_buffer(*test_context.allocator, test_context.compiler, *buf, "vuk_test_missing.bin");
+	CHECK(!missing);
+	(void)missing.error();
+}
+
+TEST_CASE("test compressed image upload regions") {
+	ImageAttachment ia{ .extent = { Sizing::eAbsolute, { 100, 60, 1 } },
+		                  .format = Format::eBc1RgbaUnormBlock,
+		                  .base_level = 0,
+		                  .level_count = 3,
+		                  .base_layer = 0,
+		                  .layer_count = 2 };
+	// BC1 has 4x4 texel blocks of 8 bytes, so a level 0 row of 25 blocks is 200 bytes
+	size_t size;
+	auto regions = tightly_packed_image_regions(ia, size);
+	REQUIRE(regions.size() == 3);
+	CHECK(regions[1].bufferOffset == 25 * 15 * 8 * 2);
+	CHECK(regions[1].imageExtent.width == 50);
+	CHECK(regions[2].bufferOffset == regions[1].bufferOffset + 13 * 8 * 8 * 2);
+	CHECK(size == regions[2].bufferOffset + 7 * 4 * 8 * 2);
+
+	// pitches are given in bytes, but copies take them in texels
+	auto bc = to_buffer_image_copy(ia, ImageSubresourceData{ .level = 0, .layer_count = 2, .row_pitch = 256, .slice_pitch = 256 * 16 });
+	CHECK(bc.bufferRowLength == 128);
+	CHECK(bc.bufferImageHeight == 64);
+	CHECK(bc.imageSubresource.layerCount == 2);
+}
+
+#ifdef VK_EXT_host_image_copy
+TEST_CASE("test host image copy") {
+	REQUIRE(test_context.prepare());
+	auto& ctx = *test_context.context;
+	ImageAttachment ia{ .usage = ImageUsageFlagBits::eTransferSrc | ImageUsageFlagBits::eTransferDst | ImageUsageFlagBits::eHostTransferEXT,
+		                  .extent = Dimension3D::absolute(4, 4),
+		                  .format = Format::eR8G8B8A8Unorm,
+		                  .sample_count = Samples::e1,
+		                  .view_type = ImageViewType::e2D,
+		                  .base_level = 0,
+		                  .level_count = 2,
+		                  .base_layer = 0,
+		                  .layer_count = 1 };
+	auto image = *allocate_image(*test_context.allocator, ia);
+	ia.image = *image;
+	if (!ctx.can_copy_memory_to_image(ia)) {
+		MESSAGE("VK_EXT_host_image_copy is not available");
+		return;
+	}
+	size_t size;
+	auto regions = tightly_packed_image_regions(ia, size);
+	REQUIRE(size == (16 + 4) * sizeof(uint32_t));
+	std::vector<uint32_t> level_0(16, 0x11223344u);
+	std::vector<uint32_t> level_1(4, 0x55667788u);
+
+	// writing a level transitions only that level, the other level keeps its contents
+	auto level_1_region = regions[1];
+	level_1_region.bufferOffset = 0;
+	REQUIRE(ctx.copy_memory_to_image(ia, level_1.data(), std::span{ &level_1_region, 1 }));
+	REQUIRE(ctx.copy_memory_to_image(ia, level_0.data(), std::span{ &regions[0], 1 }));
+	// regions that leave a level unwritten are uploaded through staging
+	CHECK(!writes_all_subresources(ia, std::span{ &regions[0], 1 }));
+	CHECK(writes_all_subresources(ia, regions));
+	// as are regions that write part of a level
+	auto partial = regions;
+	partial[0].imageExtent.width = 2;
+	CHECK(!writes_all_subresources(ia, partial));
+
+	Future written(ia);
+	written.get_control()->last_use.layout = ImageLayout::eGeneral;
+	auto dst = *allocate_buffer(*test_context.allocator, BufferCreateInfo{ MemoryUsage::eGPUtoCPU, size, 4 });
+	std::shared_ptr<RenderGraph> rg = std::make_shared<RenderGraph>("read_host_copy");
+	rg->attach_in("img", std::move(written));
+	rg->attach_buffer("dst", *dst);
+	rg->add_pass({ .name = "read",
+	               .resources = { "img"_image >> eTransferRead, "dst"_buffer >> eTransferWrite >> "dst+" },
+	               .execute = [regions](CommandBuffer& cbuf) {
+		               cbuf.copy_image_to_buffer("img", "dst", regions);
+	               } });
+	auto res = Future{ rg, "dst+" }.get<Buffer>(*test_context.allocator, test_context.compiler);
+	REQUIRE(res);
+	auto texels = std::span((uint32_t*)res->mapped_ptr, 20);
+	CHECK(texels.subspan(0, 16) == std::span(level_0));
+	CHECK(texels.subspan(16, 4) == std::span(level_1));
+
+	// uploads writing every subresource are done on the host
+	std::vector<uint32_t> both(20, 0x01020304u);
+	auto fut = host_data_to_image(*test_context.allocator, DomainFlagBits::eTransferOnTransfer, ia, both.data(), size, regions);
+	CHECK(fut.get_status() == FutureBase::Status::eHostAvailable);
+}
+#endif
+
+TEST_CASE("test buffer sub-allocation") {
+	REQUIRE(test_context.prepare());
+	auto& sfr = *test_context.sfa_resource;
+	auto before = sfr.get_buffer_fragmentation_report(MemoryUsage::eCPUtoGPU);
+
+	// a slot of a size class, a range of the TLSF and an allocation made directly by the device
+	std::array<size_t, 3> sizes = { 1000, 200 * 1024, 40 * 1024 * 1024 };
+	std::vector<Unique<Buffer>> bufs;
+	for (auto size : sizes) {
+		auto buf = allocate_buffer(*test_context.allocator, BufferCreateInfo{ MemoryUsage::eCPUtoGPU, size, 16 });
+		REQUIRE(buf);
+		CHECK(buf->get().size == size);
+		CHECK(buf->get().offset % 16 == 0);
+		bufs.emplace_back(std::move(*buf));
+	}
+	auto during = sfr.get_buffer_fragmentation_report(MemoryUsage::eCPUtoGPU);
+	CHECK(during.allocated_bytes - before.allocated_bytes == sizes[0] + sizes[1]);
+
+	// the device sees the sub-allocations at their offsets
+	auto data = { 7u, 7u, 7u };
+	for (auto& buf : bufs) {
+		std::shared_ptr<RenderGraph> rg = std::make_shared<RenderGraph>("suballocation");
+		rg->attach_buffer("buf", buf.get());
+		rg->add_pass({ .name = "fill", .resources = { "buf"_buffer >> eTransferWrite >> "buf+" }, .execute = [](CommandBuffer& cbuf) {
+			              cbuf.fill_buffer("buf", sizeof(uint32_t) * 3, 7u);
+		              } });
+		REQUIRE(Future{ rg, "buf+" }.wait(*test_context.allocator, test_context.compiler));
+		CHECK(std::span((uint32_t*)buf->mapped_ptr, 3) == std::span(data));
+	}
+
+	// a small buffer padded for an alignment of a whole block doesn't fit into a block
+	auto misaligned = allocate_buffer(*test_context.allocator, BufferCreateInfo{ MemoryUsage::eCPUtoGPU, 1024, 64 * 1024 * 1024 });
+	REQUIRE(!misaligned);
+	CHECK(misaligned.error().error_code == VK_ERROR_OUT_OF_DEVICE_MEMORY);
+}
+
+TEST_CASE("test buffer subrange divergence") {
+	REQUIRE(test_context.prepare());
+	auto data = { 0u, 0u, 0u, 0u };
+	auto [buf, fut] = create_buffer(*test_context.allocator, MemoryUsage::eCPUtoGPU, DomainFlagBits::eAny, std::span(data));
+
+	std::shared_ptr<RenderGraph> rg = std::make_shared<RenderGraph>("divergence");
+	rg->attach_in("src", std::move(fut));
+	rg->diverge_buffer("src", { .offset = 0, .size = 8 }, "lo");
+	rg->diverge_buffer("src", { .offset = 8, .size = 8 }, "hi");
+	rg->add_pass({ .name = "fill_lo", .resources = { "lo"_buffer >> eTransferWrite >> "lo+" }, .execute = [](CommandBuffer& cbuf) {
+		              cbuf.fill_buffer("lo", 8, 1u);
+	              } });
+	rg->add_pass({ .name = "fill_hi", .resources = { "hi"_buffer >> eTransferWrite >> "hi+" }, .execute = [](CommandBuffer& cbuf) {
+		              cbuf.fill_buffer("hi", 8, 2u);
+	              } });
+	std::array<Name, 2> parts = { "lo+", "hi+" };
+	rg->converge_buffer_explicit(parts, "dst");
+
+	auto res = Future{ rg, "dst" }.get<Buffer>(*test_context.allocator, test_context.compiler);
+	auto expected = { 1u, 1u, 2u, 2u };
+	CHECK(std::span((uint32_t*)res->mapped_ptr, 4) == std::span(expected));
+}
+
+TEST_CASE("test disabled passes with downstream readers") {
+	REQUIRE(test_context.prepare());
+	auto data = { 1u, 2u, 3u };
+	// a disabled transfer pass leaves its output with the contents of its input
+	{
+		auto [buf, fut] = create_buffer(*test_context.allocator, MemoryUsage::eGPUonly, DomainFlagBits::eAny, std::span(data));
+		std::shared_ptr<RenderGraph> rg = std::make_shared<RenderGraph>("disabled_transfer");
+		rg->attach_in("src", std::move(fut));
+		rg->add_pass({ .name = "fill",
+		               .resources = { "src"_buffer >> eTransferWrite >> "src+" },
+		               .execute = [](CommandBuffer& cbuf) {
+			               cbuf.fill_buffer("src", sizeof(uint32_t) * 3, 7u);
+		               },
+		               .condition = [] { return false; } });
+		auto res = download_buffer(Future{ rg, "src+" }).get<Buffer>(*test_context.allocator, test_context.compiler);
+		CHECK(std::span((uint32_t*)res->mapped_ptr, 3) == std::span(data));
+	}
+	// a render pass of only disabled passes is not begun, so its attachments are neither loaded nor cleared
+	{
+		ImageAttachment ia{ .usage = ImageUsageFlagBits::eColorAttachment | ImageUsageFlagBits::eTransferSrc | ImageUsageFlagBits::eTransferDst,
+			                  .extent = Dimension3D::absolute(3, 1),
+			                  .format = Format::eR8G8B8A8Unorm,
+			                  .sample_count = Samples::e1,
+			                  .view_type = ImageViewType::e2D,
+			                  .base_level = 0,
+			                  .level_count = 1,
+			                  .base_layer = 0,
+			                  .layer_count = 1 };
+		auto image = *allocate_image(*test_context.allocator, ia);
+		ia.image = *image;
+		auto dst = *allocate_buffer(*test_context.allocator, BufferCreateInfo{ MemoryUsage::eGPUtoCPU, sizeof(uint32_t) * 3, 4 });
+
+		std::shared_ptr<RenderGraph> rg = std::make_shared<RenderGraph>("disabled_render_pass");
+		rg->attach_in("img", host_data_to_image(*test_context.allocator, DomainFlagBits::eAny, ia, std::data(data)));
+		rg->attach_buffer("dst", *dst);
+		rg->add_pass({ .name = "draw", .resources = { "img"_image >> eColorWrite >> "img+" }, .execute = [](CommandBuffer&) {}, .condition = [] {
+			              return false;
+		              } });
+		rg->add_pass({ .name = "read",
+		               .resources = { "img+"_image >> eTransferRead, "dst"_buffer >> eTransferWrite >> "dst+" },
+		               .execute = [ia](CommandBuffer& cbuf) {
+			               cbuf.copy_image_to_buffer("img+", "dst", to_buffer_image_copy(ia, ImageSubresourceData{}));
+		               } });
+		auto res = Future{ rg, "dst+" }.get<Buffer>(*test_context.allocator, test_context.compiler);
+		CHECK(std::span((uint32_t*)res->mapped_ptr, 3) == std::span(data));
+	}
+}
+
+TEST_CASE("test cross-queue image use") {
+	REQUIRE(test_context.prepare());
+	auto data = { 1u, 2u, 3u };
+	// exclusive images are transferred between the queues with a release/acquire pair, concurrent ones are not
+	for (auto sharing_mode : { SharingMode::eExclusive, SharingMode::eConcurrent }) {
+		ImageAttachment ia{ .sharing_mode = sharing_mode,
+			                  .usage = ImageUsageFlagBits::eTransferSrc | ImageUsageFlagBits::eTransferDst,
+			                  .extent = Dimension3D::absolute(3, 1),
+			                  .format = Format::eR8G8B8A8Unorm,
+			                  .sample_count = Samples::e1,
+			                  .view_type = ImageViewType::e2D,
+			                  .base_level = 0,
+			                  .level_count = 1,
+			                  .base_layer = 0,
+			                  .layer_count = 1 };
+		auto image = *allocate_image(*test_context.allocator, ia);
+		ia.image = *image;
+		auto [src, src_fut] = create_buffer(*test_context.allocator, MemoryUsage::eCPUtoGPU, DomainFlagBits::eTransferOnTransfer, std::span(data));
+		auto dst = *allocate_buffer(*test_context.allocator, BufferCreateInfo{ MemoryUsage::eGPUtoCPU, sizeof(uint32_t) * 3, 4 });
+
+		std::shared_ptr<RenderGraph> rg = std::make_shared<RenderGraph>("cross_queue_image");
+		rg->attach_in("src", std::move(src_fut));
+		rg->attach_image("img", ia);
+		rg->attach_buffer("dst", *dst);
+		rg->add_pass({ .name = "write",
+		               .execute_on = DomainFlagBits::eTransferQueue,
+		               .resources = { "src"_buffer >> eTransferRead, "img"_image >> eTransferWrite >> "img+" },
+		               .execute = [ia](CommandBuffer& cbuf) {
+			               cbuf.copy_buffer_to_image("src", "img", to_buffer_image_copy(ia, ImageSubresourceData{}));
+		               } });
+		rg->add_pass({ .name = "read",
+		               .execute_on = DomainFlagBits::eGraphicsQueue,
+		               .resources = { "img+"_image >> eTransferRead, "dst"_buffer >> eTransferWrite >> "dst+" },
+		               .execute = [ia](CommandBuffer& cbuf) {
+			               cbuf.copy_image_to_buffer("img+", "dst", to_buffer_image_copy(ia, ImageSubresourceData{}));
+		               } });
+		auto res = Future{ rg, "dst+" }.get<Buffer>(*test_context.allocator, test_context.compiler);
+		CHECK(std::span((uint32_t*)res->mapped_ptr, 3) == std::span(data));
+	}
+}
+
+TEST_CASE("test cross-queue image barriers") {
+	REQUIRE(test_context.prepare());
+	// a concurrent image is not released by the writing queue, only acquired by the reading queue
+	size_t barrier_counts[2];
+	for (auto sharing_mode : { SharingMode::eExclusive, SharingMode::eConcurrent }) {
+		ImageAttachment ia{ .sharing_mode = sharing_mode,
+			                  .usage = ImageUsageFlagBits::eTransferSrc | ImageUsageFlagBits::eTransferDst,
+			                  .extent = Dimension3D::absolute(3, 1),
+			                  .format = Format::eR8G8B8A8Unorm,
+			                  .sample_count = Samples::e1,
+			                  .view_type = ImageViewType::e2D,
+			                  .base_level = 0,
+			                  .level_count = 1,
+			                  .base_layer = 0,
+			                  .layer_count = 1 };
+		std::shared_ptr<RenderGraph> rg = std::make_shared<RenderGraph>("cross_queue_barriers");
+		rg->attach_image("img", ia);
+		rg->add_pass({ .name = "write", .execute_on = DomainFlagBits::eTransferQueue, .resources = { "img"_image >> eTransferWrite >> "img+" } });
+		rg->add_pass({ .name = "read", .execute_on = DomainFlagBits::eGraphicsQueue, .resources = { "img+"_image >> eTransferRead } });
+		Compiler compiler;
+		REQUIRE(compiler.link(std::span{ &rg, 1 }, {}));
+		barrier_counts[sharing_mode == SharingMode::eConcurrent] = compiler.get_image_barrier_count();
+	}
+	CHECK(barrier_counts[1] == barrier_counts[0] - 1);
+}
+
+TEST_CASE("test submission coalescing") {
+	REQUIRE(test_context.prepare());
+	auto& queue = *test_context.context->transfer_queue;
+	queue.set_submit_coalescing({ .enabled = true, .max_latency = std::chrono::seconds(10) });
+	auto stats_before = queue.get_submit_stats();
+
+	auto data = { 1u, 2u, 3u };
+	std::vector<Unique<Buffer>> bufs;
+	std::vector<Future> futs;
+	for (int i = 0; i < 4; i++) {
+		auto [buf, fut] = create_buffer(*test_context.allocator, MemoryUsage::eGPUonly, DomainFlagBits::eTransferOnTransfer, std::span(data));
+		REQUIRE(fut.submit(*test_context.allocator, test_context.compiler));
+		bufs.emplace_back(std::move(buf));
+		futs.emplace_back(std::move(fut));
+	}
+	// waiting flushes the pending submissions
+	REQUIRE(wait_for_futures_explicit(*test_context.allocator, test_context.compiler, std::span(futs)));
+	auto stats_after = queue.get_submit_stats();
+	queue.set_submit_coalescing({});
+
+	CHECK(stats_after.batches - stats_before.batches == 4);
+	CHECK(stats_after.queue_submits - stats_before.queue_submits == 1);
+	for (auto& fut : futs) {
+		auto res = download_buffer(fut).get<Buffer>(*test_context.allocator, test_context.compiler);
+		CHECK(std::span((uint32_t*)res->mapped_ptr, 3) == std::span(data));
+	}
+}
+
+TEST_CASE("test submission coalescing latency deadline") {
+	REQUIRE(test_context.prepare());
+	auto& queue = *test_context.context->transfer_queue;
+	queue.set_submit_coalescing({ .enabled = true, .max_latency = std::chrono::milliseconds(1) });
+	auto stats_before = queue.get_submit_stats();
+
+	auto data = { 1u, 2u, 3u };
+	auto [buf, fut] = create_buffer(*test_context.allocator, MemoryUsage::eGPUonly, DomainFlagBits::eTransferOnTransfer, std::span(data));
+	REQUIRE(fut.submit(*test_context.allocator, test_context.compiler));
+	// nothing else is submitted and nothing waits, the submission is issued once its deadline passes
+	auto give_up = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+	while (queue.get_submit_stats().queue_submits == stats_before.queue_submits && std::chrono::steady_clock::now() < give_up) {
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+	auto stats_after = queue.get_submit_stats();
+	queue.set_submit_coalescing({});
+
+	CHECK(stats_after.queue_submits - stats_before.queue_submits == 1);
+	auto res = download_buffer(fut).get<Buffer>(*test_context.allocator, test_context.compiler);
+	CHECK(std::span((uint32_t*)res->mapped_ptr, 3) == std::span(data));
+}
+
+TEST_CASE("test submission thread") {
+	REQUIRE(test_context.prepare());
+	auto& queue = *test_context.context->transfer_queue;
+	REQUIRE(queue.start_submit_thread());
+	auto stats_before = queue.get_submit_stats();
+
+	auto data = { 1u, 2u, 3u };
+	std::vector<Unique<Buffer>> bufs;
+	std::vector<Future> futs;
+	for (int i = 0; i < 4; i++) {
+		auto [buf, fut] = create_buffer(*test_context.allocator, MemoryUsage::eGPUonly, DomainFlagBits::eTransferOnTransfer, std::span(data));
+		REQUIRE(fut.submit(*test_context.allocator, test_context.compiler));
+		bufs.emplace_back(std::move(buf));
+		futs.emplace_back(std::move(fut));
+	}
+	REQUIRE(wait_for_futures_explicit(*test_context.allocator, test_context.compiler, std::span(futs)));
+	queue.stop_submit_thread();
+	auto stats_after = queue.get_submit_stats();
+
+	CHECK(stats_after.batches - stats_before.batches == 4);
+	uint64_t latencies_recorded = 0;
+	for (size_t i = 0; i < stats_after.latency_histogram.size(); i++) {
+		latencies_recorded += stats_after.latency_histogram[i] - stats_before.latency_histogram[i];
+	}
+	CHECK(latencies_recorded == 4);
+	for (auto& fut : futs) {
+		auto res = download_buffer(fut).get<Buffer>(*test_context.allocator, test_context.compiler);
+		CHECK(std::span((uint32_t*)res->mapped_ptr, 3) == std::span(data));
+	}
+}
+
+TEST_CASE("test future completion callback") {
+	REQUIRE(test_context.prepare());
+	auto data = { 1u, 2u, 3u };
+	auto [buf, fut] = create_buffer(*test_context.allocator, MemoryUsage::eGPUonly, DomainFlagBits::eAny, std::span(data));
+	auto dl = download_buffer(fut);
+	auto ready = dl.is_ready();
+	REQUIRE(ready);
+	CHECK(!*ready);
+	REQUIRE_THROWS(dl.then([](FutureBase&) {}));
+
+	std::atomic<bool> called = false;
+	std::atomic<uint32_t> last_element = 0;
+	REQUIRE(dl.submit(*test_context.allocator, test_context.compiler));
+	REQUIRE(dl.then([&](FutureBase& fb) {
+		last_element = ((uint32_t*)fb.get_result<Buffer>().mapped_ptr)[2];
+		called = true;
+	}));
+	REQUIRE(dl.wait(*test_context.allocator, test_context.compiler));
+	ready = dl.is_ready();
+	REQUIRE(ready);
+	CHECK(*ready);
+	// the callback runs on the completion thread, shortly after the timeline value is reached
+	for (int i = 0; i < 1000 && !called; i++) {
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+	CHECK(called);
+	CHECK(last_element == 3);
+}
+
+TEST_CASE("test host wait timeout and wait-any") {
+	REQUIRE(test_context.prepare());
+	auto& ctx = *test_context.context;
+	auto data = { 1u, 2u, 3u };
+	auto [buf, fut] = create_buffer(*test_context.allocator, MemoryUsage::eGPUonly, DomainFlagBits::eTransferOnTransfer, std::span(data));
+	REQUIRE(fut.submit(*test_context.allocator, test_context.compiler));
+	auto control = fut.get_control();
+	DomainFlags domain = control->initial_domain;
+	auto stats_before = ctx.get_host_wait_stats();
+
+	// a value far in the future is never reached, but any of the waits suffices
+	std::vector<std::pair<DomainFlags, uint64_t>> waits = { { domain, control->initial_visibility + 1000 }, { domain, control->initial_visibility } };
+	auto any = ctx.wait_for_domains(std::span(waits), std::chrono::seconds(5), true);
+	REQUIRE(any);
+	CHECK(*any == VK_SUCCESS);
+	auto all = ctx.wait_for_domains(std::span(waits), std::chrono::nanoseconds(0));
+	REQUIRE(all);
+	CHECK(*all == VK_TIMEOUT);
+
+	auto stats_after = ctx.get_host_wait_stats();
+	CHECK(stats_after.waits - stats_before.waits == 2);
+	CHECK(stats_after.timeouts - stats_before.timeouts == 1);
+}
+
+TEST_CASE("test asynchronous readback") {
+	REQUIRE(test_context.prepare());
+	auto data = { 1u, 2u, 3u };
+	auto [buf, fut] = create_buffer(*test_context.allocator, MemoryUsage::eGPUonly, DomainFlagBits::eAny, std::span(data));
+	REQUIRE(fut.wait(*test_context.allocator, test_context.compiler));
+	ReadbackManager readback(*test_context.context);
+
+	uint32_t last_element = 0;
+	auto with_callback = readback.read_buffer(*test_context.allocator, test_context.compiler, fut, sizeof(uint32_t) * 3, [&](std::span<const std::byte> bytes) {
+		last_element = reinterpret_cast<const uint32_t*>(bytes.data())[2];
+	});
+	REQUIRE(with_callback);
+	auto polled = readback.read_buffer(*test_context.allocator, test_context.compiler, fut, sizeof(uint32_t) * 2);
+	REQUIRE(polled);
+	CHECK(readback.pending() == 2);
+
+	REQUIRE(test_context.context->wait_idle());
+	auto invoked = readback.update();
+	REQUIRE(invoked);
+	CHECK(*invoked == 1);
+	CHECK(last_element == 3);
+	auto bytes = readback.poll(*polled);
+	REQUIRE(bytes);
+	REQUIRE(*bytes);
+	CHECK((*bytes)->size() == sizeof(uint32_t) * 2);
+	CHECK(reinterpret_cast<const uint32_t*>((*bytes)->data())[1] == 2);
+	readback.release(*polled);
+	CHECK(readback.pending() == 0);
+}
+
+TEST_CASE("test asynchronous readback with submission coalescing") {
+	REQUIRE(test_context.prepare());
+	auto data = { 1u, 2u, 3u };
+	auto [buf, fut] = create_buffer(*test_context.allocator, MemoryUsage::eGPUonly, DomainFlagBits::eAny, std::span(data));
+	REQUIRE(fut.wait(*test_context.allocator, test_context.compiler));
+	ReadbackManager readback(*test_context.context);
+	// the deadline is never reached during the test, the copy is only issued because the reads are polled
+	auto& queue = *test_context.context->graphics_queue;
+	queue.set_submit_coalescing({ .enabled = true, .max_latency = std::chrono::seconds(60) });
+
+	uint32_t last_element = 0;
+	auto with_callback = readback.read_buffer(*test_context.allocator, test_context.compiler, fut, sizeof(uint32_t) * 3, [&](std::span<const std::byte> bytes) {
+		last_element = reinterpret_cast<const uint32_t*>(bytes.data())[2];
+	});
+	REQUIRE(with_callback);
+	auto polled = readback.read_buffer(*test_context.allocator, test_context.compiler, fut, sizeof(uint32_t) * 2);
+	REQUIRE(polled);
+
+	size_t invoked = 0;
+	std::optional<std::span<const std::byte>> bytes;
+	auto give_up = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+	while ((invoked == 0 || !bytes) && std::chrono::steady_clock::now() < give_up) {
+		auto updated = readback.update();
+		REQUIRE(updated);
+		invoked += *updated;
+		auto result = readback.poll(*polled);
+		REQUIRE(result);
+		bytes = *result;
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+	queue.set_submit_coalescing({});
+
+	CHECK(invoked == 1);
+	CHECK(last_element == 3);
+	REQUIRE(bytes);
+	CHECK(reinterpret_cast<const uint32_t*>(bytes->data())[1] == 2);
+	readback.release(*polled);
+}
+
+TEST_CASE("test asynchronous readback reclaim order") {
+	REQUIRE(test_context.prepare());
+	auto& ctx = *test_context.context;
+	size_t read_size = ctx.get_readback_ring_stats().capacity / 4;
+	REQUIRE(read_size > 0);
+	std::vector<uint32_t> data(read_size / sizeof(uint32_t), 7u);
+	auto [buf, fut] = create_buffer(*test_context.allocator, MemoryUsage::eGPUonly, DomainFlagBits::eAny, std::span(data));
+	REQUIRE(fut.wait(*test_context.allocator, test_context.compiler));
+	ReadbackManager readback(ctx);
+
+	// a polled read that is held doesn't keep the ring from serving the reads after it
+	auto held = readback.read_buffer(*test_context.allocator, test_context.compiler, fut, sizeof(uint32_t));
+	REQUIRE(held);
+	auto before = ctx.get_readback_ring_stats();
+	for (size_t i = 0; i < 16; i++) {
+		auto read = readback.read_buffer(*test_context.allocator, test_context.compiler, fut, read_size);
+		REQUIRE(read);
+		REQUIRE(ctx.wait_idle());
+		auto bytes = readback.poll(*read);
+		REQUIRE(bytes);
+		REQUIRE(*bytes);
+		CHECK(reinterpret_cast<const uint32_t*>((*bytes)->data())[data.size() - 1] == 7u);
+		readback.release(*read);
+	}
+	auto after = ctx.get_readback_ring_stats();
+	CHECK(after.fallbacks == before.fallbacks);
+	CHECK(after.allocations == before.allocations + 16);
+
+	auto bytes = readback.poll(*held);
+	REQUIRE(bytes);
+	REQUIRE(*bytes);
+	CHECK(reinterpret_cast<const uint32_t*>((*bytes)->data())[0] == 7u);
+	readback.release(*held);
+}
+
+TEST_CASE("test asynchronous image readback") {
+	REQUIRE(test_context.prepare());
+	ImageAttachment ia{ .usage = ImageUsageFlagBits::eTransferSrc | ImageUsageFlagBits::eTransferDst,
+		                  .extent = Dimension3D::absolute(4, 2),
+		                  .format = Format::eR8G8B8A8Unorm,
+		                  .sample_count = Samples::e1,
+		                  .view_type = ImageViewType::e2DArray,
+		                  .base_level = 0,
+		                  .level_count = 2,
+		                  .base_layer = 0,
+		                  .layer_count = 2 };
+	auto image = *allocate_image(*test_context.allocator, ia);
+	ia.image = *image;
+	size_t size;
+	auto regions = tightly_packed_image_regions(ia, size);
+	// 4x2 and 2x1 texels, for 2 layers each
+	REQUIRE(size == (8 + 2) * 2 * sizeof(uint32_t));
+	std::vector<uint32_t> data(size / sizeof(uint32_t));
+	for (size_t i = 0; i < data.size(); i++) {
+		data[i] = (uint32_t)i * 0x01010101u;
+	}
+	auto fut = host_data_to_image(*test_context.allocator, DomainFlagBits::eAny, ia, data.data(), size, regions);
+
+	ReadbackManager readback(*test_context.context);
+	std::vector<uint32_t> result;
+	auto read = readback.read_image(*test_context.allocator, test_context.compiler, std::move(fut), ia, [&](std::span<const std::byte> bytes) {
+		result.resize(bytes.size() / sizeof(uint32_t));
+		memcpy(result.data(), bytes.data(), bytes.size());
+	});
+	REQUIRE(read);
+	REQUIRE(test_context.context->wait_idle());
+	auto invoked = readback.update();
+	REQUIRE(invoked);
+	CHECK(*invoked == 1);
+	CHECK(std::span(result) == std::span(data));
+	CHECK(readback.pending() == 0);
+}
+
+namespace {
+	// every level of a mip chain generated from a smooth pattern in level 0, tightly packed
+	// levels above 0 start out with zero alpha, so that texels left unwritten are told apart from the pattern
+	std::vector<uint8_t> generate_mip_chain(Future (*generate)(Future, uint32_t, uint32_t), uint32_t width, uint32_t height, std::vector<BufferImageCopy>& regions) {
+		ImageAttachment ia{ .usage = ImageUsageFlagBits::eStorage | ImageUsageFlagBits::eTransferSrc | ImageUsageFlagBits::eTransferDst | ImageUsageFlagBits::eSampled,
+			                  .extent = Dimension3D::absolute(width, height),
+			                  .format = Format::eR8G8B8A8Unorm,
+			                  .sample_count = Samples::e1,
+			                  .view_type = ImageViewType::e2D,
+			                  .base_level = 0,
+			                  .level_count = (uint32_t)std::bit_width(std::max(width, height)),
+			                  .base_layer = 0,
+			                  .layer_count = 1 };
+		auto image = *allocate_image(*test_context.allocator, ia);
+		ia.image = *image;
+		size_t size;
+		regions = tightly_packed_image_regions(ia, size);
+
+		auto upload = begin_image_upload(*test_context.allocator, DomainFlagBits::eAny, ia, size, regions);
+		std::fill(upload.data.begin(), upload.data.end(), std::byte{ 0 });
+		for (uint32_t y = 0; y < height; y++) {
+			for (uint32_t x = 0; x < width; x++) {
+				auto texel = upload.data.data() + (y * width + x) * 4;
+				texel[0] = std::byte(96 + 64 * x / width);
+				texel[1] = std::byte(96 + 64 * y / height);
+				texel[2] = std::byte(128);
+				texel[3] = std::byte(255);
+			}
+		}
+		auto mips = generate(upload.commit(), 0, ia.level_count);
+
+		auto dst = *allocate_buffer(*test_context.allocator, BufferCreateInfo{ MemoryUsage::eGPUtoCPU, size, 4 });
+		std::shared_ptr<RenderGraph> rg = std::make_shared<RenderGraph>("download_mip_chain");
+		rg->attach_in("img", std::move(mips));
+		rg->attach_buffer("dst", *dst);
+		rg->add_pass({ .name = "download",
+		               .resources = { "img"_image >> eTransferRead, "dst"_buffer >> eTransferWrite >> "dst+" },
+		               .execute = [regions](CommandBuffer& cbuf) {
+			               cbuf.copy_image_to_buffer("img", "dst", regions);
+		               } });
+		auto res = Future{ rg, "dst+" }.get<Buffer>(*test_context.allocator, test_context.compiler);
+		REQUIRE(res);
+		auto data = reinterpret_cast<const uint8_t*>(res->mapped_ptr);
+		return std::vector<uint8_t>(data, data + size);
+	}
+} // namespace
+
+TEST_CASE("test compute mip generation matches blits") {
+	REQUIRE(test_context.prepare());
+	// halving a power of two level is the same 2x2 box filter either way, up to rounding
+	// odd levels are filtered differently: blits sample at scaled positions while the downsampler clamps to the last texel
+	for (auto [width, height, tolerance] : { std::tuple{ 256u, 256u, 1 }, std::tuple{ 200u, 120u, 32 } }) {
+		CAPTURE(width);
+		CAPTURE(height);
+		std::vector<BufferImageCopy> regions;
+		auto blit = generate_mip_chain(&generate_mips, width, height, regions);
+		auto spd = generate_mip_chain(&generate_mips_spd, width, height, regions);
+		REQUIRE(blit.size() == spd.size());
+
+		for (uint32_t level = 0; level < regions.size(); level++) {
+			CAPTURE(level);
+			auto& region = regions[level];
+			size_t texels = (size_t)region.imageExtent.width * region.imageExtent.height;
+			int max_difference = 0;
+			bool all_written = true;
+			for (size_t i = region.bufferOffset; i < region.bufferOffset + texels * 4; i += 4) {
+				all_written &= blit[i + 3] == 255 && spd[i + 3] == 255;
+				for (size_t c = 0; c < 3; c++) {
+					max_difference = std::max(max_difference, std::abs((int)blit[i + c] - (int)spd[i + c]));
+				}
+			}
+			CHECK(all_written);
+			CHECK(max_difference <= tolerance);
+		}
+	}
+}
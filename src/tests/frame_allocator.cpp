@@ -1,7 +1,11 @@
 #include "TestContext.hpp"
 #include "vuk/AllocatorHelpers.hpp"
 #include "vuk/Partials.hpp"
+#include <algorithm>
 #include <doctest/doctest.h>
+#include <string_view>
+#include <thread>
+#include <tuple>
 
 using namespace vuk;
 
@@ -111,6 +115,153 @@ TEST_CASE("frame allocator, cached resource identity") {
 	REQUIRE((im2 == im3 || im2 == im4));
 }
 
+TEST_CASE("frame allocator, per-thread linear allocation") {
+	REQUIRE(test_context.prepare());
+
+	DeviceSuperFrameResource sfr(*test_context.sfa_resource, 2);
+	constexpr size_t num_threads = 4;
+	constexpr size_t num_allocations = 256;
+
+	auto& fa = sfr.get_next_frame();
+	std::vector<Buffer> buffers(num_threads * num_allocations);
+	std::vector<std::thread> threads;
+	for (size_t t = 0; t < num_threads; t++) {
+		threads.emplace_back([&, t] {
+			BufferCreateInfo bci{ .mem_usage = vuk::MemoryUsage::eCPUtoGPU, .size = 64 };
+			for (size_t i = 0; i < num_allocations; i++) {
+				fa.allocate_buffers(std::span{ &buffers[t * num_allocations + i], 1 }, std::span{ &bci, 1 }, {});
+			}
+		});
+	}
+	for (auto& t : threads) {
+		t.join();
+	}
+
+	// allocations of different threads must not overlap
+	std::sort(buffers.begin(), buffers.end(), [](const Buffer& a, const Buffer& b) { return std::tie(a.buffer, a.offset) < std::tie(b.buffer, b.offset); });
+	for (size_t i = 1; i < buffers.size(); i++) {
+		if (buffers[i].buffer == buffers[i - 1].buffer) {
+			REQUIRE(buffers[i - 1].offset + buffers[i - 1].size <= buffers[i].offset);
+		}
+	}
+
+	auto stats = fa.get_linear_allocation_stats();
+	REQUIRE(stats.size() == num_threads);
+	for (auto& s : stats) {
+		REQUIRE(s.bytes_allocated == num_allocations * 64);
+		REQUIRE(s.chunk_count >= 1);
+	}
+
+	// recycling the frame keeps the high-water mark
+	sfr.get_next_frame();
+	sfr.get_next_frame();
+	stats = fa.get_linear_allocation_stats();
+	for (auto& s : stats) {
+		REQUIRE(s.bytes_allocated == 0);
+		REQUIRE(s.high_water_bytes == num_allocations * 64);
+	}
+}
+
+TEST_CASE("device memory telemetry") {
+	REQUIRE(test_context.prepare());
+
+	auto& vk = test_context.context->get_vk_resource();
+	auto before = vk.get_memory_stats();
+	Buffer buf;
+	BufferCreateInfo bci{ .mem_usage = vuk::MemoryUsage::eGPUonly, .size = 1024 * 1024 };
+	REQUIRE(vk.allocate_buffers(std::span{ &buf, 1 }, std::span{ &bci, 1 }, VUK_HERE_AND_NOW()));
+
+	auto during = vk.get_memory_stats(~0ull);
+	auto& buffers = during.resources[(size_t)TrackedResource::eBuffer];
+	REQUIRE(buffers.count == before.resources[(size_t)TrackedResource::eBuffer].count + 1);
+	REQUIRE(buffers.peak_count >= buffers.count);
+	auto& gpu_only = during.memory_usages[(int)vuk::MemoryUsage::eGPUonly - 1];
+	REQUIRE(gpu_only.bytes >= before.memory_usages[(int)vuk::MemoryUsage::eGPUonly - 1].bytes + 1024 * 1024);
+	// the allocation is attributed to this file
+	auto site = std::find_if(during.top_sites.begin(), during.top_sites.end(), [](auto& s) { return std::string_view(s.file) == __FILE__; });
+	REQUIRE(site != during.top_sites.end());
+	REQUIRE(site->bytes >= 1024 * 1024);
+	REQUIRE(to_json(during).find("\"buffer\":{\"count\":") != std::string::npos);
+
+	vk.deallocate_buffers(std::span{ &buf, 1 });
+	auto after = vk.get_memory_stats();
+	REQUIRE(after.resources[(size_t)TrackedResource::eBuffer].count == before.resources[(size_t)TrackedResource::eBuffer].count);
+}
+
+TEST_CASE("nested resource memory telemetry") {
+	REQUIRE(test_context.prepare());
+
+	DeviceSuperFrameResource sfr(test_context.context->get_vk_resource(), 2);
+	// sub-allocations share a VkBuffer, but each is accounted with its own size to its caller
+	Buffer bufs[2];
+	BufferCreateInfo bcis[2] = { { .mem_usage = vuk::MemoryUsage::eCPUtoGPU, .size = 1000 }, { .mem_usage = vuk::MemoryUsage::eCPUtoGPU, .size = 1000 } };
+	REQUIRE(sfr.allocate_buffers(bufs, bcis, VUK_HERE_AND_NOW()));
+	REQUIRE(bufs[0].buffer == bufs[1].buffer);
+
+	auto stats = sfr.get_memory_stats();
+	REQUIRE(stats.resources[(size_t)TrackedResource::eBuffer].count == 2);
+	REQUIRE(stats.memory_usages[(int)vuk::MemoryUsage::eCPUtoGPU - 1].bytes == 2000);
+	REQUIRE(stats.top_sites.size() == 1);
+	REQUIRE(std::string_view(stats.top_sites[0].file) == __FILE__);
+
+	// frame allocations are released when the frame is recycled, and only accounted on request
+	sfr.set_frame_allocation_tracking(true);
+	auto& frame = sfr.get_next_frame();
+	Buffer frame_buf;
+	BufferCreateInfo frame_bci{ .mem_usage = vuk::MemoryUsage::eGPUonly, .size = 4096 };
+	REQUIRE(frame.allocate_buffers(std::span{ &frame_buf, 1 }, std::span{ &frame_bci, 1 }, VUK_HERE_AND_NOW()));
+	Image image;
+	ImageCreateInfo ici{ .format = vuk::Format::eR8G8B8A8Unorm, .extent = vuk::Extent3D{ 64, 64, 1 }, .usage = vuk::ImageUsageFlagBits::eSampled };
+	REQUIRE(frame.allocate_images(std::span{ &image, 1 }, std::span{ &ici, 1 }, VUK_HERE_AND_NOW()));
+	auto frame_stats = frame.get_memory_stats();
+	REQUIRE(frame_stats.resources[(size_t)TrackedResource::eBuffer].bytes == 4096);
+	auto& images = frame_stats.resources[(size_t)TrackedResource::eImage];
+	REQUIRE(images.count == 1);
+	REQUIRE(images.bytes >= 64 * 64 * 4);
+	// the image is accounted to the heap it was placed in
+	size_t image_usage_bytes = 0;
+	for (auto& usage : frame_stats.memory_usages) {
+		image_usage_bytes += usage.bytes;
+	}
+	REQUIRE(image_usage_bytes == 4096 + images.bytes);
+	// the super frame resource doesn't see the frame allocations
+	REQUIRE(sfr.get_memory_stats().resources[(size_t)TrackedResource::eImage].count == 0);
+
+	// deallocations are deferred until the frame they were made in is recycled
+	sfr.deallocate_buffers(bufs);
+	REQUIRE(sfr.get_memory_stats().resources[(size_t)TrackedResource::eBuffer].count == 2);
+	for (int i = 0; i < 2; i++) {
+		sfr.get_next_frame();
+	}
+	REQUIRE(frame.get_memory_stats().total.count == 0);
+	REQUIRE(sfr.get_memory_stats().total.count == 0);
+}
+
+TEST_CASE("device memory budget") {
+	REQUIRE(test_context.prepare());
+
+	auto& vk = test_context.context->get_vk_resource();
+	vk.update_memory_budget();
+	auto budget = vk.get_memory_budget(vuk::MemoryUsage::eGPUonly);
+	REQUIRE(budget.budget > 0);
+	REQUIRE(budget.headroom <= budget.budget);
+
+	// a zero threshold is crossed by every heap on the first query, but only once
+	size_t calls = 0;
+	auto events_before = vk.get_memory_budget_events();
+	auto id = vk.register_eviction_callback(0.f, [&](const MemoryBudget&) { calls++; });
+	vk.update_memory_budget();
+	auto heaps_crossed = calls;
+	REQUIRE(heaps_crossed > 0);
+	vk.update_memory_budget();
+	REQUIRE(calls == heaps_crossed);
+	vk.unregister_eviction_callback(id);
+
+	auto events = vk.get_memory_budget_events();
+	REQUIRE(events.budget_queries == events_before.budget_queries + 2);
+	REQUIRE(events.eviction_callbacks == events_before.eviction_callbacks + heaps_crossed);
+}
+
 /*
 TEST_CASE("multiframe allocator, uncached resource") {
 	REQUIRE(test_context.prepare());
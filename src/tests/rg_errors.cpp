@@ -29,4 +29,20 @@ TEST_CASE("error: cbuf references unknown resource") {
 	auto ex = compiler.link(std::span{ &rg, 1 }, {});
 	REQUIRE((bool)ex);
 	REQUIRE_THROWS(ex->execute(*test_context.allocator, {}));
-}
\ No newline at end of file
+}
+TEST_CASE("error: overlapping diverged buffer subranges") {
+	REQUIRE(test_context.prepare());
+
+	std::shared_ptr<RenderGraph> rg = std::make_shared<RenderGraph>("overlap");
+	rg->attach_buffer("src", Buffer{ .size = 16, .memory_usage = MemoryUsage::eGPUonly });
+	rg->diverge_buffer("src", { .offset = 0, .size = 12 }, "lo");
+	rg->diverge_buffer("src", { .offset = 8 }, "hi");
+	rg->add_pass({ .resources = { "lo"_buffer >> eTransferWrite >> "lo+" } });
+	rg->add_pass({ .resources = { "hi"_buffer >> eTransferWrite >> "hi+" } });
+	std::array<Name, 2> parts = { "lo+", "hi+" };
+	rg->converge_buffer_explicit(parts, "dst");
+	rg->add_pass({ .resources = { "dst"_buffer >> eTransferRead } });
+
+	Compiler compiler;
+	REQUIRE_THROWS(compiler.compile(std::span{ &rg, 1 }, {}));
+}
@@ -0,0 +1,78 @@
+#include "TestContext.hpp"
+#include "vuk/AllocatorHelpers.hpp"
+#include "vuk/Partials.hpp"
+#include <doctest/doctest.h>
+
+using namespace vuk;
+
+namespace {
+	// writes value into the current version, and downloads the previous version
+	Future write_and_read_previous(PersistentResource& pr, uint32_t value) {
+		std::shared_ptr<RenderGraph> rg = std::make_shared<RenderGraph>("persistent");
+		rg->attach_persistent("hist", pr);
+		rg->attach_buffer("dl", Buffer{ .memory_usage = MemoryUsage::eGPUtoCPU });
+		rg->inference_rule("dl", same_size_as("hist_prev1"));
+		rg->add_pass({ .resources = { "hist_prev1"_buffer >> eTransferRead, "dl"_buffer >> eTransferWrite }, .execute = [](CommandBuffer& cbuf) {
+			              cbuf.copy_buffer("hist_prev1", "dl", sizeof(uint32_t));
+		              } });
+		rg->add_pass({ .resources = { "hist"_buffer >> eTransferWrite }, .execute = [value](CommandBuffer& cbuf) {
+			              cbuf.fill_buffer("hist", sizeof(uint32_t), value);
+		              } });
+		return { rg, "dl+" };
+	}
+} // namespace
+
+TEST_CASE("persistent resource: previous frame reads") {
+	REQUIRE(test_context.prepare());
+	auto pr = create_persistent_buffer(*test_context.allocator, BufferCreateInfo{ MemoryUsage::eGPUonly, sizeof(uint32_t), 1 }, 2);
+	REQUIRE(pr);
+	CHECK(pr->history_length() == 2);
+
+	// with two versions, the version written in a frame is read as the previous version in the next one, and overwritten in the one after
+	for (uint32_t frame = 1; frame <= 4; frame++) {
+		auto res = write_and_read_previous(*pr, frame).get<Buffer>(*test_context.allocator, test_context.compiler);
+		REQUIRE(res);
+		if (frame > 1) {
+			CHECK(*reinterpret_cast<uint32_t*>(res->mapped_ptr) == frame - 1);
+		}
+		pr->advance();
+	}
+}
+
+TEST_CASE("persistent resource: history rotation") {
+	REQUIRE(test_context.prepare());
+	auto pr = create_persistent_buffer(*test_context.allocator, BufferCreateInfo{ MemoryUsage::eGPUonly, sizeof(uint32_t), 1 }, 3);
+	REQUIRE(pr);
+	auto current = pr->get_version(0).get_result<Buffer>();
+	auto previous = pr->get_version(1).get_result<Buffer>();
+	pr->advance();
+	CHECK(pr->get_version(1).get_result<Buffer>() == current);
+	CHECK(pr->get_version(2).get_result<Buffer>() == previous);
+	pr->advance();
+	pr->advance();
+	CHECK(pr->get_version(0).get_result<Buffer>() == current);
+	CHECK(PersistentResource::history_name("hist", 0) == Name("hist"));
+	CHECK(PersistentResource::history_name("hist", 2) == Name("hist_prev2"));
+}
+
+TEST_CASE("persistent resource: history is only recorded on submission") {
+	REQUIRE(test_context.prepare());
+	auto pr = create_persistent_buffer(*test_context.allocator, BufferCreateInfo{ MemoryUsage::eGPUonly, sizeof(uint32_t), 1 }, 2);
+	REQUIRE(pr);
+	REQUIRE(write_and_read_previous(*pr, 1).wait(*test_context.allocator, test_context.compiler));
+	auto& version = pr->get_version(0);
+	CHECK(version.status == FutureBase::Status::eSubmitted);
+	auto last_use = version.last_use;
+	auto visibility = version.initial_visibility;
+
+	// linked, but never executed or submitted
+	std::shared_ptr<RenderGraph> rg = std::make_shared<RenderGraph>("unsubmitted");
+	rg->attach_persistent("hist", *pr);
+	rg->add_pass({ .resources = { "hist"_buffer >> eComputeRW }, .execute = [](CommandBuffer&) {} });
+	Compiler compiler;
+	REQUIRE(compiler.link(std::span{ &rg, 1 }, {}));
+
+	CHECK(version.last_use.stages == last_use.stages);
+	CHECK(version.last_use.access == last_use.access);
+	CHECK(version.initial_visibility == visibility);
+}